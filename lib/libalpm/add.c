@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <limits.h>
 #include <fcntl.h>
@@ -25,12 +26,14 @@
 #include "alpm_list.h"
 #include "handle.h"
 #include "libarchive-compat.h"
+#include "readahead.h"
 #include "trans.h"
 #include "util.h"
 #include "log.h"
 #include "backup.h"
 #include "package.h"
 #include "db.h"
+#include "deps.h"
 #include "remove.h"
 #include "handle.h"
 
@@ -97,17 +100,23 @@ int SYMEXPORT alpm_add_pkg(alpm_handle_t *handle, alpm_pkg_t *pkg)
 	return 0;
 }
 
-static int perform_extraction(alpm_handle_t *handle, struct archive *archive,
+static int perform_extraction(alpm_handle_t *handle, alpm_readahead_t *reader,
 		struct archive_entry *entry, const char *filename)
 {
 	int ret;
 	struct archive *archive_writer;
-	const int archive_flags = ARCHIVE_EXTRACT_OWNER |
-	                          ARCHIVE_EXTRACT_PERM |
-	                          ARCHIVE_EXTRACT_TIME |
-	                          ARCHIVE_EXTRACT_UNLINK |
-	                          ARCHIVE_EXTRACT_XATTR |
-	                          ARCHIVE_EXTRACT_SECURE_SYMLINKS;
+	int archive_flags = ARCHIVE_EXTRACT_OWNER |
+	                    ARCHIVE_EXTRACT_PERM |
+	                    ARCHIVE_EXTRACT_TIME |
+	                    ARCHIVE_EXTRACT_UNLINK |
+	                    ARCHIVE_EXTRACT_XATTR |
+	                    ARCHIVE_EXTRACT_SECURE_SYMLINKS;
+
+	/* in an empty root the file is created straight away (O_EXCL); only if
+	 * it exists after all does libarchive look at what is in its way */
+	if(handle->trans->freshroot) {
+		archive_flags &= ~ARCHIVE_EXTRACT_UNLINK;
+	}
 
 	archive_entry_set_pathname(entry, filename);
 
@@ -121,20 +130,20 @@ static int perform_extraction(alpm_handle_t *handle, struct archive *archive,
 
 	archive_write_disk_set_options(archive_writer, archive_flags);
 
-	ret = archive_read_extract2(archive, entry, archive_writer);
+	ret = _alpm_readahead_extract(reader, entry, archive_writer);
 
 	archive_write_free(archive_writer);
 
-	if(ret == ARCHIVE_WARN && archive_errno(archive) != ENOSPC) {
+	if(ret == ARCHIVE_WARN && _alpm_readahead_errno(reader) != ENOSPC) {
 		/* operation succeeded but a "non-critical" error was encountered */
 		_alpm_log(handle, ALPM_LOG_WARNING, _("warning given when extracting %s (%s)\n"),
-				filename, archive_error_string(archive));
+				filename, _alpm_readahead_error_string(reader));
 	} else if(ret != ARCHIVE_OK) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not extract %s (%s)\n"),
-				filename, archive_error_string(archive));
+				filename, _alpm_readahead_error_string(reader));
 		alpm_logaction(handle, ALPM_CALLER_PREFIX,
 				"error: could not extract %s (%s)\n",
-				filename, archive_error_string(archive));
+				filename, _alpm_readahead_error_string(reader));
 		return 1;
 	}
 	return 0;
@@ -152,7 +161,7 @@ static int try_rename(alpm_handle_t *handle, const char *src, const char *dest)
 	return 0;
 }
 
-static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
+static int extract_db_file(alpm_handle_t *handle, alpm_readahead_t *reader,
 		struct archive_entry *entry, alpm_pkg_t *newpkg, const char *entryname)
 {
 	char filename[PATH_MAX]; /* the actual file we're extracting */
@@ -166,16 +175,16 @@ static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
 	} else if(*entryname == '.') {
 		/* reserve all files starting with '.' for future possibilities */
 		_alpm_log(handle, ALPM_LOG_DEBUG, "skipping extraction of '%s'\n", entryname);
-		archive_read_data_skip(archive);
+		_alpm_readahead_data_skip(reader);
 		return 0;
 	}
 	archive_entry_set_perm(entry, 0644);
 	snprintf(filename, PATH_MAX, "%s%s-%s/%s",
 			_alpm_db_path(handle->db_local), newpkg->name, newpkg->version, dbfile);
-	return perform_extraction(handle, archive, entry, filename);
+	return perform_extraction(handle, reader, entry, filename);
 }
 
-static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
+static int extract_single_file(alpm_handle_t *handle, alpm_readahead_t *reader,
 		struct archive_entry *entry, alpm_pkg_t *newpkg, alpm_pkg_t *oldpkg)
 {
 	const char *entryname = archive_entry_pathname(entry);
@@ -189,7 +198,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	size_t filename_len;
 
 	if(*entryname == '.') {
-		return extract_db_file(handle, archive, entry, newpkg, entryname);
+		return extract_db_file(handle, reader, entry, newpkg, entryname);
 	}
 
 	if (!alpm_filelist_contains(&newpkg->files, entryname)) {
@@ -212,7 +221,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 		_alpm_log(handle, ALPM_LOG_DEBUG, "%s is in NoExtract,"
 				" skipping extraction of %s\n",
 				entryname, filename);
-		archive_read_data_skip(archive);
+		_alpm_readahead_data_skip(reader);
 		return 0;
 	}
 
@@ -230,9 +239,16 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	 *      or backup the file.
 	 *  5- file replacing directory- don't allow it.
 	 *  6- skip extraction, dir already exists.
+	 *
+	 * In an empty root only directories can exist, created by the packages
+	 * before, so files are always case 1.
 	 */
 
-	isnewfile = llstat(filename, &lsbuf) != 0;
+	if(handle->trans->freshroot && !S_ISDIR(entrymode)) {
+		isnewfile = 1;
+	} else {
+		isnewfile = llstat(filename, &lsbuf) != 0;
+	}
 	if(isnewfile) {
 		/* cases 1,2: file doesn't exist, skip all backup checks */
 	} else if(S_ISDIR(lsbuf.st_mode) && S_ISDIR(entrymode)) {
@@ -272,13 +288,13 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 
 		_alpm_log(handle, ALPM_LOG_DEBUG, "extract: skipping dir extraction of %s\n",
 				filename);
-		archive_read_data_skip(archive);
+		_alpm_readahead_data_skip(reader);
 		return 0;
 	} else if(S_ISDIR(lsbuf.st_mode)) {
 		/* case 5: trying to overwrite dir with file, don't allow it */
 		_alpm_log(handle, ALPM_LOG_ERROR, _("extract: not overwriting dir with file %s\n"),
 				filename);
-		archive_read_data_skip(archive);
+		_alpm_readahead_data_skip(reader);
 		return 1;
 	} else if(S_ISDIR(entrymode)) {
 		/* case 4: trying to overwrite file with dir */
@@ -312,7 +328,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	}
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "extracting %s\n", filename);
-	if(perform_extraction(handle, archive, entry, filename)) {
+	if(perform_extraction(handle, reader, entry, filename)) {
 		errors++;
 		return errors;
 	}
@@ -332,7 +348,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 		};
 		/* "remove" the .pacnew suffix */
 		filename[filename_len] = '\0';
-		EVENT(handle, &event);
+		_alpm_log_pacnew(handle, &event);
 		alpm_logaction(handle, ALPM_CALLER_PREFIX,
 				"warning: %s installed as %s.pacnew\n", filename, filename);
 	} else if(needbackup) {
@@ -386,7 +402,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"action: keeping current file and installing"
 					" new one with .pacnew ending\n");
-			EVENT(handle, &event);
+			_alpm_log_pacnew(handle, &event);
 			alpm_logaction(handle, ALPM_CALLER_PREFIX,
 					"warning: %s installed as %s\n", origfile, filename);
 		}
@@ -422,64 +438,128 @@ static time_t get_install_time(void)
 	return now;
 }
 
-static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
-		size_t pkg_current, size_t pkg_count)
+/* Write the database entries commit_finish() held back while installing
+ * into an empty root. */
+static int write_db_entries(alpm_handle_t *handle)
 {
-	int ret = 0, errors = 0;
-	int is_upgrade = 0;
-	alpm_pkg_t *oldpkg = NULL;
-	alpm_db_t *db = handle->db_local;
 	alpm_trans_t *trans = handle->trans;
-	alpm_progress_t progress = ALPM_PROGRESS_ADD_START;
-	alpm_event_package_operation_t event;
-	const char *log_msg = "adding";
+	alpm_list_t *i;
+	int ret = 0;
+
+	for(i = trans->dbwrite; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+
+		_alpm_log(handle, ALPM_LOG_DEBUG, "adding database entry '%s'\n", pkg->name);
+		if(_alpm_local_db_write(handle->db_local, pkg, INFRQ_ALL)) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not update database entry %s-%s\n"),
+					pkg->name, pkg->version);
+			alpm_logaction(handle, ALPM_CALLER_PREFIX,
+					"error: could not update database entry %s-%s\n",
+					pkg->name, pkg->version);
+			handle->pm_errno = ALPM_ERR_DB_WRITE;
+			ret = -1;
+		}
+	}
+	alpm_list_free(trans->dbwrite);
+	trans->dbwrite = NULL;
+	return ret;
+}
+
+/* a package being installed, by commit_single_pkg() or upgrade_parallel() */
+struct pkg_commit {
+	alpm_pkg_t *newpkg;
+	alpm_pkg_t *oldpkg;
 	const char *pkgfile;
-	struct archive *archive;
-	struct archive_entry *entry;
-	int fd, cwdfd;
-	struct stat buf;
+	alpm_event_package_operation_t event;
+	alpm_progress_t progress;
+	const char *log_msg;
+	int is_upgrade;
+	size_t current;
+	size_t count;
+
+	/* scheduling in upgrade_parallel() */
+	char *path;        /* absolute path of the package file */
+	size_t after;      /* number of packages to finish before it starts */
+	int exclusive;     /* has install scripts, nothing else is extracted meanwhile */
+	int drain;         /* may only start once all packages before it are done */
+	int announced;     /* the start event was sent */
+
+	/* set by the extracting worker, read under the pool lock */
+	int percent;
+	int errors;        /* -1 if it could not be extracted at all */
+	int done;
+	alpm_list_t *output;
+};
+
+/* threads extracting the packages handed to them by upgrade_parallel() */
+struct extract_pool {
+	alpm_handle_t *handle;
+	pthread_mutex_t lock;
+	pthread_cond_t work;     /* a package was queued or the pool stops */
+	pthread_cond_t changed;  /* a package made progress or is done */
+	struct pkg_commit *commits;
+	size_t queued;
+	size_t taken;
+	int stop;
+};
+
+static void commit_init(alpm_handle_t *handle, struct pkg_commit *commit)
+{
+	alpm_pkg_t *newpkg = commit->newpkg;
 
-	ASSERT(trans != NULL, return -1);
+	commit->progress = ALPM_PROGRESS_ADD_START;
+	commit->log_msg = "adding";
+	commit->pkgfile = newpkg->origin_data.file;
 
 	/* see if this is an upgrade. if so, remove the old package first */
-	if(_alpm_db_get_pkgfromcache(db, newpkg->name) && (oldpkg = newpkg->oldpkg)) {
-		int cmp = _alpm_pkg_compare_versions(newpkg, oldpkg);
+	if(_alpm_db_get_pkgfromcache(handle->db_local, newpkg->name)
+			&& (commit->oldpkg = newpkg->oldpkg)) {
+		int cmp = _alpm_pkg_compare_versions(newpkg, commit->oldpkg);
 		if(cmp < 0) {
-			log_msg = "downgrading";
-			progress = ALPM_PROGRESS_DOWNGRADE_START;
-			event.operation = ALPM_PACKAGE_DOWNGRADE;
+			commit->log_msg = "downgrading";
+			commit->progress = ALPM_PROGRESS_DOWNGRADE_START;
+			commit->event.operation = ALPM_PACKAGE_DOWNGRADE;
 		} else if(cmp == 0) {
-			log_msg = "reinstalling";
-			progress = ALPM_PROGRESS_REINSTALL_START;
-			event.operation = ALPM_PACKAGE_REINSTALL;
+			commit->log_msg = "reinstalling";
+			commit->progress = ALPM_PROGRESS_REINSTALL_START;
+			commit->event.operation = ALPM_PACKAGE_REINSTALL;
 		} else {
-			log_msg = "upgrading";
-			progress = ALPM_PROGRESS_UPGRADE_START;
-			event.operation = ALPM_PACKAGE_UPGRADE;
+			commit->log_msg = "upgrading";
+			commit->progress = ALPM_PROGRESS_UPGRADE_START;
+			commit->event.operation = ALPM_PACKAGE_UPGRADE;
 		}
-		is_upgrade = 1;
+		commit->is_upgrade = 1;
 
 		/* copy over the install reason */
-		newpkg->reason = alpm_pkg_get_reason(oldpkg);
+		newpkg->reason = alpm_pkg_get_reason(commit->oldpkg);
 	} else {
-		event.operation = ALPM_PACKAGE_INSTALL;
+		commit->event.operation = ALPM_PACKAGE_INSTALL;
 	}
 
-	event.type = ALPM_EVENT_PACKAGE_OPERATION_START;
-	event.oldpkg = oldpkg;
-	event.newpkg = newpkg;
-	EVENT(handle, &event);
+	commit->event.type = ALPM_EVENT_PACKAGE_OPERATION_START;
+	commit->event.oldpkg = commit->oldpkg;
+	commit->event.newpkg = newpkg;
+}
 
-	pkgfile = newpkg->origin_data.file;
+/* Everything up to the extraction: the pre_install or pre_upgrade script,
+ * removing the old version and preparing the database entry. */
+static int commit_prepare(alpm_handle_t *handle, struct pkg_commit *commit)
+{
+	alpm_pkg_t *newpkg = commit->newpkg, *oldpkg = commit->oldpkg;
+	alpm_trans_t *trans = handle->trans;
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "%s package %s-%s\n",
-			log_msg, newpkg->name, newpkg->version);
+			commit->log_msg, newpkg->name, newpkg->version);
 		/* pre_install/pre_upgrade scriptlet */
 	if(alpm_pkg_has_scriptlet(newpkg) &&
 			!(trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
-		const char *scriptlet_name = is_upgrade ? "pre_upgrade" : "pre_install";
+		const char *scriptlet_name = commit->is_upgrade ? "pre_upgrade" : "pre_install";
 
-		_alpm_runscriptlet(handle, pkgfile, scriptlet_name,
+		/* the script sees the packages before it in the database */
+		if(write_db_entries(handle) != 0) {
+			return -1;
+		}
+		_alpm_runscriptlet(handle, commit->pkgfile, scriptlet_name,
 				newpkg->version, oldpkg ? oldpkg->version : NULL, 1);
 	}
 
@@ -500,7 +580,7 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 
 	/* prepare directory for database entries so permissions are correct after
 	   changelog/install script installation */
-	if(_alpm_local_db_prepare(db, newpkg)) {
+	if(_alpm_local_db_prepare(handle->db_local, newpkg)) {
 		alpm_logaction(handle, ALPM_CALLER_PREFIX,
 				"error: could not create database entry %s-%s\n",
 				newpkg->name, newpkg->version);
@@ -508,54 +588,70 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		return -1;
 	}
 
-	fd = _alpm_open_archive(db->handle, pkgfile, &buf,
-			&archive, ALPM_ERR_PKG_OPEN);
-	if(fd < 0) {
-		return -1;
+	if(!(trans->flags & ALPM_TRANS_FLAG_DBONLY)) {
+		_alpm_trans_check_libs(handle, newpkg);
 	}
+	return 0;
+}
 
-	/* save the cwd so we can restore it later */
-	OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
-	if(cwdfd < 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
+/* Report how far the extraction got, through the pool if there is one. */
+static void commit_progress(alpm_handle_t *handle, struct pkg_commit *commit,
+		struct extract_pool *pool, int percent)
+{
+	if(pool == NULL) {
+		PROGRESS(handle, commit->progress, commit->newpkg->name, percent,
+				commit->count, commit->current);
+	} else if(percent != commit->percent) {
+		pthread_mutex_lock(&pool->lock);
+		commit->percent = percent;
+		pthread_cond_signal(&pool->changed);
+		pthread_mutex_unlock(&pool->lock);
 	}
+}
 
-	/* libarchive requires this for extracting hard links */
-	if(chdir(handle->root) != 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
-				handle->root, strerror(errno));
-		_alpm_archive_read_free(archive);
-		if(cwdfd >= 0) {
-			close(cwdfd);
-		}
-		close(fd);
+/* Extract a package into the current directory, which has to be the root.
+ * Returns the number of files that failed, -1 if the archive could not be
+ * read at all. */
+static int commit_extract(alpm_handle_t *handle, struct pkg_commit *commit,
+		struct archive *archive, struct extract_pool *pool)
+{
+	alpm_pkg_t *newpkg = commit->newpkg;
+	struct archive_entry *entry;
+	alpm_readahead_t *reader;
+	int64_t pos;
+	int errors = 0, ret;
+
+	/* decompress in another thread while the files are written out; with a
+	 * single CPU that thread would only add the cost of handing over blocks,
+	 * and the workers of a pool already keep the CPUs busy */
+	if((reader = _alpm_readahead_new(handle, archive,
+					pool == NULL && sysconf(_SC_NPROCESSORS_ONLN) > 1)) == NULL) {
 		return -1;
 	}
 
-	if(trans->flags & ALPM_TRANS_FLAG_DBONLY) {
+	if(handle->trans->flags & ALPM_TRANS_FLAG_DBONLY) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting db files\n");
-		while(archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
+		while((ret = _alpm_readahead_next_header(reader, &entry, &pos)) == ARCHIVE_OK) {
 			const char *entryname = archive_entry_pathname(entry);
 			if(entryname[0] == '.') {
-				errors += extract_db_file(handle, archive, entry, newpkg, entryname);
+				errors += extract_db_file(handle, reader, entry, newpkg, entryname);
 			} else {
-				archive_read_data_skip(archive);
+				_alpm_readahead_data_skip(reader);
 			}
 		}
 	} else {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting files\n");
 
 		/* call PROGRESS once with 0 percent, as we sort-of skip that here */
-		PROGRESS(handle, progress, newpkg->name, 0, pkg_count, pkg_current);
+		commit_progress(handle, commit, pool, 0);
 
-		while(archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
+		while((ret = _alpm_readahead_next_header(reader, &entry, &pos)) == ARCHIVE_OK) {
 			int percent;
 
 			if(newpkg->size != 0) {
 				/* Using compressed size for calculations here, as newpkg->isize is not
 				 * exact when it comes to comparing to the ACTUAL uncompressed size
 				 * (missing metadata sizes) */
-				int64_t pos = _alpm_archive_compressed_ftell(archive);
 				percent = (pos * 100) / newpkg->size;
 				if(percent >= 100) {
 					percent = 100;
@@ -564,28 +660,39 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 				percent = 0;
 			}
 
-			PROGRESS(handle, progress, newpkg->name, percent, pkg_count, pkg_current);
+			commit_progress(handle, commit, pool, percent);
 
 			/* extract the next file from the archive */
-			errors += extract_single_file(handle, archive, entry, newpkg, oldpkg);
+			errors += extract_single_file(handle, reader, entry, newpkg, commit->oldpkg);
 		}
 	}
 
-	_alpm_archive_read_free(archive);
-	close(fd);
-
-	/* restore the old cwd if we have it */
-	if(cwdfd >= 0) {
-		if(fchdir(cwdfd) != 0) {
-			_alpm_log(handle, ALPM_LOG_ERROR,
-					_("could not restore working directory (%s)\n"), strerror(errno));
-		}
-		close(cwdfd);
+	/* a package that breaks off is not just shorter */
+	if(ret != ARCHIVE_EOF) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not read package %s: %s\n"),
+				newpkg->name, _alpm_readahead_error_string(reader));
+		alpm_logaction(handle, ALPM_CALLER_PREFIX,
+				"error: could not read package %s: %s\n",
+				newpkg->name, _alpm_readahead_error_string(reader));
+		errors++;
 	}
 
+	_alpm_readahead_free(reader);
+	return errors;
+}
+
+/* Everything after the extraction: the database entry, the post_install or
+ * post_upgrade script and the events. */
+static int commit_finish(alpm_handle_t *handle, struct pkg_commit *commit, int errors)
+{
+	alpm_pkg_t *newpkg = commit->newpkg, *oldpkg = commit->oldpkg;
+	alpm_db_t *db = handle->db_local;
+	alpm_trans_t *trans = handle->trans;
+	int ret = 0;
+
 	if(errors) {
 		ret = -1;
-		if(is_upgrade) {
+		if(commit->is_upgrade) {
 			_alpm_log(handle, ALPM_LOG_ERROR, _("problem occurred while upgrading %s\n"),
 					newpkg->name);
 			alpm_logaction(handle, ALPM_CALLER_PREFIX,
@@ -604,16 +711,21 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 	newpkg->installdate = get_install_time();
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "updating database\n");
-	_alpm_log(handle, ALPM_LOG_DEBUG, "adding database entry '%s'\n", newpkg->name);
 
-	if(_alpm_local_db_write(db, newpkg, INFRQ_ALL)) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not update database entry %s-%s\n"),
-				newpkg->name, newpkg->version);
-		alpm_logaction(handle, ALPM_CALLER_PREFIX,
-				"error: could not update database entry %s-%s\n",
-				newpkg->name, newpkg->version);
-		handle->pm_errno = ALPM_ERR_DB_WRITE;
-		return -1;
+	if(trans->freshroot) {
+		/* written in one go with the others, see write_db_entries() */
+		trans->dbwrite = alpm_list_add(trans->dbwrite, newpkg);
+	} else {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "adding database entry '%s'\n", newpkg->name);
+		if(_alpm_local_db_write(db, newpkg, INFRQ_ALL)) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not update database entry %s-%s\n"),
+					newpkg->name, newpkg->version);
+			alpm_logaction(handle, ALPM_CALLER_PREFIX,
+					"error: could not update database entry %s-%s\n",
+					newpkg->name, newpkg->version);
+			handle->pm_errno = ALPM_ERR_DB_WRITE;
+			return -1;
+		}
 	}
 
 	if(_alpm_db_add_pkgincache(db, newpkg) == -1) {
@@ -621,9 +733,9 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 				newpkg->name);
 	}
 
-	PROGRESS(handle, progress, newpkg->name, 100, pkg_count, pkg_current);
+	PROGRESS(handle, commit->progress, newpkg->name, 100, commit->count, commit->current);
 
-	switch(event.operation) {
+	switch(commit->event.operation) {
 		case ALPM_PACKAGE_INSTALL:
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "installed %s (%s)\n",
 					newpkg->name, newpkg->version);
@@ -649,23 +761,359 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 	if(alpm_pkg_has_scriptlet(newpkg)
 			&& !(trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
 		char *scriptlet = _alpm_local_db_pkgpath(db, newpkg, "install");
-		const char *scriptlet_name = is_upgrade ? "post_upgrade" : "post_install";
+		const char *scriptlet_name = commit->is_upgrade ? "post_upgrade" : "post_install";
 
-		_alpm_runscriptlet(handle, scriptlet, scriptlet_name,
-				newpkg->version, oldpkg ? oldpkg->version : NULL, 0);
+		if(_alpm_trans_defer_scriptlet(handle, newpkg, scriptlet, scriptlet_name,
+					newpkg->version, oldpkg ? oldpkg->version : NULL) != 0) {
+			/* the script sees its package in the database */
+			if(write_db_entries(handle) != 0) {
+				ret = -1;
+			}
+			_alpm_runscriptlet(handle, scriptlet, scriptlet_name,
+					newpkg->version, oldpkg ? oldpkg->version : NULL, 0);
+		}
 		free(scriptlet);
 	}
 
-	event.type = ALPM_EVENT_PACKAGE_OPERATION_DONE;
-	EVENT(handle, &event);
+	commit->event.type = ALPM_EVENT_PACKAGE_OPERATION_DONE;
+	EVENT(handle, &commit->event);
+
+	return ret;
+}
+
+static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
+		size_t pkg_current, size_t pkg_count)
+{
+	struct pkg_commit commit = {
+		.newpkg = newpkg,
+		.current = pkg_current,
+		.count = pkg_count
+	};
+	struct archive *archive;
+	int fd, cwdfd, errors;
+	struct stat buf;
+	long ncpus;
+
+	ASSERT(handle->trans != NULL, return -1);
+
+	commit_init(handle, &commit);
+	EVENT(handle, &commit.event);
+
+	if(commit_prepare(handle, &commit) != 0) {
+		return -1;
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	fd = _alpm_open_archive_threads(handle, commit.pkgfile, &buf,
+			&archive, ALPM_ERR_PKG_OPEN, ncpus > 1 ? ncpus : 1);
+	if(fd < 0) {
+		return -1;
+	}
+
+	/* save the cwd so we can restore it later */
+	OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
+	if(cwdfd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
+	}
+
+	/* libarchive requires this for extracting hard links */
+	if(chdir(handle->root) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
+				handle->root, strerror(errno));
+		_alpm_archive_read_free(archive);
+		if(cwdfd >= 0) {
+			close(cwdfd);
+		}
+		close(fd);
+		return -1;
+	}
+
+	errors = commit_extract(handle, &commit, archive, NULL);
+
+	_alpm_archive_read_free(archive);
+	close(fd);
+
+	/* restore the old cwd if we have it */
+	if(cwdfd >= 0) {
+		if(fchdir(cwdfd) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("could not restore working directory (%s)\n"), strerror(errno));
+		}
+		close(cwdfd);
+	}
+
+	if(errors < 0) {
+		return -1;
+	}
+	return commit_finish(handle, &commit, errors);
+}
+
+static void *extract_worker(void *data)
+{
+	struct extract_pool *pool = data;
+	alpm_handle_t *handle = pool->handle;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		struct pkg_commit *commit;
+		struct archive *archive;
+		struct stat buf;
+		int fd, errors = -1;
+
+		while(pool->taken == pool->queued && !pool->stop) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if(pool->taken == pool->queued) {
+			break;
+		}
+		commit = pool->commits + pool->taken++;
+		if(commit->done) {
+			/* failed before its extraction */
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		/* messages are passed on once the packages before are done */
+		_alpm_log_capture(&commit->output);
+		/* the other workers keep the CPUs busy, so no decompression threads,
+		 * neither in libarchive nor in commit_extract() */
+		fd = _alpm_open_archive(handle, commit->pkgfile, &buf, &archive, ALPM_ERR_PKG_OPEN);
+		if(fd >= 0) {
+			errors = commit_extract(handle, commit, archive, pool);
+			_alpm_archive_read_free(archive);
+			close(fd);
+		}
+		_alpm_log_capture(NULL);
+
+		pthread_mutex_lock(&pool->lock);
+		commit->errors = errors;
+		commit->done = 1;
+		pthread_cond_signal(&pool->changed);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* Whether removing the old version of a package may remove a directory, which
+ * a package extracted meanwhile could be creating files in. */
+static int removes_dirs(alpm_pkg_t *oldpkg, alpm_pkg_t *newpkg)
+{
+	alpm_filelist_t *files = alpm_pkg_get_files(oldpkg);
+	size_t i;
+
+	for(i = 0; files && i < files->count; i++) {
+		const char *name = files->files[i].name;
+		size_t len = strlen(name);
+		if(len > 0 && name[len - 1] == '/'
+				&& alpm_filelist_contains(&newpkg->files, name) == NULL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void commit_schedule(alpm_handle_t *handle, struct pkg_commit *commits, size_t idx)
+{
+	struct pkg_commit *commit = commits + idx;
+	int scriptlet = alpm_pkg_has_scriptlet(commit->newpkg)
+		&& !(handle->trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET);
+	alpm_list_t *i;
+
+	/* install scripts see all packages before them installed and none after */
+	commit->exclusive = scriptlet;
+	commit->drain = scriptlet
+		|| (commit->oldpkg && removes_dirs(commit->oldpkg, commit->newpkg));
+
+	/* the packages it depends on are installed completely first */
+	for(i = alpm_pkg_get_depends(commit->newpkg); i; i = i->next) {
+		size_t k;
+		for(k = idx; k > commit->after; k--) {
+			if(_alpm_depcmp(commits[k - 1].newpkg, i->data)) {
+				commit->after = k;
+				break;
+			}
+		}
+	}
+}
+
+/* Install the packages of the transaction with a pool of threads extracting
+ * them. Packages are prepared and finished on this thread in the order of the
+ * transaction, which also passes on all callbacks and the output captured in
+ * the workers; only the extraction runs in the workers. A package starts once
+ * the packages it depends on are finished. Packages with install scripts run
+ * on their own, as do upgrades which may remove directories.
+ * Returns 1 without installing anything if the pool could not be set up. */
+static int upgrade_parallel(alpm_handle_t *handle, size_t pkg_count)
+{
+	alpm_trans_t *trans = handle->trans;
+	struct extract_pool pool = { .handle = handle };
+	struct pkg_commit *commits;
+	pthread_t *threads = NULL;
+	size_t nthreads, started = 0, finished = 0, barrier = 0, i;
+	alpm_list_t *targ;
+	int ret = 1, stop = 0, cwdfd = -1;
+
+	CALLOC(commits, pkg_count, sizeof(struct pkg_commit), return 1);
+	for(i = 0, targ = trans->add; targ; targ = targ->next, i++) {
+		struct pkg_commit *commit = commits + i;
+		commit->newpkg = targ->data;
+		commit->current = i + 1;
+		commit->count = pkg_count;
+		/* the workers run in the root */
+		if((commit->path = realpath(commit->newpkg->origin_data.file, NULL)) == NULL) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "could not resolve %s: %s\n",
+					commit->newpkg->origin_data.file, strerror(errno));
+			goto cleanup;
+		}
+	}
+
+	OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
+	if(cwdfd < 0 || chdir(handle->root) != 0) {
+		goto cleanup;
+	}
+
+	nthreads = handle->extractjobs < pkg_count ? handle->extractjobs : pkg_count;
+	CALLOC(threads, nthreads, sizeof(pthread_t), goto restore);
+	pool.commits = commits;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.changed, NULL);
+	for(i = 0; i < nthreads; i++) {
+		if(pthread_create(threads + i, NULL, extract_worker, &pool) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+	if(nthreads == 0) {
+		goto join;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "extracting %zu packages with up to %zu threads\n",
+			pkg_count, nthreads);
+
+	ret = 0;
+	for(i = 0; i < pkg_count; i++) {
+		commit_init(handle, commits + i);
+		commits[i].pkgfile = commits[i].path;
+		commit_schedule(handle, commits, i);
+	}
+
+	while(finished < pkg_count) {
+		struct pkg_commit *commit;
+		int reported = trans->flags & ALPM_TRANS_FLAG_DBONLY ? 0 : -1;
+
+		/* start what may be extracted alongside the packages in flight */
+		while(!stop && started < pkg_count && started - finished < nthreads) {
+			int head = started == finished, prepared;
 
+			commit = commits + started;
+			if(commit->after > finished || barrier > finished
+					|| (commit->drain && !head)) {
+				break;
+			}
+			if(trans->state == STATE_INTERRUPTED) {
+				stop = 1;
+				break;
+			}
+
+			if(head) {
+				EVENT(handle, &commit->event);
+				commit->announced = 1;
+			} else {
+				/* held back until the packages before it are done */
+				_alpm_log_capture(&commit->output);
+			}
+			prepared = commit_prepare(handle, commit);
+			_alpm_log_capture(NULL);
+
+			pthread_mutex_lock(&pool.lock);
+			if(prepared != 0) {
+				commit->errors = -1;
+				commit->done = 1;
+				stop = 1;
+			}
+			pool.queued = ++started;
+			pthread_cond_signal(&pool.work);
+			pthread_mutex_unlock(&pool.lock);
+			if(commit->exclusive) {
+				barrier = started;
+			}
+		}
+		if(finished == started) {
+			/* stopped before another package started */
+			break;
+		}
+
+		/* wait for the oldest package, passing on how far it got */
+		commit = commits + finished;
+		if(!commit->announced) {
+			EVENT(handle, &commit->event);
+			commit->announced = 1;
+		}
+		pthread_mutex_lock(&pool.lock);
+		for(;;) {
+			int percent = commit->percent;
+			if(commit->done && commit->errors < 0) {
+				break;
+			} else if(percent != reported) {
+				pthread_mutex_unlock(&pool.lock);
+				PROGRESS(handle, commit->progress, commit->newpkg->name, percent,
+						commit->count, commit->current);
+				reported = percent;
+				pthread_mutex_lock(&pool.lock);
+			} else if(commit->done) {
+				break;
+			} else {
+				pthread_cond_wait(&pool.changed, &pool.lock);
+			}
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		_alpm_log_replay(handle, commit->output);
+		commit->output = NULL;
+		if(commit->errors < 0 || commit_finish(handle, commit, commit->errors) != 0) {
+			/* finish the packages in flight, start no more */
+			trans->state = STATE_INTERRUPTED;
+			handle->pm_errno = ALPM_ERR_TRANS_ABORT;
+			ret = -1;
+			stop = 1;
+		}
+		finished++;
+	}
+
+join:
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+	for(i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool.work);
+	pthread_cond_destroy(&pool.changed);
+	pthread_mutex_destroy(&pool.lock);
+	free(threads);
+
+restore:
+	if(fchdir(cwdfd) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("could not restore working directory (%s)\n"), strerror(errno));
+	}
+
+cleanup:
+	if(cwdfd >= 0) {
+		close(cwdfd);
+	}
+	for(i = 0; i < pkg_count; i++) {
+		free(commits[i].path);
+	}
+	free(commits);
 	return ret;
 }
 
 int _alpm_upgrade_packages(alpm_handle_t *handle)
 {
 	size_t pkg_count, pkg_current;
-	int skip_ldconfig = 0, ret = 0;
+	int ret = 0, serial = 1;
 	alpm_list_t *targ;
 	alpm_trans_t *trans = handle->trans;
 
@@ -676,30 +1124,43 @@ int _alpm_upgrade_packages(alpm_handle_t *handle)
 	pkg_count = alpm_list_count(trans->add);
 	pkg_current = 1;
 
+	if(handle->extractjobs > 1 && pkg_count > 1) {
+		ret = upgrade_parallel(handle, pkg_count);
+		if(ret == 1) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "could not start extraction threads\n");
+			ret = 0;
+		} else {
+			serial = 0;
+		}
+	}
+
 	/* loop through our package list adding/upgrading one at a time */
-	for(targ = trans->add; targ; targ = targ->next) {
+	for(targ = serial ? trans->add : NULL; targ; targ = targ->next) {
 		alpm_pkg_t *newpkg = targ->data;
 
 		if(handle->trans->state == STATE_INTERRUPTED) {
-			return ret;
+			break;
 		}
 
 		if(commit_single_pkg(handle, newpkg, pkg_current, pkg_count)) {
 			/* something screwed up on the commit, abort the trans */
 			trans->state = STATE_INTERRUPTED;
 			handle->pm_errno = ALPM_ERR_TRANS_ABORT;
-			/* running ldconfig at this point could possibly screw system */
-			skip_ldconfig = 1;
 			ret = -1;
 		}
 
 		pkg_current++;
 	}
 
-	if(!skip_ldconfig) {
-		/* run ldconfig if it exists */
-		_alpm_ldconfig(handle);
+	/* also after a failure, for the packages installed before it */
+	if(write_db_entries(handle) != 0) {
+		ret = -1;
 	}
 
+	/* flush all database entries written above in one go */
+	_alpm_local_db_sync(handle->db_local);
+
+	/* ldconfig runs once at the end of the commit, see _alpm_trans_run_deferred() */
+
 	return ret;
 }
@@ -66,6 +66,9 @@ alpm_handle_t SYMEXPORT *alpm_initialize(const char *root, const char *dbpath,
 #endif
 
 	myhandle->parallel_downloads = 1;
+	myhandle->hookjobs = 1;
+	myhandle->extractjobs = 1;
+	myhandle->progress_interval = 100;
 
 #ifdef ENABLE_NLS
 	bindtextdomain("libalpm", LOCALEDIR);
@@ -151,6 +151,14 @@ typedef struct _alpm_backup_t {
  */
 alpm_file_t *alpm_filelist_contains(const alpm_filelist_t *filelist, const char *path);
 
+/** The callback type for visiting the paths of a package.
+ * @param ctx user-provided context
+ * @param path the path relative to the install root, only valid until the
+ * callback returns
+ * @return 0 to continue, any other value to stop
+ */
+typedef int (*alpm_cb_file)(void *ctx, const char *path);
+
 /* End of libalpm_files */
 /** @} */
 
@@ -1503,6 +1511,16 @@ typedef void (*alpm_cb_log)(void *ctx, alpm_loglevel_t level, const char *fmt, v
 int alpm_logaction(alpm_handle_t *handle, const char *prefix,
 		const char *fmt, ...) __attribute__((format(printf, 3, 4)));
 
+/** Write out log lines held back by buffered logging.
+ * Front ends can call this from their signal handlers before exiting: it
+ * takes no lock and only calls write(). Every line complete when it is
+ * called is written out; a line that the interrupted code was writing out
+ * at that moment may appear twice in the log file.
+ * @param handle the context handle
+ * @return 0 on success, -1 if writing to the log file failed
+ */
+int alpm_logaction_flush(alpm_handle_t *handle);
+
 /* End of libalpm_log */
 /** @} */
 
@@ -1725,6 +1743,33 @@ int alpm_option_remove_cachedir(alpm_handle_t *handle, const char *cachedir);
 /** @} */
 
 
+/** @name Accessors to the content-addressed package store
+ *
+ * When set, package files are additionally kept in this directory under
+ * their SHA-256 digest, and the cachedirs hold hard links into it. A
+ * package already present in the store, for example because another root
+ * sharing the same store downloaded it under the same or a different file
+ * name, is linked into the cache instead of being downloaded again.
+ * The store is disabled by default.
+ * @{
+ */
+
+/** Returns the path to the content-addressed package store.
+ * @param handle the context handle
+ * @return the path to the store, or NULL if it is disabled
+ */
+const char *alpm_option_get_cachestore(alpm_handle_t *handle);
+
+/** Sets the path to the content-addressed package store.
+ * @param handle the context handle
+ * @param cachestore the store directory, or NULL to disable the store
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_set_cachestore(alpm_handle_t *handle, const char *cachestore);
+/* End of cachestore accessors */
+/** @} */
+
+
 /** @name Accessors to the list of package hook directories.
  *
  * libalpm will search these directories for hooks to run. A hook in
@@ -1893,6 +1938,34 @@ int alpm_option_set_usesyslog(alpm_handle_t *handle, int usesyslog);
 /** @} */
 
 
+/** @name Accessors for buffered logging
+ *
+ * By default every line passed to \link alpm_logaction \endlink is written
+ * to the log file straight away. With buffered logging, lines are collected
+ * in memory and written out when the buffer fills up, at the end of a
+ * transaction, when an error is logged, on \link alpm_release \endlink and
+ * whenever \link alpm_logaction_flush \endlink is called. Lines sent to the
+ * syslog are not affected.
+ * @{
+ */
+
+/** Returns whether the log file is buffered (0 is FALSE, TRUE otherwise).
+ * @param handle the context handle
+ * @return 0 or 1 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_get_bufferedlog(alpm_handle_t *handle);
+
+/** Sets whether to buffer the log file (0 is FALSE, TRUE otherwise).
+ * Turning buffering off writes out any pending lines.
+ * @param handle the context handle
+ * @param bufferedlog whether to buffer the log file
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_set_bufferedlog(alpm_handle_t *handle, int bufferedlog);
+/* End of bufferedlog accessors */
+/** @} */
+
+
 /** @name Accessors to the list of no-upgrade files.
  * These functions modify the list of files which should
  * not be updated by package installation.
@@ -2160,6 +2233,54 @@ int alpm_option_set_checkspace(alpm_handle_t *handle, int checkspace);
 /** @} */
 
 
+/** @name Accessors for the verification cache.
+ *
+ * When enabled, libalpm remembers package files that passed checksum and
+ * signature checks in a file below the database path and skips the checks
+ * for them as long as the file, the expected digest, the signature and the
+ * keyring in GPGDir are all unchanged.
+ * @{
+ */
+
+/** Get whether the verification cache is used.
+ * @param handle the context handle
+ * @return 0 if disabled, 1 if enabled
+ */
+int alpm_option_get_verifycache(alpm_handle_t *handle);
+
+/** Enable/disable the verification cache.
+ * @param handle the context handle
+ * @param verifycache 0 for disabled, 1 for enabled
+ */
+int alpm_option_set_verifycache(alpm_handle_t *handle, int verifycache);
+/* End of verifycache accessors */
+/** @} */
+
+
+/** @name Accessors for the package metadata cache.
+ *
+ * When enabled, libalpm remembers the metadata of package files loaded
+ * without their file list in a file below the database path, and later
+ * loads of such a file read the metadata from there as long as the file
+ * is unchanged.
+ * @{
+ */
+
+/** Get whether the package metadata cache is used.
+ * @param handle the context handle
+ * @return 0 if disabled, 1 if enabled
+ */
+int alpm_option_get_metacache(alpm_handle_t *handle);
+
+/** Enable/disable the package metadata cache.
+ * @param handle the context handle
+ * @param metacache 0 for disabled, 1 for enabled
+ */
+int alpm_option_set_metacache(alpm_handle_t *handle, int metacache);
+/* End of metacache accessors */
+/** @} */
+
+
 /** @name Accessors for the database extension
  *
  * This controls the extension used for sync databases. libalpm will use this
@@ -2285,6 +2406,85 @@ int alpm_option_set_parallel_downloads(alpm_handle_t *handle, unsigned int num_s
 /* End of parallel_downloads accessors */
 /** @} */
 
+/** @name Accessors for parallel hooks
+ * Hooks marked Parallel that follow each other in the run order are run
+ * concurrently. This setting configures how many of them may run at once.
+ *
+ * By default this value is set to 1, meaning all hooks run sequentially.
+ *
+ * @{
+ */
+
+/** Gets the number of Parallel hooks that may run at the same time.
+ * @param handle the context handle
+ * @return the number of hooks that may run at the same time
+ */
+int alpm_option_get_hookjobs(alpm_handle_t *handle);
+
+/** Sets the number of Parallel hooks that may run at the same time.
+ * @param handle the context handle
+ * @param jobs maximum number of hooks to run at once
+ * @return 0 on success, -1 on error
+ */
+int alpm_option_set_hookjobs(alpm_handle_t *handle, unsigned int jobs);
+/* End of hookjobs accessors */
+/** @} */
+
+/** @name Accessors for parallel extraction
+ * Packages installed by a transaction that neither depend on each other nor
+ * have install scripts are extracted concurrently. This setting configures
+ * how many of them may be extracted at once. Install scripts, database
+ * entries and callbacks are still run one package after another, in the
+ * order of the transaction.
+ *
+ * By default this value is set to 1, meaning packages are extracted one
+ * after another.
+ *
+ * @{
+ */
+
+/** Gets the number of packages that may be extracted at the same time.
+ * @param handle the context handle
+ * @return the number of packages that may be extracted at the same time
+ */
+int alpm_option_get_extractjobs(alpm_handle_t *handle);
+
+/** Sets the number of packages that may be extracted at the same time.
+ * @param handle the context handle
+ * @param jobs maximum number of packages to extract at once
+ * @return 0 on success, -1 on error
+ */
+int alpm_option_set_extractjobs(alpm_handle_t *handle, unsigned int jobs);
+/* End of extractjobs accessors */
+/** @} */
+
+/** @name Accessors for the progress update interval
+ *
+ * Progress and download progress callbacks are only called when the
+ * reported percentage changes, or when this many milliseconds have passed
+ * since the last call for the same operation. Setting it to 0 only reports
+ * changes of the percentage.
+ *
+ * By default this value is set to 100.
+ *
+ * @{
+ */
+
+/** Gets the minimum interval between repeated progress updates.
+ * @param handle the context handle
+ * @return the interval in milliseconds
+ */
+int alpm_option_get_progress_interval(alpm_handle_t *handle);
+
+/** Sets the minimum interval between repeated progress updates.
+ * @param handle the context handle
+ * @param interval the interval in milliseconds
+ * @return 0 on success, -1 on error
+ */
+int alpm_option_set_progress_interval(alpm_handle_t *handle, unsigned int interval);
+/* End of progress_interval accessors */
+/** @} */
+
 /** @name Accessors for sandbox
  *
  * By default, libalpm will sandbox the downloader process.
@@ -2634,6 +2834,27 @@ alpm_list_t *alpm_pkg_get_replaces(alpm_pkg_t *pkg);
  */
 alpm_filelist_t *alpm_pkg_get_files(alpm_pkg_t *pkg);
 
+/** Determines whether a package contains a given path.
+ * Same as calling alpm_filelist_contains() on alpm_pkg_get_files(), but
+ * packages from a files database keep their compressed file list instead of
+ * building the full one.
+ * @param pkg a pointer to package
+ * @param path the path to search for, relative to the install root
+ * @return 1 if the package contains path, 0 otherwise
+ */
+int alpm_pkg_has_file(alpm_pkg_t *pkg, const char *path);
+
+/** Calls a function for every path installed by pkg, in sorted order.
+ * Packages from a files database are walked in their compressed form, so
+ * this is cheaper than alpm_pkg_get_files() when only the names are needed.
+ * @param pkg a pointer to package
+ * @param fn the function to call for each path
+ * @param ctx user-provided context passed to fn
+ * @return 0 if every path was visited, the first non-zero value returned by
+ * fn otherwise, or -1 on error (pm_errno is set accordingly)
+ */
+int alpm_pkg_files_foreach(alpm_pkg_t *pkg, alpm_cb_file fn, void *ctx);
+
 /** Returns the list of files backed up when installing pkg.
  * @param pkg a pointer to package
  * @return a reference to a list of alpm_backup_t objects
@@ -2917,6 +3138,113 @@ int alpm_remove_pkg(alpm_handle_t *handle, alpm_pkg_t *pkg);
 /* End of libalpm_trans */
 /** @} */
 
+/** @addtogroup libalpm_repo Repository Databases
+ * @brief Functions to write the sync databases served by a repository
+ *
+ * A repository is described by its sync database, "<repo>.db.<ext>", and
+ * the matching files database, "<repo>.files.<ext>", kept in the same
+ * directory. Both are updated together:
+ *
+ * - Open and lock the databases with \link alpm_repo_open \endlink
+ * - Add and remove any number of packages with \link alpm_repo_add \endlink,
+ *   \link alpm_repo_add_list \endlink and \link alpm_repo_remove \endlink
+ * - Write the new databases with \link alpm_repo_commit \endlink
+ * - Unlock with \link alpm_repo_free \endlink
+ *
+ * Package files are read once each, the digest being computed on the way,
+ * and the databases are rewritten in a single pass over the old archives
+ * without unpacking them. Signing the databases is left to the caller.
+ * @{
+ */
+
+/** An opened repository database. */
+typedef struct _alpm_repo_t alpm_repo_t;
+
+/** Repository update flags */
+typedef enum _alpm_repoflag_t {
+	/** Do not replace an entry with the same version of a package. */
+	ALPM_REPO_FLAG_NEWONLY = 1,
+	/** Do not replace an entry with an older version of a package. */
+	ALPM_REPO_FLAG_NODOWNGRADE = (1 << 1),
+	/** Embed the detached signature of each added package. */
+	ALPM_REPO_FLAG_INCLUDESIGS = (1 << 2),
+	/** Delete the package files of replaced and removed entries on commit. */
+	ALPM_REPO_FLAG_REMOVEOLD = (1 << 3),
+	/** Write the databases as indexed archives, each package compressed on
+	 * its own, so that libalpm can read a package without decompressing the
+	 * whole database. Only gzip and zstd compressed databases can be
+	 * indexed; they stay readable as plain compressed tar archives. */
+	ALPM_REPO_FLAG_SEEKABLE = (1 << 4)
+} alpm_repoflag_t;
+
+/** Open a repository database for update.
+ * The databases are locked with "<dbfile>.lck" until the repository is
+ * freed. A database that does not exist yet is created empty on commit.
+ * @param handle the context handle
+ * @param dbfile path to the sync database, such as "core.db.tar.gz"
+ * @param flags bitfield of alpm_repoflag_t
+ * @return the opened repository, NULL on error
+ */
+alpm_repo_t *alpm_repo_open(alpm_handle_t *handle, const char *dbfile, int flags);
+
+/** Add a package file to a repository.
+ * An existing entry for the same package name is replaced.
+ * @param repo the repository
+ * @param pkgfile path to the package file
+ * @return 0 on success, 1 if the package was skipped because of the
+ * repository flags, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_repo_add(alpm_repo_t *repo, const char *pkgfile);
+
+/** Add several package files to a repository.
+ * The files are loaded and checksummed in parallel, using the number of
+ * threads set with \link alpm_repo_set_jobs \endlink, and their entries
+ * are then replaced in list order, as if each file had been passed to
+ * \link alpm_repo_add \endlink in turn. Files that fail to load are
+ * reported through the log callback and skipped.
+ * @param repo the repository
+ * @param pkgfiles list of package file paths
+ * @return 0 on success, -1 if any file could not be added
+ */
+int alpm_repo_add_list(alpm_repo_t *repo, alpm_list_t *pkgfiles);
+
+/** Set the number of threads used by a repository.
+ * They are used to load packages in \link alpm_repo_add_list \endlink,
+ * to write the databases and files databases at the same time and, for
+ * zstd and xz compressed databases, to compress them. The default is 1.
+ * @param repo the repository
+ * @param jobs number of threads, at least 1
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_repo_set_jobs(alpm_repo_t *repo, unsigned int jobs);
+
+/** Remove a package from a repository.
+ * @param repo the repository
+ * @param pkgname name of the package
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_repo_remove(alpm_repo_t *repo, const char *pkgname);
+
+/** Write the changes made to a repository.
+ * The new databases replace the old ones, which are kept with an ".old"
+ * suffix. New entries are written sorted by name, stamped with the build
+ * date of their package, so that the same packages give the same databases.
+ * Nothing is written if no package was added or removed and the databases
+ * already exist.
+ * @param repo the repository
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_repo_commit(alpm_repo_t *repo);
+
+/** Unlock a repository and free it.
+ * Uncommitted changes are discarded.
+ * @param repo the repository
+ */
+void alpm_repo_free(alpm_repo_t *repo);
+
+/* End of libalpm_repo */
+/** @} */
+
 
 /** \addtogroup libalpm_misc Miscellaneous Functions
  * @brief Various libalpm functions
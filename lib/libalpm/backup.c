@@ -13,6 +13,7 @@
 #include "alpm_list.h"
 #include "log.h"
 #include "util.h"
+#include "package.h"
 
 /* split a backup string "file\thash" into the relevant components */
 int _alpm_split_backup(const char *string, alpm_backup_t **backup)
@@ -48,7 +49,9 @@ alpm_backup_t *_alpm_needbackup(const char *file, alpm_pkg_t *pkg)
 		return NULL;
 	}
 
-	for(lp = alpm_pkg_get_backup(pkg); lp; lp = lp->next) {
+	/* not alpm_pkg_get_backup(), which resets pm_errno of the handle
+	 * shared with the other extracting threads */
+	for(lp = pkg->ops->get_backup(pkg); lp; lp = lp->next) {
 		alpm_backup_t *backup = lp->data;
 
 		if(strcmp(file, backup->name) == 0) {
@@ -19,7 +19,6 @@
 
 #include "base64.h"
 
-#if 0
 static const unsigned char base64_enc_map[64] =
 {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',
@@ -30,7 +29,6 @@ static const unsigned char base64_enc_map[64] =
     'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7',
     '8', '9', '+', '/'
 };
-#endif
 
 static const unsigned char base64_dec_map[128] =
 {
@@ -49,7 +47,6 @@ static const unsigned char base64_dec_map[128] =
      49,  50,  51, 127, 127, 127, 127, 127
 };
 
-#if 0
 /*
  * Encode a buffer into base64 format
  */
@@ -112,7 +109,6 @@ int base64_encode( unsigned char *dst, size_t *dlen,
 
     return( 0 );
 }
-#endif
 
 /*
  * Decode a base64-formatted buffer
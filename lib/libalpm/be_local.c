@@ -12,6 +12,7 @@
 #include <string.h>
 #include <stdint.h> /* intmax_t */
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <limits.h> /* PATH_MAX */
 
@@ -30,6 +31,8 @@
 #include "package.h"
 #include "deps.h"
 #include "filelist.h"
+#include "trans.h"
+#include "dbparse.h"
 
 /* local database format version */
 size_t ALPM_LOCAL_DB_VERSION = 9;
@@ -670,37 +673,50 @@ char *_alpm_local_db_pkgpath(alpm_db_t *db, alpm_pkg_t *info,
 }
 
 #define READ_NEXT() do { \
-	if(safe_fgets(line, sizeof(line), fp) == NULL && !feof(fp)) goto error; \
-	_alpm_strip_newline(line, 0); \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL) { \
+		line = data + datalen; \
+		len = 0; \
+	} \
 } while(0)
 
 #define READ_AND_STORE(f) do { \
 	READ_NEXT(); \
-	STRDUP(f, line, goto error); \
+	MALLOC(f, len + 1, goto error); \
+	memcpy(f, line, len + 1); \
 } while(0)
 
 #define READ_AND_STORE_ALL(f) do { \
 	char *linedup; \
-	if(safe_fgets(line, sizeof(line), fp) == NULL) {\
-		if(!feof(fp)) goto error; else break; \
-	} \
-	if(_alpm_strip_newline(line, 0) == 0) break; \
-	STRDUP(linedup, line, goto error); \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL || len == 0) break; \
+	MALLOC(linedup, len + 1, goto error); \
+	memcpy(linedup, line, len + 1); \
 	f = alpm_list_add(f, linedup); \
 } while(1) /* note the while(1) and not (0) */
 
 #define READ_AND_SPLITDEP(f) do { \
-	if(safe_fgets(line, sizeof(line), fp) == NULL) {\
-		if(!feof(fp)) goto error; else break; \
-	} \
-	if(_alpm_strip_newline(line, 0) == 0) break; \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL || len == 0) break; \
 	f = alpm_list_add(f, alpm_dep_from_string(line)); \
 } while(1) /* note the while(1) and not (0) */
 
+/* read a whole file of the entry of a package, to be split in place */
+static int local_db_read_file(alpm_db_t *db, alpm_pkg_t *info,
+		const char *filename, char **data, size_t *len)
+{
+	char *path = _alpm_local_db_pkgpath(db, info, filename);
+	if(!path || _alpm_dbparse_read_file(path, data, len) != 0) {
+		_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"), path, strerror(errno));
+		free(path);
+		return -1;
+	}
+	free(path);
+	return 0;
+}
+
 static int local_db_read(alpm_pkg_t *info, int inforeq)
 {
-	FILE *fp = NULL;
-	char line[1024] = {0};
+	alpm_dbparse_t parser;
+	char *data = NULL, *line;
+	size_t datalen, len;
 	alpm_db_t *db = info->origin_data.db;
 
 	/* bitmask logic here:
@@ -725,141 +741,148 @@ static int local_db_read(alpm_pkg_t *info, int inforeq)
 
 	/* DESC */
 	if(inforeq & INFRQ_DESC && !(info->infolevel & INFRQ_DESC)) {
-		char *path = _alpm_local_db_pkgpath(db, info, "desc");
-		if(!path || (fp = fopen(path, "r")) == NULL) {
-			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"), path, strerror(errno));
-			free(path);
+		if(local_db_read_file(db, info, "desc", &data, &datalen) != 0) {
 			goto error;
 		}
-		free(path);
-		while(!feof(fp)) {
-			if(safe_fgets(line, sizeof(line), fp) == NULL && !feof(fp)) {
-				goto error;
-			}
-			if(_alpm_strip_newline(line, 0) == 0) {
-				/* length of stripped line was zero */
+		_alpm_dbparse_init(&parser, data, datalen);
+		while((line = _alpm_dbparse_next(&parser, &len)) != NULL) {
+			if(len == 0) {
 				continue;
 			}
-			if(strcmp(line, "%NAME%") == 0) {
-				READ_NEXT();
-				if(strcmp(line, info->name) != 0) {
-					_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: name "
-								"mismatch on package %s\n"), db->treename, info->name);
-				}
-			} else if(strcmp(line, "%VERSION%") == 0) {
-				READ_NEXT();
-				if(strcmp(line, info->version) != 0) {
-					_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: version "
-								"mismatch on package %s\n"), db->treename, info->name);
-				}
-			} else if(strcmp(line, "%BASE%") == 0) {
-				READ_AND_STORE(info->base);
-			} else if(strcmp(line, "%DESC%") == 0) {
-				READ_AND_STORE(info->desc);
-			} else if(strcmp(line, "%GROUPS%") == 0) {
-				READ_AND_STORE_ALL(info->groups);
-			} else if(strcmp(line, "%URL%") == 0) {
-				READ_AND_STORE(info->url);
-			} else if(strcmp(line, "%LICENSE%") == 0) {
-				READ_AND_STORE_ALL(info->licenses);
-			} else if(strcmp(line, "%ARCH%") == 0) {
-				READ_AND_STORE(info->arch);
-			} else if(strcmp(line, "%BUILDDATE%") == 0) {
-				READ_NEXT();
-				info->builddate = _alpm_parsedate(line);
-			} else if(strcmp(line, "%INSTALLDATE%") == 0) {
-				READ_NEXT();
-				info->installdate = _alpm_parsedate(line);
-			} else if(strcmp(line, "%PACKAGER%") == 0) {
-				READ_AND_STORE(info->packager);
-			} else if(strcmp(line, "%REASON%") == 0) {
-				READ_NEXT();
-				info->reason = _read_pkgreason(db->handle, info->name, line);
-			} else if(strcmp(line, "%VALIDATION%") == 0) {
-				alpm_list_t *i, *v = NULL;
-				READ_AND_STORE_ALL(v);
-				for(i = v; i; i = alpm_list_next(i))
-				{
-					if(strcmp(i->data, "none") == 0) {
-						info->validation |= ALPM_PKG_VALIDATION_NONE;
-					} else if(strcmp(i->data, "sha256") == 0) {
-						info->validation |= ALPM_PKG_VALIDATION_SHA256SUM;
-					} else if(strcmp(i->data, "pgp") == 0) {
-						info->validation |= ALPM_PKG_VALIDATION_SIGNATURE;
-					} else {
-						_alpm_log(db->handle, ALPM_LOG_WARNING,
-								_("unknown validation type for package %s: %s\n"),
-								info->name, (const char *)i->data);
+			switch(_alpm_dbparse_key(line, len)) {
+				case DBKEY_NAME:
+					READ_NEXT();
+					if(strcmp(line, info->name) != 0) {
+						_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: name "
+									"mismatch on package %s\n"), db->treename, info->name);
 					}
-				}
-				FREELIST(v);
-			} else if(strcmp(line, "%SIZE%") == 0) {
-				READ_NEXT();
-				info->isize = _alpm_strtoofft(line);
-			} else if(strcmp(line, "%REPLACES%") == 0) {
-				READ_AND_SPLITDEP(info->replaces);
-			} else if(strcmp(line, "%DEPENDS%") == 0) {
-				READ_AND_SPLITDEP(info->depends);
-			} else if(strcmp(line, "%OPTDEPENDS%") == 0) {
-				READ_AND_SPLITDEP(info->optdepends);
-			} else if(strcmp(line, "%MAKEDEPENDS%") == 0) {
-				READ_AND_SPLITDEP(info->makedepends);
-			} else if(strcmp(line, "%CHECKDEPENDS%") == 0) {
-				READ_AND_SPLITDEP(info->checkdepends);
-			} else if(strcmp(line, "%CONFLICTS%") == 0) {
-				READ_AND_SPLITDEP(info->conflicts);
-			} else if(strcmp(line, "%PROVIDES%") == 0) {
-				READ_AND_SPLITDEP(info->provides);
-			} else if(strcmp(line, "%XDATA%") == 0) {
-				alpm_list_t *i, *lines = NULL;
-				READ_AND_STORE_ALL(lines);
-				for(i = lines; i; i = i->next) {
-					alpm_pkg_xdata_t *pd = _alpm_pkg_parse_xdata(i->data);
-					if(pd == NULL || !alpm_list_append(&info->xdata, pd)) {
-						_alpm_pkg_xdata_free(pd);
-						FREELIST(lines);
-						goto error;
+					break;
+				case DBKEY_VERSION:
+					READ_NEXT();
+					if(strcmp(line, info->version) != 0) {
+						_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: version "
+									"mismatch on package %s\n"), db->treename, info->name);
+					}
+					break;
+				case DBKEY_BASE:
+					READ_AND_STORE(info->base);
+					break;
+				case DBKEY_DESC:
+					READ_AND_STORE(info->desc);
+					break;
+				case DBKEY_GROUPS:
+					READ_AND_STORE_ALL(info->groups);
+					break;
+				case DBKEY_URL:
+					READ_AND_STORE(info->url);
+					break;
+				case DBKEY_LICENSE:
+					READ_AND_STORE_ALL(info->licenses);
+					break;
+				case DBKEY_ARCH:
+					READ_AND_STORE(info->arch);
+					break;
+				case DBKEY_BUILDDATE:
+					READ_NEXT();
+					info->builddate = _alpm_parsedate(line);
+					break;
+				case DBKEY_INSTALLDATE:
+					READ_NEXT();
+					info->installdate = _alpm_parsedate(line);
+					break;
+				case DBKEY_PACKAGER:
+					READ_AND_STORE(info->packager);
+					break;
+				case DBKEY_REASON:
+					READ_NEXT();
+					info->reason = _read_pkgreason(db->handle, info->name, line);
+					break;
+				case DBKEY_VALIDATION:
+					while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0) {
+						if(strcmp(line, "none") == 0) {
+							info->validation |= ALPM_PKG_VALIDATION_NONE;
+						} else if(strcmp(line, "sha256") == 0) {
+							info->validation |= ALPM_PKG_VALIDATION_SHA256SUM;
+						} else if(strcmp(line, "pgp") == 0) {
+							info->validation |= ALPM_PKG_VALIDATION_SIGNATURE;
+						} else {
+							_alpm_log(db->handle, ALPM_LOG_WARNING,
+									_("unknown validation type for package %s: %s\n"),
+									info->name, line);
+						}
 					}
+					break;
+				case DBKEY_SIZE:
+					READ_NEXT();
+					info->isize = _alpm_strtoofft(line);
+					break;
+				case DBKEY_REPLACES:
+					READ_AND_SPLITDEP(info->replaces);
+					break;
+				case DBKEY_DEPENDS:
+					READ_AND_SPLITDEP(info->depends);
+					break;
+				case DBKEY_OPTDEPENDS:
+					READ_AND_SPLITDEP(info->optdepends);
+					break;
+				case DBKEY_MAKEDEPENDS:
+					READ_AND_SPLITDEP(info->makedepends);
+					break;
+				case DBKEY_CHECKDEPENDS:
+					READ_AND_SPLITDEP(info->checkdepends);
+					break;
+				case DBKEY_CONFLICTS:
+					READ_AND_SPLITDEP(info->conflicts);
+					break;
+				case DBKEY_PROVIDES:
+					READ_AND_SPLITDEP(info->provides);
+					break;
+				case DBKEY_XDATA: {
+					alpm_list_t *i, *lines = NULL;
+					READ_AND_STORE_ALL(lines);
+					for(i = lines; i; i = i->next) {
+						alpm_pkg_xdata_t *pd = _alpm_pkg_parse_xdata(i->data);
+						if(pd == NULL || !alpm_list_append(&info->xdata, pd)) {
+							_alpm_pkg_xdata_free(pd);
+							FREELIST(lines);
+							goto error;
+						}
+					}
+					FREELIST(lines);
+					break;
 				}
-				FREELIST(lines);
-			} else {
-				_alpm_log(db->handle, ALPM_LOG_WARNING, _("%s: unknown key '%s' in local database\n"), info->name, line);
-				alpm_list_t *lines = NULL;
-				READ_AND_STORE_ALL(lines);
-				FREELIST(lines);
+				default:
+					_alpm_log(db->handle, ALPM_LOG_WARNING, _("%s: unknown key '%s' in local database\n"), info->name, line);
+					/* skip the section */
+					while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0);
+					break;
 			}
 		}
-		fclose(fp);
-		fp = NULL;
+		FREE(data);
 		info->infolevel |= INFRQ_DESC;
 	}
 
 	/* FILES */
 	if(inforeq & INFRQ_FILES && !(info->infolevel & INFRQ_FILES)) {
-		char *path = _alpm_local_db_pkgpath(db, info, "files");
-		if(!path || (fp = fopen(path, "r")) == NULL) {
-			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"), path, strerror(errno));
-			free(path);
+		if(local_db_read_file(db, info, "files", &data, &datalen) != 0) {
 			goto error;
 		}
-		free(path);
-		while(safe_fgets(line, sizeof(line), fp)) {
-			_alpm_strip_newline(line, 0);
-			if(strcmp(line, "%FILES%") == 0) {
-				size_t files_count = 0, files_size = 0, len;
+		_alpm_dbparse_init(&parser, data, datalen);
+		while((line = _alpm_dbparse_next(&parser, &len)) != NULL) {
+			alpm_dbkey_t key = _alpm_dbparse_key(line, len);
+			if(key == DBKEY_FILES) {
+				size_t files_count = 0, files_size = 0;
 				alpm_file_t *files = NULL;
 
-				while(safe_fgets(line, sizeof(line), fp) &&
-						(len = _alpm_strip_newline(line, 0))) {
+				while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0) {
 					if(!_alpm_greedy_grow((void **)&files, &files_size,
 								(files_count ? (files_count + 1) * sizeof(alpm_file_t) : 8 * sizeof(alpm_file_t)))) {
 						goto nomem;
 					}
 					/* since we know the length of the file string already,
 					 * we can do malloc + memcpy rather than strdup */
-					len += 1;
-					MALLOC(files[files_count].name, len, goto nomem);
-					memcpy(files[files_count].name, line, len);
+					MALLOC(files[files_count].name, len + 1, goto nomem);
+					memcpy(files[files_count].name, line, len + 1);
 					files_count++;
 				}
 				/* attempt to hand back any memory we don't need */
@@ -878,8 +901,8 @@ nomem:
 				}
 				FREE(files);
 				goto error;
-			} else if(strcmp(line, "%BACKUP%") == 0) {
-				while(safe_fgets(line, sizeof(line), fp) && _alpm_strip_newline(line, 0)) {
+			} else if(key == DBKEY_BACKUP) {
+				while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0) {
 					alpm_backup_t *backup;
 					CALLOC(backup, 1, sizeof(alpm_backup_t), goto error);
 					if(_alpm_split_backup(line, &backup)) {
@@ -890,8 +913,7 @@ nomem:
 				}
 			}
 		}
-		fclose(fp);
-		fp = NULL;
+		FREE(data);
 		info->infolevel |= INFRQ_FILES;
 	}
 
@@ -909,9 +931,7 @@ nomem:
 
 error:
 	info->infolevel |= INFRQ_ERROR;
-	if(fp) {
-		fclose(fp);
-	}
+	free(data);
 	return -1;
 }
 
@@ -939,6 +959,163 @@ int _alpm_local_db_prepare(alpm_db_t *db, alpm_pkg_t *info)
 	return retval;
 }
 
+/* Entries written while a transaction is committing are only flushed to disk
+ * once, by _alpm_local_db_sync(), instead of after every single file. */
+static int local_db_sync_deferred(alpm_db_t *db)
+{
+	alpm_trans_t *trans = db->handle->trans;
+	return trans && trans->state == STATE_COMMITTING;
+}
+
+static FILE *local_db_fopen_tmp(alpm_db_t *db, alpm_pkg_t *info,
+		const char *filename, char **path, char **tmppath)
+{
+	FILE *fp;
+	size_t len;
+
+	*tmppath = NULL;
+	if((*path = _alpm_local_db_pkgpath(db, info, filename)) == NULL) {
+		return NULL;
+	}
+	len = strlen(*path) + 5;
+	MALLOC(*tmppath, len, FREE(*path); RET_ERR(db->handle, ALPM_ERR_MEMORY, NULL));
+	snprintf(*tmppath, len, "%s.tmp", *path);
+
+	if((fp = fopen(*tmppath, "w")) == NULL) {
+		_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				*tmppath, strerror(errno));
+		FREE(*path);
+		FREE(*tmppath);
+	}
+	return fp;
+}
+
+/* Finish a file opened by local_db_fopen_tmp() and atomically replace the
+ * database file with it, so a crash never leaves a truncated entry behind. */
+static int local_db_fclose_tmp(alpm_db_t *db, FILE *fp,
+		char *path, char *tmppath)
+{
+	int ret = 0;
+
+	if(fflush(fp) != 0 || (!local_db_sync_deferred(db) && fsync(fileno(fp)) != 0)) {
+		ret = -1;
+	}
+	if(fclose(fp) != 0) {
+		ret = -1;
+	}
+	if(ret == 0 && rename(tmppath, path) != 0) {
+		ret = -1;
+	}
+	if(ret != 0) {
+		_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not write file %s: %s\n"),
+				path, strerror(errno));
+		unlink(tmppath);
+	}
+
+	free(path);
+	free(tmppath);
+	return ret;
+}
+
+static int fsync_path(const char *path, int flags)
+{
+	int fd, ret;
+
+	OPEN(fd, path, O_RDONLY | O_CLOEXEC | flags);
+	if(fd < 0) {
+		return -1;
+	}
+	ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+/* Flush every file of a package entry followed by the entry directory. */
+static int fsync_pkg_dir(const char *pkgpath)
+{
+	DIR *dirp;
+	struct dirent *dp;
+	char path[PATH_MAX];
+	int ret = 0;
+
+	if((dirp = opendir(pkgpath)) == NULL) {
+		return -1;
+	}
+	while((dp = readdir(dirp)) != NULL) {
+		if(strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0) {
+			continue;
+		}
+		snprintf(path, PATH_MAX, "%s%s", pkgpath, dp->d_name);
+		if(fsync_path(path, 0) != 0) {
+			ret = -1;
+		}
+	}
+	closedir(dirp);
+
+	if(fsync_path(pkgpath, O_DIRECTORY) != 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/** Flush all local database changes of the committing transaction to disk.
+ * Uses a single syncfs() on the database filesystem where available and
+ * falls back to one fsync() pass over the entries written by the transaction.
+ * @param db the local database
+ * @return 0 on success, -1 on error
+ */
+int _alpm_local_db_sync(alpm_db_t *db)
+{
+	alpm_trans_t *trans = db->handle->trans;
+	const char *dbpath;
+	alpm_list_t *i;
+	int ret = 0;
+
+	if((dbpath = _alpm_db_path(db)) == NULL) {
+		return -1;
+	}
+
+#ifdef HAVE_SYNCFS
+	{
+		int fd;
+		OPEN(fd, dbpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(fd >= 0) {
+			ret = syncfs(fd);
+			close(fd);
+			if(ret == 0) {
+				if(trans) {
+					FREELIST(trans->dbsync);
+				}
+				return 0;
+			}
+		}
+		_alpm_log(db->handle, ALPM_LOG_DEBUG,
+				"syncfs failed on %s (%s), syncing entries one by one\n",
+				dbpath, strerror(errno));
+		ret = 0;
+	}
+#endif
+
+	if(trans) {
+		for(i = trans->dbsync; i; i = i->next) {
+			if(fsync_pkg_dir(i->data) != 0) {
+				ret = -1;
+			}
+		}
+		FREELIST(trans->dbsync);
+	}
+	if(fsync_path(dbpath, O_DIRECTORY) != 0) {
+		ret = -1;
+	}
+
+	if(ret != 0) {
+		_alpm_log(db->handle, ALPM_LOG_WARNING,
+				_("could not synchronize local database to disk: %s\n"),
+				strerror(errno));
+	}
+	return ret;
+}
+
 static void write_deps(FILE *fp, const char *header, alpm_list_t *deplist)
 {
 	alpm_list_t *lp;
@@ -972,19 +1149,14 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq)
 
 	/* DESC */
 	if(inforeq & INFRQ_DESC) {
-		char *path;
+		char *path, *tmppath;
 		_alpm_log(db->handle, ALPM_LOG_DEBUG,
 				"writing %s-%s DESC information back to db\n",
 				info->name, info->version);
-		path = _alpm_local_db_pkgpath(db, info, "desc");
-		if(!path || (fp = fopen(path, "w")) == NULL) {
-			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
-					path, strerror(errno));
+		if((fp = local_db_fopen_tmp(db, info, "desc", &path, &tmppath)) == NULL) {
 			retval = -1;
-			free(path);
 			goto cleanup;
 		}
-		free(path);
 		fprintf(fp, "%%NAME%%\n%s\n\n"
 						"%%VERSION%%\n%s\n\n", info->name, info->version);
 		if(info->base) {
@@ -1069,25 +1241,23 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq)
 			fputc('\n', fp);
 		}
 
-		fclose(fp);
+		retval = local_db_fclose_tmp(db, fp, path, tmppath);
 		fp = NULL;
+		if(retval != 0) {
+			goto cleanup;
+		}
 	}
 
 	/* FILES */
 	if(inforeq & INFRQ_FILES) {
-		char *path;
+		char *path, *tmppath;
 		_alpm_log(db->handle, ALPM_LOG_DEBUG,
 				"writing %s-%s FILES information back to db\n",
 				info->name, info->version);
-		path = _alpm_local_db_pkgpath(db, info, "files");
-		if(!path || (fp = fopen(path, "w")) == NULL) {
-			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
-					path, strerror(errno));
+		if((fp = local_db_fopen_tmp(db, info, "files", &path, &tmppath)) == NULL) {
 			retval = -1;
-			free(path);
 			goto cleanup;
 		}
-		free(path);
 		if(info->files.count) {
 			size_t i;
 			fputs("%FILES%\n", fp);
@@ -1106,13 +1276,35 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq)
 			}
 			fputc('\n', fp);
 		}
-		fclose(fp);
+		retval = local_db_fclose_tmp(db, fp, path, tmppath);
 		fp = NULL;
+		if(retval != 0) {
+			goto cleanup;
+		}
 	}
 
 	/* INSTALL and MTREE */
 	/* nothing needed here (automatically extracted) */
 
+	if(local_db_sync_deferred(db)) {
+		/* remember the entry so _alpm_local_db_sync() can flush it */
+		char *pkgpath = _alpm_local_db_pkgpath(db, info, NULL);
+		alpm_trans_t *trans = db->handle->trans;
+		if(pkgpath && !alpm_list_find_str(trans->dbsync, pkgpath)) {
+			trans->dbsync = alpm_list_add(trans->dbsync, pkgpath);
+		} else {
+			free(pkgpath);
+		}
+	} else {
+		char *pkgpath = _alpm_local_db_pkgpath(db, info, NULL);
+		if(pkgpath && fsync_path(pkgpath, O_DIRECTORY) != 0) {
+			_alpm_log(db->handle, ALPM_LOG_WARNING,
+					_("could not synchronize local database to disk: %s\n"),
+					strerror(errno));
+		}
+		free(pkgpath);
+	}
+
 cleanup:
 	umask(oldmask);
 	return retval;
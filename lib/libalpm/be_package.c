@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <unistd.h>
 
 /* libarchive */
 #include <archive.h>
@@ -28,6 +29,10 @@
 #include "deps.h"
 #include "filelist.h"
 #include "util.h"
+#include "verifycache.h"
+#include "metacache.h"
+#include "dbparse.h"
+#include "util-common.h"
 
 struct package_changelog {
 	struct archive *archive;
@@ -138,29 +143,79 @@ static const struct pkg_operations *get_file_pkg_ops(void)
 	return &file_pkg_ops;
 }
 
+/* a .PKGINFO larger than this is not taken for one */
+#define MAX_PKGINFO_SIZE (16 * 1024 * 1024)
+/* 512K for a line length seems reasonable */
+#define MAX_PKGINFO_LINE (512 * 1024)
+
+/**
+ * Read the whole package description file of a package.
+ * @param handle the context handle
+ * @param a the archive to read from, pointed at the .PKGINFO entry
+ * @param entry the .PKGINFO entry
+ * @param data where to store the NUL-terminated contents
+ * @param datalen where to store the length of the contents
+ *
+ * @return 0 on success, -1 on error
+ */
+static int read_descfile(alpm_handle_t *handle, struct archive *a,
+		struct archive_entry *entry, char **data, size_t *datalen)
+{
+	size_t len = 0, size = 4096;
+	la_ssize_t n;
+	char *buf;
+
+	if(archive_entry_size_is_set(entry) && archive_entry_size(entry) < MAX_PKGINFO_SIZE) {
+		size = archive_entry_size(entry) + 2;
+	}
+	MALLOC(buf, size, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	while((n = archive_read_data(a, buf + len, size - len - 1)) > 0) {
+		len += n;
+		if(len + 1 == size) {
+			if(size > MAX_PKGINFO_SIZE) {
+				_alpm_log(handle, ALPM_LOG_DEBUG, "package description file is too large\n");
+				free(buf);
+				return -1;
+			}
+			size *= 2;
+			REALLOC(buf, size, free(buf); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+		}
+	}
+	if(n < 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "error reading package descfile\n");
+		free(buf);
+		return -1;
+	}
+	buf[len] = '\0';
+	*data = buf;
+	*datalen = len;
+	return 0;
+}
+
 /**
  * Parses the package description file for a package into a alpm_pkg_t struct.
- * @param archive the archive to read from, pointed at the .PKGINFO entry
+ * @param data the contents of the .PKGINFO, split into lines in place
+ * @param datalen length of the contents
  * @param newpkg an empty alpm_pkg_t struct to fill with package info
  *
  * @return 0 on success, -1 on error
  */
-static int parse_descfile(alpm_handle_t *handle, struct archive *a, alpm_pkg_t *newpkg)
+static int parse_descfile(alpm_handle_t *handle, char *data, size_t datalen,
+		alpm_pkg_t *newpkg)
 {
+	alpm_dbparse_t parser;
 	char *ptr = NULL;
 	char *key = NULL;
-	int ret, linenum = 0;
-	struct archive_read_buffer buf = {0};
-
-	/* 512K for a line length seems reasonable */
-	buf.max_line_size = 512 * 1024;
-
-	/* loop until we reach EOF or other error */
-	while((ret = _alpm_archive_fgets(a, &buf)) == ARCHIVE_OK) {
-		size_t len = _alpm_strip_newline(buf.line, buf.real_line_size);
+	int linenum = 0;
+	size_t len;
 
+	_alpm_dbparse_init(&parser, data, datalen);
+	while((key = _alpm_dbparse_next(&parser, &len)) != NULL) {
 		linenum++;
-		key = buf.line;
+		if(len >= MAX_PKGINFO_LINE) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "error parsing package descfile\n");
+			return -1;
+		}
 		if(len == 0 || key[0] == '#') {
 			continue;
 		}
@@ -245,11 +300,25 @@ static int parse_descfile(alpm_handle_t *handle, struct archive *a, alpm_pkg_t *
 			}
 		}
 	}
-	if(ret != ARCHIVE_EOF) {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "error parsing package descfile\n");
+
+	return 0;
+}
+
+/* Check the fields of a parsed .PKGINFO every package must have. */
+static int check_descfile(alpm_handle_t *handle, const char *pkgfile, alpm_pkg_t *newpkg)
+{
+	if(newpkg->name == NULL || strlen(newpkg->name) == 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("missing package name in %s\n"), pkgfile);
+		return -1;
+	}
+	if(newpkg->version == NULL || strlen(newpkg->version) == 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("missing package version in %s\n"), pkgfile);
+		return -1;
+	}
+	if(strchr(newpkg->version, '-') == NULL) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("invalid package version in %s\n"), pkgfile);
 		return -1;
 	}
-
 	return 0;
 }
 
@@ -260,7 +329,9 @@ static int parse_descfile(alpm_handle_t *handle, struct archive *a, alpm_pkg_t *
  * @param syncpkg package object to load verification data from (md5sum,
  * sha256sum, and/or base64 signature)
  * @param level the required level of signature verification
- * @param sigdata signature data from the package to pass back
+ * @param sigdata signature data from the package to pass back; left untouched
+ * when the result comes from the verification cache, which only holds
+ * packages that passed, as callers only need it to report a failure
  * @param validation successful validations performed on the package file
  * @return 0 if package is fully valid, -1 and pm_errno otherwise
  */
@@ -268,7 +339,8 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		const char *pkgfile, alpm_pkg_t *syncpkg, int level,
 		alpm_siglist_t **sigdata, int *validation)
 {
-	int has_sig;
+	int has_sig, cached, cacheable;
+	const char *sha256sum = NULL, *sig = NULL;
 	handle->pm_errno = ALPM_ERR_OK;
 
 	if(pkgfile == NULL || strlen(pkgfile) == 0) {
@@ -301,6 +373,26 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		}
 	}
 
+	if(syncpkg) {
+		sig = syncpkg->base64_sig;
+		if(!has_sig || !sig) {
+			sha256sum = syncpkg->sha256sum;
+		}
+	}
+
+	/* nothing worth remembering if neither checksum nor signature is checked,
+	 * which also keeps plain metadata loads such as -Sc out of the cache */
+	cacheable = validation && (sha256sum || (level & ALPM_SIG_PACKAGE));
+
+	/* checked with the same inputs before? */
+	if(cacheable && _alpm_verifycache_lookup(handle, pkgfile, sha256sum, sig,
+				level, &cached) == 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s was verified before, skipping checks\n",
+				pkgfile);
+		*validation |= cached;
+		return 0;
+	}
+
 	if(syncpkg && (!has_sig || !syncpkg->base64_sig)) {
 		if(syncpkg->sha256sum) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "sha256sum: %s\n", syncpkg->sha256sum);
@@ -316,7 +408,6 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 
 	/* even if we don't have a sig, run the check code if level tells us to */
 	if(level & ALPM_SIG_PACKAGE) {
-		const char *sig = syncpkg ? syncpkg->base64_sig : NULL;
 		_alpm_log(handle, ALPM_LOG_DEBUG, "sig data: %s\n", sig ? sig : "<from .sig>");
 		if(!has_sig && !(level & ALPM_SIG_PACKAGE_OPTIONAL)) {
 			handle->pm_errno = ALPM_ERR_PKG_MISSING_SIG;
@@ -337,6 +428,10 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		*validation = ALPM_PKG_VALIDATION_NONE;
 	}
 
+	if(cacheable) {
+		_alpm_verifycache_add(handle, pkgfile, sha256sum, sig, level, *validation);
+	}
+
 	return 0;
 }
 
@@ -521,47 +616,40 @@ error:
 	return -1;
 }
 
-/**
- * Load a package and create the corresponding alpm_pkg_t struct.
- * @param handle the context handle
- * @param pkgfile path to the package file
- * @param full whether to stop the load after metadata is read or continue
- * through the full archive
- */
-alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
-		const char *pkgfile, int full)
+/* Fill in the fields of a package read from a file. */
+static int pkg_set_file_origin(alpm_handle_t *handle, const char *pkgfile,
+		alpm_pkg_t *newpkg)
+{
+	newpkg->origin = ALPM_PKG_FROM_FILE;
+	STRDUP(newpkg->origin_data.file, pkgfile, return -1);
+	newpkg->ops = get_file_pkg_ops();
+	newpkg->handle = handle;
+	newpkg->infolevel = INFRQ_BASE | INFRQ_DESC | INFRQ_SCRIPTLET;
+	newpkg->validation = ALPM_PKG_VALIDATION_NONE;
+	return 0;
+}
+
+/* Read the package metadata, and the file list if full is set, from an
+ * opened package archive. The archive is left for the caller to free. If
+ * pkginfo is given, a copy of the .PKGINFO is handed back in it. */
+static alpm_pkg_t *pkg_load_archive(alpm_handle_t *handle, const char *pkgfile,
+		int full, struct archive *archive, off_t size,
+		char **pkginfo, size_t *pkginfolen)
 {
-	int ret, fd;
+	int ret;
 	int config = 0;
 	int hit_mtree = 0;
-	struct archive *archive;
 	struct archive_entry *entry;
 	alpm_pkg_t *newpkg;
-	struct stat st;
-	size_t files_size = 0;
-
-	if(pkgfile == NULL || strlen(pkgfile) == 0) {
-		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL);
-	}
-
-	fd = _alpm_open_archive(handle, pkgfile, &st, &archive, ALPM_ERR_PKG_OPEN);
-	if(fd < 0) {
-		if(errno == ENOENT) {
-			handle->pm_errno = ALPM_ERR_PKG_NOT_FOUND;
-		} else if(errno == EACCES) {
-			handle->pm_errno = ALPM_ERR_BADPERMS;
-		} else {
-			handle->pm_errno = ALPM_ERR_PKG_OPEN;
-		}
-		return NULL;
-	}
+	size_t files_size = 0, datalen;
+	char *data;
 
 	newpkg = _alpm_pkg_new();
 	if(newpkg == NULL) {
 		GOTO_ERR(handle, ALPM_ERR_MEMORY, error);
 	}
 	STRDUP(newpkg->filename, pkgfile, GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
-	newpkg->size = st.st_size;
+	newpkg->size = size;
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "starting package load for %s\n", pkgfile);
 
@@ -573,21 +661,25 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 
 		if(strcmp(entry_name, ".PKGINFO") == 0) {
 			/* parse the info file */
-			if(parse_descfile(handle, archive, newpkg) != 0) {
+			if(config || read_descfile(handle, archive, entry, &data, &datalen) != 0) {
 				_alpm_log(handle, ALPM_LOG_ERROR, _("could not parse package description file in %s\n"),
 						pkgfile);
 				goto pkg_invalid;
 			}
-			if(newpkg->name == NULL || strlen(newpkg->name) == 0) {
-				_alpm_log(handle, ALPM_LOG_ERROR, _("missing package name in %s\n"), pkgfile);
-				goto pkg_invalid;
+			if(pkginfo) {
+				/* the parser splits the lines in place */
+				MALLOC(*pkginfo, datalen + 1, free(data); GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+				memcpy(*pkginfo, data, datalen + 1);
+				*pkginfolen = datalen;
 			}
-			if(newpkg->version == NULL || strlen(newpkg->version) == 0) {
-				_alpm_log(handle, ALPM_LOG_ERROR, _("missing package version in %s\n"), pkgfile);
+			ret = parse_descfile(handle, data, datalen, newpkg);
+			free(data);
+			if(ret != 0) {
+				_alpm_log(handle, ALPM_LOG_ERROR, _("could not parse package description file in %s\n"),
+						pkgfile);
 				goto pkg_invalid;
 			}
-			if(strchr(newpkg->version, '-') == NULL) {
-				_alpm_log(handle, ALPM_LOG_ERROR, _("invalid package version in %s\n"), pkgfile);
+			if(check_descfile(handle, pkgfile, newpkg) != 0) {
 				goto pkg_invalid;
 			}
 			config = 1;
@@ -600,6 +692,10 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 			continue;
 		} else if(handle_simple_path(newpkg, entry_name)) {
 			continue;
+		} else if(config && (!full || hit_mtree)) {
+			/* the metadata comes before the files of the package, stop at
+			 * the first of them without decompressing its data */
+			break;
 		} else if(full && !hit_mtree) {
 			/* building the file list: expensive way */
 			if(add_entry_to_files_list(&newpkg->files, &files_size, entry, entry_name) < 0) {
@@ -612,11 +708,6 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 					pkgfile, archive_error_string(archive));
 			GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
 		}
-
-		/* if we are not doing a full read, see if we have all we need */
-		if((!full || hit_mtree) && config) {
-			break;
-		}
 	}
 
 	if(ret != ARCHIVE_EOF && ret != ARCHIVE_OK) { /* An error occurred */
@@ -631,12 +722,9 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 	}
 
 	/* internal fields for package struct */
-	newpkg->origin = ALPM_PKG_FROM_FILE;
-	STRDUP(newpkg->origin_data.file, pkgfile, goto error);
-	newpkg->ops = get_file_pkg_ops();
-	newpkg->handle = handle;
-	newpkg->infolevel = INFRQ_BASE | INFRQ_DESC | INFRQ_SCRIPTLET;
-	newpkg->validation = ALPM_PKG_VALIDATION_NONE;
+	if(pkg_set_file_origin(handle, pkgfile, newpkg) != 0) {
+		goto error;
+	}
 
 	if(full) {
 		if(newpkg->files.files) {
@@ -655,19 +743,223 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 		goto pkg_invalid;
 	}
 
-	_alpm_archive_read_free(archive);
-	close(fd);
 	return newpkg;
 
 pkg_invalid:
-	handle->pm_errno = ALPM_ERR_PKG_INVALID;
+	_alpm_set_errno(handle, ALPM_ERR_PKG_INVALID);
 error:
 	_alpm_pkg_free(newpkg);
+	if(pkginfo) {
+		FREE(*pkginfo);
+	}
+
+	return NULL;
+}
+
+/* Build a package from a .PKGINFO kept in the metadata cache, the way
+ * pkg_load_archive() does without its file list. */
+static alpm_pkg_t *pkg_load_pkginfo(alpm_handle_t *handle, const char *pkgfile,
+		off_t size, char *pkginfo, size_t len, int scriptlet)
+{
+	alpm_pkg_t *newpkg;
+
+	if((newpkg = _alpm_pkg_new()) == NULL) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+	}
+	STRDUP(newpkg->filename, pkgfile, goto error);
+	newpkg->size = size;
+	newpkg->scriptlet = scriptlet;
+	if(parse_descfile(handle, pkginfo, len, newpkg) != 0
+			|| check_descfile(handle, pkgfile, newpkg) != 0
+			|| pkg_set_file_origin(handle, pkgfile, newpkg) != 0
+			|| _alpm_pkg_check_meta(newpkg) != 0) {
+		goto error;
+	}
+	return newpkg;
+
+error:
+	_alpm_pkg_free(newpkg);
+	return NULL;
+}
+
+static void pkg_open_error(alpm_handle_t *handle)
+{
+	if(errno == ENOENT) {
+		_alpm_set_errno(handle, ALPM_ERR_PKG_NOT_FOUND);
+	} else if(errno == EACCES) {
+		_alpm_set_errno(handle, ALPM_ERR_BADPERMS);
+	} else {
+		_alpm_set_errno(handle, ALPM_ERR_PKG_OPEN);
+	}
+}
+
+/**
+ * Load a package and create the corresponding alpm_pkg_t struct.
+ * @param handle the context handle
+ * @param pkgfile path to the package file
+ * @param full whether to stop the load after metadata is read or continue
+ * through the full archive
+ */
+alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
+		const char *pkgfile, int full)
+{
+	struct archive *archive;
+	alpm_pkg_t *newpkg;
+	struct stat st;
+	char *pkginfo = NULL;
+	size_t len = 0;
+	int fd, scriptlet, cache = !full && handle->metacache;
+
+	if(pkgfile == NULL || strlen(pkgfile) == 0) {
+		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL);
+	}
+
+	/* metadata read before from the same file needs no decompression */
+	if(cache && stat(pkgfile, &st) == 0 && S_ISREG(st.st_mode)
+			&& _alpm_metacache_lookup(handle, &st, &pkginfo, &len, &scriptlet) == 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "loading metadata of %s from the cache\n", pkgfile);
+		newpkg = pkg_load_pkginfo(handle, pkgfile, st.st_size, pkginfo, len, scriptlet);
+		FREE(pkginfo);
+		if(newpkg) {
+			return newpkg;
+		}
+		/* fall back on the package itself */
+	}
+
+	fd = _alpm_open_archive(handle, pkgfile, &st, &archive, ALPM_ERR_PKG_OPEN);
+	if(fd < 0) {
+		pkg_open_error(handle);
+		return NULL;
+	}
+
+	newpkg = pkg_load_archive(handle, pkgfile, full, archive, st.st_size,
+			cache ? &pkginfo : NULL, &len);
 	_alpm_archive_read_free(archive);
 	close(fd);
+	if(newpkg && pkginfo) {
+		_alpm_metacache_add(handle, pkgfile, &st, pkginfo, len, newpkg->scriptlet);
+	}
+	free(pkginfo);
+	return newpkg;
+}
 
-	return NULL;
+#if defined HAVE_LIBSSL || defined HAVE_LIBNETTLE
+struct digest_reader {
+	int fd;
+	unsigned char *buf;
+	size_t bufsize;
+	alpm_sha256_t *sha;
+};
+
+/* hand every block libarchive reads to the digest on its way through */
+static la_ssize_t digest_read(struct archive *archive, void *data, const void **buf)
+{
+	struct digest_reader *reader = data;
+	ssize_t n;
+
+	do {
+		n = read(reader->fd, reader->buf, reader->bufsize);
+	} while(n < 0 && errno == EINTR);
+	if(n < 0) {
+		archive_set_error(archive, errno, "%s", strerror(errno));
+		return -1;
+	}
+	_alpm_sha256_update(reader->sha, reader->buf, n);
+	*buf = reader->buf;
+	return n;
+}
+
+/**
+ * Load a package like _alpm_pkg_load_internal() and compute the SHA-256
+ * digest of the package file from the same read.
+ * @param handle the context handle
+ * @param pkgfile path to the package file
+ * @param full whether to also read the file list
+ * @param sha256sum where to store the hex digest, to be freed by the caller
+ * @return the package, NULL on error
+ */
+alpm_pkg_t *_alpm_pkg_load_digest(alpm_handle_t *handle, const char *pkgfile,
+		int full, char **sha256sum)
+{
+	struct digest_reader reader = { -1, NULL, ALPM_BUFFER_SIZE, NULL };
+	struct archive *archive = NULL;
+	alpm_pkg_t *newpkg = NULL;
+	unsigned char digest[32];
+	struct stat st;
+	ssize_t n;
+
+	if(pkgfile == NULL || strlen(pkgfile) == 0 || sha256sum == NULL) {
+		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL);
+	}
+	*sha256sum = NULL;
+
+	OPEN(reader.fd, pkgfile, O_RDONLY | O_CLOEXEC);
+	if(reader.fd < 0 || fstat(reader.fd, &st) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("could not open file %s: %s\n"), pkgfile, strerror(errno));
+		pkg_open_error(handle);
+		goto cleanup;
+	}
+#ifdef HAVE_STRUCT_STAT_ST_BLKSIZE
+	if(st.st_blksize > ALPM_BUFFER_SIZE) {
+		reader.bufsize = st.st_blksize;
+	}
+#endif
+	MALLOC(reader.buf, reader.bufsize, GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup));
+	if((reader.sha = _alpm_sha256_new()) == NULL
+			|| (archive = archive_read_new()) == NULL) {
+		GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup);
+	}
+	_alpm_archive_read_support_filter_all(archive);
+	archive_read_support_format_all(archive);
+	if(archive_read_open(archive, &reader, NULL, digest_read, NULL) != ARCHIVE_OK) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				pkgfile, archive_error_string(archive));
+		GOTO_ERR(handle, ALPM_ERR_PKG_OPEN, cleanup);
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "loading %s and computing its digest\n", pkgfile);
+	if((newpkg = pkg_load_archive(handle, pkgfile, full, archive, st.st_size,
+					NULL, NULL)) == NULL) {
+		goto cleanup;
+	}
+
+	/* the loader stops after the metadata or at the end of the tar stream;
+	 * whatever libarchive did not need still belongs to the file */
+	while((n = read(reader.fd, reader.buf, reader.bufsize)) > 0
+			|| (n < 0 && errno == EINTR)) {
+		if(n > 0) {
+			_alpm_sha256_update(reader.sha, reader.buf, n);
+		}
+	}
+	if(n < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("error while reading package %s: %s\n"),
+				pkgfile, strerror(errno));
+		_alpm_pkg_free(newpkg);
+		newpkg = NULL;
+		GOTO_ERR(handle, ALPM_ERR_PKG_OPEN, cleanup);
+	}
+
+	_alpm_sha256_finish(reader.sha, digest);
+	reader.sha = NULL;
+	if((*sha256sum = hex_representation(digest, 32)) == NULL) {
+		_alpm_pkg_free(newpkg);
+		newpkg = NULL;
+		GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup);
+	}
+
+cleanup:
+	if(archive) {
+		_alpm_archive_read_free(archive);
+	}
+	_alpm_sha256_finish(reader.sha, NULL);
+	free(reader.buf);
+	if(reader.fd >= 0) {
+		close(reader.fd);
+	}
+	return newpkg;
 }
+#endif /* HAVE_LIBSSL || HAVE_LIBNETTLE */
 
 /* adopted limit from dulge-dulge-dulge-repo-add */
 #define MAX_SIGFILE_SIZE 16384
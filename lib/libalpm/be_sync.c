@@ -27,6 +27,7 @@
 #include "deps.h"
 #include "dload.h"
 #include "filelist.h"
+#include "dbparse.h"
 
 static char *get_sync_dir(alpm_handle_t *handle)
 {
@@ -264,6 +265,62 @@ cleanup:
 /* Forward decl so I don't reorganize the whole file right now */
 static int sync_db_read(alpm_db_t *db, struct archive *archive,
 		struct archive_entry *entry, alpm_pkg_t **likely_pkg);
+static int sync_pkg_read(alpm_pkg_t *pkg, int inforeq);
+
+#define LAZY_LOAD(info) \
+	do { \
+		if(!(pkg->infolevel & info)) { \
+			sync_pkg_read(pkg, info); \
+		} \
+	} while(0)
+
+/* Sync package accessor functions. Populating the package cache only keeps
+ * the desc and files entries of each package as they are; the fields are
+ * parsed from them the first time one of their group is asked for, so that
+ * listing names and versions does not pay for the rest.
+ */
+
+static const char *_sync_get_base(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->base;
+}
+
+static const char *_sync_get_desc(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->desc;
+}
+
+static const char *_sync_get_url(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->url;
+}
+
+static alpm_time_t _sync_get_builddate(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->builddate;
+}
+
+static const char *_sync_get_packager(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->packager;
+}
+
+static const char *_sync_get_arch(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->arch;
+}
+
+static off_t _sync_get_isize(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->isize;
+}
 
 static int _sync_get_validation(alpm_pkg_t *pkg)
 {
@@ -271,6 +328,7 @@ static int _sync_get_validation(alpm_pkg_t *pkg)
 		return pkg->validation;
 	}
 
+	LAZY_LOAD(INFRQ_DESC);
 	if(pkg->sha256sum) {
 		pkg->validation |= ALPM_PKG_VALIDATION_SHA256SUM;
 	}
@@ -285,6 +343,83 @@ static int _sync_get_validation(alpm_pkg_t *pkg)
 	return pkg->validation;
 }
 
+static alpm_list_t *_sync_get_licenses(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->licenses;
+}
+
+static alpm_list_t *_sync_get_groups(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->groups;
+}
+
+static alpm_list_t *_sync_get_depends(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->depends;
+}
+
+static alpm_list_t *_sync_get_optdepends(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->optdepends;
+}
+
+static alpm_list_t *_sync_get_makedepends(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->makedepends;
+}
+
+static alpm_list_t *_sync_get_checkdepends(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->checkdepends;
+}
+
+static alpm_list_t *_sync_get_conflicts(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->conflicts;
+}
+
+static alpm_list_t *_sync_get_provides(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->provides;
+}
+
+static alpm_list_t *_sync_get_replaces(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->replaces;
+}
+
+static alpm_filelist_t *_sync_get_files(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_FILES);
+	if(pkg->packedfiles && pkg->files.files == NULL) {
+		if(_alpm_filelist_unpack(pkg->packedfiles, &pkg->files) != 0) {
+			_alpm_alloc_fail(pkg->packedfiles->size);
+			pkg->handle->pm_errno = ALPM_ERR_MEMORY;
+		}
+	}
+	return &(pkg->files);
+}
+
+static alpm_list_t *_sync_get_xdata(alpm_pkg_t *pkg)
+{
+	LAZY_LOAD(INFRQ_DESC);
+	return pkg->xdata;
+}
+
+static int _sync_force_load(alpm_pkg_t *pkg)
+{
+	return sync_pkg_read(pkg, INFRQ_DESC | INFRQ_FILES);
+}
+
 /** Package sync operations struct accessor. We implement this as a method
  * because we want to reuse the majority of the default_pkg_ops struct and
  * add only a few operations of our own on top.
@@ -295,12 +430,200 @@ static const struct pkg_operations *get_sync_pkg_ops(void)
 	static int sync_pkg_ops_initialized = 0;
 	if(!sync_pkg_ops_initialized) {
 		sync_pkg_ops = default_pkg_ops;
+		sync_pkg_ops.get_base = _sync_get_base;
+		sync_pkg_ops.get_desc = _sync_get_desc;
+		sync_pkg_ops.get_url = _sync_get_url;
+		sync_pkg_ops.get_builddate = _sync_get_builddate;
+		sync_pkg_ops.get_packager = _sync_get_packager;
+		sync_pkg_ops.get_arch = _sync_get_arch;
+		sync_pkg_ops.get_isize = _sync_get_isize;
 		sync_pkg_ops.get_validation = _sync_get_validation;
+		sync_pkg_ops.get_licenses = _sync_get_licenses;
+		sync_pkg_ops.get_groups = _sync_get_groups;
+		sync_pkg_ops.get_depends = _sync_get_depends;
+		sync_pkg_ops.get_optdepends = _sync_get_optdepends;
+		sync_pkg_ops.get_makedepends = _sync_get_makedepends;
+		sync_pkg_ops.get_checkdepends = _sync_get_checkdepends;
+		sync_pkg_ops.get_conflicts = _sync_get_conflicts;
+		sync_pkg_ops.get_provides = _sync_get_provides;
+		sync_pkg_ops.get_replaces = _sync_get_replaces;
+		sync_pkg_ops.get_files = _sync_get_files;
+		sync_pkg_ops.get_xdata = _sync_get_xdata;
+		sync_pkg_ops.force_load = _sync_force_load;
 		sync_pkg_ops_initialized = 1;
 	}
 	return &sync_pkg_ops;
 }
 
+/* Indexed sync databases, as written by dulge-repo-update --seekable.
+ *
+ * Each package directory is a tar stream of its own, compressed as a
+ * separate gzip member or zstd frame, and a last frame holds the end of
+ * archive marker. Concatenated they are the usual compressed tar archive,
+ * so tools that do not know the format read it as any other database.
+ * The file ends with an index of the packages, one
+ *     <name>-<version> <offset> <size>\n
+ * line each, followed by ALPM_DBINDEX_MAGIC and the size of the index as
+ * 16 hexadecimal digits. The index is carried in a zstd skippable frame
+ * or in the comment of an empty gzip member, which decompressors skip:
+ *     zstd: 5e 2a 4d 18 <size:le32> <index> <footer>
+ *     gzip: 1f 8b 08 10 00 00 00 00 00 ff <index> <footer> 00 03 00 <8 x 00>
+ * Only the index is read when the package cache is built; the entries of
+ * a package are decoded from its frame the first time they are needed.
+ */
+
+static int read_full(int fd, void *buf, size_t len, off_t offset)
+{
+	char *p = buf;
+	while(len > 0) {
+		ssize_t n = pread(fd, p, len, offset);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			if(n == 0) {
+				/* the file is shorter than the index says */
+				errno = EIO;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+/* decode the frame of a package of an indexed sync database, keeping its
+ * entries for sync_pkg_read() like sync_db_populate() does */
+static int sync_pkg_load_frame(alpm_pkg_t *pkg)
+{
+	alpm_db_t *db = pkg->origin_data.db;
+	alpm_handle_t *handle = pkg->handle;
+	struct archive *archive = NULL;
+	struct archive_entry *entry;
+	alpm_pkg_t *likely_pkg = pkg;
+	const char *dbpath;
+	char *frame = NULL;
+	size_t namelen, verlen;
+	int fd = -1, archive_ret;
+
+	_alpm_log(handle, ALPM_LOG_FUNCTION, "loading package %s from db '%s'\n",
+			pkg->name, db->treename);
+
+	dbpath = _alpm_db_path(db);
+	if(!dbpath) {
+		goto error;
+	}
+	OPEN(fd, dbpath, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				dbpath, strerror(errno));
+		handle->pm_errno = ALPM_ERR_DB_OPEN;
+		goto error;
+	}
+	MALLOC(frame, (size_t)pkg->dbframe_size,
+			handle->pm_errno = ALPM_ERR_MEMORY; goto error);
+	if(read_full(fd, frame, (size_t)pkg->dbframe_size, pkg->dbframe_offset) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+				db->treename, strerror(errno));
+		handle->pm_errno = ALPM_ERR_DB_INVALID;
+		goto error;
+	}
+
+	if((archive = archive_read_new()) == NULL) {
+		handle->pm_errno = ALPM_ERR_MEMORY;
+		goto error;
+	}
+	_alpm_archive_read_support_filter_all(archive);
+	archive_read_support_format_tar(archive);
+	if(archive_read_open_memory(archive, frame, (size_t)pkg->dbframe_size) != ARCHIVE_OK) {
+		goto archive_error;
+	}
+
+	namelen = strlen(pkg->name);
+	verlen = strlen(pkg->version);
+	while((archive_ret = archive_read_next_header(archive, &entry)) == ARCHIVE_OK) {
+		const char *entryname = archive_entry_pathname(entry);
+		/* only the entries of this package belong in its frame */
+		if(entryname == NULL || strncmp(entryname, pkg->name, namelen) != 0
+				|| entryname[namelen] != '-'
+				|| strncmp(entryname + namelen + 1, pkg->version, verlen) != 0
+				|| (entryname[namelen + 1 + verlen] != '/'
+					&& entryname[namelen + 1 + verlen] != '\0')) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("%s database is inconsistent: unexpected entry '%s' for package %s\n"),
+					db->treename, entryname ? entryname : "", pkg->name);
+			handle->pm_errno = ALPM_ERR_DB_INVALID;
+			goto error;
+		}
+		if(!S_ISDIR(archive_entry_mode(entry))
+				&& sync_db_read(db, archive, entry, &likely_pkg) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("could not parse package description file '%s' from db '%s'\n"),
+					entryname, db->treename);
+			handle->pm_errno = ALPM_ERR_DB_INVALID;
+			goto error;
+		}
+	}
+	if(archive_ret != ARCHIVE_EOF) {
+		goto archive_error;
+	}
+
+	pkg->dbframe_size = 0;
+	_alpm_archive_read_free(archive);
+	free(frame);
+	close(fd);
+	return 0;
+
+archive_error:
+	_alpm_log(handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+			db->treename, archive_error_string(archive));
+	handle->pm_errno = ALPM_ERR_LIBARCHIVE;
+error:
+	if(archive) {
+		_alpm_archive_read_free(archive);
+	}
+	free(frame);
+	if(fd >= 0) {
+		close(fd);
+	}
+	return -1;
+}
+
+static int sync_pkg_parse(alpm_pkg_t *pkg, char *data, const char *filename);
+
+/* parse the kept entries of a package for the fields in inforeq */
+static int sync_pkg_read(alpm_pkg_t *pkg, int inforeq)
+{
+	if(pkg->infolevel & INFRQ_ERROR) {
+		return -1;
+	}
+	if(pkg->dbframe_size && sync_pkg_load_frame(pkg) != 0) {
+		goto error;
+	}
+
+	if(inforeq & INFRQ_DESC && !(pkg->infolevel & INFRQ_DESC)) {
+		if(pkg->rawdesc && sync_pkg_parse(pkg, pkg->rawdesc, "desc") != 0) {
+			goto error;
+		}
+		FREE(pkg->rawdesc);
+		pkg->infolevel |= INFRQ_DESC;
+	}
+	if(inforeq & INFRQ_FILES && !(pkg->infolevel & INFRQ_FILES)) {
+		if(pkg->rawfiles && sync_pkg_parse(pkg, pkg->rawfiles, "files") != 0) {
+			goto error;
+		}
+		FREE(pkg->rawfiles);
+		pkg->infolevel |= INFRQ_FILES;
+	}
+	return 0;
+
+error:
+	pkg->infolevel |= INFRQ_ERROR;
+	return -1;
+}
+
 static alpm_pkg_t *load_pkg_for_entry(alpm_db_t *db, const char *entryname,
 		const char **entry_filename, alpm_pkg_t *likely_pkg)
 {
@@ -343,6 +666,8 @@ static alpm_pkg_t *load_pkg_for_entry(alpm_db_t *db, const char *entryname,
 		pkg->origin_data.db = db;
 		pkg->ops = get_sync_pkg_ops();
 		pkg->handle = db->handle;
+		/* the rest is parsed from the entries when it is needed */
+		pkg->infolevel = INFRQ_BASE;
 
 		if(_alpm_pkg_check_meta(pkg) != 0) {
 			_alpm_pkg_free(pkg);
@@ -400,6 +725,124 @@ static size_t estimate_package_count(struct stat *st, struct archive *archive)
 	return (size_t)((st->st_size / per_package) + 1);
 }
 
+/* build the package cache of an indexed sync database from its index;
+ * returns 1 if the database has no index */
+static int sync_db_load_index(alpm_db_t *db, int fd, struct stat *st)
+{
+	static const unsigned char gzip_head[10] = {
+		0x1f, 0x8b, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff
+	};
+	static const unsigned char gzip_tail[11] = { 0x00, 0x03, 0x00 };
+	unsigned char head[10], tail[ALPM_DBINDEX_FOOTER_SIZE + sizeof(gzip_tail)];
+	unsigned char *footer;
+	char hex[17], *index = NULL, *line, *next, *end;
+	unsigned long long len;
+	off_t start;
+	size_t count = 0;
+
+	if(!S_ISREG(st->st_mode) || st->st_size < (off_t)(sizeof(head) + sizeof(tail))
+			|| read_full(fd, head, sizeof(head), 0) != 0
+			|| read_full(fd, tail, sizeof(tail), st->st_size - sizeof(tail)) != 0) {
+		return 1;
+	}
+	if(memcmp(head, gzip_head, 2) == 0) {
+		if(memcmp(tail + ALPM_DBINDEX_FOOTER_SIZE, gzip_tail, sizeof(gzip_tail)) != 0) {
+			return 1;
+		}
+		footer = tail;
+	} else if(memcmp(head, "\x28\xb5\x2f\xfd", 4) == 0) {
+		footer = tail + sizeof(gzip_tail);
+	} else {
+		return 1;
+	}
+	if(memcmp(footer, ALPM_DBINDEX_MAGIC, strlen(ALPM_DBINDEX_MAGIC)) != 0) {
+		return 1;
+	}
+	memcpy(hex, footer + strlen(ALPM_DBINDEX_MAGIC), 16);
+	hex[16] = '\0';
+	len = strtoull(hex, &end, 16);
+	if(*end != '\0' || len == 0
+			|| len > (unsigned long long)st->st_size - sizeof(head) - sizeof(tail)) {
+		return 1;
+	}
+	start = st->st_size - (off_t)len - ALPM_DBINDEX_FOOTER_SIZE
+		- (footer == tail ? (off_t)sizeof(gzip_tail) : 0);
+
+	/* the index must be where the frame holding it says it is */
+	if(footer == tail) {
+		if(read_full(fd, head, sizeof(gzip_head), start - sizeof(gzip_head)) != 0
+				|| memcmp(head, gzip_head, sizeof(gzip_head)) != 0) {
+			return 1;
+		}
+	} else {
+		unsigned long long framelen = len + ALPM_DBINDEX_FOOTER_SIZE;
+		if(read_full(fd, head, 8, start - 8) != 0
+				|| memcmp(head, "\x5e\x2a\x4d\x18", 4) != 0
+				|| head[4] != (framelen & 0xff) || head[5] != ((framelen >> 8) & 0xff)
+				|| head[6] != ((framelen >> 16) & 0xff) || head[7] != ((framelen >> 24) & 0xff)) {
+			return 1;
+		}
+	}
+
+	MALLOC(index, len + 1, RET_ERR(db->handle, ALPM_ERR_MEMORY, -1));
+	if(read_full(fd, index, len, start) != 0) {
+		_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+				db->treename, strerror(errno));
+		free(index);
+		RET_ERR(db->handle, ALPM_ERR_DB_INVALID, -1);
+	}
+	index[len] = '\0';
+	for(line = index; (line = strchr(line, '\n')); line++) {
+		count++;
+	}
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "reading index of %zu packages from db '%s'\n",
+			count, db->treename);
+
+	db->pkgcache = _alpm_pkghash_create(count);
+	if(db->pkgcache == NULL) {
+		free(index);
+		RET_ERR(db->handle, ALPM_ERR_MEMORY, -1);
+	}
+
+	for(line = index; *line; line = next) {
+		char *offset, *size;
+		alpm_pkg_t *pkg;
+
+		if((next = strchr(line, '\n')) == NULL) {
+			goto invalid;
+		}
+		*next++ = '\0';
+		if((size = strrchr(line, ' ')) == NULL) {
+			goto invalid;
+		}
+		*size++ = '\0';
+		if((offset = strrchr(line, ' ')) == NULL) {
+			goto invalid;
+		}
+		*offset++ = '\0';
+
+		pkg = load_pkg_for_entry(db, line, NULL, NULL);
+		if(pkg == NULL || pkg->dbframe_size != 0) {
+			goto invalid;
+		}
+		pkg->dbframe_offset = _alpm_strtoofft(offset);
+		pkg->dbframe_size = _alpm_strtoofft(size);
+		if(pkg->dbframe_offset < 0 || pkg->dbframe_size <= 0
+				|| pkg->dbframe_size > start - pkg->dbframe_offset) {
+			goto invalid;
+		}
+	}
+
+	free(index);
+	return 0;
+
+invalid:
+	_alpm_log(db->handle, ALPM_LOG_ERROR, _("invalid index entry '%s' in db '%s'\n"),
+			line, db->treename);
+	free(index);
+	RET_ERR(db->handle, ALPM_ERR_DB_INVALID, -1);
+}
+
 static int sync_db_populate(alpm_db_t *db)
 {
 	const char *dbpath;
@@ -431,6 +874,18 @@ static int sync_db_populate(alpm_db_t *db)
 		db->status |= DB_STATUS_INVALID;
 		return -1;
 	}
+	/* only the index of an indexed database needs to be read now */
+	ret = sync_db_load_index(db, fd, &buf);
+	if(ret == 0) {
+		goto loaded;
+	} else if(ret < 0) {
+		db->status &= ~DB_STATUS_VALID;
+		db->status |= DB_STATUS_INVALID;
+		_alpm_db_free_pkgcache(db);
+		goto cleanup;
+	}
+	ret = 0;
+
 	est_count = estimate_package_count(&buf, archive);
 
 	/* currently only .files dbs contain file lists - make flexible when required*/
@@ -473,6 +928,7 @@ static int sync_db_populate(alpm_db_t *db)
 		GOTO_ERR(db->handle, ALPM_ERR_LIBARCHIVE, cleanup);
 	}
 
+loaded:
 	count = alpm_list_count(db->pkgcache->list);
 	if(count > 0) {
 		db->pkgcache->list = alpm_list_msort(db->pkgcache->list,
@@ -518,157 +974,149 @@ static int _alpm_validate_filename(alpm_db_t *db, const char *pkgname,
 }
 
 #define READ_NEXT() do { \
-	if(_alpm_archive_fgets(archive, &buf) != ARCHIVE_OK) goto error; \
-	line = buf.line; \
-	_alpm_strip_newline(line, buf.real_line_size); \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL) goto error; \
 } while(0)
 
 #define READ_AND_STORE(f) do { \
 	READ_NEXT(); \
-	STRDUP(f, line, goto error); \
+	MALLOC(f, len + 1, goto error); \
+	memcpy(f, line, len + 1); \
 } while(0)
 
 #define READ_AND_STORE_ALL(f) do { \
 	char *linedup; \
-	if(_alpm_archive_fgets(archive, &buf) != ARCHIVE_OK) goto error; \
-	if(_alpm_strip_newline(buf.line, buf.real_line_size) == 0) break; \
-	STRDUP(linedup, buf.line, goto error); \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL || len == 0) break; \
+	MALLOC(linedup, len + 1, goto error); \
+	memcpy(linedup, line, len + 1); \
 	f = alpm_list_add(f, linedup); \
 } while(1) /* note the while(1) and not (0) */
 
+/* a dependency without a name is malformed */
 #define READ_AND_SPLITDEP(f) do { \
-	if(_alpm_archive_fgets(archive, &buf) != ARCHIVE_OK) goto error; \
-	if(_alpm_strip_newline(buf.line, buf.real_line_size) == 0) break; \
-	f = alpm_list_add(f, alpm_dep_from_string(line)); \
+	alpm_depend_t *dep; \
+	if((line = _alpm_dbparse_next(&parser, &len)) == NULL || len == 0) break; \
+	if((dep = alpm_dep_from_string(line)) == NULL) goto error; \
+	if(dep->name[0] == '\0') { \
+		alpm_dep_free(dep); \
+		goto error; \
+	} \
+	f = alpm_list_add(f, dep); \
 } while(1) /* note the while(1) and not (0) */
 
-static int sync_db_read(alpm_db_t *db, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t **likely_pkg)
+/* parse a desc, depends or files entry kept by sync_db_read(), splitting it
+ * into lines in place */
+static int sync_pkg_parse(alpm_pkg_t *pkg, char *data, const char *filename)
 {
-	const char *entryname, *filename;
-	alpm_pkg_t *pkg;
-	struct archive_read_buffer buf = {0};
+	alpm_db_t *db = pkg->origin_data.db;
+	alpm_dbparse_t parser;
+	char *line;
+	size_t len;
 
-	entryname = archive_entry_pathname(entry);
-	if(entryname == NULL) {
-		_alpm_log(db->handle, ALPM_LOG_DEBUG,
-				"invalid archive entry provided to _alpm_sync_db_read, skipping\n");
-		return -1;
-	}
-
-	_alpm_log(db->handle, ALPM_LOG_FUNCTION, "loading package data from archive entry %s\n",
-			entryname);
+	_alpm_log(db->handle, ALPM_LOG_FUNCTION, "parsing %s of package %s from db '%s'\n",
+			filename, pkg->name, db->treename);
 
-	/* 512K for a line length seems reasonable */
-	buf.max_line_size = 512 * 1024;
-
-	pkg = load_pkg_for_entry(db, entryname, &filename, *likely_pkg);
-
-	if(pkg == NULL) {
-		_alpm_log(db->handle, ALPM_LOG_DEBUG,
-				"entry %s could not be loaded into %s sync database\n",
-				entryname, db->treename);
-		return -1;
-	}
-
-	if(filename == NULL) {
-		/* A file exists outside of a subdirectory. This isn't a read error, so return
-		 * success and try to continue on. */
-		_alpm_log(db->handle, ALPM_LOG_WARNING, _("unknown database file: %s\n"),
-				entryname);
-		return 0;
-	}
-
-	if(strcmp(filename, "desc") == 0 || strcmp(filename, "depends") == 0
-			|| strcmp(filename, "files") == 0) {
-		int ret;
-		while((ret = _alpm_archive_fgets(archive, &buf)) == ARCHIVE_OK) {
-			char *line = buf.line;
-			if(_alpm_strip_newline(line, buf.real_line_size) == 0) {
-				/* length of stripped line was zero */
-				continue;
-			}
+	_alpm_dbparse_init(&parser, data, strlen(data));
+	while((line = _alpm_dbparse_next(&parser, &len)) != NULL) {
+		if(len == 0) {
+			continue;
+		}
 
-			if(strcmp(line, "%NAME%") == 0) {
+		switch(_alpm_dbparse_key(line, len)) {
+			case DBKEY_NAME:
 				READ_NEXT();
 				if(strcmp(line, pkg->name) != 0) {
 					_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: name "
 								"mismatch on package %s\n"), db->treename, pkg->name);
 				}
-			} else if(strcmp(line, "%VERSION%") == 0) {
+				break;
+			case DBKEY_VERSION:
 				READ_NEXT();
 				if(strcmp(line, pkg->version) != 0) {
 					_alpm_log(db->handle, ALPM_LOG_ERROR, _("%s database is inconsistent: version "
 								"mismatch on package %s\n"), db->treename, pkg->name);
 				}
-			} else if(strcmp(line, "%FILENAME%") == 0) {
+				break;
+			case DBKEY_FILENAME:
 				READ_AND_STORE(pkg->filename);
 				if(_alpm_validate_filename(db, pkg->name, pkg->filename) < 0) {
 					return -1;
 				}
-			} else if(strcmp(line, "%BASE%") == 0) {
+				break;
+			case DBKEY_BASE:
 				READ_AND_STORE(pkg->base);
-			} else if(strcmp(line, "%DESC%") == 0) {
+				break;
+			case DBKEY_DESC:
 				READ_AND_STORE(pkg->desc);
-			} else if(strcmp(line, "%GROUPS%") == 0) {
+				break;
+			case DBKEY_GROUPS:
 				READ_AND_STORE_ALL(pkg->groups);
-			} else if(strcmp(line, "%URL%") == 0) {
+				break;
+			case DBKEY_URL:
 				READ_AND_STORE(pkg->url);
-			} else if(strcmp(line, "%LICENSE%") == 0) {
+				break;
+			case DBKEY_LICENSE:
 				READ_AND_STORE_ALL(pkg->licenses);
-			} else if(strcmp(line, "%ARCH%") == 0) {
+				break;
+			case DBKEY_ARCH:
 				READ_AND_STORE(pkg->arch);
-			} else if(strcmp(line, "%BUILDDATE%") == 0) {
+				break;
+			case DBKEY_BUILDDATE:
 				READ_NEXT();
 				pkg->builddate = _alpm_parsedate(line);
-			} else if(strcmp(line, "%PACKAGER%") == 0) {
+				break;
+			case DBKEY_PACKAGER:
 				READ_AND_STORE(pkg->packager);
-			} else if(strcmp(line, "%CSIZE%") == 0) {
+				break;
+			case DBKEY_CSIZE:
 				READ_NEXT();
 				pkg->size = _alpm_strtoofft(line);
-			} else if(strcmp(line, "%ISIZE%") == 0) {
+				break;
+			case DBKEY_ISIZE:
 				READ_NEXT();
 				pkg->isize = _alpm_strtoofft(line);
-			} else if(strcmp(line, "%MD5SUM%") == 0) {
+				break;
+			case DBKEY_MD5SUM:
 				/* Field is deprecated, skip */
 				READ_NEXT();
-			} else if(strcmp(line, "%SHA256SUM%") == 0) {
+				break;
+			case DBKEY_SHA256SUM:
 				READ_AND_STORE(pkg->sha256sum);
-			} else if(strcmp(line, "%PGPSIG%") == 0) {
+				break;
+			case DBKEY_PGPSIG:
 				READ_AND_STORE(pkg->base64_sig);
-			} else if(strcmp(line, "%REPLACES%") == 0) {
+				break;
+			case DBKEY_REPLACES:
 				READ_AND_SPLITDEP(pkg->replaces);
-			} else if(strcmp(line, "%DEPENDS%") == 0) {
+				break;
+			case DBKEY_DEPENDS:
 				READ_AND_SPLITDEP(pkg->depends);
-			} else if(strcmp(line, "%OPTDEPENDS%") == 0) {
+				break;
+			case DBKEY_OPTDEPENDS:
 				READ_AND_SPLITDEP(pkg->optdepends);
-			} else if(strcmp(line, "%MAKEDEPENDS%") == 0) {
+				break;
+			case DBKEY_MAKEDEPENDS:
 				READ_AND_SPLITDEP(pkg->makedepends);
-			} else if(strcmp(line, "%CHECKDEPENDS%") == 0) {
+				break;
+			case DBKEY_CHECKDEPENDS:
 				READ_AND_SPLITDEP(pkg->checkdepends);
-			} else if(strcmp(line, "%CONFLICTS%") == 0) {
+				break;
+			case DBKEY_CONFLICTS:
 				READ_AND_SPLITDEP(pkg->conflicts);
-			} else if(strcmp(line, "%PROVIDES%") == 0) {
+				break;
+			case DBKEY_PROVIDES:
 				READ_AND_SPLITDEP(pkg->provides);
-			} else if(strcmp(line, "%FILES%") == 0) {
-				/* TODO: this could lazy load if there is future demand */
+				break;
+			case DBKEY_FILES: {
 				size_t files_count = 0, files_size = 0;
 				alpm_file_t *files = NULL;
 
-				while(1) {
-					if(_alpm_archive_fgets(archive, &buf) != ARCHIVE_OK) {
-						goto error;
-					}
-					line = buf.line;
-					if(_alpm_strip_newline(line, buf.real_line_size) == 0) {
-						break;
-					}
-
+				while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0) {
 					if(!_alpm_greedy_grow((void **)&files, &files_size,
 								(files_count ? (files_count + 1) * sizeof(alpm_file_t) : 8 * sizeof(alpm_file_t)))) {
 						goto error;
 					}
-					STRDUP(files[files_count].name, line, goto error);
+					MALLOC(files[files_count].name, len + 1, goto error);
+					memcpy(files[files_count].name, line, len + 1);
 					files_count++;
 				}
 				/* attempt to hand back any memory we don't need */
@@ -680,7 +1128,20 @@ static int sync_db_read(alpm_db_t *db, struct archive *archive,
 				pkg->files.count = files_count;
 				pkg->files.files = files;
 				_alpm_filelist_sort(&pkg->files);
-			} else if(strcmp(line, "%DATA%") == 0) {
+				/* keep only the front-coded copy; alpm_pkg_get_files()
+				 * rebuilds the array the first time it is asked for */
+				if(files_count > 0 && (pkg->packedfiles = _alpm_filelist_pack(&pkg->files))) {
+					size_t i;
+					for(i = 0; i < files_count; i++) {
+						free(files[i].name);
+					}
+					free(files);
+					pkg->files.count = 0;
+					pkg->files.files = NULL;
+				}
+				break;
+			}
+			case DBKEY_DATA: {
 				alpm_list_t *i, *lines = NULL;
 				READ_AND_STORE_ALL(lines);
 				for(i = lines; i; i = i->next) {
@@ -692,27 +1153,103 @@ static int sync_db_read(alpm_db_t *db, struct archive *archive,
 					}
 				}
 				FREELIST(lines);
-			} else {
-				_alpm_log(db->handle, ALPM_LOG_WARNING, _("%s: unknown key '%s' in sync database\n"), pkg->name, line);
-				alpm_list_t *lines = NULL;
-				READ_AND_STORE_ALL(lines);
-				FREELIST(lines);
+				break;
 			}
+			default:
+				_alpm_log(db->handle, ALPM_LOG_WARNING, _("%s: unknown key '%s' in sync database\n"), pkg->name, line);
+				/* skip the section */
+				while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0);
+				break;
 		}
-		if(ret != ARCHIVE_EOF) {
-			goto error;
+	}
+
+	return 0;
+
+error:
+	_alpm_log(db->handle, ALPM_LOG_ERROR,
+			_("could not parse package description file '%s-%s/%s' from db '%s'\n"),
+			pkg->name, pkg->version, filename, db->treename);
+	return -1;
+}
+
+/* read the whole data of an archive entry, appending it to *data */
+static int read_entry_data(alpm_handle_t *handle, struct archive *archive,
+		struct archive_entry *entry, char **data)
+{
+	size_t len = *data ? strlen(*data) : 0, size;
+	la_ssize_t n;
+
+	size = len + (archive_entry_size_is_set(entry) ? archive_entry_size(entry) : 4096) + 2;
+	REALLOC(*data, size, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	if(len) {
+		/* keep the sections of depends apart from those of desc */
+		(*data)[len++] = '\n';
+	}
+	while((n = archive_read_data(archive, *data + len, size - len - 1)) > 0) {
+		len += n;
+		if(len + 1 == size) {
+			size *= 2;
+			REALLOC(*data, size, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
 		}
-		*likely_pkg = pkg;
+	}
+	(*data)[len] = '\0';
+	if(n < 0) {
+		RET_ERR(handle, ALPM_ERR_LIBARCHIVE, -1);
+	}
+	return 0;
+}
+
+static int sync_db_read(alpm_db_t *db, struct archive *archive,
+		struct archive_entry *entry, alpm_pkg_t **likely_pkg)
+{
+	const char *entryname, *filename;
+	alpm_pkg_t *pkg;
+	char **data;
+
+	entryname = archive_entry_pathname(entry);
+	if(entryname == NULL) {
+		_alpm_log(db->handle, ALPM_LOG_DEBUG,
+				"invalid archive entry provided to _alpm_sync_db_read, skipping\n");
+		return -1;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_FUNCTION, "loading package data from archive entry %s\n",
+			entryname);
+
+	pkg = load_pkg_for_entry(db, entryname, &filename, *likely_pkg);
+
+	if(pkg == NULL) {
+		_alpm_log(db->handle, ALPM_LOG_DEBUG,
+				"entry %s could not be loaded into %s sync database\n",
+				entryname, db->treename);
+		return -1;
+	}
+
+	if(filename == NULL) {
+		/* A file exists outside of a subdirectory. This isn't a read error, so return
+		 * success and try to continue on. */
+		_alpm_log(db->handle, ALPM_LOG_WARNING, _("unknown database file: %s\n"),
+				entryname);
+		return 0;
+	}
+
+	/* the entries are only kept here, sync_pkg_read() parses them */
+	if(strcmp(filename, "desc") == 0 || strcmp(filename, "depends") == 0) {
+		data = &pkg->rawdesc;
+	} else if(strcmp(filename, "files") == 0) {
+		data = &pkg->rawfiles;
 	} else {
 		/* unknown database file */
 		_alpm_log(db->handle, ALPM_LOG_DEBUG, "unknown database file: %s\n", filename);
+		return 0;
+	}
+	if(read_entry_data(db->handle, archive, entry, data) != 0) {
+		_alpm_log(db->handle, ALPM_LOG_DEBUG, "error reading database file: %s\n", filename);
+		return -1;
 	}
+	*likely_pkg = pkg;
 
 	return 0;
-
-error:
-	_alpm_log(db->handle, ALPM_LOG_DEBUG, "error parsing database file: %s\n", filename);
-	return -1;
 }
 
 struct db_operations sync_db_ops = {
@@ -22,6 +22,8 @@
 #include "log.h"
 #include "deps.h"
 #include "filelist.h"
+#include "bulkstat.h"
+#include "vector.h"
 
 /**
  * @brief Creates a new conflict.
@@ -72,29 +74,12 @@ error:
 	return NULL;
 }
 
-/**
- * @brief Searches for a conflict in a list.
- *
- * @param needle conflict to search for
- * @param haystack list of conflicts to search
- *
- * @return 1 if needle is in haystack, 0 otherwise
- */
-static int conflict_isin(alpm_conflict_t *needle, alpm_list_t *haystack)
-{
-	alpm_list_t *i;
-	for(i = haystack; i; i = i->next) {
-		alpm_conflict_t *conflict = i->data;
-		if(needle->package1->name_hash == conflict->package1->name_hash
-				&& needle->package2->name_hash == conflict->package2->name_hash
-				&& strcmp(needle->package1->name, conflict->package1->name) == 0
-				&& strcmp(needle->package2->name, conflict->package2->name) == 0) {
-			return 1;
-		}
-	}
-
-	return 0;
-}
+/* conflicts found so far, with the package name pairs they were found for */
+struct conflict_list {
+	alpm_list_t *list;
+	/* "name1 name2" -> the same allocated key */
+	alpm_strset_t seen;
+};
 
 /**
  * @brief Adds the pkg1/pkg2 conflict to the baddeps list.
@@ -107,22 +92,33 @@ static int conflict_isin(alpm_conflict_t *needle, alpm_list_t *haystack)
  *
  * @return 0 on success, -1 on error
  */
-static int add_conflict(alpm_handle_t *handle, alpm_list_t **baddeps,
+static int add_conflict(alpm_handle_t *handle, struct conflict_list *baddeps,
 		alpm_pkg_t *pkg1, alpm_pkg_t *pkg2, alpm_depend_t *reason)
 {
-	alpm_conflict_t *conflict = conflict_new(pkg1, pkg2, reason);
-	if(!conflict) {
-		return -1;
+	alpm_conflict_t *conflict;
+	char *conflict_str, *key;
+	int added;
+
+	if(asprintf(&key, "%s %s", pkg1->name, pkg2->name) == -1) {
+		_alpm_alloc_fail(strlen(pkg1->name) + strlen(pkg2->name) + 2);
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
 	}
-	if(!conflict_isin(conflict, *baddeps)) {
-		char *conflict_str = alpm_dep_compute_string(reason);
-		*baddeps = alpm_list_add(*baddeps, conflict);
-		_alpm_log(handle, ALPM_LOG_DEBUG, "package %s conflicts with %s (by %s)\n",
-				pkg1->name, pkg2->name, conflict_str);
-		free(conflict_str);
-	} else {
-		alpm_conflict_free(conflict);
+	if((added = _alpm_strset_add(&baddeps->seen, key, key)) != 1) {
+		free(key);
+		if(added < 0) {
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+		}
+		return 0;
+	}
+
+	if((conflict = conflict_new(pkg1, pkg2, reason)) == NULL) {
+		return -1;
 	}
+	conflict_str = alpm_dep_compute_string(reason);
+	baddeps->list = alpm_list_add(baddeps->list, conflict);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "package %s conflicts with %s (by %s)\n",
+			pkg1->name, pkg2->name, conflict_str);
+	free(conflict_str);
 	return 0;
 }
 
@@ -142,23 +138,31 @@ static int add_conflict(alpm_handle_t *handle, alpm_list_t **baddeps,
  */
 static void check_conflict(alpm_handle_t *handle,
 		alpm_list_t *list1, alpm_list_t *list2,
-		alpm_list_t **baddeps, int order)
+		struct conflict_list *baddeps, int order)
 {
+	alpm_depindex_t idx = {0};
 	alpm_list_t *i;
 
 	if(!baddeps) {
 		return;
 	}
+	/* only packages named or providing the conflict's name can match it */
+	if(_alpm_depindex_add_list(&idx, list2) != 0) {
+		_alpm_depindex_free(&idx);
+		handle->pm_errno = ALPM_ERR_MEMORY;
+		return;
+	}
 	for(i = list1; i; i = i->next) {
 		alpm_pkg_t *pkg1 = i->data;
 		alpm_list_t *j;
 
 		for(j = alpm_pkg_get_conflicts(pkg1); j; j = j->next) {
 			alpm_depend_t *conflict = j->data;
-			alpm_list_t *k;
+			alpm_vector_t *candidates = _alpm_depindex_get(&idx, conflict->name);
+			size_t k;
 
-			for(k = list2; k; k = k->next) {
-				alpm_pkg_t *pkg2 = k->data;
+			for(k = 0; candidates && k < candidates->count; k++) {
+				alpm_pkg_t *pkg2 = candidates->data[k];
 
 				if(pkg1->name_hash == pkg2->name_hash
 						&& strcmp(pkg1->name, pkg2->name) == 0) {
@@ -176,6 +180,7 @@ static void check_conflict(alpm_handle_t *handle,
 			}
 		}
 	}
+	_alpm_depindex_free(&idx);
 }
 
 /**
@@ -188,12 +193,13 @@ static void check_conflict(alpm_handle_t *handle,
  */
 alpm_list_t *_alpm_innerconflicts(alpm_handle_t *handle, alpm_list_t *packages)
 {
-	alpm_list_t *baddeps = NULL;
+	struct conflict_list baddeps = {0};
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "check targets vs targets\n");
 	check_conflict(handle, packages, packages, &baddeps, 0);
 
-	return baddeps;
+	_alpm_strset_free(&baddeps.seen, free);
+	return baddeps.list;
 }
 
 /**
@@ -201,7 +207,7 @@ alpm_list_t *_alpm_innerconflicts(alpm_handle_t *handle, alpm_list_t *packages)
  */
 alpm_list_t *_alpm_outerconflicts(alpm_db_t *db, alpm_list_t *packages)
 {
-	alpm_list_t *baddeps = NULL;
+	struct conflict_list baddeps = {0};
 
 	if(db == NULL) {
 		return NULL;
@@ -217,7 +223,8 @@ alpm_list_t *_alpm_outerconflicts(alpm_db_t *db, alpm_list_t *packages)
 	check_conflict(db->handle, dblist, packages, &baddeps, -1);
 
 	alpm_list_free(dblist);
-	return baddeps;
+	_alpm_strset_free(&baddeps.seen, free);
+	return baddeps.list;
 }
 
 alpm_list_t SYMEXPORT *alpm_checkconflicts(alpm_handle_t *handle,
@@ -371,6 +378,25 @@ static int _alpm_can_overwrite_file(alpm_handle_t *handle, const char *path, con
 		|| _alpm_fnmatch_patterns(handle->overwrite_files, rootedpath) == 0;
 }
 
+/* lstat every file of a list below the root in a single batch */
+static int stat_filelist(alpm_handle_t *handle, char **files, size_t count,
+		struct stat **sts, int **errs)
+{
+	*sts = NULL;
+	*errs = NULL;
+	if(count == 0) {
+		return 0;
+	}
+
+	MALLOC(*sts, count * sizeof(**sts), RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	MALLOC(*errs, count * sizeof(**errs),
+			FREE(*sts); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+
+	llstat_bulk(handle->root, (const char * const *)files, count, *sts, *errs);
+
+	return 0;
+}
+
 /**
  * @brief Find file conflicts that may occur during the transaction.
  *
@@ -405,8 +431,12 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 	for(current = 0, i = upgrade; i; i = i->next, current++) {
 		alpm_pkg_t *p1 = i->data;
 		alpm_list_t *j;
-		alpm_list_t *newfiles = NULL;
+		char **newfiles = NULL;
+		ssize_t newcount;
 		alpm_pkg_t *dbpkg;
+		struct stat *sts;
+		int *errs;
+		size_t n;
 
 		int percent = (current * 100) / numtargs;
 		PROGRESS(handle, ALPM_PROGRESS_CONFLICTS_START, "", percent,
@@ -416,19 +446,26 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 		_alpm_log(handle, ALPM_LOG_DEBUG, "searching for file conflicts: %s\n",
 				p1->name);
 		for(j = i->next; j; j = j->next) {
-			alpm_list_t *common_files;
+			char **common_files;
+			ssize_t common_count;
 			alpm_pkg_t *p2 = j->data;
 
 			alpm_filelist_t *p1_files = alpm_pkg_get_files(p1);
 			alpm_filelist_t *p2_files = alpm_pkg_get_files(p2);
 
-			common_files = _alpm_filelist_intersection(p1_files, p2_files);
+			common_count = _alpm_filelist_intersection(p1_files, p2_files, &common_files);
+			if(common_count < 0) {
+				alpm_list_free_inner(conflicts,
+						(alpm_list_fn_free) alpm_conflict_free);
+				alpm_list_free(conflicts);
+				RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+			}
 
 			if(common_files) {
-				alpm_list_t *k;
+				ssize_t k;
 				char path[PATH_MAX];
-				for(k = common_files; k; k = k->next) {
-					char *filename = k->data;
+				for(k = 0; k < common_count; k++) {
+					char *filename = common_files[k];
 					snprintf(path, PATH_MAX, "%s%s", handle->root, filename);
 
 					/* can skip file-file conflicts when forced *
@@ -449,14 +486,19 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 						alpm_list_free_inner(conflicts,
 								(alpm_list_fn_free) alpm_conflict_free);
 						alpm_list_free(conflicts);
-						alpm_list_free(common_files);
+						free(common_files);
 						return NULL;
 					}
 				}
-				alpm_list_free(common_files);
+				free(common_files);
 			}
 		}
 
+		/* an empty root has nothing to conflict with */
+		if(handle->trans->freshroot) {
+			continue;
+		}
+
 		/* CHECK 2: check every target against the filesystem */
 		_alpm_log(handle, ALPM_LOG_DEBUG, "searching for filesystem conflicts: %s\n",
 				p1->name);
@@ -464,24 +506,31 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 
 		/* Do two different checks here. If the package is currently installed,
 		 * then only check files that are new in the new package. If the package
-		 * is not currently installed, then simply stat the whole filelist. Note
-		 * that the former list needs to be freed while the latter list should NOT
-		 * be freed. */
+		 * is not currently installed, then simply stat the whole filelist. In
+		 * both cases only the array of names is freed afterwards. */
 		if(dbpkg) {
 			/* older ver of package currently installed */
-			newfiles = _alpm_filelist_difference(alpm_pkg_get_files(p1),
-					alpm_pkg_get_files(dbpkg));
+			newcount = _alpm_filelist_difference(alpm_pkg_get_files(p1),
+					alpm_pkg_get_files(dbpkg), &newfiles);
 		} else {
-			/* no version of package currently installed */
-			alpm_filelist_t *fl = alpm_pkg_get_files(p1);
-			size_t filenum;
-			for(filenum = 0; filenum < fl->count; filenum++) {
-				newfiles = alpm_list_add(newfiles, fl->files[filenum].name);
-			}
+			/* no version of package currently installed; an empty
+			 * installed list makes the difference a copy of the filelist */
+			alpm_filelist_t empty = {0};
+			newcount = _alpm_filelist_difference(alpm_pkg_get_files(p1),
+					&empty, &newfiles);
+		}
+
+		/* stat all new files up front, the results are used in array order */
+		if(newcount < 0 || stat_filelist(handle, newfiles, newcount, &sts, &errs) != 0) {
+			alpm_list_free_inner(conflicts,
+					(alpm_list_fn_free) alpm_conflict_free);
+			alpm_list_free(conflicts);
+			free(newfiles);
+			RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
 		}
 
-		for(j = newfiles; j; j = j->next) {
-			const char *filestr = j->data;
+		for(n = 0; n < (size_t)newcount; n++) {
+			const char *filestr = newfiles[n];
 			const char *relative_path;
 			alpm_list_t *k;
 			/* have we acted on this conflict? */
@@ -494,10 +543,11 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 			pathlen = snprintf(path, PATH_MAX, "%s%s", handle->root, filestr);
 			relative_path = path + rootlen;
 
-			/* stat the file - if it exists, do some checks */
-			if(llstat(path, &lsbuf) != 0) {
+			/* if the file exists, do some checks */
+			if(errs[n] != 0) {
 				continue;
 			}
+			lsbuf = sts[n];
 
 			_alpm_log(handle, ALPM_LOG_DEBUG, "checking possible conflict: %s\n", path);
 
@@ -521,9 +571,9 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 
 					/* go ahead and skip any files inside filestr as they will
 					 * necessarily be resolved by replacing the file with a dir
-					 * NOTE: afterward, j will point to the last file inside filestr */
-					for( ; j->next; j = j->next) {
-						const char *filestr2 = j->next->data;
+					 * NOTE: afterward, n will point to the last file inside filestr */
+					for( ; n + 1 < (size_t)newcount; n++) {
+						const char *filestr2 = newfiles[n + 1];
 						if(strncmp(filestr, filestr2, fslen) != 0) {
 							break;
 						}
@@ -542,10 +592,10 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 					if(pfile_isdir) {
 						/* go ahead and skip any files inside filestr as they will
 						 * necessarily be resolved by replacing the file with a dir
-						 * NOTE: afterward, j will point to the last file inside filestr */
+						 * NOTE: afterward, n will point to the last file inside filestr */
 						size_t fslen = strlen(filestr);
-						for( ; j->next; j = j->next) {
-							const char *filestr2 = j->next->data;
+						for( ; n + 1 < (size_t)newcount; n++) {
+							const char *filestr2 = newfiles[n + 1];
 							if(strncmp(filestr, filestr2, fslen) != 0) {
 								break;
 							}
@@ -581,9 +631,9 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 						/* replacing a file with a directory:
 						 * go ahead and skip any files inside filestr as they will
 						 * necessarily be resolved by replacing the file with a dir
-						 * NOTE: afterward, j will point to the last file inside filestr */
-						for( ; j->next; j = j->next) {
-							const char *filestr2 = j->next->data;
+						 * NOTE: afterward, n will point to the last file inside filestr */
+						for( ; n + 1 < (size_t)newcount; n++) {
+							const char *filestr2 = newfiles[n + 1];
 							if(strncmp(filestr, filestr2, fslen) != 0) {
 								break;
 							}
@@ -655,12 +705,16 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 					alpm_list_free_inner(conflicts,
 							(alpm_list_fn_free) alpm_conflict_free);
 					alpm_list_free(conflicts);
-					alpm_list_free(newfiles);
+					free(newfiles);
+					free(sts);
+					free(errs);
 					return NULL;
 				}
 			}
 		}
-		alpm_list_free(newfiles);
+		free(newfiles);
+		free(sts);
+		free(errs);
 	}
 	PROGRESS(handle, ALPM_PROGRESS_CONFLICTS_START, "", 100,
 			numtargs, current);
@@ -28,6 +28,11 @@ typedef enum _alpm_dbinfrq_t {
 	INFRQ_ERROR = (1 << 30)
 } alpm_dbinfrq_t;
 
+/* Indexed sync databases end with "ALPMIDX1" and the size of the index
+ * preceding it as 16 hexadecimal digits; see be_sync.c */
+#define ALPM_DBINDEX_MAGIC "ALPMIDX1"
+#define ALPM_DBINDEX_FOOTER_SIZE 24
+
 /** Database status. Bitflags. */
 enum _alpm_dbstatus_t {
 	DB_STATUS_VALID = (1 << 0),
@@ -84,6 +89,7 @@ void _alpm_db_unregister(alpm_db_t *db);
 int _alpm_local_db_prepare(alpm_db_t *db, alpm_pkg_t *info);
 int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq);
 int _alpm_local_db_remove(alpm_db_t *db, alpm_pkg_t *info);
+int _alpm_local_db_sync(alpm_db_t *db);
 char *_alpm_local_db_pkgpath(alpm_db_t *db, alpm_pkg_t *info, const char *filename);
 
 /* cache bullshit */
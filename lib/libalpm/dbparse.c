@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* libalpm */
+#include "dbparse.h"
+#include "util.h"
+
+struct dbkey_entry {
+	const char *name;
+	size_t len;
+	alpm_dbkey_t key;
+};
+
+/* Perfect hash of the section names, without their '%' signs: the length
+ * plus the first and the last character, weighted so that no two names
+ * share a slot. Any new name has to be checked against the others; the
+ * desc-parse test does so for all of them. */
+#define DBKEY_HASH(k, len) \
+	(((len) + (unsigned char)(k)[0] * 21 + (unsigned char)(k)[(len) - 1] * 31) & 63)
+
+static const struct dbkey_entry dbkeys[64] = {
+	[5] = { "NAME", 4, DBKEY_NAME },
+	[6] = { "PACKAGER", 8, DBKEY_PACKAGER },
+	[7] = { "VERSION", 7, DBKEY_VERSION },
+	[9] = { "BASE", 4, DBKEY_BASE },
+	[10] = { "VALIDATION", 10, DBKEY_VALIDATION },
+	[14] = { "BUILDDATE", 9, DBKEY_BUILDDATE },
+	[15] = { "REPLACES", 8, DBKEY_REPLACES },
+	[16] = { "FILES", 5, DBKEY_FILES },
+	[17] = { "ARCH", 4, DBKEY_ARCH },
+	[18] = { "OPTDEPENDS", 10, DBKEY_OPTDEPENDS },
+	[21] = { "CONFLICTS", 9, DBKEY_CONFLICTS },
+	[24] = { "CHECKDEPENDS", 12, DBKEY_CHECKDEPENDS },
+	[28] = { "XDATA", 5, DBKEY_XDATA },
+	[29] = { "ISIZE", 5, DBKEY_ISIZE },
+	[30] = { "LICENSE", 7, DBKEY_LICENSE },
+	[31] = { "CSIZE", 5, DBKEY_CSIZE },
+	[32] = { "BACKUP", 6, DBKEY_BACKUP },
+	[33] = { "FILENAME", 8, DBKEY_FILENAME },
+	[35] = { "INSTALLDATE", 11, DBKEY_INSTALLDATE },
+	[37] = { "PROVIDES", 8, DBKEY_PROVIDES },
+	[38] = { "GROUPS", 6, DBKEY_GROUPS },
+	[40] = { "DEPENDS", 7, DBKEY_DEPENDS },
+	[41] = { "MAKEDEPENDS", 11, DBKEY_MAKEDEPENDS },
+	[42] = { "MD5SUM", 6, DBKEY_MD5SUM },
+	[43] = { "SHA256SUM", 9, DBKEY_SHA256SUM },
+	[46] = { "SIZE", 4, DBKEY_SIZE },
+	[47] = { "PGPSIG", 6, DBKEY_PGPSIG },
+	[48] = { "URL", 3, DBKEY_URL },
+	[50] = { "REASON", 6, DBKEY_REASON },
+	[53] = { "DESC", 4, DBKEY_DESC },
+	[55] = { "DATA", 4, DBKEY_DATA },
+};
+
+/** Start splitting a buffer into lines.
+ * @param parser the parser to set up
+ * @param data the buffer, which is modified; data[len] must be a NUL
+ * @param len length of the buffer, without the NUL
+ */
+void _alpm_dbparse_init(alpm_dbparse_t *parser, char *data, size_t len)
+{
+	parser->pos = data;
+	parser->end = data + len;
+}
+
+/** Split the next line off the buffer.
+ * @param parser the parser
+ * @param len where to store the length of the line, may be NULL
+ * @return the line without its newline, NULL at the end of the buffer
+ */
+char *_alpm_dbparse_next(alpm_dbparse_t *parser, size_t *len)
+{
+	char *line = parser->pos, *nl;
+
+	if(line >= parser->end) {
+		return NULL;
+	}
+	if((nl = memchr(line, '\n', parser->end - line)) != NULL) {
+		*nl = '\0';
+		parser->pos = nl + 1;
+	} else {
+		/* last line, already followed by the NUL */
+		nl = parser->end;
+		parser->pos = nl;
+	}
+	if(len) {
+		*len = nl - line;
+	}
+	return line;
+}
+
+/** Find which section a header line opens.
+ * @param line the line, e.g. "%NAME%"
+ * @param len length of the line
+ * @return the section, DBKEY_UNKNOWN if the line is not a known header
+ */
+alpm_dbkey_t _alpm_dbparse_key(const char *line, size_t len)
+{
+	const struct dbkey_entry *entry;
+
+	if(len < 3 || line[0] != '%' || line[len - 1] != '%') {
+		return DBKEY_UNKNOWN;
+	}
+	line++;
+	len -= 2;
+	entry = dbkeys + DBKEY_HASH(line, len);
+	if(entry->len != len || memcmp(entry->name, line, len) != 0) {
+		return DBKEY_UNKNOWN;
+	}
+	return entry->key;
+}
+
+/** Read a whole file into a NUL-terminated buffer.
+ * @param path the file to read
+ * @param data where to store the buffer, to be freed by the caller
+ * @param len where to store the length of the data, without the NUL
+ * @return 0 on success, -1 on error with errno set
+ */
+int _alpm_dbparse_read_file(const char *path, char **data, size_t *len)
+{
+	struct stat st;
+	size_t size, pos = 0;
+	ssize_t n;
+	char *buf;
+	int fd, err;
+
+	OPEN(fd, path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return -1;
+	}
+	if(fstat(fd, &st) != 0) {
+		goto error;
+	}
+	size = st.st_size;
+	MALLOC(buf, size + 1, errno = ENOMEM; goto error);
+	while(pos < size && (n = read(fd, buf + pos, size - pos)) != 0) {
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			free(buf);
+			goto error;
+		}
+		pos += n;
+	}
+	close(fd);
+	/* a file that shrank while being read is taken as it is now */
+	buf[pos] = '\0';
+	*data = buf;
+	*len = pos;
+	return 0;
+
+error:
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+}
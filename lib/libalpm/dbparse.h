@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef ALPM_DBPARSE_H
+#define ALPM_DBPARSE_H
+
+#include <stddef.h>
+
+/** Section headers of the desc, depends and files entries of the databases */
+typedef enum _alpm_dbkey_t {
+	DBKEY_UNKNOWN = 0,
+	DBKEY_NAME,
+	DBKEY_VERSION,
+	DBKEY_BASE,
+	DBKEY_DESC,
+	DBKEY_GROUPS,
+	DBKEY_URL,
+	DBKEY_LICENSE,
+	DBKEY_ARCH,
+	DBKEY_BUILDDATE,
+	DBKEY_INSTALLDATE,
+	DBKEY_PACKAGER,
+	DBKEY_REASON,
+	DBKEY_VALIDATION,
+	DBKEY_SIZE,
+	DBKEY_CSIZE,
+	DBKEY_ISIZE,
+	DBKEY_FILENAME,
+	DBKEY_MD5SUM,
+	DBKEY_SHA256SUM,
+	DBKEY_PGPSIG,
+	DBKEY_REPLACES,
+	DBKEY_DEPENDS,
+	DBKEY_OPTDEPENDS,
+	DBKEY_MAKEDEPENDS,
+	DBKEY_CHECKDEPENDS,
+	DBKEY_CONFLICTS,
+	DBKEY_PROVIDES,
+	DBKEY_XDATA,
+	DBKEY_DATA,
+	DBKEY_FILES,
+	DBKEY_BACKUP
+} alpm_dbkey_t;
+
+/**
+ * @brief A database entry being split into lines.
+ *
+ * The lines are cut in place: each newline is overwritten with a NUL, so the
+ * lines can be used as strings without being copied. The buffer must hold a
+ * NUL right after its last byte.
+ */
+typedef struct _alpm_dbparse_t {
+	/** start of the next line */
+	char *pos;
+	/** end of the data, where the terminating NUL is */
+	char *end;
+} alpm_dbparse_t;
+
+void _alpm_dbparse_init(alpm_dbparse_t *parser, char *data, size_t len);
+char *_alpm_dbparse_next(alpm_dbparse_t *parser, size_t *len);
+alpm_dbkey_t _alpm_dbparse_key(const char *line, size_t len);
+int _alpm_dbparse_read_file(const char *path, char **data, size_t *len);
+
+#endif /* ALPM_DBPARSE_H */
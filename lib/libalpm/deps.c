@@ -81,16 +81,214 @@ static alpm_pkg_t *find_dep_satisfier(alpm_list_t *pkgs, alpm_depend_t *dep)
 	return NULL;
 }
 
+#define DEPINDEX_PKG(idx, item) ((idx)->pkg ? (idx)->pkg(item) : (alpm_pkg_t *)(item))
+
+static void depindex_free_candidates(void *data)
+{
+	_alpm_vector_free(data, NULL);
+	free(data);
+}
+
+static int depindex_add_name(alpm_depindex_t *idx, const char *name, void *item)
+{
+	alpm_vector_t *candidates = _alpm_strset_get(&idx->names, name);
+
+	if(candidates == NULL) {
+		CALLOC(candidates, 1, sizeof(alpm_vector_t), return -1);
+		if(_alpm_strset_add(&idx->names, name, candidates) != 1) {
+			free(candidates);
+			return -1;
+		}
+	}
+	/* an item providing its own name is listed once */
+	if(candidates->count && candidates->data[candidates->count - 1] == item) {
+		return 0;
+	}
+	return _alpm_vector_push(candidates, item);
+}
+
+/** Add an item to a dependency index.
+ * The candidates for a name are kept in the order items were added, so
+ * that lookups find the same satisfier as walking a list would.
+ * @param idx the index
+ * @param item the package, or the item holding it
+ * @return 0 on success, -1 on allocation failure
+ */
+int _alpm_depindex_add(alpm_depindex_t *idx, void *item)
+{
+	alpm_pkg_t *pkg = DEPINDEX_PKG(idx, item);
+	alpm_list_t *i;
+
+	if(_alpm_vector_push(&idx->items, item) != 0
+			|| depindex_add_name(idx, pkg->name, item) != 0) {
+		return -1;
+	}
+	for(i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+		alpm_depend_t *provision = i->data;
+		if(depindex_add_name(idx, provision->name, item) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int _alpm_depindex_add_list(alpm_depindex_t *idx, alpm_list_t *items)
+{
+	for(; items; items = items->next) {
+		if(_alpm_depindex_add(idx, items->data) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void depindex_pop_name(alpm_depindex_t *idx, const char *name, void *item)
+{
+	alpm_vector_t *candidates = _alpm_strset_get(&idx->names, name);
+	if(candidates && candidates->count
+			&& candidates->data[candidates->count - 1] == item) {
+		candidates->count--;
+	}
+}
+
+/** Drop the items added last.
+ * @param idx the index
+ * @param count number of items to keep
+ */
+void _alpm_depindex_truncate(alpm_depindex_t *idx, size_t count)
+{
+	while(idx->items.count > count) {
+		void *item = idx->items.data[--idx->items.count];
+		alpm_pkg_t *pkg = DEPINDEX_PKG(idx, item);
+		alpm_list_t *i;
+
+		depindex_pop_name(idx, pkg->name, item);
+		for(i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+			alpm_depend_t *provision = i->data;
+			depindex_pop_name(idx, provision->name, item);
+		}
+	}
+}
+
+/** Get the items named or providing name, in the order they were added.
+ * @return the candidates, NULL if there are none
+ */
+alpm_vector_t *_alpm_depindex_get(alpm_depindex_t *idx, const char *name)
+{
+	return _alpm_strset_get(&idx->names, name);
+}
+
+/** Find the first item satisfying a dependency. */
+void *_alpm_depindex_find(alpm_depindex_t *idx, alpm_depend_t *dep)
+{
+	alpm_vector_t *candidates = _alpm_strset_get(&idx->names, dep->name);
+	size_t i;
+
+	for(i = 0; candidates && i < candidates->count; i++) {
+		if(_alpm_depcmp(DEPINDEX_PKG(idx, candidates->data[i]), dep)) {
+			return candidates->data[i];
+		}
+	}
+	return NULL;
+}
+
+/** Find the first item whose package is called name, like alpm_pkg_find(). */
+void *_alpm_depindex_find_name(alpm_depindex_t *idx, const char *name)
+{
+	alpm_vector_t *candidates = _alpm_strset_get(&idx->names, name);
+	size_t i;
+
+	for(i = 0; candidates && i < candidates->count; i++) {
+		if(strcmp(DEPINDEX_PKG(idx, candidates->data[i])->name, name) == 0) {
+			return candidates->data[i];
+		}
+	}
+	return NULL;
+}
+
+void _alpm_depindex_free(alpm_depindex_t *idx)
+{
+	_alpm_strset_free(&idx->names, depindex_free_candidates);
+	_alpm_vector_free(&idx->items, NULL);
+}
+
+static alpm_pkg_t *vertex_pkg(void *vertex)
+{
+	return ((alpm_graph_t *)vertex)->data;
+}
+
+/* a local package that dep_graph_init() may pull into the graph */
+struct local_vertex {
+	alpm_pkg_t *pkg;
+	size_t pos;
+	int added;
+};
+
+static alpm_pkg_t *local_vertex_pkg(void *local)
+{
+	return ((struct local_vertex *)local)->pkg;
+}
+
+static int vertex_cmp(const void *p1, const void *p2)
+{
+	const alpm_graph_t *v1 = *(alpm_graph_t * const *)p1;
+	const alpm_graph_t *v2 = *(alpm_graph_t * const *)p2;
+	return (v1->index > v2->index) - (v1->index < v2->index);
+}
+
+static int local_vertex_cmp(const void *p1, const void *p2)
+{
+	const struct local_vertex *l1 = *(struct local_vertex * const *)p1;
+	const struct local_vertex *l2 = *(struct local_vertex * const *)p2;
+	return (l1->pos > l2->pos) - (l1->pos < l2->pos);
+}
+
+/* Store the items of idx that satisfy a dependency of pkg in matches,
+ * once each and in the order given by cmp. */
+static int dep_satisfiers(alpm_depindex_t *idx, alpm_pkg_t *pkg,
+		alpm_vector_t *matches, int (*cmp)(const void *, const void *))
+{
+	alpm_list_t *i;
+	size_t j, n = 0;
+
+	matches->count = 0;
+	for(i = alpm_pkg_get_depends(pkg); i; i = i->next) {
+		alpm_depend_t *dep = i->data;
+		alpm_vector_t *candidates = _alpm_depindex_get(idx, dep->name);
+		for(j = 0; candidates && j < candidates->count; j++) {
+			if(_alpm_depcmp(DEPINDEX_PKG(idx, candidates->data[j]), dep)
+					&& _alpm_vector_push(matches, candidates->data[j]) != 0) {
+				return -1;
+			}
+		}
+	}
+	if(matches->count > 1) {
+		qsort(matches->data, matches->count, sizeof(void *), cmp);
+		for(j = 1; j < matches->count; j++) {
+			if(matches->data[j] != matches->data[n]) {
+				matches->data[++n] = matches->data[j];
+			}
+		}
+		matches->count = n + 1;
+	}
+	return 0;
+}
+
 /* Convert a list of alpm_pkg_t * to a graph structure,
  * with a edge for each dependency.
- * Returns a list of vertices (one vertex = one package)
+ * Fills vertices (one vertex = one package), the targets come first
  * (used by alpm_sortbydeps)
  */
-static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
-		alpm_list_t *targets, alpm_list_t *ignore)
+static int dep_graph_init(alpm_handle_t *handle, alpm_list_t *targets,
+		alpm_list_t *ignore, alpm_vector_t *vertices)
 {
-	alpm_list_t *i, *j;
-	alpm_list_t *vertices = NULL;
+	alpm_list_t *i;
+	alpm_depindex_t vertexidx = { .pkg = vertex_pkg };
+	alpm_depindex_t localidx = { .pkg = local_vertex_pkg };
+	alpm_vector_t matches = {0};
+	struct local_vertex *locals = NULL;
+	size_t v, j;
+	int ret = -1;
 	alpm_list_t *localpkgs = alpm_list_diff(
 			alpm_db_get_pkgcache(handle->db_local), targets, _alpm_pkg_cmp);
 
@@ -103,58 +301,95 @@ static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
 	/* We create the vertices */
 	for(i = targets; i; i = i->next) {
 		alpm_graph_t *vertex = _alpm_graph_new();
+		if(vertex == NULL) {
+			goto cleanup;
+		}
 		vertex->data = (void *)i->data;
-		vertices = alpm_list_add(vertices, vertex);
+		vertex->index = vertices->count;
+		if(_alpm_vector_push(vertices, vertex) != 0) {
+			_alpm_graph_free(vertex);
+			goto cleanup;
+		}
+		if(_alpm_depindex_add(&vertexidx, vertex) != 0) {
+			goto cleanup;
+		}
+	}
+
+	CALLOC(locals, alpm_list_count(localpkgs) + 1, sizeof(struct local_vertex),
+			goto cleanup);
+	for(i = localpkgs, j = 0; i; i = i->next, j++) {
+		locals[j].pkg = i->data;
+		locals[j].pos = j;
+		if(_alpm_depindex_add(&localidx, locals + j) != 0) {
+			goto cleanup;
+		}
 	}
 
 	/* We compute the edges */
-	for(i = vertices; i; i = i->next) {
-		alpm_graph_t *vertex_i = i->data;
+	for(v = 0; v < vertices->count; v++) {
+		alpm_graph_t *vertex_i = vertices->data[v];
 		alpm_pkg_t *p_i = vertex_i->data;
+
 		/* TODO this should be somehow combined with alpm_checkdeps */
-		for(j = vertices; j; j = j->next) {
-			alpm_graph_t *vertex_j = j->data;
-			alpm_pkg_t *p_j = vertex_j->data;
-			if(_alpm_pkg_depends_on(p_i, p_j)) {
-				vertex_i->children =
-					alpm_list_add(vertex_i->children, vertex_j);
-			}
+		if(dep_satisfiers(&vertexidx, p_i, &matches, vertex_cmp) != 0
+				|| _alpm_vector_reserve(&vertex_i->children, matches.count) != 0) {
+			goto cleanup;
+		}
+		for(j = 0; j < matches.count; j++) {
+			vertex_i->children.data[vertex_i->children.count++] = matches.data[j];
 		}
 
 		/* lazily add local packages to the dep graph so they don't
 		 * get resolved unnecessarily */
-		j = localpkgs;
-		while(j) {
-			alpm_list_t *next = j->next;
-			if(_alpm_pkg_depends_on(p_i, j->data)) {
-				alpm_graph_t *vertex_j = _alpm_graph_new();
-				vertex_j->data = (void *)j->data;
-				vertices = alpm_list_add(vertices, vertex_j);
-				vertex_i->children = alpm_list_add(vertex_i->children, vertex_j);
-				localpkgs = alpm_list_remove_item(localpkgs, j);
-				free(j);
-			}
-			j = next;
+		if(dep_satisfiers(&localidx, p_i, &matches, local_vertex_cmp) != 0) {
+			goto cleanup;
 		}
+		for(j = 0; j < matches.count; j++) {
+			struct local_vertex *local = matches.data[j];
+			alpm_graph_t *vertex_j;
 
-		vertex_i->iterator = vertex_i->children;
+			if(local->added) {
+				continue;
+			}
+			if((vertex_j = _alpm_graph_new()) == NULL) {
+				goto cleanup;
+			}
+			vertex_j->data = local->pkg;
+			vertex_j->index = vertices->count;
+			if(_alpm_vector_push(vertices, vertex_j) != 0) {
+				_alpm_graph_free(vertex_j);
+				goto cleanup;
+			}
+			if(_alpm_depindex_add(&vertexidx, vertex_j) != 0
+					|| _alpm_vector_push(&vertex_i->children, vertex_j) != 0) {
+				goto cleanup;
+			}
+			local->added = 1;
+		}
 	}
+	ret = 0;
+
+cleanup:
+	_alpm_vector_free(&matches, NULL);
+	_alpm_depindex_free(&vertexidx);
+	_alpm_depindex_free(&localidx);
+	free(locals);
 	alpm_list_free(localpkgs);
-	return vertices;
+	return ret;
 }
 
-static void _alpm_warn_dep_cycle(alpm_handle_t *handle, alpm_list_t *targets,
+static void _alpm_warn_dep_cycle(alpm_handle_t *handle, size_t ntargets,
 		alpm_graph_t *ancestor, alpm_graph_t *vertex, int reverse)
 {
 	/* vertex depends on and is required by ancestor */
-	if(!alpm_list_find_ptr(targets, vertex->data)) {
+	if(vertex->index >= ntargets) {
 		/* child is not part of the transaction, not a problem */
 		return;
 	}
 
 	/* find the nearest ancestor that's part of the transaction */
 	while(ancestor) {
-		if(alpm_list_find_ptr(targets, ancestor->data)) {
+		if(ancestor->index < ntargets) {
 			break;
 		}
 		ancestor = ancestor->parent;
@@ -199,9 +434,9 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		alpm_list_t *targets, alpm_list_t *ignore, int reverse)
 {
 	alpm_list_t *newtargs = NULL;
-	alpm_list_t *vertices = NULL;
-	alpm_list_t *i;
+	alpm_vector_t vertices = {0};
 	alpm_graph_t *vertex;
+	size_t ntargets, next = 0;
 
 	if(targets == NULL) {
 		return NULL;
@@ -209,27 +444,30 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "started sorting dependencies\n");
 
-	vertices = dep_graph_init(handle, targets, ignore);
+	if(dep_graph_init(handle, targets, ignore, &vertices) != 0) {
+		/* keep the targets rather than dropping them */
+		_alpm_vector_free(&vertices, _alpm_graph_free);
+		return alpm_list_copy(targets);
+	}
+	ntargets = alpm_list_count(targets);
 
-	i = vertices;
-	vertex = vertices->data;
-	while(i) {
+	vertex = vertices.data[0];
+	while(next < vertices.count) {
 		/* mark that we touched the vertex */
 		vertex->state = ALPM_GRAPH_STATE_PROCESSING;
 		int switched_to_child = 0;
-		while(vertex->iterator && !switched_to_child) {
-			alpm_graph_t *nextchild = vertex->iterator->data;
-			vertex->iterator = vertex->iterator->next;
+		while(vertex->iterator < vertex->children.count && !switched_to_child) {
+			alpm_graph_t *nextchild = vertex->children.data[vertex->iterator++];
 			if(nextchild->state == ALPM_GRAPH_STATE_UNPROCESSED) {
 				switched_to_child = 1;
 				nextchild->parent = vertex;
 				vertex = nextchild;
 			} else if(nextchild->state == ALPM_GRAPH_STATE_PROCESSING) {
-				_alpm_warn_dep_cycle(handle, targets, vertex, nextchild, reverse);
+				_alpm_warn_dep_cycle(handle, ntargets, vertex, nextchild, reverse);
 			}
 		}
 		if(!switched_to_child) {
-			if(alpm_list_find_ptr(targets, vertex->data)) {
+			if(vertex->index < ntargets) {
 				newtargs = alpm_list_add(newtargs, vertex->data);
 			}
 			/* mark that we've left this vertex */
@@ -237,8 +475,8 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 			vertex = vertex->parent;
 			if(!vertex) {
 				/* top level vertex reached, move to the next unprocessed vertex */
-				for(i = i->next; i; i = i->next) {
-					vertex = i->data;
+				for(next++; next < vertices.count; next++) {
+					vertex = vertices.data[next];
 					if(vertex->state == ALPM_GRAPH_STATE_UNPROCESSED) {
 						break;
 					}
@@ -257,8 +495,7 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		newtargs = tmptargs;
 	}
 
-	alpm_list_free_inner(vertices, _alpm_graph_free);
-	alpm_list_free(vertices);
+	_alpm_vector_free(&vertices, _alpm_graph_free);
 
 	return newtargs;
 }
@@ -287,20 +524,36 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 		int reversedeps)
 {
 	alpm_list_t *i, *j;
-	alpm_list_t *dblist = NULL, *modified = NULL;
+	alpm_strset_t changed = {0};
+	alpm_depindex_t dblist = {0}, modified = {0}, upgradeidx = {0};
 	alpm_list_t *baddeps = NULL;
+	size_t k;
 	int nodepversion;
 
 	CHECK_HANDLE(handle, return NULL);
 
+	for(i = rem; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(pkg && _alpm_strset_add(&changed, pkg->name, NULL) < 0) {
+			goto error;
+		}
+	}
+	for(i = upgrade; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(pkg && _alpm_strset_add(&changed, pkg->name, NULL) < 0) {
+			goto error;
+		}
+	}
 	for(i = pkglist; i; i = i->next) {
 		alpm_pkg_t *pkg = i->data;
-		if(alpm_pkg_find(rem, pkg->name) || alpm_pkg_find(upgrade, pkg->name)) {
-			modified = alpm_list_add(modified, pkg);
-		} else {
-			dblist = alpm_list_add(dblist, pkg);
+		if(_alpm_depindex_add(_alpm_strset_contains(&changed, pkg->name)
+					? &modified : &dblist, pkg) != 0) {
+			goto error;
 		}
 	}
+	if(_alpm_depindex_add_list(&upgradeidx, upgrade) != 0) {
+		goto error;
+	}
 
 	nodepversion = no_dep_version(handle);
 
@@ -319,8 +572,8 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 			/* 1. we check the upgrade list */
 			/* 2. we check database for untouched satisfying packages */
 			/* 3. we check the dependency ignore list */
-			if(!find_dep_satisfier(upgrade, depend) &&
-					!find_dep_satisfier(dblist, depend) &&
+			if(!_alpm_depindex_find(&upgradeidx, depend) &&
+					!_alpm_depindex_find(&dblist, depend) &&
 					!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 				/* Unsatisfied dependency in the upgrade list */
 				alpm_depmissing_t *miss;
@@ -338,22 +591,22 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 	if(reversedeps) {
 		/* reversedeps handles the backwards dependencies, ie,
 		 * the packages listed in the requiredby field. */
-		for(i = dblist; i; i = i->next) {
-			alpm_pkg_t *lp = i->data;
+		for(k = 0; k < dblist.items.count; k++) {
+			alpm_pkg_t *lp = dblist.items.data[k];
 			for(j = alpm_pkg_get_depends(lp); j; j = j->next) {
 				alpm_depend_t *depend = j->data;
 				alpm_depmod_t orig_mod = depend->mod;
 				if(nodepversion) {
 					depend->mod = ALPM_DEP_MOD_ANY;
 				}
-				alpm_pkg_t *causingpkg = find_dep_satisfier(modified, depend);
+				alpm_pkg_t *causingpkg = _alpm_depindex_find(&modified, depend);
 				/* we won't break this depend, if it is already broken, we ignore it */
 				/* 1. check upgrade list for satisfiers */
 				/* 2. check dblist for satisfiers */
 				/* 3. we check the dependency ignore list */
 				if(causingpkg &&
-						!find_dep_satisfier(upgrade, depend) &&
-						!find_dep_satisfier(dblist, depend) &&
+						!_alpm_depindex_find(&upgradeidx, depend) &&
+						!_alpm_depindex_find(&dblist, depend) &&
 						!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 					alpm_depmissing_t *miss;
 					char *missdepstring = alpm_dep_compute_string(depend);
@@ -368,10 +621,19 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 		}
 	}
 
-	alpm_list_free(modified);
-	alpm_list_free(dblist);
+	_alpm_strset_free(&changed, NULL);
+	_alpm_depindex_free(&modified);
+	_alpm_depindex_free(&dblist);
+	_alpm_depindex_free(&upgradeidx);
 
 	return baddeps;
+
+error:
+	_alpm_strset_free(&changed, NULL);
+	_alpm_depindex_free(&modified);
+	_alpm_depindex_free(&dblist);
+	_alpm_depindex_free(&upgradeidx);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
 }
 
 static int dep_vercmp(const char *version1, alpm_depmod_t mod,
@@ -612,14 +874,14 @@ int _alpm_recursedeps(alpm_db_t *db, alpm_list_t **targs, int include_explicit)
  * @param handle the context handle
  * @param dep is the dependency to search for
  * @param dbs are the databases to search
- * @param excluding are the packages to exclude from the search
+ * @param excluding are the packages to exclude from the search, may be NULL
  * @param prompt if true, ask an alpm_question_install_ignorepkg_t to decide
  *        if ignored packages should be installed; if false, skip ignored
  *        packages.
  * @return the resolved package
  **/
 static alpm_pkg_t *resolvedep(alpm_handle_t *handle, alpm_depend_t *dep,
-		alpm_list_t *dbs, alpm_list_t *excluding, int prompt)
+		alpm_list_t *dbs, alpm_depindex_t *excluding, int prompt)
 {
 	alpm_list_t *i, *j;
 	int ignored = 0;
@@ -638,7 +900,7 @@ static alpm_pkg_t *resolvedep(alpm_handle_t *handle, alpm_depend_t *dep,
 
 		pkg = _alpm_db_get_pkgfromcache(db, dep->name);
 		if(pkg && _alpm_depcmp_literal(pkg, dep)
-				&& !alpm_pkg_find(excluding, pkg->name)) {
+				&& !(excluding && _alpm_depindex_find_name(excluding, pkg->name))) {
 			if(alpm_pkg_should_ignore(handle, pkg)) {
 				alpm_question_install_ignorepkg_t question = {
 					.type = ALPM_QUESTION_INSTALL_IGNOREPKG,
@@ -669,7 +931,7 @@ static alpm_pkg_t *resolvedep(alpm_handle_t *handle, alpm_depend_t *dep,
 			alpm_pkg_t *pkg = j->data;
 			if((pkg->name_hash != dep->name_hash || strcmp(pkg->name, dep->name) != 0)
 					&& _alpm_depcmp_provides(dep, alpm_pkg_get_provides(pkg))
-					&& !alpm_pkg_find(excluding, pkg->name)) {
+					&& !(excluding && _alpm_depindex_find_name(excluding, pkg->name))) {
 				if(alpm_pkg_should_ignore(handle, pkg)) {
 					alpm_question_install_ignorepkg_t question = {
 						.type = ALPM_QUESTION_INSTALL_IGNOREPKG,
@@ -749,76 +1011,127 @@ alpm_pkg_t SYMEXPORT *alpm_find_dbs_satisfier(alpm_handle_t *handle,
 	return pkg;
 }
 
+/* state of _alpm_resolvedeps() */
+struct resolver {
+	alpm_handle_t *handle;
+	/* local packages that are not removed */
+	alpm_depindex_t local;
+	/* transaction targets, preferred when resolving */
+	alpm_depindex_t preferred;
+	/* packages resolved so far, in order */
+	alpm_depindex_t packages;
+	/* packages removed by the transaction */
+	alpm_depindex_t remove;
+	alpm_list_t **data;
+};
+
+/* the first untouched local package satisfying a dependency of pkg */
+static alpm_pkg_t *local_satisfier(struct resolver *r, alpm_pkg_t *pkg,
+		alpm_depend_t *dep)
+{
+	alpm_vector_t *candidates = _alpm_depindex_get(&r->local, dep->name);
+	size_t i;
+
+	for(i = 0; candidates && i < candidates->count; i++) {
+		alpm_pkg_t *lpkg = candidates->data[i];
+		if(lpkg->name_hash == pkg->name_hash && strcmp(lpkg->name, pkg->name) == 0) {
+			/* replaced by pkg */
+			continue;
+		}
+		if(_alpm_depcmp(lpkg, dep)) {
+			return lpkg;
+		}
+	}
+	return NULL;
+}
+
+/* The dependencies of pkg that are neither satisfied by pkg itself, by a
+ * local package it does not replace nor by an assumed installed package;
+ * alpm_checkdeps() for the single package pkg. */
+static alpm_list_t *missing_deps(struct resolver *r, alpm_pkg_t *pkg)
+{
+	alpm_handle_t *handle = r->handle;
+	alpm_list_t *i, *baddeps = NULL;
+	int nodepversion = no_dep_version(handle);
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "checkdeps: package %s-%s\n",
+			pkg->name, pkg->version);
+
+	for(i = alpm_pkg_get_depends(pkg); i; i = i->next) {
+		alpm_depend_t *depend = i->data;
+		alpm_depmod_t orig_mod = depend->mod;
+		if(nodepversion) {
+			depend->mod = ALPM_DEP_MOD_ANY;
+		}
+		if(!_alpm_depcmp(pkg, depend) &&
+				!local_satisfier(r, pkg, depend) &&
+				!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
+			char *missdepstring = alpm_dep_compute_string(depend);
+			_alpm_log(handle, ALPM_LOG_DEBUG, "checkdeps: missing dependency '%s' for package '%s'\n",
+					missdepstring, pkg->name);
+			free(missdepstring);
+			baddeps = alpm_list_add(baddeps, depmiss_new(pkg->name, depend, NULL));
+		}
+		depend->mod = orig_mod;
+	}
+	return baddeps;
+}
+
 /**
  * Computes resolvable dependencies for a given package and adds that package
- * and those resolvable dependencies to a list.
+ * and those resolvable dependencies to the resolved packages.
  *
- * @param handle the context handle
- * @param localpkgs is the list of local packages
+ * @param r the resolver state
  * @param pkg is the package to resolve
- * @param preferred packages to prefer when resolving
- * @param packages is a pointer to a list of packages which will be
- *        searched first for any dependency packages needed to complete the
- *        resolve, and to which will be added any [pkg] and all of its
- *        dependencies not already on the list
- * @param remove is the set of packages which will be removed in this
- *        transaction
- * @param data returns the dependency which could not be satisfied in the
- *        event of an error
- * @return 0 on success, with [pkg] and all of its dependencies not already on
- *         the [*packages] list added to that list, or -1 on failure due to an
- *         unresolvable dependency, in which case the [*packages] list will be
- *         unmodified by this function
+ * @return 0 on success, with [pkg] and all of its dependencies not already
+ *         resolved added, or -1 on failure due to an unresolvable dependency,
+ *         in which case the resolved packages are left unmodified
  */
-int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
-		alpm_pkg_t *pkg, alpm_list_t *preferred, alpm_list_t **packages,
-		alpm_list_t *rem, alpm_list_t **data)
+static int resolve_pkg(struct resolver *r, alpm_pkg_t *pkg)
 {
+	alpm_handle_t *handle = r->handle;
+	size_t count = r->packages.items.count;
 	int ret = 0;
 	alpm_list_t *j;
-	alpm_list_t *targ;
+	alpm_list_t *localdb = NULL;
 	alpm_list_t *deps = NULL;
-	alpm_list_t *packages_copy;
 
-	if(alpm_pkg_find(*packages, pkg->name) != NULL) {
+	if(_alpm_depindex_find_name(&r->packages, pkg->name) != NULL) {
 		return 0;
 	}
 
-	/* Create a copy of the packages list, so that it can be restored
-	   on error */
-	packages_copy = alpm_list_copy(*packages);
 	/* [pkg] has not already been resolved into the packages list, so put it
 	   on that list */
-	*packages = alpm_list_add(*packages, pkg);
+	if(_alpm_depindex_add(&r->packages, pkg) != 0) {
+		_alpm_depindex_truncate(&r->packages, count);
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "started resolving dependencies\n");
-	targ = alpm_list_add(NULL, pkg);
-	deps = alpm_checkdeps(handle, localpkgs, rem, targ, 0);
-	alpm_list_free(targ);
-	targ = NULL;
+	deps = missing_deps(r, pkg);
 
 	for(j = deps; j; j = j->next) {
 		alpm_depmissing_t *miss = j->data;
 		alpm_depend_t *missdep = miss->depend;
-		/* check if one of the packages in the [*packages] list already satisfies
-		 * this dependency */
-		if(find_dep_satisfier(*packages, missdep)) {
+		/* check if one of the resolved packages already satisfies this
+		 * dependency */
+		if(_alpm_depindex_find(&r->packages, missdep)) {
 			alpm_depmissing_free(miss);
 			continue;
 		}
 		/* check if one of the packages in the [preferred] list already satisfies
 		 * this dependency */
-		alpm_pkg_t *spkg = find_dep_satisfier(preferred, missdep);
+		alpm_pkg_t *spkg = _alpm_depindex_find(&r->preferred, missdep);
 		if(!spkg) {
 			/* find a satisfier package in the given repositories */
-			spkg = resolvedep(handle, missdep, handle->dbs_sync, *packages, 0);
+			spkg = resolvedep(handle, missdep, handle->dbs_sync, &r->packages, 0);
 		}
-		if(spkg && _alpm_resolvedeps(handle, localpkgs, spkg, preferred, packages, rem, data) == 0) {
+		if(spkg && resolve_pkg(r, spkg) == 0) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"pulling dependency %s (needed by %s)\n",
 					spkg->name, pkg->name);
 			alpm_depmissing_free(miss);
-		} else if(resolvedep(handle, missdep, (targ = alpm_list_add(NULL, handle->db_local)), rem, 0)) {
+		} else if(resolvedep(handle, missdep, (localdb = alpm_list_add(NULL, handle->db_local)), &r->remove, 0)) {
 			alpm_depmissing_free(miss);
 		} else {
 			handle->pm_errno = ALPM_ERR_UNSATISFIED_DEPS;
@@ -827,26 +1140,95 @@ int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 					_("cannot resolve \"%s\", a dependency of \"%s\"\n"),
 					missdepstring, pkg->name);
 			free(missdepstring);
-			if(data) {
-				*data = alpm_list_add(*data, miss);
+			if(r->data) {
+				*r->data = alpm_list_add(*r->data, miss);
 			}
 			ret = -1;
 		}
-		alpm_list_free(targ);
-		targ = NULL;
+		alpm_list_free(localdb);
+		localdb = NULL;
 	}
 	alpm_list_free(deps);
 
 	if(ret != 0) {
-		alpm_list_free(*packages);
-		*packages = packages_copy;
-	} else {
-		alpm_list_free(packages_copy);
+		_alpm_depindex_truncate(&r->packages, count);
 	}
 	_alpm_log(handle, ALPM_LOG_DEBUG, "finished resolving dependencies\n");
 	return ret;
 }
 
+/**
+ * Computes the resolvable dependencies of the transaction targets.
+ *
+ * Targets are resolved one at a time, in order; satisfiers among the
+ * targets are preferred over other packages of the sync databases.
+ *
+ * @param handle the context handle
+ * @param localpkgs is the list of local packages
+ * @param targets the packages to resolve
+ * @param rem is the set of packages which will be removed in this
+ *        transaction
+ * @param packages returns the targets that could be resolved and all of
+ *        their dependencies
+ * @param unresolvable targets with an unresolvable dependency are
+ *        appended to this list
+ * @param data returns the dependencies which could not be satisfied
+ * @return 0 on success, -1 on allocation failure
+ */
+int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
+		alpm_list_t *targets, alpm_list_t *rem, alpm_list_t **packages,
+		alpm_list_t **unresolvable, alpm_list_t **data)
+{
+	struct resolver r = { .handle = handle, .data = data };
+	alpm_strset_t removed = {0};
+	alpm_list_t *i;
+	int ret = -1;
+
+	for(i = rem; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(_alpm_strset_add(&removed, pkg->name, NULL) < 0
+				|| _alpm_depindex_add(&r.remove, pkg) != 0) {
+			goto error;
+		}
+	}
+	for(i = localpkgs; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(!_alpm_strset_contains(&removed, pkg->name)
+				&& _alpm_depindex_add(&r.local, pkg) != 0) {
+			goto error;
+		}
+	}
+	if(_alpm_depindex_add_list(&r.preferred, targets) != 0) {
+		goto error;
+	}
+
+	for(i = targets; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(resolve_pkg(&r, pkg) == -1) {
+			*unresolvable = alpm_list_add(*unresolvable, pkg);
+		}
+		/* Else, the resolved packages now additionally contain [pkg] and all
+		   of its dependencies not already on the list */
+	}
+
+	*packages = _alpm_vector_to_list(&r.packages.items);
+	if(*packages == NULL && r.packages.items.count) {
+		goto error;
+	}
+	ret = 0;
+
+error:
+	if(ret != 0) {
+		handle->pm_errno = ALPM_ERR_MEMORY;
+	}
+	_alpm_strset_free(&removed, NULL);
+	_alpm_depindex_free(&r.local);
+	_alpm_depindex_free(&r.preferred);
+	_alpm_depindex_free(&r.packages);
+	_alpm_depindex_free(&r.remove);
+	return ret;
+}
+
 char SYMEXPORT *alpm_dep_compute_string(const alpm_depend_t *dep)
 {
 	const char *name, *opr, *ver, *desc_delim, *desc;
@@ -11,16 +11,36 @@
 #include "sync.h"
 #include "package.h"
 #include "alpm.h"
+#include "vector.h"
+
+/* Packages indexed by name and by provided name, so that satisfiers of a
+ * dependency can be found without walking a whole list. */
+typedef struct _alpm_depindex_t {
+	/** the indexed items, in the order they were added */
+	alpm_vector_t items;
+	/** name -> alpm_vector_t of the items with that name or provision */
+	alpm_strset_t names;
+	/** package of an item, NULL if the items are packages */
+	alpm_pkg_t *(*pkg)(void *item);
+} alpm_depindex_t;
 
 alpm_depend_t *_alpm_dep_dup(const alpm_depend_t *dep);
 alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		alpm_list_t *targets, alpm_list_t *ignore, int reverse);
 int _alpm_recursedeps(alpm_db_t *db, alpm_list_t **targs, int include_explicit);
-int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs, alpm_pkg_t *pkg,
-		alpm_list_t *preferred, alpm_list_t **packages, alpm_list_t *remove,
-		alpm_list_t **data);
+int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
+		alpm_list_t *targets, alpm_list_t *remove, alpm_list_t **packages,
+		alpm_list_t **unresolvable, alpm_list_t **data);
 int _alpm_depcmp_literal(alpm_pkg_t *pkg, alpm_depend_t *dep);
 int _alpm_depcmp_provides(alpm_depend_t *dep, alpm_list_t *provisions);
 int _alpm_depcmp(alpm_pkg_t *pkg, alpm_depend_t *dep);
 
+int _alpm_depindex_add(alpm_depindex_t *idx, void *item);
+int _alpm_depindex_add_list(alpm_depindex_t *idx, alpm_list_t *items);
+void _alpm_depindex_truncate(alpm_depindex_t *idx, size_t count);
+alpm_vector_t *_alpm_depindex_get(alpm_depindex_t *idx, const char *name);
+void *_alpm_depindex_find(alpm_depindex_t *idx, alpm_depend_t *dep);
+void *_alpm_depindex_find_name(alpm_depindex_t *idx, const char *name);
+void _alpm_depindex_free(alpm_depindex_t *idx);
+
 #endif /* ALPM_DEPS_H */
@@ -37,6 +37,7 @@
 #include "log.h"
 #include "trans.h"
 #include "handle.h"
+#include "bulkstat.h"
 
 static int mount_point_cmp(const void *p1, const void *p2)
 {
@@ -221,22 +222,36 @@ static int calculate_removed_size(alpm_handle_t *handle,
 {
 	size_t i;
 	alpm_filelist_t *filelist = alpm_pkg_get_files(pkg);
+	const char **paths;
+	struct stat *sts;
+	int *errs;
 
 	if(!filelist->count) {
 		return 0;
 	}
 
+	MALLOC(paths, filelist->count * sizeof(*paths),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	MALLOC(sts, filelist->count * sizeof(*sts),
+			free(paths); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	MALLOC(errs, filelist->count * sizeof(*errs),
+			free(paths); free(sts); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+
+	for(i = 0; i < filelist->count; i++) {
+		paths[i] = filelist->files[i].name;
+	}
+	llstat_bulk(handle->root, paths, filelist->count, sts, errs);
+
 	for(i = 0; i < filelist->count; i++) {
-		const alpm_file_t *file = filelist->files + i;
 		alpm_mountpoint_t *mp;
-		struct stat st;
+		struct stat *st = sts + i;
 		char path[PATH_MAX];
 		blkcnt_t remove_size;
-		const char *filename = file->name;
+		const char *filename = paths[i];
 
 		snprintf(path, PATH_MAX, "%s%s", handle->root, filename);
 
-		if(llstat(path, &st) == -1) {
+		if(errs[i] != 0) {
 			if(alpm_option_match_noextract(handle, filename)) {
 				_alpm_log(handle, ALPM_LOG_WARNING,
 						_("could not get file information for %s\n"), filename);
@@ -246,7 +261,7 @@ static int calculate_removed_size(alpm_handle_t *handle,
 
 		/* skip directories and symlinks to be consistent with libarchive that
 		 * reports them to be zero size */
-		if(S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode)) {
+		if(S_ISDIR(st->st_mode) || S_ISLNK(st->st_mode)) {
 			continue;
 		}
 
@@ -270,11 +285,15 @@ static int calculate_removed_size(alpm_handle_t *handle,
 		}
 
 		/* the addition of (divisor - 1) performs ceil() with integer division */
-		remove_size = (st.st_size + mp->fsp.f_bsize - 1) / mp->fsp.f_bsize;
+		remove_size = (st->st_size + mp->fsp.f_bsize - 1) / mp->fsp.f_bsize;
 		mp->blocks_needed -= remove_size;
 		mp->used |= USED_REMOVE;
 	}
 
+	free(paths);
+	free(sts);
+	free(errs);
+
 	return 0;
 }
 
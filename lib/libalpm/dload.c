@@ -280,6 +280,14 @@ static int dload_progress_cb(void *file, curl_off_t dltotal, curl_off_t dlnow,
 		return 0;
 	}
 
+	/* curl calls us for every received chunk; only pass on updates that
+	 * move the percentage or are due by time. The final update of a
+	 * transfer always moves it to 100. */
+	if(!_alpm_progress_limit(payload->handle, &payload->progress,
+				(int)(dlnow * 100 / dltotal))) {
+		return 0;
+	}
+
 	/* do NOT include initial_size since it wasn't part of the package's
 	 * download_size (nor included in the total download size callback) */
 	cb_data.total = dltotal;
@@ -467,6 +475,8 @@ static int curl_retry_next_server(CURLM *curlm, CURL *curl, struct dload_payload
 		cb_data.resume = payload->allow_resume;
 		handle->dlcb(handle->dlcb_ctx, payload->remote_name, ALPM_DOWNLOAD_RETRY, &cb_data);
 	}
+	/* the front end starts the bar over, so the first update must get through */
+	memset(&payload->progress, 0, sizeof(payload->progress));
 
 	/* Set curl with the new URL */
 	curl_easy_setopt(curl, CURLOPT_URL, payload->fileurl);
@@ -925,6 +935,9 @@ static int curl_download_internal_sandboxed(alpm_handle_t *handle,
 	sigaddset(&sa_ign.sa_mask, SIGCHLD);
 	sigprocmask(SIG_BLOCK, &sa_ign.sa_mask, &oldblock);
 
+	/* don't let the child inherit (and write out again) buffered log lines */
+	_alpm_log_flush(handle);
+
 	pid = fork();
 	if(pid == -1) {
 		/* fork failed, make sure errno is preserved after cleanup */
@@ -1084,8 +1097,19 @@ static int move_file(const char *filepath, const char *directory)
 	const char *filename = mbasename(filepath);
 	char *dest = _alpm_get_fullpath(directory, filename, "");
 	if(rename(filepath, dest)) {
-		FREE(dest);
-		return -1;
+		/* the download directory may be on another filesystem; copy, which
+		 * reflinks where supported, and drop the original */
+		if(errno != EXDEV) {
+			FREE(dest);
+			return -1;
+		}
+		if(_alpm_copyfile(filepath, dest) != 0) {
+			/* don't leave a partial file in the cache */
+			unlink(dest);
+			FREE(dest);
+			return -1;
+		}
+		unlink(filepath);
 	}
 	FREE(dest);
 	return 0;
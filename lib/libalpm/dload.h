@@ -9,6 +9,7 @@
 
 #include "alpm_list.h"
 #include "alpm.h"
+#include "handle.h"
 
 struct dload_payload {
 	alpm_handle_t *handle;
@@ -34,6 +35,7 @@ struct dload_payload {
 	off_t initial_size;
 	off_t max_size;
 	off_t prevprogress;
+	struct _alpm_progress_limit_t progress;
 	int force;
 	int allow_resume;
 	int errors_ok;
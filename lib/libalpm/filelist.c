@@ -6,6 +6,7 @@
 
 
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -13,24 +14,179 @@
 #include "filelist.h"
 #include "util.h"
 
-/* Returns the difference of the provided two lists of files.
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define FILELIST_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* All set operations boil down to finding the first byte where two paths
+ * differ or end. Paths in a sorted list share long prefixes, so that search
+ * dominates; it is done 16 or 32 bytes at a time where the CPU allows. */
+typedef size_t (*mismatch_fn)(const char *a, const char *b);
+
+static size_t mismatch_scalar(const char *a, const char *b)
+{
+	size_t i = 0;
+	while(a[i] && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+#ifdef FILELIST_SIMD
+/* true if len bytes can be read at p without crossing into the next page */
+#define PAGE_SAFE(p, len) ((((uintptr_t)(p)) & 4095) <= 4096 - (len))
+
+__attribute__((target("sse4.2")))
+static size_t mismatch_sse42(const char *a, const char *b)
+{
+	const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH
+		| _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+	size_t i = 0;
+
+	while(1) {
+		if(PAGE_SAFE(a + i, 16) && PAGE_SAFE(b + i, 16)) {
+			__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+			int idx = _mm_cmpistri(va, vb, mode);
+			if(idx < 16) {
+				return i + idx;
+			}
+			if(_mm_cmpistrz(va, vb, mode)) {
+				/* both paths end here and are equal */
+				int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(vb, _mm_setzero_si128()));
+				return i + __builtin_ctz(zeros);
+			}
+			i += 16;
+		} else {
+			if(a[i] == '\0' || a[i] != b[i]) {
+				return i;
+			}
+			i++;
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static size_t mismatch_avx2(const char *a, const char *b)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+
+	while(1) {
+		if(PAGE_SAFE(a + i, 32) && PAGE_SAFE(b + i, 32)) {
+			__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+			unsigned int neq = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+			unsigned int end = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, zero));
+			if(neq | end) {
+				return i + __builtin_ctz(neq | end);
+			}
+			i += 32;
+		} else {
+			if(a[i] == '\0' || a[i] != b[i]) {
+				return i;
+			}
+			i++;
+		}
+	}
+}
+#endif
+
+static const struct {
+	const char *name;
+	mismatch_fn fn;
+} mismatch_kernels[] = {
+#ifdef FILELIST_SIMD
+	{ "avx2", mismatch_avx2 },
+	{ "sse4.2", mismatch_sse42 },
+#endif
+	{ "scalar", mismatch_scalar },
+};
+
+static mismatch_fn mismatch_kernel;
+
+static int kernel_supported(const char *name)
+{
+#ifdef FILELIST_SIMD
+	__builtin_cpu_init();
+	if(strcmp(name, "avx2") == 0) {
+		return __builtin_cpu_supports("avx2");
+	} else if(strcmp(name, "sse4.2") == 0) {
+		return __builtin_cpu_supports("sse4.2");
+	}
+#endif
+	return strcmp(name, "scalar") == 0;
+}
+
+static mismatch_fn get_mismatch_kernel(void)
+{
+	/* racing threads all store the same pointer */
+	if(mismatch_kernel == NULL) {
+		size_t i;
+		for(i = 0; i < ARRAYSIZE(mismatch_kernels); i++) {
+			if(kernel_supported(mismatch_kernels[i].name)) {
+				mismatch_kernel = mismatch_kernels[i].fn;
+				break;
+			}
+		}
+	}
+	return mismatch_kernel;
+}
+
+/* Select the comparison kernel by name ("avx2", "sse4.2" or "scalar"), or
+ * the best one available for NULL. Returns -1 if the kernel is unsupported.
+ */
+int _alpm_filelist_set_kernel(const char *name)
+{
+	size_t i;
+	if(name == NULL) {
+		mismatch_kernel = NULL;
+		get_mismatch_kernel();
+		return 0;
+	}
+	for(i = 0; i < ARRAYSIZE(mismatch_kernels); i++) {
+		if(strcmp(name, mismatch_kernels[i].name) == 0 && kernel_supported(name)) {
+			mismatch_kernel = mismatch_kernels[i].fn;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static inline int filelist_strcmp(mismatch_fn mismatch, const char *a, const char *b)
+{
+	size_t i = mismatch(a, b);
+	return (unsigned char)a[i] - (unsigned char)b[i];
+}
+
+/* Returns the difference of the provided two lists of files in names.
  * Pre-condition: both lists are sorted!
- * When done, free the list but NOT the contained data.
+ * When done, free the array but NOT the contained data.
+ * Returns the number of names or -1 if out of memory.
  */
-alpm_list_t *_alpm_filelist_difference(alpm_filelist_t *filesA,
-		alpm_filelist_t *filesB)
+ssize_t _alpm_filelist_difference(alpm_filelist_t *filesA,
+		alpm_filelist_t *filesB, char ***names)
 {
-	alpm_list_t *ret = NULL;
-	size_t ctrA = 0, ctrB = 0;
+	mismatch_fn mismatch = get_mismatch_kernel();
+	size_t ctrA = 0, ctrB = 0, count = 0;
+	char **ret;
+
+	*names = NULL;
+	if(filesA->count == 0) {
+		return 0;
+	}
+	MALLOC(ret, filesA->count * sizeof(char *), return -1);
 
 	while(ctrA < filesA->count && ctrB < filesB->count) {
 		char *strA = filesA->files[ctrA].name;
 		char *strB = filesB->files[ctrB].name;
 
-		int cmp = strcmp(strA, strB);
+		int cmp = filelist_strcmp(mismatch, strA, strB);
 		if(cmp < 0) {
 			/* item only in filesA, qualifies as a difference */
-			ret = alpm_list_add(ret, strA);
+			ret[count++] = strA;
 			ctrA++;
 		} else if(cmp > 0) {
 			ctrB++;
@@ -42,19 +198,19 @@ alpm_list_t *_alpm_filelist_difference(alpm_filelist_t *filesA,
 
 	/* ensure we have completely emptied pA */
 	while(ctrA < filesA->count) {
-		ret = alpm_list_add(ret, filesA->files[ctrA].name);
+		ret[count++] = filesA->files[ctrA].name;
 		ctrA++;
 	}
 
-	return ret;
+	*names = ret;
+	return count;
 }
 
-static int _alpm_filelist_pathcmp(const char *p1, const char *p2)
+static int _alpm_filelist_pathcmp(mismatch_fn mismatch, const char *p1, const char *p2)
 {
-	while(*p1 && *p1 == *p2) {
-		p1++;
-		p2++;
-	}
+	size_t i = mismatch(p1, p2);
+	p1 += i;
+	p2 += i;
 
 	/* skip trailing '/' */
 	if(*p1 == '\0' && *p2 == '/') {
@@ -66,20 +222,29 @@ static int _alpm_filelist_pathcmp(const char *p1, const char *p2)
 	return *p1 - *p2;
 }
 
-/* Returns the intersection of the provided two lists of files.
+/* Returns the intersection of the provided two lists of files in names.
  * Pre-condition: both lists are sorted!
- * When done, free the list but NOT the contained data.
+ * When done, free the array but NOT the contained data.
+ * Returns the number of names or -1 if out of memory.
  */
-alpm_list_t *_alpm_filelist_intersection(alpm_filelist_t *filesA,
-		alpm_filelist_t *filesB)
+ssize_t _alpm_filelist_intersection(alpm_filelist_t *filesA,
+		alpm_filelist_t *filesB, char ***names)
 {
-	alpm_list_t *ret = NULL;
-	size_t ctrA = 0, ctrB = 0;
+	mismatch_fn mismatch = get_mismatch_kernel();
+	size_t ctrA = 0, ctrB = 0, count = 0;
 	alpm_file_t *arrA = filesA->files, *arrB = filesB->files;
+	char **ret;
+
+	*names = NULL;
+	if(filesA->count == 0 || filesB->count == 0) {
+		return 0;
+	}
+	MALLOC(ret, (filesA->count < filesB->count ? filesA->count : filesB->count)
+			* sizeof(char *), return -1);
 
 	while(ctrA < filesA->count && ctrB < filesB->count) {
 		const char *strA = arrA[ctrA].name, *strB = arrB[ctrB].name;
-		int cmp = _alpm_filelist_pathcmp(strA, strB);
+		int cmp = _alpm_filelist_pathcmp(mismatch, strA, strB);
 		if(cmp < 0) {
 			ctrA++;
 		} else if(cmp > 0) {
@@ -87,14 +252,19 @@ alpm_list_t *_alpm_filelist_intersection(alpm_filelist_t *filesA,
 		} else {
 			/* when not directories, item in both qualifies as an intersect */
 			if(strA[strlen(strA) - 1] != '/' || strB[strlen(strB) - 1] != '/') {
-				ret = alpm_list_add(ret, arrA[ctrA].name);
+				ret[count++] = arrA[ctrA].name;
 			}
 			ctrA++;
 			ctrB++;
 		}
 	}
 
-	return ret;
+	if(count == 0) {
+		free(ret);
+		ret = NULL;
+	}
+	*names = ret;
+	return count;
 }
 
 /* Helper function for comparing files list entries
@@ -109,16 +279,29 @@ static int _alpm_files_cmp(const void *f1, const void *f2)
 alpm_file_t SYMEXPORT *alpm_filelist_contains(const alpm_filelist_t *filelist,
 		const char *path)
 {
-	alpm_file_t key;
+	mismatch_fn mismatch;
+	size_t lo, hi;
 
 	if(!filelist || filelist->count == 0) {
 		return NULL;
 	}
 
-	key.name = (char *)path;
+	mismatch = get_mismatch_kernel();
+	lo = 0;
+	hi = filelist->count;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = filelist_strcmp(mismatch, path, filelist->files[mid].name);
+		if(cmp == 0) {
+			return filelist->files + mid;
+		} else if(cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
 
-	return bsearch(&key, filelist->files, filelist->count,
-			sizeof(alpm_file_t), _alpm_files_cmp);
+	return NULL;
 }
 
 void _alpm_filelist_sort(alpm_filelist_t *filelist)
@@ -133,3 +316,244 @@ void _alpm_filelist_sort(alpm_filelist_t *filelist)
 		}
 	}
 }
+
+/* number of paths between full, unshared entries in a packed file list */
+#define FILELIST_RESTART 16
+
+static size_t varint_put(unsigned char *buf, size_t val)
+{
+	size_t len = 0;
+	while(val >= 0x80) {
+		if(buf) {
+			buf[len] = (unsigned char)(val | 0x80);
+		}
+		val >>= 7;
+		len++;
+	}
+	if(buf) {
+		buf[len] = (unsigned char)val;
+	}
+	return len + 1;
+}
+
+static const unsigned char *varint_get(const unsigned char *buf, size_t *val)
+{
+	size_t shift = 0;
+	*val = 0;
+	while(*buf & 0x80) {
+		*val |= (size_t)(*buf & 0x7f) << shift;
+		shift += 7;
+		buf++;
+	}
+	*val |= (size_t)*buf << shift;
+	return buf + 1;
+}
+
+static size_t common_prefix(const char *a, const char *b)
+{
+	size_t len = 0;
+	while(a[len] && a[len] == b[len]) {
+		len++;
+	}
+	return len;
+}
+
+/* Build a packed copy of a sorted file list. Only the names are kept.
+ * Returns NULL if memory could not be allocated; free the result with free().
+ */
+alpm_filelist_packed_t *_alpm_filelist_pack(const alpm_filelist_t *filelist)
+{
+	alpm_filelist_packed_t *packed;
+	size_t i, nrestarts, size = 0, maxlen = 0;
+	unsigned char *ptr;
+
+	for(i = 0; i < filelist->count; i++) {
+		const char *name = filelist->files[i].name;
+		size_t len = strlen(name), shared = 0;
+		if(i % FILELIST_RESTART != 0) {
+			shared = common_prefix(filelist->files[i - 1].name, name);
+		}
+		size += varint_put(NULL, shared) + len - shared + 1;
+		if(len > maxlen) {
+			maxlen = len;
+		}
+	}
+	if(size > UINT32_MAX) {
+		return NULL;
+	}
+
+	nrestarts = (filelist->count + FILELIST_RESTART - 1) / FILELIST_RESTART;
+	packed = malloc(sizeof(*packed) + nrestarts * sizeof(uint32_t) + size);
+	if(packed == NULL) {
+		return NULL;
+	}
+	packed->count = filelist->count;
+	packed->size = size;
+	packed->maxlen = maxlen;
+	packed->restarts = (uint32_t *)(packed + 1);
+	packed->blob = (unsigned char *)(packed->restarts + nrestarts);
+
+	ptr = packed->blob;
+	for(i = 0; i < filelist->count; i++) {
+		const char *name = filelist->files[i].name;
+		size_t shared = 0, rest;
+		if(i % FILELIST_RESTART == 0) {
+			packed->restarts[i / FILELIST_RESTART] = (uint32_t)(ptr - packed->blob);
+		} else {
+			shared = common_prefix(filelist->files[i - 1].name, name);
+		}
+		ptr += varint_put(ptr, shared);
+		rest = strlen(name + shared) + 1;
+		memcpy(ptr, name + shared, rest);
+		ptr += rest;
+	}
+
+	return packed;
+}
+
+/* Binary search the restart points, then walk one block keeping track of how
+ * much of path matches the current entry; no entry is ever rebuilt.
+ */
+int _alpm_filelist_packed_contains(const alpm_filelist_packed_t *packed,
+		const char *path)
+{
+	size_t lo, hi, i, end, matched;
+	const unsigned char *ptr;
+
+	if(!packed || packed->count == 0) {
+		return 0;
+	}
+
+	lo = 0;
+	hi = (packed->count + FILELIST_RESTART - 1) / FILELIST_RESTART;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		/* restart entries start with a single zero shared-length byte */
+		const char *name = (const char *)packed->blob + packed->restarts[mid] + 1;
+		int cmp = strcmp(path, name);
+		if(cmp == 0) {
+			return 1;
+		} else if(cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	if(lo == 0) {
+		return 0;
+	}
+
+	i = (lo - 1) * FILELIST_RESTART;
+	end = i + FILELIST_RESTART;
+	if(end > packed->count) {
+		end = packed->count;
+	}
+	ptr = packed->blob + packed->restarts[lo - 1] + 1;
+	matched = common_prefix((const char *)ptr, path);
+	ptr += strlen((const char *)ptr) + 1;
+
+	for(i++; i < end; i++) {
+		size_t shared, k = 0;
+		ptr = varint_get(ptr, &shared);
+		if(shared < matched) {
+			/* differs from the previous entry where that one still matched */
+			return 0;
+		} else if(shared == matched) {
+			while(ptr[k] && ptr[k] == (unsigned char)path[matched + k]) {
+				k++;
+			}
+			if(ptr[k] == (unsigned char)path[matched + k]) {
+				return 1;
+			} else if(ptr[k] > (unsigned char)path[matched + k]) {
+				return 0;
+			}
+			matched += k;
+		}
+		ptr += strlen((const char *)ptr) + 1;
+	}
+
+	return 0;
+}
+
+/* Calls fn with every path in order. The path is only valid during the call.
+ * Returns 0, the first non-zero value returned by fn, or -1 if out of memory.
+ */
+int _alpm_filelist_packed_foreach(const alpm_filelist_packed_t *packed,
+		alpm_cb_file fn, void *ctx)
+{
+	const unsigned char *ptr;
+	char *name;
+	size_t i;
+	int ret = 0;
+
+	if(!packed || packed->count == 0) {
+		return 0;
+	}
+	if((name = malloc(packed->maxlen + 1)) == NULL) {
+		return -1;
+	}
+
+	ptr = packed->blob;
+	for(i = 0; i < packed->count && ret == 0; i++) {
+		size_t shared, rest;
+		ptr = varint_get(ptr, &shared);
+		rest = strlen((const char *)ptr) + 1;
+		memcpy(name + shared, ptr, rest);
+		ptr += rest;
+		ret = fn(ctx, name);
+	}
+
+	free(name);
+	return ret;
+}
+
+static int unpack_file(void *ctx, const char *path)
+{
+	alpm_filelist_t *filelist = ctx;
+	alpm_file_t *file = filelist->files + filelist->count;
+	STRDUP(file->name, path, return -1);
+	filelist->count++;
+	return 0;
+}
+
+/* Expand a packed file list into an alpm_filelist_t owning its names.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int _alpm_filelist_unpack(const alpm_filelist_packed_t *packed,
+		alpm_filelist_t *filelist)
+{
+	alpm_filelist_t unpacked = {0};
+
+	if(packed->count == 0) {
+		*filelist = unpacked;
+		return 0;
+	}
+
+	CALLOC(unpacked.files, packed->count, sizeof(alpm_file_t), return -1);
+	if(_alpm_filelist_packed_foreach(packed, unpack_file, &unpacked) != 0) {
+		size_t i;
+		for(i = 0; i < unpacked.count; i++) {
+			free(unpacked.files[i].name);
+		}
+		free(unpacked.files);
+		return -1;
+	}
+
+	*filelist = unpacked;
+	return 0;
+}
+
+alpm_filelist_packed_t *_alpm_filelist_packed_dup(const alpm_filelist_packed_t *packed)
+{
+	alpm_filelist_packed_t *copy;
+	size_t nrestarts = (packed->count + FILELIST_RESTART - 1) / FILELIST_RESTART;
+	size_t len = sizeof(*packed) + nrestarts * sizeof(uint32_t) + packed->size;
+
+	if((copy = malloc(len)) == NULL) {
+		return NULL;
+	}
+	memcpy(copy, packed, len);
+	copy->restarts = (uint32_t *)(copy + 1);
+	copy->blob = (unsigned char *)(copy->restarts + nrestarts);
+	return copy;
+}
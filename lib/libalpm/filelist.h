@@ -7,14 +7,40 @@
 #ifndef ALPM_FILELIST_H
 #define ALPM_FILELIST_H
 
+#include <stdint.h>
+#include <sys/types.h> /* ssize_t */
+
 #include "alpm.h"
 
-alpm_list_t *_alpm_filelist_difference(alpm_filelist_t *filesA,
-		alpm_filelist_t *filesB);
+ssize_t _alpm_filelist_difference(alpm_filelist_t *filesA,
+		alpm_filelist_t *filesB, char ***names);
+
+ssize_t _alpm_filelist_intersection(alpm_filelist_t *filesA,
+		alpm_filelist_t *filesB, char ***names);
 
-alpm_list_t *_alpm_filelist_intersection(alpm_filelist_t *filesA,
-		alpm_filelist_t *filesB);
+int _alpm_filelist_set_kernel(const char *name);
 
 void _alpm_filelist_sort(alpm_filelist_t *filelist);
 
+/* Read-only, front-coded file list. Every path is stored as the length of the
+ * prefix it shares with the previous path followed by the remaining bytes,
+ * all in one allocation. Every FILELIST_RESTART-th path is stored whole and
+ * its offset kept in restarts[] so lookups can binary search. */
+typedef struct _alpm_filelist_packed_t {
+	size_t count;
+	size_t size;
+	size_t maxlen;
+	uint32_t *restarts;
+	unsigned char *blob;
+} alpm_filelist_packed_t;
+
+alpm_filelist_packed_t *_alpm_filelist_pack(const alpm_filelist_t *filelist);
+alpm_filelist_packed_t *_alpm_filelist_packed_dup(const alpm_filelist_packed_t *packed);
+int _alpm_filelist_packed_contains(const alpm_filelist_packed_t *packed,
+		const char *path);
+int _alpm_filelist_packed_foreach(const alpm_filelist_packed_t *packed,
+		alpm_cb_file fn, void *ctx);
+int _alpm_filelist_unpack(const alpm_filelist_packed_t *packed,
+		alpm_filelist_t *filelist);
+
 #endif /* ALPM_FILELIST_H */
@@ -21,6 +21,6 @@ void _alpm_graph_free(void *data)
 {
 	ASSERT(data != NULL, return);
 	alpm_graph_t *graph = data;
-	alpm_list_free(graph->children);
+	_alpm_vector_free(&graph->children, NULL);
 	free(graph);
 }
@@ -10,6 +10,7 @@
 #include <sys/types.h> /* off_t */
 
 #include "alpm_list.h"
+#include "vector.h"
 
 enum _alpm_graph_vertex_state {
 	ALPM_GRAPH_STATE_UNPROCESSED,
@@ -20,8 +21,9 @@ enum _alpm_graph_vertex_state {
 typedef struct _alpm_graph_t {
 	void *data;
 	struct _alpm_graph_t *parent; /* where did we come from? */
-	alpm_list_t *children;
-	alpm_list_t *iterator; /* used for DFS without recursion */
+	alpm_vector_t children;
+	size_t iterator; /* next child to visit, for DFS without recursion */
+	size_t index; /* position in the list of vertices */
 	off_t weight; /* weight of the node */
 	enum _alpm_graph_vertex_state state;
 } alpm_graph_t;
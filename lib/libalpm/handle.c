@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pwd.h>
+#include <time.h>
 
 /* libalpm */
 #include "handle.h"
@@ -23,6 +24,9 @@
 #include "trans.h"
 #include "alpm.h"
 #include "deps.h"
+#include "signing.h"
+#include "verifycache.h"
+#include "metacache.h"
 
 alpm_handle_t *_alpm_handle_new(void)
 {
@@ -30,6 +34,9 @@ alpm_handle_t *_alpm_handle_new(void)
 
 	CALLOC(handle, 1, sizeof(alpm_handle_t), return NULL);
 	handle->lockfd = -1;
+	handle->logfd = -1;
+	pthread_mutex_init(&handle->metacache_lock, NULL);
+	pthread_mutex_init(&handle->loglock, NULL);
 
 	return handle;
 }
@@ -58,17 +65,18 @@ void _alpm_handle_free(alpm_handle_t *handle)
 
 	/* close logfile */
 	if(handle->logstream) {
+		_alpm_log_flush(handle);
 		fclose(handle->logstream);
 		handle->logstream = NULL;
+		handle->logfd = -1;
 	}
+	FREE(handle->logbuf);
 	if(handle->usesyslog) {
 		handle->usesyslog = 0;
 		closelog();
 	}
 
-#ifdef HAVE_LIBGPGME
-	FREELIST(handle->known_keys);
-#endif
+	_alpm_gpgme_session_end(handle);
 
 #ifdef HAVE_LIBCURL
 	curl_multi_cleanup(handle->curlm);
@@ -76,12 +84,17 @@ void _alpm_handle_free(alpm_handle_t *handle)
 	FREELIST(handle->server_errors);
 #endif
 
+	/* the metadata cache is written out to dbpath */
+	_alpm_verifycache_free(handle);
+	_alpm_metacache_free(handle);
+
 	/* free memory */
 	_alpm_trans_free(handle->trans);
 	FREE(handle->root);
 	FREE(handle->dbpath);
 	FREE(handle->dbext);
 	FREELIST(handle->cachedirs);
+	FREE(handle->cachestore);
 	FREELIST(handle->hookdirs);
 	FREE(handle->logfile);
 	FREE(handle->lockfile);
@@ -93,6 +106,8 @@ void _alpm_handle_free(alpm_handle_t *handle)
 	FREELIST(handle->ignorepkg);
 	FREELIST(handle->ignoregroup);
 	FREELIST(handle->overwrite_files);
+	pthread_mutex_destroy(&handle->metacache_lock);
+	pthread_mutex_destroy(&handle->loglock);
 
 	alpm_list_free_inner(handle->assumeinstalled, (alpm_list_fn_free)alpm_dep_free);
 	alpm_list_free(handle->assumeinstalled);
@@ -164,6 +179,59 @@ int _alpm_handle_unlock(alpm_handle_t *handle)
 	return 0;
 }
 
+static long long progress_now_ms(void)
+{
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	if(clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
+		return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+	}
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/** Decide whether a progress update should reach the front end.
+ * An update is delivered the first time, whenever the integer percentage
+ * changes, and otherwise at most once every progress_interval milliseconds.
+ * @param handle the context handle
+ * @param limit state of the progress bar being updated
+ * @param percent the new percentage
+ * @return 1 if the update should be delivered, 0 if it can be dropped
+ */
+int _alpm_progress_limit(alpm_handle_t *handle,
+		struct _alpm_progress_limit_t *limit, int percent)
+{
+	long long now = progress_now_ms();
+
+	if(limit->time != 0 && percent == limit->percent
+			&& (handle->progress_interval == 0
+				|| now - limit->time < handle->progress_interval)) {
+		return 0;
+	}
+	limit->percent = percent;
+	/* keep 0 free to mean "never delivered" */
+	limit->time = now ? now : 1;
+	return 1;
+}
+
+/* Rate limit for PROGRESS(): a call for a different operation or package
+ * always starts a new bar and is delivered. */
+int _alpm_progress_due(alpm_handle_t *handle, alpm_progress_t event,
+		const char *pkg, int percent, size_t howmany, size_t current)
+{
+	if(event != handle->progress_event || pkg != handle->progress_pkg
+			|| howmany != handle->progress_howmany
+			|| current != handle->progress_current) {
+		handle->progress_event = event;
+		handle->progress_pkg = pkg;
+		handle->progress_howmany = howmany;
+		handle->progress_current = current;
+		handle->progress_limit.time = 0;
+	}
+	return _alpm_progress_limit(handle, &handle->progress_limit, percent);
+}
+
 
 alpm_cb_log SYMEXPORT alpm_option_get_logcb(alpm_handle_t *handle)
 {
@@ -261,6 +329,12 @@ alpm_list_t SYMEXPORT *alpm_option_get_cachedirs(alpm_handle_t *handle)
 	return handle->cachedirs;
 }
 
+const char SYMEXPORT *alpm_option_get_cachestore(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return handle->cachestore;
+}
+
 const char SYMEXPORT *alpm_option_get_logfile(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -291,6 +365,12 @@ int SYMEXPORT alpm_option_get_usesyslog(alpm_handle_t *handle)
 	return handle->usesyslog;
 }
 
+int SYMEXPORT alpm_option_get_bufferedlog(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->bufferedlog;
+}
+
 alpm_list_t SYMEXPORT *alpm_option_get_noupgrades(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -339,6 +419,18 @@ int SYMEXPORT alpm_option_get_checkspace(alpm_handle_t *handle)
 	return handle->checkspace;
 }
 
+int SYMEXPORT alpm_option_get_verifycache(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->verifycache;
+}
+
+int SYMEXPORT alpm_option_get_metacache(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->metacache;
+}
+
 const char SYMEXPORT *alpm_option_get_dbext(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -351,6 +443,24 @@ int SYMEXPORT alpm_option_get_parallel_downloads(alpm_handle_t *handle)
 	return handle->parallel_downloads;
 }
 
+int SYMEXPORT alpm_option_get_hookjobs(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->hookjobs;
+}
+
+int SYMEXPORT alpm_option_get_extractjobs(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->extractjobs;
+}
+
+int SYMEXPORT alpm_option_get_progress_interval(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->progress_interval;
+}
+
 int SYMEXPORT alpm_option_set_logcb(alpm_handle_t *handle, alpm_cb_log cb, void *ctx)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -570,13 +680,31 @@ int SYMEXPORT alpm_option_set_logfile(alpm_handle_t *handle, const char *logfile
 		FREE(oldlogfile);
 	}
 	if(handle->logstream) {
+		_alpm_log_flush(handle);
 		fclose(handle->logstream);
 		handle->logstream = NULL;
+		handle->logfd = -1;
 	}
 	_alpm_log(handle, ALPM_LOG_DEBUG, "option 'logfile' = %s\n", handle->logfile);
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_cachestore(alpm_handle_t *handle, const char *cachestore)
+{
+	int err;
+	CHECK_HANDLE(handle, return -1);
+	if(cachestore == NULL) {
+		FREE(handle->cachestore);
+		_alpm_log(handle, ALPM_LOG_DEBUG, "option 'cachestore' = (null)\n");
+		return 0;
+	}
+	if((err = _alpm_set_directory_option(cachestore, &(handle->cachestore), 0))) {
+		RET_ERR(handle, err, -1);
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "option 'cachestore' = %s\n", handle->cachestore);
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_gpgdir(alpm_handle_t *handle, const char *gpgdir)
 {
 	int err;
@@ -617,6 +745,16 @@ int SYMEXPORT alpm_option_set_usesyslog(alpm_handle_t *handle, int usesyslog)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_bufferedlog(alpm_handle_t *handle, int bufferedlog)
+{
+	CHECK_HANDLE(handle, return -1);
+	if(!bufferedlog) {
+		_alpm_log_flush(handle);
+	}
+	handle->bufferedlog = bufferedlog;
+	return 0;
+}
+
 static int _alpm_option_strlist_add(alpm_handle_t *handle, alpm_list_t **list, const char *str)
 {
 	char *dup;
@@ -844,6 +982,20 @@ int SYMEXPORT alpm_option_set_checkspace(alpm_handle_t *handle, int checkspace)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_verifycache(alpm_handle_t *handle, int verifycache)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->verifycache = verifycache;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_metacache(alpm_handle_t *handle, int metacache)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->metacache = metacache;
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_dbext(alpm_handle_t *handle, const char *dbext)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -953,6 +1105,30 @@ int SYMEXPORT alpm_option_set_parallel_downloads(alpm_handle_t *handle,
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_hookjobs(alpm_handle_t *handle, unsigned int jobs)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(jobs >= 1, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->hookjobs = jobs;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_extractjobs(alpm_handle_t *handle, unsigned int jobs)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(jobs >= 1, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->extractjobs = jobs;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_progress_interval(alpm_handle_t *handle,
+		unsigned int interval)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->progress_interval = interval;
+	return 0;
+}
+
 int alpm_option_get_disable_sandbox(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -8,6 +8,7 @@
 #define ALPM_HANDLE_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <regex.h>
 #include <unistd.h>
@@ -15,6 +16,7 @@
 #include "alpm_list.h"
 #include "alpm.h"
 #include "trans.h"
+#include "vector.h"
 
 #ifdef HAVE_LIBCURL
 #include <curl/curl.h>
@@ -34,16 +36,28 @@ do { \
 } while(0)
 #define PROGRESS(h, e, p, per, n, r) \
 do { \
-	if((h)->progresscb) { \
+	if((h)->progresscb && _alpm_progress_due(h, e, p, per, n, r)) { \
 		(h)->progresscb((h)->progresscb_ctx, e, p, per, n, r); \
 	} \
 } while(0)
 
+/* state used to coalesce progress updates, see _alpm_progress_limit() */
+struct _alpm_progress_limit_t {
+	int percent;     /* last delivered percentage */
+	long long time;  /* when it was delivered, in ms; 0 if never */
+};
+
 struct _alpm_handle_t {
 	/* internal usage */
 	alpm_db_t *db_local;    /* local db pointer */
 	alpm_list_t *dbs_sync;  /* List of (alpm_db_t *) */
 	FILE *logstream;        /* log file stream pointer */
+	int logfd;              /* file descriptor of logstream */
+	char *logbuf;           /* lines not yet written with bufferedlog */
+	size_t logstate;        /* what of logbuf is filled and written, see log.c */
+	pthread_mutex_t loglock; /* serializes appending to and writing out logbuf */
+	time_t logtime;         /* when logstamp was formatted */
+	char logstamp[32];
 	alpm_trans_t *trans;
 	uid_t user;
 
@@ -57,9 +71,20 @@ struct _alpm_handle_t {
 	unsigned short disable_sandbox_filesystem;
 	unsigned short disable_sandbox_syscalls;
 	unsigned int parallel_downloads; /* number of download streams */
+	unsigned int hookjobs;           /* number of Parallel hooks run at once */
+	unsigned int extractjobs;        /* number of packages extracted at once */
+	unsigned int progress_interval;  /* ms between repeated progress updates */
+
+	/* last delivered PROGRESS() call */
+	alpm_progress_t progress_event;
+	const char *progress_pkg;
+	size_t progress_howmany;
+	size_t progress_current;
+	struct _alpm_progress_limit_t progress_limit;
 
 #ifdef HAVE_LIBGPGME
-	alpm_list_t *known_keys;  /* keys verified to be in our keychain */
+	struct gpgme_context *gpgctx;     /* verification session, see signing.c */
+	struct _alpm_keycache_t *keycache; /* keys looked up in our keychain */
 #endif
 
 	/* callback functions */
@@ -84,6 +109,7 @@ struct _alpm_handle_t {
 	char *gpgdir;            /* Directory where GnuPG files are stored */
 	char *sandboxuser;       /* User to switch to for sensitive operations */
 	alpm_list_t *cachedirs;  /* Paths to dulge cache directories */
+	char *cachestore;        /* Content-addressed package store, NULL if unused */
 	alpm_list_t *hookdirs;   /* Paths to hook directories */
 	alpm_list_t *overwrite_files; /* Paths that may be overwritten */
 
@@ -97,7 +123,10 @@ struct _alpm_handle_t {
 	/* options */
 	alpm_list_t *architectures; /* Architectures of packages we should allow */
 	int usesyslog;           /* Use syslog instead of logfile? */ /* TODO move to frontend */
+	int bufferedlog;         /* Buffer the log file, see log.c */
 	int checkspace;          /* Check disk space before installing */
+	int verifycache;         /* Remember packages that passed verification */
+	int metacache;           /* Remember the metadata of package files */
 	char *dbext;             /* Sync DB extension */
 	int siglevel;            /* Default signature verification level */
 	int localfilesiglevel;   /* Signature verification level for local file
@@ -110,6 +139,18 @@ struct _alpm_handle_t {
 
 	/* lock file descriptor */
 	int lockfd;
+
+	/* verification cache, loaded on first use */
+	alpm_vector_t verifycache_entries;
+	alpm_strset_t verifycache_index;
+	int verifycache_loaded;
+
+	/* package metadata cache, loaded on first use */
+	alpm_vector_t metacache_entries;
+	alpm_strset_t metacache_index;
+	int metacache_loaded;
+	int metacache_dirty;
+	pthread_mutex_t metacache_lock;
 };
 
 alpm_handle_t *_alpm_handle_new(void);
@@ -118,6 +159,11 @@ void _alpm_handle_free(alpm_handle_t *handle);
 int _alpm_handle_lock(alpm_handle_t *handle);
 int _alpm_handle_unlock(alpm_handle_t *handle);
 
+int _alpm_progress_limit(alpm_handle_t *handle,
+		struct _alpm_progress_limit_t *limit, int percent);
+int _alpm_progress_due(alpm_handle_t *handle, alpm_progress_t event,
+		const char *pkg, int percent, size_t howmany, size_t current);
+
 alpm_errno_t _alpm_set_directory_option(const char *value,
 		char **storage, int must_exist);
 
@@ -42,7 +42,7 @@ struct _alpm_hook_t {
 	char **cmd;
 	alpm_list_t *matches;
 	alpm_hook_when_t when;
-	int abort_on_fail, needs_targets;
+	int abort_on_fail, needs_targets, parallel;
 };
 
 struct _alpm_hook_cb_ctx {
@@ -215,6 +215,8 @@ static int _alpm_hook_parse_cb(const char *file, int line,
 			hook->abort_on_fail = 1;
 		} else if(strcmp(key, "NeedsTargets") == 0) {
 			hook->needs_targets = 1;
+		} else if(strcmp(key, "Parallel") == 0) {
+			hook->parallel = 1;
 		} else if(strcmp(key, "Exec") == 0) {
 			if(hook->cmd != NULL) {
 				warning(_("hook %s line %d: overwriting previous definition of %s\n"), file, line, "Exec");
@@ -488,7 +490,7 @@ static alpm_list_t *_alpm_strlist_dedup(alpm_list_t *list)
 	return list;
 }
 
-static int _alpm_hook_run_hook(alpm_handle_t *handle, struct _alpm_hook_t *hook)
+static int _alpm_hook_check_depends(alpm_handle_t *handle, struct _alpm_hook_t *hook)
 {
 	alpm_list_t *i, *pkgs = _alpm_db_get_pkgcache(handle->db_local);
 
@@ -499,13 +501,25 @@ static int _alpm_hook_run_hook(alpm_handle_t *handle, struct _alpm_hook_t *hook)
 			return -1;
 		}
 	}
+	return 0;
+}
+
+static alpm_list_t *_alpm_hook_targets(struct _alpm_hook_t *hook)
+{
+	hook->matches = alpm_list_msort(hook->matches,
+			alpm_list_count(hook->matches), (alpm_list_fn_cmp)strcmp);
+	/* hooks with multiple triggers could have duplicate matches */
+	return hook->matches = _alpm_strlist_dedup(hook->matches);
+}
+
+static int _alpm_hook_run_hook(alpm_handle_t *handle, struct _alpm_hook_t *hook)
+{
+	if(_alpm_hook_check_depends(handle, hook) != 0) {
+		return -1;
+	}
 
 	if(hook->needs_targets) {
-		alpm_list_t *ctx;
-		hook->matches = alpm_list_msort(hook->matches,
-				alpm_list_count(hook->matches), (alpm_list_fn_cmp)strcmp);
-		/* hooks with multiple triggers could have duplicate matches */
-		ctx = hook->matches = _alpm_strlist_dedup(hook->matches);
+		alpm_list_t *ctx = _alpm_hook_targets(hook);
 		return _alpm_run_chroot(handle, hook->cmd[0], hook->cmd,
 				(_alpm_cb_io) _alpm_hook_feed_targets, &ctx);
 	} else {
@@ -513,6 +527,112 @@ static int _alpm_hook_run_hook(alpm_handle_t *handle, struct _alpm_hook_t *hook)
 	}
 }
 
+static void _alpm_hook_event(alpm_handle_t *handle, struct _alpm_hook_t *hook,
+		alpm_event_hook_run_t *hook_event, int done)
+{
+	if(!done) {
+		alpm_logaction(handle, ALPM_CALLER_PREFIX, "running '%s'...\n", hook->name);
+		hook_event->type = ALPM_EVENT_HOOK_RUN_START;
+		hook_event->name = hook->name;
+		hook_event->desc = hook->desc;
+		EVENT(handle, hook_event);
+	} else {
+		hook_event->type = ALPM_EVENT_HOOK_RUN_DONE;
+		EVENT(handle, hook_event);
+		hook_event->position++;
+	}
+}
+
+static void _alpm_hook_job_cb(alpm_handle_t *handle,
+		struct _alpm_chroot_job_t *job, int done, void *ctx)
+{
+	_alpm_hook_event(handle, job->data, ctx, done);
+}
+
+static int _alpm_hook_same_cmd(struct _alpm_hook_t *h1, struct _alpm_hook_t *h2)
+{
+	char **a = h1->cmd, **b = h2->cmd;
+	while(*a && *b && strcmp(*a, *b) == 0) {
+		a++;
+		b++;
+	}
+	return *a == NULL && *b == NULL;
+}
+
+/* Number of hooks from the start of the list that can run together: a run
+ * of consecutive Parallel hooks, cut short before a hook that executes the
+ * same command line as one already in it. Any other hook runs on its own,
+ * as does an AbortOnFail hook so that its failure stops the hooks after it. */
+static size_t _alpm_hook_batch_size(alpm_handle_t *handle, alpm_list_t *hooks)
+{
+	alpm_list_t *i, *j;
+	size_t count = 0;
+
+	if(handle->hookjobs <= 1) {
+		return 1;
+	}
+
+	for(i = hooks; i; i = i->next, count++) {
+		struct _alpm_hook_t *hook = i->data;
+		if(!hook->parallel || hook->abort_on_fail) {
+			break;
+		}
+		for(j = hooks; j != i; j = j->next) {
+			struct _alpm_hook_t *other = j->data;
+			if(_alpm_hook_same_cmd(other, hook)) {
+				return count;
+			}
+		}
+	}
+
+	return count ? count : 1;
+}
+
+/* Run a batch of Parallel hooks, each hook's output is emitted together
+ * with its events once it has finished. A batch holds no AbortOnFail hook
+ * (see _alpm_hook_batch_size), so a failing hook doesn't fail the batch.
+ * Returns -1 if the batch could not be run. */
+static int _alpm_hook_run_batch(alpm_handle_t *handle, alpm_list_t *hooks,
+		size_t count, alpm_event_hook_run_t *hook_event)
+{
+	struct _alpm_chroot_job_t *jobs;
+	alpm_list_t **targets, *i;
+	size_t n, njobs = 0;
+
+	CALLOC(jobs, count, sizeof(struct _alpm_chroot_job_t), return -1);
+	CALLOC(targets, count, sizeof(alpm_list_t *), free(jobs); return -1);
+
+	for(i = hooks, n = 0; n < count; i = i->next, n++) {
+		struct _alpm_hook_t *hook = i->data;
+
+		if(_alpm_hook_check_depends(handle, hook) != 0) {
+			/* report it as a hook that failed straight away */
+			_alpm_hook_event(handle, hook, hook_event, 0);
+			_alpm_hook_event(handle, hook, hook_event, 1);
+			continue;
+		}
+
+		jobs[njobs].cmd = hook->cmd[0];
+		jobs[njobs].argv = hook->cmd;
+		jobs[njobs].data = hook;
+		if(hook->needs_targets) {
+			targets[njobs] = _alpm_hook_targets(hook);
+			jobs[njobs].stdin_cb = (_alpm_cb_io) _alpm_hook_feed_targets;
+			jobs[njobs].stdin_ctx = &targets[njobs];
+		}
+		njobs++;
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "running %zu hooks with up to %u jobs\n",
+			njobs, handle->hookjobs);
+	_alpm_run_chroot_jobs(handle, jobs, njobs, handle->hookjobs,
+			_alpm_hook_job_cb, hook_event);
+
+	free(targets);
+	free(jobs);
+	return 0;
+}
+
 int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 {
 	alpm_event_hook_t event = { .when = when };
@@ -632,22 +752,27 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 		hook_event.position = 1;
 		hook_event.total = triggered;
 
-		for(i = hooks_triggered; i; i = i->next, hook_event.position++) {
+		i = hooks_triggered;
+		while(i) {
 			struct _alpm_hook_t *hook = i->data;
-			alpm_logaction(handle, ALPM_CALLER_PREFIX, "running '%s'...\n", hook->name);
+			size_t count = _alpm_hook_batch_size(handle, i);
 
-			hook_event.type = ALPM_EVENT_HOOK_RUN_START;
-			hook_event.name = hook->name;
-			hook_event.desc = hook->desc;
-			EVENT(handle, &hook_event);
-
-			if(_alpm_hook_run_hook(handle, hook) != 0 && hook->abort_on_fail) {
-				ret = -1;
+			if(count > 1) {
+				if(_alpm_hook_run_batch(handle, i, count, &hook_event) != 0) {
+					ret = -1;
+				}
+				while(count--) {
+					i = i->next;
+				}
+			} else {
+				_alpm_hook_event(handle, hook, &hook_event, 0);
+				if(_alpm_hook_run_hook(handle, hook) != 0 && hook->abort_on_fail) {
+					ret = -1;
+				}
+				_alpm_hook_event(handle, hook, &hook_event, 1);
+				i = i->next;
 			}
 
-			hook_event.type = ALPM_EVENT_HOOK_RUN_DONE;
-			EVENT(handle, &hook_event);
-
 			if(ret != 0 && when == ALPM_HOOK_PRE_TRANSACTION) {
 				break;
 			}
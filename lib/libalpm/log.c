@@ -7,9 +7,13 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <syslog.h>
 #include <time.h>
+#include <unistd.h>
 
 /* libalpm */
 #include "log.h"
@@ -17,16 +21,301 @@
 #include "util.h"
 #include "alpm.h"
 
-static int _alpm_log_leader(FILE *f, const char *prefix)
+/* size of the buffer used with alpm_option_set_bufferedlog() */
+#define LOGBUF_SIZE 16384
+
+/* The log buffer is described by one word, handle->logstate, so that a
+ * signal handler can read and change it atomically without taking a lock:
+ * how far the complete lines in the buffer reach, how much of them is
+ * written out, and whether a signal handler is writing them out (frozen).
+ * While frozen the lines in the buffer are left alone and new lines go
+ * straight to the log file. Each length fits into LOGSTATE_BITS, so the
+ * word is no wider than size_t even where that has 32 bits. */
+#define LOGSTATE_BITS 15
+#define LOGSTATE_MASK (((size_t)1 << LOGSTATE_BITS) - 1)
+#define LOGSTATE(done, len) ((size_t)(done) << LOGSTATE_BITS | (size_t)(len))
+#define LOGSTATE_DONE(state) ((state) >> LOGSTATE_BITS & LOGSTATE_MASK)
+#define LOGSTATE_LEN(state) ((state) & LOGSTATE_MASK)
+#define LOGSTATE_FROZEN ((size_t)1 << (2 * LOGSTATE_BITS))
+
+/* a message, event or error of a thread whose output is captured */
+struct log_chunk {
+	enum { CHUNK_LOG, CHUNK_ACTION, CHUNK_PACNEW, CHUNK_PACSAVE, CHUNK_ERROR } type;
+	alpm_loglevel_t level;
+	alpm_errno_t error;
+	char *prefix;
+	char *text;
+	alpm_event_pacnew_created_t pacnew;
+	alpm_event_pacsave_created_t pacsave;
+};
+
+/* when set, the output of this thread is collected here as a list of
+ * log_chunk instead of being passed on, see _alpm_log_capture() */
+static __thread alpm_list_t **log_capture;
+
+static void log_chunk_free(struct log_chunk *chunk)
+{
+	free(chunk->prefix);
+	free(chunk->text);
+	free(chunk);
+}
+
+/* Collect a piece of output; a chunk that can't be allocated is lost. */
+static void log_capture_add(int type, alpm_loglevel_t level, const char *prefix,
+		const char *fmt, va_list args)
+{
+	struct log_chunk *chunk;
+
+	CALLOC(chunk, 1, sizeof(struct log_chunk), return);
+	chunk->type = type;
+	chunk->level = level;
+	if((prefix && (chunk->prefix = strdup(prefix)) == NULL)
+			|| vasprintf(&chunk->text, fmt, args) == -1) {
+		chunk->text = NULL;
+		log_chunk_free(chunk);
+		return;
+	}
+	*log_capture = alpm_list_add(*log_capture, chunk);
+}
+
+/** Collect the output of the calling thread instead of passing it on.
+ * Messages, log file lines, pacnew and pacsave events and errors are kept in
+ * order until _alpm_log_replay() delivers them from the thread owning the
+ * handle.
+ * @param chunks where to collect the output, NULL to stop collecting
+ */
+void _alpm_log_capture(alpm_list_t **chunks)
+{
+	log_capture = chunks;
+}
+
+/** Deliver output collected by _alpm_log_capture() and free it.
+ * @param handle the context handle
+ * @param chunks the collected output
+ */
+void _alpm_log_replay(alpm_handle_t *handle, alpm_list_t *chunks)
+{
+	alpm_list_t *i;
+
+	for(i = chunks; i; i = i->next) {
+		struct log_chunk *chunk = i->data;
+		switch(chunk->type) {
+			case CHUNK_LOG:
+				_alpm_log(handle, chunk->level, "%s", chunk->text);
+				break;
+			case CHUNK_ACTION:
+				alpm_logaction(handle, chunk->prefix, "%s", chunk->text);
+				break;
+			case CHUNK_PACNEW:
+				chunk->pacnew.file = chunk->text;
+				EVENT(handle, &chunk->pacnew);
+				break;
+			case CHUNK_PACSAVE:
+				chunk->pacsave.file = chunk->text;
+				EVENT(handle, &chunk->pacsave);
+				break;
+			case CHUNK_ERROR:
+				handle->pm_errno = chunk->error;
+				break;
+		}
+		log_chunk_free(chunk);
+	}
+	alpm_list_free(chunks);
+}
+
+/* Collect an event about a file; an event that can't be allocated is lost. */
+static struct log_chunk *log_capture_file_event(int type, const char *file)
+{
+	struct log_chunk *chunk;
+
+	CALLOC(chunk, 1, sizeof(struct log_chunk), return NULL);
+	chunk->type = type;
+	if((chunk->text = strdup(file)) == NULL) {
+		log_chunk_free(chunk);
+		return NULL;
+	}
+	*log_capture = alpm_list_add(*log_capture, chunk);
+	return chunk;
+}
+
+/** Deliver a pacnew event, or collect it if the output of the calling thread
+ * is captured.
+ * @param handle the context handle
+ * @param event the event
+ */
+void _alpm_log_pacnew(alpm_handle_t *handle, alpm_event_pacnew_created_t *event)
+{
+	if(log_capture) {
+		struct log_chunk *chunk = log_capture_file_event(CHUNK_PACNEW, event->file);
+		if(chunk) {
+			chunk->pacnew = *event;
+		}
+		return;
+	}
+	EVENT(handle, event);
+}
+
+/** Deliver a pacsave event, or collect it if the output of the calling thread
+ * is captured.
+ * @param handle the context handle
+ * @param event the event
+ */
+void _alpm_log_pacsave(alpm_handle_t *handle, alpm_event_pacsave_created_t *event)
+{
+	if(log_capture) {
+		struct log_chunk *chunk = log_capture_file_event(CHUNK_PACSAVE, event->file);
+		if(chunk) {
+			chunk->pacsave = *event;
+		}
+		return;
+	}
+	EVENT(handle, event);
+}
+
+/** Set the error of the handle, or collect it if the output of the calling
+ * thread is captured, so that threads sharing the handle don't race on it.
+ * @param handle the context handle
+ * @param err the error
+ */
+void _alpm_set_errno(alpm_handle_t *handle, alpm_errno_t err)
+{
+	struct log_chunk *chunk;
+
+	if(log_capture && (chunk = calloc(1, sizeof(struct log_chunk))) != NULL) {
+		alpm_list_t *added = alpm_list_add(*log_capture, chunk);
+		if(added != NULL) {
+			chunk->type = CHUNK_ERROR;
+			chunk->error = err;
+			*log_capture = added;
+			return;
+		}
+		free(chunk);
+	}
+	handle->pm_errno = err;
+}
+
+/* the timestamp only changes once per second, so only format it then */
+static const char *_alpm_log_timestamp(alpm_handle_t *handle)
 {
 	time_t t = time(NULL);
-	struct tm *tm = localtime(&t);
-	int length = 32;
-	char timestamp[length];
 
-	/* Use ISO-8601 date format */
-	strftime(timestamp,length,"%FT%T%z", tm);
-	return fprintf(f, "[%s] [%s] ", timestamp, prefix);
+	if(t != handle->logtime || handle->logstamp[0] == '\0') {
+		struct tm *tm = localtime(&t);
+		/* Use ISO-8601 date format */
+		strftime(handle->logstamp, sizeof(handle->logstamp), "%FT%T%z", tm);
+		handle->logtime = t;
+	}
+	return handle->logstamp;
+}
+
+/* write() all of len bytes of buf, as a signal handler may */
+static int log_write_all(int fd, const char *buf, size_t len)
+{
+	while(len > 0) {
+		ssize_t nwrite = write(fd, buf, len);
+		if(nwrite == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += nwrite;
+		len -= nwrite;
+	}
+	return 0;
+}
+
+/* Write out the complete lines in the log buffer and empty it. What was
+ * written is recorded after each write(), so a signal handler flushing in
+ * between writes out the rest; it may write a piece a second time, but no
+ * line is lost. Called with loglock held. */
+static int log_write_out(alpm_handle_t *handle)
+{
+	size_t state = __atomic_load_n(&handle->logstate, __ATOMIC_ACQUIRE);
+	int ret = 0, saved_errno = errno;
+
+	if(handle->logbuf == NULL || handle->logfd < 0) {
+		return 0;
+	}
+
+	while(!(state & LOGSTATE_FROZEN) && LOGSTATE_DONE(state) < LOGSTATE_LEN(state)) {
+		size_t done = LOGSTATE_DONE(state), len = LOGSTATE_LEN(state);
+		ssize_t nwrite = write(handle->logfd, handle->logbuf + done, len - done);
+
+		if(nwrite == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			ret = -1;
+			break;
+		}
+		/* on failure a signal handler took over, state is reloaded */
+		if(__atomic_compare_exchange_n(&handle->logstate, &state,
+					LOGSTATE(done + nwrite, len), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			state = LOGSTATE(done + nwrite, len);
+		}
+	}
+
+	/* all written, the next line goes to the start of the buffer again */
+	if(!(state & LOGSTATE_FROZEN) && LOGSTATE_DONE(state) == LOGSTATE_LEN(state)) {
+		__atomic_compare_exchange_n(&handle->logstate, &state, 0, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+	}
+
+	errno = saved_errno;
+	return ret;
+}
+
+/* Append a line to the log buffer, flushing it first if it is full. Lines
+ * that don't fit even into an empty buffer, or come while a signal handler
+ * writes the buffer out, are written out directly. The line only becomes
+ * visible to a flush once it is complete, so a signal handler never writes
+ * out half of it. Called with loglock held. */
+static int _alpm_log_buffered(alpm_handle_t *handle, const char *prefix,
+		const char *fmt, va_list args)
+{
+	const char *stamp = _alpm_log_timestamp(handle);
+	int attempt;
+
+	if(handle->logbuf == NULL) {
+		MALLOC(handle->logbuf, LOGBUF_SIZE, return -1);
+	}
+
+	for(attempt = 0; attempt < 2; attempt++) {
+		size_t state = __atomic_load_n(&handle->logstate, __ATOMIC_ACQUIRE);
+		size_t len = LOGSTATE_LEN(state), space = LOGBUF_SIZE - len;
+		char *ptr = handle->logbuf + len;
+		int lead, msg = -1;
+		va_list args_copy;
+
+		if(state & LOGSTATE_FROZEN) {
+			break;
+		}
+		lead = snprintf(ptr, space, "[%s] [%s] ", stamp, prefix);
+		if(lead >= 0 && (size_t)lead < space) {
+			va_copy(args_copy, args);
+			msg = vsnprintf(ptr + lead, space - lead, fmt, args_copy);
+			va_end(args_copy);
+		}
+		if(msg >= 0 && (size_t)(lead + msg) < space) {
+			if(__atomic_compare_exchange_n(&handle->logstate, &state,
+						LOGSTATE(LOGSTATE_DONE(state), len + lead + msg), 0,
+						__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+				return 0;
+			}
+			/* a signal handler took the buffer, it doesn't write this part */
+			return log_write_all(handle->logfd, ptr, lead + msg);
+		}
+		if(log_write_out(handle) != 0) {
+			return -1;
+		}
+	}
+
+	if(dprintf(handle->logfd, "[%s] [%s] ", stamp, prefix) < 0
+			|| vdprintf(handle->logfd, fmt, args) < 0) {
+		return -1;
+	}
+	return 0;
 }
 
 int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
@@ -41,6 +330,13 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 		prefix = "UNKNOWN";
 	}
 
+	if(log_capture) {
+		va_start(args, fmt);
+		log_capture_add(CHUNK_ACTION, 0, prefix, fmt, args);
+		va_end(args);
+		return 0;
+	}
+
 	/* check if the logstream is open already, opening it if needed */
 	if(handle->logstream == NULL && handle->logfile != NULL) {
 		int fd;
@@ -58,6 +354,8 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 				handle->pm_errno = ALPM_ERR_SYSTEM;
 			}
 			ret = -1;
+		} else {
+			handle->logfd = fd;
 		}
 	}
 
@@ -72,8 +370,16 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 		va_end(args_syslog);
 	}
 
-	if(handle->logstream) {
-		if(_alpm_log_leader(handle->logstream, prefix) < 0
+	if(handle->logstream && handle->bufferedlog) {
+		pthread_mutex_lock(&handle->loglock);
+		if(_alpm_log_buffered(handle, prefix, fmt, args) != 0) {
+			ret = -1;
+			handle->pm_errno = ALPM_ERR_SYSTEM;
+		}
+		pthread_mutex_unlock(&handle->loglock);
+	} else if(handle->logstream) {
+		if(fprintf(handle->logstream, "[%s] [%s] ",
+					_alpm_log_timestamp(handle), prefix) < 0
 				|| vfprintf(handle->logstream, fmt, args) < 0) {
 			ret = -1;
 			handle->pm_errno = ALPM_ERR_SYSTEM;
@@ -85,15 +391,75 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 	return ret;
 }
 
+/* No lock is taken, so that a signal handler can call this whatever the
+ * code it interrupted was doing with the buffer: freezing it keeps the
+ * lines in it where they are until they are written out. */
+int SYMEXPORT alpm_logaction_flush(alpm_handle_t *handle)
+{
+	size_t state, done, len;
+	int ret = 0, saved_errno = errno;
+
+	if(handle == NULL || handle->logfd < 0) {
+		return 0;
+	}
+	state = __atomic_fetch_or(&handle->logstate, LOGSTATE_FROZEN, __ATOMIC_ACQ_REL);
+	if(state & LOGSTATE_FROZEN) {
+		/* another flush is writing it out */
+		return 0;
+	}
+	done = LOGSTATE_DONE(state);
+	len = LOGSTATE_LEN(state);
+	if(done < len) {
+		ret = log_write_all(handle->logfd, handle->logbuf + done, len - done);
+	}
+	__atomic_store_n(&handle->logstate, LOGSTATE(len, len), __ATOMIC_RELEASE);
+	errno = saved_errno;
+	return ret;
+}
+
+/** Write out buffered log lines, waiting for other threads that log.
+ * Use this rather than alpm_logaction_flush() where the lines have to be
+ * on disk when it returns, e.g. before forking or at the end of a
+ * transaction.
+ * @param handle the context handle
+ * @return 0 on success, -1 if writing to the log file failed
+ */
+int _alpm_log_flush(alpm_handle_t *handle)
+{
+	int ret;
+
+	if(handle == NULL || handle->logbuf == NULL) {
+		return 0;
+	}
+	pthread_mutex_lock(&handle->loglock);
+	ret = log_write_out(handle);
+	pthread_mutex_unlock(&handle->loglock);
+	return ret;
+}
+
 void _alpm_log(alpm_handle_t *handle, alpm_loglevel_t flag, const char *fmt, ...)
 {
 	va_list args;
 
-	if(handle == NULL || handle->logcb == NULL) {
+	if(handle == NULL) {
 		return;
 	}
 
-	va_start(args, fmt);
-	handle->logcb(handle->logcb_ctx, flag, fmt, args);
-	va_end(args);
+	if(log_capture) {
+		va_start(args, fmt);
+		log_capture_add(CHUNK_LOG, flag, NULL, fmt, args);
+		va_end(args);
+		return;
+	}
+
+	if(handle->logcb) {
+		va_start(args, fmt);
+		handle->logcb(handle->logcb_ctx, flag, fmt, args);
+		va_end(args);
+	}
+
+	if(flag == ALPM_LOG_ERROR) {
+		/* get everything leading up to an error on disk */
+		_alpm_log_flush(handle);
+	}
 }
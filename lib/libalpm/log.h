@@ -13,5 +13,11 @@
 
 void _alpm_log(alpm_handle_t *handle, alpm_loglevel_t flag,
 		const char *fmt, ...) __attribute__((format(printf,3,4)));
+int _alpm_log_flush(alpm_handle_t *handle);
+void _alpm_log_capture(alpm_list_t **chunks);
+void _alpm_log_replay(alpm_handle_t *handle, alpm_list_t *chunks);
+void _alpm_log_pacnew(alpm_handle_t *handle, alpm_event_pacnew_created_t *event);
+void _alpm_log_pacsave(alpm_handle_t *handle, alpm_event_pacsave_created_t *event);
+void _alpm_set_errno(alpm_handle_t *handle, alpm_errno_t err);
 
 #endif /* ALPM_LOG_H */
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* Cache of the metadata of package files.
+ *
+ * <dbpath>/metacache holds one record per package file: a header line made
+ * of the identity of the file (device, inode, size, mtime, ctime), whether
+ * it has an install script, the length of its .PKGINFO and its path, then
+ * the .PKGINFO itself and a newline. A metadata-only load of a file whose
+ * identity is unchanged parses the cached .PKGINFO instead of opening the
+ * archive. Records of files that are gone or have changed are dropped when
+ * the cache is loaded; the cache file is rewritten when the handle is
+ * released if any record was dropped or added.
+ *
+ * Package loads may run in parallel, every access holds metacache_lock.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* libalpm */
+#include "metacache.h"
+#include "dbparse.h"
+#include "handle.h"
+#include "log.h"
+#include "util.h"
+#include "vector.h"
+
+#define METACACHE_FILE "metacache"
+
+struct meta_entry {
+	char *key;
+	char *path;
+	char *pkginfo;
+	size_t len;
+	int scriptlet;
+};
+
+static void meta_entry_free(struct meta_entry *entry)
+{
+	if(entry) {
+		free(entry->key);
+		free(entry->path);
+		free(entry->pkginfo);
+		free(entry);
+	}
+}
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+#define MTIME_NSEC(st) ((long long)(st)->st_mtim.tv_nsec)
+#define CTIME_NSEC(st) ((long long)(st)->st_ctim.tv_nsec)
+#else
+#define MTIME_NSEC(st) 0LL
+#define CTIME_NSEC(st) 0LL
+#endif
+
+/* identity of a package file, any change to the file changes it */
+static void meta_key(const struct stat *st, char *key, size_t size)
+{
+	snprintf(key, size, "%llu %llu %lld %lld.%lld %lld.%lld",
+			(unsigned long long)st->st_dev, (unsigned long long)st->st_ino,
+			(long long)st->st_size,
+			(long long)st->st_mtime, MTIME_NSEC(st),
+			(long long)st->st_ctime, CTIME_NSEC(st));
+}
+
+static char *metacache_path(alpm_handle_t *handle)
+{
+	char *path;
+	size_t len = strlen(handle->dbpath) + strlen(METACACHE_FILE) + 1;
+	MALLOC(path, len, return NULL);
+	snprintf(path, len, "%s%s", handle->dbpath, METACACHE_FILE);
+	return path;
+}
+
+static int meta_entry_insert(alpm_handle_t *handle, struct meta_entry *entry)
+{
+	if(_alpm_vector_push(&handle->metacache_entries, entry) != 0) {
+		meta_entry_free(entry);
+		return -1;
+	}
+	if(_alpm_strset_add(&handle->metacache_index, entry->key, entry) != 1) {
+		/* a record of the same file, or no memory to index it */
+		handle->metacache_entries.count--;
+		meta_entry_free(entry);
+		return -1;
+	}
+	return 0;
+}
+
+/* Parse one record at *pos, NULL at the end of the data or on a broken record. */
+static struct meta_entry *meta_record_parse(char **pos, char *end)
+{
+	unsigned long long dev, ino;
+	long long size, mtime, mnsec, ctime, cnsec;
+	struct meta_entry *entry;
+	char key[128], *line = *pos, *nl;
+	int scriptlet, off = 0;
+	size_t len;
+
+	if(line >= end || (nl = memchr(line, '\n', end - line)) == NULL) {
+		return NULL;
+	}
+	*nl = '\0';
+	if(sscanf(line, "%llu %llu %lld %lld.%lld %lld.%lld %d %zu %n", &dev, &ino,
+				&size, &mtime, &mnsec, &ctime, &cnsec, &scriptlet, &len, &off) != 9
+			|| off == 0 || line[off] == '\0'
+			|| len > (size_t)(end - nl - 1) || nl[1 + len] != '\n') {
+		return NULL;
+	}
+	snprintf(key, sizeof(key), "%llu %llu %lld %lld.%lld %lld.%lld",
+			dev, ino, size, mtime, mnsec, ctime, cnsec);
+
+	CALLOC(entry, 1, sizeof(struct meta_entry), return NULL);
+	entry->scriptlet = scriptlet;
+	entry->len = len;
+	STRDUP(entry->key, key, goto error);
+	STRDUP(entry->path, line + off, goto error);
+	MALLOC(entry->pkginfo, len + 1, goto error);
+	memcpy(entry->pkginfo, nl + 1, len);
+	entry->pkginfo[len] = '\0';
+	*pos = nl + 2 + len;
+	return entry;
+
+error:
+	meta_entry_free(entry);
+	return NULL;
+}
+
+static void metacache_load(alpm_handle_t *handle)
+{
+	char *path, *data, *pos, key[128];
+	size_t len, dropped = 0;
+	struct meta_entry *entry;
+	struct stat st;
+
+	handle->metacache_loaded = 1;
+	if((path = metacache_path(handle)) == NULL) {
+		return;
+	}
+	if(_alpm_dbparse_read_file(path, &data, &len) != 0) {
+		free(path);
+		return;
+	}
+	free(path);
+
+	pos = data;
+	while((entry = meta_record_parse(&pos, data + len)) != NULL) {
+		/* drop the records of files that were removed or replaced */
+		if(stat(entry->path, &st) != 0) {
+			meta_entry_free(entry);
+			dropped++;
+			continue;
+		}
+		meta_key(&st, key, sizeof(key));
+		if(strcmp(key, entry->key) != 0) {
+			meta_entry_free(entry);
+			dropped++;
+		} else if(meta_entry_insert(handle, entry) != 0) {
+			dropped++;
+		}
+	}
+	if(pos != data + len) {
+		/* a truncated or garbled record, drop it and anything after it */
+		dropped++;
+	}
+	free(data);
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "loaded %zu package metadata cache entries, dropped %zu\n",
+			handle->metacache_entries.count, dropped);
+	handle->metacache_dirty = dropped > 0;
+}
+
+/** Look up the metadata of a package file in the cache.
+ * @param handle the context handle
+ * @param st status of the package file
+ * @param pkginfo set to a copy of the cached .PKGINFO on a hit, to be freed
+ * by the caller
+ * @param len set to the length of the .PKGINFO
+ * @param scriptlet set to whether the package has an install script
+ * @return 0 on a hit, -1 otherwise
+ */
+int _alpm_metacache_lookup(alpm_handle_t *handle, const struct stat *st,
+		char **pkginfo, size_t *len, int *scriptlet)
+{
+	struct meta_entry *entry;
+	char key[128];
+	int ret = -1;
+
+	if(!handle->metacache) {
+		return -1;
+	}
+	meta_key(st, key, sizeof(key));
+
+	pthread_mutex_lock(&handle->metacache_lock);
+	if(!handle->metacache_loaded) {
+		metacache_load(handle);
+	}
+	if((entry = _alpm_strset_get(&handle->metacache_index, key)) != NULL) {
+		MALLOC(*pkginfo, entry->len + 1, goto cleanup);
+		memcpy(*pkginfo, entry->pkginfo, entry->len + 1);
+		*len = entry->len;
+		*scriptlet = entry->scriptlet;
+		ret = 0;
+	}
+cleanup:
+	pthread_mutex_unlock(&handle->metacache_lock);
+	return ret;
+}
+
+/** Remember the metadata of a package file.
+ * @param handle the context handle
+ * @param pkgfile path of the package file
+ * @param st status of the package file when it was read
+ * @param pkginfo the .PKGINFO of the package
+ * @param len length of the .PKGINFO
+ * @param scriptlet whether the package has an install script
+ */
+void _alpm_metacache_add(alpm_handle_t *handle, const char *pkgfile,
+		const struct stat *st, const char *pkginfo, size_t len, int scriptlet)
+{
+	struct meta_entry *entry;
+	char key[128];
+	char *path;
+
+	if(!handle->metacache || strchr(pkgfile, '\n') != NULL) {
+		return;
+	}
+	/* relative paths would not be found again from another directory */
+	if((path = realpath(pkgfile, NULL)) == NULL) {
+		return;
+	}
+	meta_key(st, key, sizeof(key));
+
+	CALLOC(entry, 1, sizeof(struct meta_entry), free(path); return);
+	entry->path = path;
+	entry->scriptlet = scriptlet;
+	entry->len = len;
+	STRDUP(entry->key, key, meta_entry_free(entry); return);
+	MALLOC(entry->pkginfo, len + 1, meta_entry_free(entry); return);
+	memcpy(entry->pkginfo, pkginfo, len);
+	entry->pkginfo[len] = '\0';
+
+	pthread_mutex_lock(&handle->metacache_lock);
+	if(!handle->metacache_loaded) {
+		metacache_load(handle);
+	}
+	if(meta_entry_insert(handle, entry) == 0) {
+		handle->metacache_dirty = 1;
+	}
+	pthread_mutex_unlock(&handle->metacache_lock);
+}
+
+/* Write all records to a new cache file. Failure only costs reopening the
+ * packages next time. */
+static void metacache_write(alpm_handle_t *handle)
+{
+	char *path, *tmppath = NULL;
+	size_t i;
+	FILE *fp;
+
+	if((path = metacache_path(handle)) == NULL) {
+		return;
+	}
+	if(asprintf(&tmppath, "%s.tmp", path) == -1) {
+		free(path);
+		return;
+	}
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write package metadata cache %s: %s\n",
+				tmppath, strerror(errno));
+		free(tmppath);
+		free(path);
+		return;
+	}
+	for(i = 0; i < handle->metacache_entries.count; i++) {
+		struct meta_entry *entry = handle->metacache_entries.data[i];
+		fprintf(fp, "%s %d %zu %s\n", entry->key, entry->scriptlet, entry->len, entry->path);
+		fwrite(entry->pkginfo, 1, entry->len, fp);
+		fputc('\n', fp);
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		unlink(tmppath);
+	}
+	free(tmppath);
+	free(path);
+}
+
+/** Write the cache back if it changed and free it. */
+void _alpm_metacache_free(alpm_handle_t *handle)
+{
+	if(handle->metacache_dirty) {
+		metacache_write(handle);
+	}
+	_alpm_strset_free(&handle->metacache_index, NULL);
+	_alpm_vector_free(&handle->metacache_entries, (alpm_list_fn_free)meta_entry_free);
+	handle->metacache_loaded = 0;
+	handle->metacache_dirty = 0;
+}
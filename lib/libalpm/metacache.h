@@ -0,0 +1,18 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef ALPM_METACACHE_H
+#define ALPM_METACACHE_H
+
+#include <sys/stat.h>
+
+#include "alpm.h"
+
+int _alpm_metacache_lookup(alpm_handle_t *handle, const struct stat *st,
+		char **pkginfo, size_t *len, int *scriptlet);
+void _alpm_metacache_add(alpm_handle_t *handle, const char *pkgfile,
+		const struct stat *st, const char *pkginfo, size_t len, int scriptlet);
+void _alpm_metacache_free(alpm_handle_t *handle);
+
+#endif /* ALPM_METACACHE_H */
@@ -18,6 +18,7 @@
 #include "db.h"
 #include "handle.h"
 #include "deps.h"
+#include "filelist.h"
 
 int SYMEXPORT alpm_pkg_free(alpm_pkg_t *pkg)
 {
@@ -143,6 +144,7 @@ const char SYMEXPORT *alpm_pkg_get_filename(alpm_pkg_t *pkg)
 {
 	ASSERT(pkg != NULL, return NULL);
 	pkg->handle->pm_errno = ALPM_ERR_OK;
+	_alpm_pkg_load_sync(pkg);
 	return pkg->filename;
 }
 
@@ -219,6 +221,7 @@ const char SYMEXPORT *alpm_pkg_get_sha256sum(alpm_pkg_t *pkg)
 {
 	ASSERT(pkg != NULL, return NULL);
 	pkg->handle->pm_errno = ALPM_ERR_OK;
+	_alpm_pkg_load_sync(pkg);
 	return pkg->sha256sum;
 }
 
@@ -226,12 +229,14 @@ const char SYMEXPORT *alpm_pkg_get_base64_sig(alpm_pkg_t *pkg)
 {
 	ASSERT(pkg != NULL, return NULL);
 	pkg->handle->pm_errno = ALPM_ERR_OK;
+	_alpm_pkg_load_sync(pkg);
 	return pkg->base64_sig;
 }
 
 int SYMEXPORT alpm_pkg_get_sig(alpm_pkg_t *pkg, unsigned char **sig, size_t *sig_len)
 {
 	ASSERT(pkg != NULL, return -1);
+	_alpm_pkg_load_sync(pkg);
 
 	if(pkg->base64_sig) {
 		int ret = alpm_decode_signature(pkg->base64_sig, sig, sig_len);
@@ -278,6 +283,7 @@ off_t SYMEXPORT alpm_pkg_get_size(alpm_pkg_t *pkg)
 {
 	ASSERT(pkg != NULL, return -1);
 	pkg->handle->pm_errno = ALPM_ERR_OK;
+	_alpm_pkg_load_sync(pkg);
 	return pkg->size;
 }
 
@@ -372,6 +378,41 @@ alpm_filelist_t SYMEXPORT *alpm_pkg_get_files(alpm_pkg_t *pkg)
 	return pkg->ops->get_files(pkg);
 }
 
+int SYMEXPORT alpm_pkg_has_file(alpm_pkg_t *pkg, const char *path)
+{
+	ASSERT(pkg != NULL, return 0);
+	pkg->handle->pm_errno = ALPM_ERR_OK;
+	ASSERT(path != NULL, RET_ERR(pkg->handle, ALPM_ERR_WRONG_ARGS, 0));
+	if(pkg->packedfiles) {
+		return _alpm_filelist_packed_contains(pkg->packedfiles, path);
+	}
+	return alpm_filelist_contains(pkg->ops->get_files(pkg), path) != NULL;
+}
+
+int SYMEXPORT alpm_pkg_files_foreach(alpm_pkg_t *pkg, alpm_cb_file fn, void *ctx)
+{
+	alpm_filelist_t *filelist;
+	size_t i;
+	int ret = 0;
+
+	ASSERT(pkg != NULL, return -1);
+	pkg->handle->pm_errno = ALPM_ERR_OK;
+	ASSERT(fn != NULL, RET_ERR(pkg->handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	if(pkg->packedfiles) {
+		if((ret = _alpm_filelist_packed_foreach(pkg->packedfiles, fn, ctx)) == -1) {
+			pkg->handle->pm_errno = ALPM_ERR_MEMORY;
+		}
+		return ret;
+	}
+
+	filelist = pkg->ops->get_files(pkg);
+	for(i = 0; filelist && i < filelist->count && ret == 0; i++) {
+		ret = fn(ctx, filelist->files[i].name);
+	}
+	return ret;
+}
+
 alpm_list_t SYMEXPORT *alpm_pkg_get_backup(alpm_pkg_t *pkg)
 {
 	ASSERT(pkg != NULL, return NULL);
@@ -612,6 +653,13 @@ int _alpm_pkg_dup(alpm_pkg_t *pkg, alpm_pkg_t **new_ptr)
 		}
 		newpkg->files.count = pkg->files.count;
 	}
+	if(pkg->packedfiles) {
+		newpkg->packedfiles = _alpm_filelist_packed_dup(pkg->packedfiles);
+		if(newpkg->packedfiles == NULL) {
+			_alpm_alloc_fail(pkg->packedfiles->size);
+			goto cleanup;
+		}
+	}
 
 	/* internal */
 	newpkg->infolevel = pkg->infolevel;
@@ -621,6 +669,8 @@ int _alpm_pkg_dup(alpm_pkg_t *pkg, alpm_pkg_t **new_ptr)
 	} else {
 		newpkg->origin_data.db = pkg->origin_data.db;
 	}
+	newpkg->dbframe_offset = pkg->dbframe_offset;
+	newpkg->dbframe_size = pkg->dbframe_size;
 	newpkg->ops = pkg->ops;
 	newpkg->handle = pkg->handle;
 
@@ -689,6 +739,9 @@ void _alpm_pkg_free(alpm_pkg_t *pkg)
 		}
 		free(pkg->files.files);
 	}
+	free(pkg->packedfiles);
+	free(pkg->rawdesc);
+	free(pkg->rawfiles);
 	alpm_list_free_inner(pkg->backup, (alpm_list_fn_free)_alpm_backup_free);
 	alpm_list_free(pkg->backup);
 	alpm_list_free_inner(pkg->xdata, (alpm_list_fn_free)_alpm_pkg_xdata_free);
@@ -850,3 +903,14 @@ int _alpm_pkg_check_meta(alpm_pkg_t *pkg)
 
 	return error_found;
 }
+
+/* Sync packages only hold their name and version until something else is
+ * asked for through their operations; load them before reading the other
+ * fields straight from the struct. */
+int _alpm_pkg_load_sync(alpm_pkg_t *pkg)
+{
+	if(pkg->origin == ALPM_PKG_FROM_SYNCDB && !(pkg->infolevel & INFRQ_DESC)) {
+		return pkg->ops->force_load(pkg);
+	}
+	return 0;
+}
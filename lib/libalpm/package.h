@@ -108,6 +108,8 @@ struct _alpm_pkg_t {
 	const struct pkg_operations *ops;
 
 	alpm_filelist_t files;
+	/* names only, sync packages from files databases */
+	struct _alpm_filelist_packed_t *packedfiles;
 
 	/* origin == PKG_FROM_FILE, use pkg->origin_data.file
 	 * origin == PKG_FROM_*DB, use pkg->origin_data.db */
@@ -116,6 +118,14 @@ struct _alpm_pkg_t {
 		char *file;
 	} origin_data;
 
+	/* where the entries of a package of an indexed sync database are,
+	 * size 0 once they have been read */
+	off_t dbframe_offset;
+	off_t dbframe_size;
+	/* desc and files entries of sync packages, until they are parsed */
+	char *rawdesc;
+	char *rawfiles;
+
 	alpm_pkgfrom_t origin;
 	alpm_pkgreason_t reason;
 	int scriptlet;
@@ -140,6 +150,10 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		alpm_siglist_t **sigdata, int *validation);
 alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 		const char *pkgfile, int full);
+#if defined HAVE_LIBSSL || defined HAVE_LIBNETTLE
+alpm_pkg_t *_alpm_pkg_load_digest(alpm_handle_t *handle, const char *pkgfile,
+		int full, char **sha256sum);
+#endif
 
 int _alpm_pkg_cmp(const void *p1, const void *p2);
 int _alpm_pkg_compare_versions(alpm_pkg_t *local_pkg, alpm_pkg_t *pkg);
@@ -148,5 +162,6 @@ alpm_pkg_xdata_t *_alpm_pkg_parse_xdata(const char *string);
 void _alpm_pkg_xdata_free(alpm_pkg_xdata_t *pd);
 
 int _alpm_pkg_check_meta(alpm_pkg_t *pkg);
+int _alpm_pkg_load_sync(alpm_pkg_t *pkg);
 
 #endif /* ALPM_PACKAGE_H */
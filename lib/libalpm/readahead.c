@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* Read ahead of the extraction of a package.
+ *
+ * A reader thread walks the archive, so decompressing it overlaps with
+ * writing the files out. Every header and data block it reads is copied
+ * into a bounded ring; the extracting thread takes them out again through
+ * calls shaped like the libarchive ones they replace. The ring holds at
+ * most READAHEAD_SLOTS blocks and READAHEAD_BYTES bytes, the reader waits
+ * when it is full.
+ *
+ * The last slot of the ring is an end marker carrying the status of the
+ * read which stopped the reader, it is never taken out. Without a thread,
+ * the archive is read directly by the same calls.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libalpm */
+#include "readahead.h"
+#include "libarchive-compat.h"
+#include "log.h"
+#include "util.h"
+
+#define READAHEAD_SLOTS 64
+#define READAHEAD_BYTES (8 * 1024 * 1024)
+
+enum ra_type {
+	RA_HEADER,
+	RA_DATA,
+	RA_END
+};
+
+struct ra_slot {
+	enum ra_type type;
+	/* RA_HEADER: a copy of the entry and the compressed bytes read so far */
+	struct archive_entry *entry;
+	int64_t pos;
+	/* RA_DATA: a copy of a block of the entry's data */
+	void *data;
+	size_t size;
+	int64_t offset;
+	/* RA_END: how the reader stopped, and whether it was in the data of an entry */
+	int status;
+	int in_data;
+	int errnum;
+	char *errstr;
+};
+
+struct _alpm_readahead_t {
+	struct archive *archive;
+	int threaded;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+	struct ra_slot ring[READAHEAD_SLOTS];
+	size_t head;
+	size_t count;
+	size_t queued;
+	int stop;
+	/* owned by the extracting thread */
+	struct archive_entry *entry;
+	void *block;
+	int errnum;
+	char *errstr;
+};
+
+static void ra_set_error(alpm_readahead_t *ra, int errnum, const char *errstr)
+{
+	free(ra->errstr);
+	ra->errnum = errnum;
+	ra->errstr = errstr ? strdup(errstr) : NULL;
+}
+
+/* Queue a slot, waiting for room. Fails once the reader has to stop. */
+static int ra_push(alpm_readahead_t *ra, struct ra_slot *slot)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&ra->lock);
+	while(!ra->stop && (ra->count == READAHEAD_SLOTS
+				|| (ra->count > 0 && ra->queued + slot->size > READAHEAD_BYTES))) {
+		pthread_cond_wait(&ra->drained, &ra->lock);
+	}
+	if(!ra->stop) {
+		ra->ring[(ra->head + ra->count) % READAHEAD_SLOTS] = *slot;
+		ra->count++;
+		ra->queued += slot->size;
+		pthread_cond_signal(&ra->filled);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&ra->lock);
+	return ret;
+}
+
+/* Read the data of the current entry into the ring, ARCHIVE_EOF at its end. */
+static int ra_read_data(alpm_readahead_t *ra)
+{
+	const void *buf;
+	size_t size;
+	la_int64_t offset;
+	int ret;
+
+	while((ret = archive_read_data_block(ra->archive, &buf, &size, &offset)) == ARCHIVE_OK) {
+		struct ra_slot slot = { .type = RA_DATA, .size = size, .offset = offset };
+
+		if(size > 0) {
+			if((slot.data = malloc(size)) == NULL) {
+				archive_set_error(ra->archive, ENOMEM, "out of memory");
+				return ARCHIVE_FATAL;
+			}
+			memcpy(slot.data, buf, size);
+		}
+		if(ra_push(ra, &slot) != 0) {
+			free(slot.data);
+			return ARCHIVE_FATAL;
+		}
+	}
+	return ret;
+}
+
+static void *ra_reader(void *data)
+{
+	alpm_readahead_t *ra = data;
+	struct archive_entry *entry;
+	struct ra_slot end = { .type = RA_END };
+	int ret;
+
+	while((ret = archive_read_next_header(ra->archive, &entry)) == ARCHIVE_OK) {
+		struct ra_slot slot = { .type = RA_HEADER };
+
+		slot.pos = _alpm_archive_compressed_ftell(ra->archive);
+		if((slot.entry = archive_entry_clone(entry)) == NULL) {
+			archive_set_error(ra->archive, ENOMEM, "out of memory");
+			ret = ARCHIVE_FATAL;
+			break;
+		}
+		if(ra_push(ra, &slot) != 0) {
+			archive_entry_free(slot.entry);
+			return NULL;
+		}
+		if((ret = ra_read_data(ra)) != ARCHIVE_EOF) {
+			end.in_data = 1;
+			break;
+		}
+	}
+
+	end.status = ret;
+	if(ret != ARCHIVE_EOF) {
+		const char *errstr = archive_error_string(ra->archive);
+		end.errnum = archive_errno(ra->archive);
+		end.errstr = errstr ? strdup(errstr) : NULL;
+	}
+	if(ra_push(ra, &end) != 0) {
+		free(end.errstr);
+	}
+	return NULL;
+}
+
+/* Wait for the next slot, it stays in the ring until ra_pop(). */
+static struct ra_slot *ra_peek(alpm_readahead_t *ra)
+{
+	struct ra_slot *slot;
+
+	pthread_mutex_lock(&ra->lock);
+	while(ra->count == 0) {
+		pthread_cond_wait(&ra->filled, &ra->lock);
+	}
+	slot = ra->ring + ra->head;
+	pthread_mutex_unlock(&ra->lock);
+	return slot;
+}
+
+static void ra_pop(alpm_readahead_t *ra)
+{
+	pthread_mutex_lock(&ra->lock);
+	ra->queued -= ra->ring[ra->head].size;
+	ra->head = (ra->head + 1) % READAHEAD_SLOTS;
+	ra->count--;
+	pthread_cond_signal(&ra->drained);
+	pthread_mutex_unlock(&ra->lock);
+}
+
+/* The next block of the current entry, ARCHIVE_EOF at its end. The block is
+ * valid until the next call. */
+static int ra_data_block(alpm_readahead_t *ra, const void **buf, size_t *size,
+		int64_t *offset)
+{
+	struct ra_slot *slot;
+
+	FREE(ra->block);
+	slot = ra_peek(ra);
+	if(slot->type == RA_DATA) {
+		ra->block = slot->data;
+		*buf = slot->data;
+		*size = slot->size;
+		*offset = slot->offset;
+		ra_pop(ra);
+		return ARCHIVE_OK;
+	} else if(slot->type == RA_END && slot->in_data) {
+		ra_set_error(ra, slot->errnum, slot->errstr);
+		return slot->status;
+	}
+	return ARCHIVE_EOF;
+}
+
+/** Start reading a package archive ahead of its extraction.
+ * Falls back to reading in the calling thread if no thread can be started.
+ * @param handle the context handle
+ * @param archive an archive opened for reading, read only through the
+ * returned object until it is freed
+ * @param threaded whether to read in another thread, otherwise the archive
+ * is read in the calling thread as it is asked for
+ * @return the read-ahead object, NULL on error
+ */
+alpm_readahead_t *_alpm_readahead_new(alpm_handle_t *handle, struct archive *archive,
+		int threaded)
+{
+	alpm_readahead_t *ra;
+
+	CALLOC(ra, 1, sizeof(alpm_readahead_t), RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	ra->archive = archive;
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->filled, NULL);
+	pthread_cond_init(&ra->drained, NULL);
+	if(!threaded) {
+		return ra;
+	}
+	if(pthread_create(&ra->thread, NULL, ra_reader, ra) == 0) {
+		ra->threaded = 1;
+	} else {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not start a thread to read the archive\n");
+	}
+	return ra;
+}
+
+/** Read the next entry, like archive_read_next_header().
+ * Any data left of the previous entry is skipped.
+ * @param ra the read-ahead object
+ * @param entry set to the entry, valid until the next call
+ * @param pos set to the compressed bytes read up to the entry
+ * @return ARCHIVE_OK, ARCHIVE_EOF at the end of the archive or an error
+ */
+int _alpm_readahead_next_header(alpm_readahead_t *ra, struct archive_entry **entry,
+		int64_t *pos)
+{
+	struct ra_slot *slot;
+
+	if(!ra->threaded) {
+		int ret = archive_read_next_header(ra->archive, entry);
+		*pos = _alpm_archive_compressed_ftell(ra->archive);
+		return ret;
+	}
+
+	FREE(ra->block);
+	while((slot = ra_peek(ra))->type == RA_DATA) {
+		free(slot->data);
+		ra_pop(ra);
+	}
+	if(slot->type == RA_END) {
+		ra_set_error(ra, slot->errnum, slot->errstr);
+		return slot->status;
+	}
+	archive_entry_free(ra->entry);
+	ra->entry = slot->entry;
+	*entry = slot->entry;
+	*pos = slot->pos;
+	ra_pop(ra);
+	return ARCHIVE_OK;
+}
+
+/** Skip the data of the current entry, like archive_read_data_skip().
+ * @param ra the read-ahead object
+ * @return ARCHIVE_OK or an error
+ */
+int _alpm_readahead_data_skip(alpm_readahead_t *ra)
+{
+	const void *buf;
+	size_t size;
+	int64_t offset;
+	int ret;
+
+	if(!ra->threaded) {
+		return archive_read_data_skip(ra->archive);
+	}
+	while((ret = ra_data_block(ra, &buf, &size, &offset)) == ARCHIVE_OK);
+	return ret == ARCHIVE_EOF ? ARCHIVE_OK : ret;
+}
+
+/** Write the current entry out, like archive_read_extract2().
+ * @param ra the read-ahead object
+ * @param entry the entry as it is to be written
+ * @param writer the disk writer
+ * @return the worst status of the read and the write, with the error of the
+ * first failure available from _alpm_readahead_error_string()
+ */
+int _alpm_readahead_extract(alpm_readahead_t *ra, struct archive_entry *entry,
+		struct archive *writer)
+{
+	const void *buf;
+	size_t size;
+	int64_t offset;
+	int ret, ret2;
+
+	if(!ra->threaded) {
+		return archive_read_extract2(ra->archive, entry, writer);
+	}
+
+	/* the steps of archive_read_extract2(), down to which errors it reports */
+	ret = archive_write_header(writer, entry);
+	if(ret != ARCHIVE_OK) {
+		ra_set_error(ra, archive_errno(writer), archive_error_string(writer));
+	} else if(!archive_entry_size_is_set(entry) || archive_entry_size(entry) > 0) {
+		while((ret = ra_data_block(ra, &buf, &size, &offset)) == ARCHIVE_OK) {
+			la_ssize_t written = archive_write_data_block(writer, buf, size, offset);
+			if(written < ARCHIVE_OK) {
+				ret = written < ARCHIVE_WARN ? ARCHIVE_WARN : (int)written;
+				ra_set_error(ra, archive_errno(writer), archive_error_string(writer));
+				break;
+			}
+		}
+		if(ret == ARCHIVE_EOF) {
+			ret = ARCHIVE_OK;
+		}
+	}
+	ret2 = archive_write_finish_entry(writer);
+	if(ret2 != ARCHIVE_OK) {
+		ra_set_error(ra, archive_errno(writer), archive_error_string(writer));
+	}
+	if(ret2 < ret || (ret2 != ARCHIVE_OK && ret == ARCHIVE_OK)) {
+		ret = ret2;
+	}
+	return ret;
+}
+
+/** The error number of the last failure. */
+int _alpm_readahead_errno(alpm_readahead_t *ra)
+{
+	return ra->threaded ? ra->errnum : archive_errno(ra->archive);
+}
+
+/** The description of the last failure. */
+const char *_alpm_readahead_error_string(alpm_readahead_t *ra)
+{
+	return ra->threaded ? ra->errstr : archive_error_string(ra->archive);
+}
+
+/** Stop reading ahead and free the object, the archive is left to the caller.
+ * @param ra the read-ahead object
+ */
+void _alpm_readahead_free(alpm_readahead_t *ra)
+{
+	if(ra == NULL) {
+		return;
+	}
+	if(ra->threaded) {
+		size_t i;
+
+		pthread_mutex_lock(&ra->lock);
+		ra->stop = 1;
+		pthread_cond_signal(&ra->drained);
+		pthread_mutex_unlock(&ra->lock);
+		pthread_join(ra->thread, NULL);
+
+		for(i = 0; i < ra->count; i++) {
+			struct ra_slot *slot = ra->ring + (ra->head + i) % READAHEAD_SLOTS;
+			archive_entry_free(slot->entry);
+			free(slot->data);
+			free(slot->errstr);
+		}
+	}
+	archive_entry_free(ra->entry);
+	free(ra->block);
+	free(ra->errstr);
+	pthread_cond_destroy(&ra->filled);
+	pthread_cond_destroy(&ra->drained);
+	pthread_mutex_destroy(&ra->lock);
+	free(ra);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef ALPM_READAHEAD_H
+#define ALPM_READAHEAD_H
+
+#include <stdint.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "alpm.h"
+
+typedef struct _alpm_readahead_t alpm_readahead_t;
+
+alpm_readahead_t *_alpm_readahead_new(alpm_handle_t *handle, struct archive *archive,
+		int threaded);
+int _alpm_readahead_next_header(alpm_readahead_t *ra, struct archive_entry **entry,
+		int64_t *pos);
+int _alpm_readahead_data_skip(alpm_readahead_t *ra);
+int _alpm_readahead_extract(alpm_readahead_t *ra, struct archive_entry *entry,
+		struct archive *writer);
+int _alpm_readahead_errno(alpm_readahead_t *ra);
+const char *_alpm_readahead_error_string(alpm_readahead_t *ra);
+void _alpm_readahead_free(alpm_readahead_t *ra);
+
+#endif /* ALPM_READAHEAD_H */
@@ -538,7 +538,7 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 						free(newpath);
 						return -1;
 					}
-					EVENT(handle, &event);
+					_alpm_log_pacsave(handle, &event);
 					alpm_logaction(handle, ALPM_CALLER_PREFIX,
 							"warning: %s saved as %s\n", file, newpath);
 					free(newpath);
@@ -698,6 +698,7 @@ int _alpm_remove_single_package(alpm_handle_t *handle,
 
 	if(!(handle->trans->flags & ALPM_TRANS_FLAG_DBONLY)) {
 		/* TODO check returned errors if any */
+		_alpm_trans_check_libs(handle, oldpkg);
 		remove_package_files(handle, oldpkg, newpkg, targ_count, pkg_count);
 	}
 
@@ -739,12 +740,14 @@ int _alpm_remove_single_package(alpm_handle_t *handle,
 /**
  * @brief Remove packages in the current transaction.
  *
+ * ldconfig, if needed, is run at the end of the commit by
+ * _alpm_trans_run_deferred().
+ *
  * @param handle the context handle
- * @param run_ldconfig whether to run ld_config after removing the packages
  *
  * @return 0 on success, -1 if errors occurred while removing files
  */
-int _alpm_remove_packages(alpm_handle_t *handle, int run_ldconfig)
+int _alpm_remove_packages(alpm_handle_t *handle)
 {
 	alpm_list_t *targ;
 	size_t pkg_count, targ_count;
@@ -764,17 +767,15 @@ int _alpm_remove_packages(alpm_handle_t *handle, int run_ldconfig)
 		if(_alpm_remove_single_package(handle, pkg, NULL,
 					targ_count, pkg_count) == -1) {
 			handle->pm_errno = ALPM_ERR_TRANS_ABORT;
-			/* running ldconfig at this point could possibly screw system */
-			run_ldconfig = 0;
 			ret = -1;
 		}
 
 		targ_count++;
 	}
 
-	if(run_ldconfig) {
-		/* run ldconfig if it exists */
-		_alpm_ldconfig(handle);
+	if(trans->add == NULL) {
+		/* a sync transaction flushes the database after installing */
+		_alpm_local_db_sync(handle->db_local);
 	}
 
 	return ret;
@@ -12,7 +12,7 @@
 #include "trans.h"
 
 int _alpm_remove_prepare(alpm_handle_t *handle, alpm_list_t **data);
-int _alpm_remove_packages(alpm_handle_t *handle, int run_ldconfig);
+int _alpm_remove_packages(alpm_handle_t *handle);
 
 int _alpm_remove_single_package(alpm_handle_t *handle,
 		alpm_pkg_t *oldpkg, alpm_pkg_t *newpkg,
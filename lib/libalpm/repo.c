@@ -0,0 +1,1493 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* Writer for the sync databases served by a repository.
+ *
+ * The entries of the existing "<repo>.db.<ext>" are indexed by package name
+ * when it is opened; only their name, version and file name are kept. Added
+ * packages are loaded once, the digest being computed from the same read,
+ * and their desc and files entries are built in memory. On commit the old
+ * database and files database are streamed entry by entry into new archives,
+ * leaving out the replaced and removed packages, and the new entries are
+ * appended before the result is rotated into place like dulge-repo-add does.
+ *
+ * With ALPM_REPO_FLAG_SEEKABLE the databases are written in the indexed
+ * layout described in be_sync.c: the tar output is cut after every package
+ * directory and each piece compressed on its own, then the index of the
+ * pieces is appended.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libarchive */
+#include <archive.h>
+#include <archive_entry.h>
+
+/* libalpm */
+#include "alpm.h"
+#include "alpm_list.h"
+#include "base64.h"
+#include "deps.h"
+#include "filelist.h"
+#include "handle.h"
+#include "libarchive-compat.h"
+#include "log.h"
+#include "package.h"
+#include "util.h"
+#include "vector.h"
+#include "util-common.h"
+
+/* largest detached signature dulge-repo-add accepts */
+#define REPO_MAX_SIGSIZE 16384
+
+struct repo_entry {
+	char *name;
+	char *version;
+	char *filename;
+	/* directories of this package in the old databases */
+	alpm_list_t *olddirs;
+	/* entries written on commit, NULL if there is nothing new to write */
+	char *desc;
+	char *files;
+	/* mtime of the new entries, so that rebuilding gives the same archive */
+	time_t builddate;
+	int removed;
+};
+
+struct _alpm_repo_t {
+	alpm_handle_t *handle;
+	int flags;
+	/* directory of the databases, with a trailing slash */
+	char *dir;
+	/* "<repo>" and "<ext>" of "<repo>.db.<ext>" */
+	char *prefix;
+	char *suffix;
+	char *lockfile;
+	/* every struct repo_entry, indexed by name */
+	alpm_vector_t entries;
+	alpm_strset_t names;
+	/* directories of the old databases left out on commit */
+	alpm_strset_t dropped;
+	/* package files deleted on commit */
+	alpm_list_t *oldfiles;
+	/* threads to load packages and compress the databases with */
+	unsigned int jobs;
+	int modified;
+};
+
+static const struct {
+	const char *ext;
+	const char *filter;
+} repo_filters[] = {
+	{ "tar", NULL },
+	{ "tar.gz", "gzip" },
+	{ "tar.bz2", "bzip2" },
+	{ "tar.xz", "xz" },
+	{ "tar.zst", "zstd" },
+	{ "tar.lrz", "lrzip" },
+	{ "tar.lzo", "lzop" },
+	{ "tar.Z", "compress" },
+	{ "tar.lz4", "lz4" },
+	{ "tar.lz", "lzip" },
+};
+
+static void repo_entry_free(struct repo_entry *entry)
+{
+	free(entry->name);
+	free(entry->version);
+	free(entry->filename);
+	FREELIST(entry->olddirs);
+	free(entry->desc);
+	free(entry->files);
+	free(entry);
+}
+
+static int repo_find_filter(const char *suffix, const char **filter)
+{
+	size_t i;
+	for(i = 0; i < ARRAYSIZE(repo_filters); i++) {
+		if(strcmp(suffix, repo_filters[i].ext) == 0) {
+			*filter = repo_filters[i].filter;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static char *repo_path(alpm_repo_t *repo, const char *pre, const char *db,
+		const char *post)
+{
+	char *path;
+	if(asprintf(&path, "%s%s%s.%s.%s%s", repo->dir, pre, repo->prefix, db,
+				repo->suffix, post) == -1) {
+		_alpm_alloc_fail(0);
+		return NULL;
+	}
+	return path;
+}
+
+/* value of a single-line field of a desc entry */
+static char *desc_field(const char *desc, const char *field)
+{
+	size_t len = strlen(field);
+	const char *line = desc, *end;
+	char *value;
+
+	while(line && *line) {
+		if(strncmp(line, field, len) == 0 && line[len] == '\n') {
+			line += len + 1;
+			end = strchr(line, '\n');
+			len = end ? (size_t)(end - line) : strlen(line);
+			STRNDUP(value, line, len, return NULL);
+			return value;
+		}
+		line = strchr(line, '\n');
+		if(line) {
+			line++;
+		}
+	}
+	return NULL;
+}
+
+static struct repo_entry *repo_lookup(alpm_repo_t *repo, const char *name)
+{
+	struct repo_entry *entry = _alpm_strset_get(&repo->names, name);
+	return entry && !entry->removed ? entry : NULL;
+}
+
+static struct repo_entry *repo_entry_get(alpm_repo_t *repo, const char *name)
+{
+	struct repo_entry *entry = _alpm_strset_get(&repo->names, name);
+
+	if(entry) {
+		return entry;
+	}
+	CALLOC(entry, 1, sizeof(struct repo_entry), return NULL);
+	STRDUP(entry->name, name, free(entry); return NULL);
+	if(_alpm_vector_push(&repo->entries, entry) != 0) {
+		repo_entry_free(entry);
+		return NULL;
+	}
+	_alpm_strset_add(&repo->names, entry->name, entry);
+	return entry;
+}
+
+/* leave the directories of the old databases out of the next commit */
+static int repo_entry_drop(alpm_repo_t *repo, struct repo_entry *entry)
+{
+	alpm_list_t *i;
+
+	/* the set takes over the names */
+	for(i = entry->olddirs; i; i = i->next) {
+		switch(_alpm_strset_add(&repo->dropped, i->data, i->data)) {
+			case 1:
+				i->data = NULL;
+				break;
+			case -1:
+				return -1;
+		}
+	}
+	FREELIST(entry->olddirs);
+	FREE(entry->desc);
+	FREE(entry->files);
+	return 0;
+}
+
+static int repo_queue_oldfile(alpm_repo_t *repo, const char *dir,
+		struct repo_entry *entry)
+{
+	char *path, *sigpath;
+
+	if(!(repo->flags & ALPM_REPO_FLAG_REMOVEOLD) || entry->filename == NULL) {
+		return 0;
+	}
+	if(asprintf(&path, "%s%s", dir, entry->filename) == -1) {
+		return -1;
+	}
+	if(asprintf(&sigpath, "%s.sig", path) == -1) {
+		free(path);
+		return -1;
+	}
+	repo->oldfiles = alpm_list_add(repo->oldfiles, path);
+	repo->oldfiles = alpm_list_add(repo->oldfiles, sigpath);
+	return 0;
+}
+
+static int repo_read_entry(struct archive *archive, char **data)
+{
+	size_t size = 0, len = 0;
+	char *buf = NULL;
+	ssize_t n;
+
+	do {
+		if(size - len < ALPM_BUFFER_SIZE + 1) {
+			size += ALPM_BUFFER_SIZE * 2;
+			REALLOC(buf, size, return -1);
+		}
+		n = archive_read_data(archive, buf + len, size - len - 1);
+		if(n < 0) {
+			free(buf);
+			return -1;
+		}
+		len += n;
+	} while(n > 0);
+	buf[len] = '\0';
+	*data = buf;
+	return 0;
+}
+
+/* index the entries of the old sync database */
+static int repo_load(alpm_repo_t *repo, const char *dbfile)
+{
+	alpm_handle_t *handle = repo->handle;
+	struct archive *archive;
+	struct archive_entry *ae;
+	struct stat st;
+	int fd, ret, entries = 0, descs = 0;
+
+	fd = _alpm_open_archive(handle, dbfile, &st, &archive, ALPM_ERR_DB_OPEN);
+	if(fd < 0) {
+		return -1;
+	}
+
+	while((ret = archive_read_next_header(archive, &ae)) == ARCHIVE_OK) {
+		const char *path = archive_entry_pathname(ae);
+		const char *slash = strchr(path, '/');
+		struct repo_entry *entry;
+		char *desc, *name, *dirname;
+
+		entries++;
+		if(slash == NULL || strcmp(slash, "/desc") != 0) {
+			continue;
+		}
+		descs++;
+		if(repo_read_entry(archive, &desc) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+					dbfile, archive_error_string(archive));
+			GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
+		}
+		name = desc_field(desc, "%NAME%");
+		if(name == NULL || (entry = repo_entry_get(repo, name)) == NULL) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("%s database is inconsistent: name "
+						"mismatch on package %s\n"), repo->prefix, path);
+			free(name);
+			free(desc);
+			GOTO_ERR(handle, ALPM_ERR_DB_INVALID, error);
+		}
+		free(name);
+		if(entry->version == NULL) {
+			entry->version = desc_field(desc, "%VERSION%");
+			entry->filename = desc_field(desc, "%FILENAME%");
+		}
+		free(desc);
+		if(entry->version == NULL) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("%s database is inconsistent: version "
+						"mismatch on package %s\n"), repo->prefix, path);
+			GOTO_ERR(handle, ALPM_ERR_DB_INVALID, error);
+		}
+		STRNDUP(dirname, path, slash - path, GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+		entry->olddirs = alpm_list_add(entry->olddirs, dirname);
+	}
+	if(ret != ARCHIVE_EOF) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+				dbfile, archive_error_string(archive));
+		GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
+	}
+	if(entries && !descs) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("Repository file '%s' is not a proper dulge database.\n"), dbfile);
+		GOTO_ERR(handle, ALPM_ERR_DB_INVALID, error);
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "indexed %zu packages of %s\n",
+			repo->names.count, dbfile);
+	_alpm_archive_read_free(archive);
+	close(fd);
+	return 0;
+
+error:
+	_alpm_archive_read_free(archive);
+	close(fd);
+	return -1;
+}
+
+alpm_repo_t SYMEXPORT *alpm_repo_open(alpm_handle_t *handle, const char *dbfile, int flags)
+{
+	alpm_repo_t *repo;
+	const char *base, *ext, *filter;
+	char pid[32];
+	int fd;
+	ssize_t len;
+
+	CHECK_HANDLE(handle, return NULL);
+	ASSERT(dbfile != NULL, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL));
+
+	base = mbasename(dbfile);
+	ext = strstr(base, ".db.");
+	if(ext == NULL || ext == base || repo_find_filter(ext + 4, &filter) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("'%s' does not have a valid database archive extension.\n"), dbfile);
+		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL);
+	}
+
+	if(flags & ALPM_REPO_FLAG_SEEKABLE && (filter == NULL
+				|| (strcmp(filter, "gzip") != 0 && strcmp(filter, "zstd") != 0))) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("seekable databases must be compressed with gzip or zstd: %s\n"), dbfile);
+		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL);
+	}
+
+	CALLOC(repo, 1, sizeof(alpm_repo_t), RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	repo->handle = handle;
+	repo->flags = flags;
+	repo->jobs = 1;
+	STRNDUP(repo->dir, dbfile, base - dbfile, goto mem_error);
+	if(*repo->dir == '\0') {
+		free(repo->dir);
+		STRDUP(repo->dir, "./", goto mem_error);
+	}
+	STRNDUP(repo->prefix, base, ext - base, goto mem_error);
+	STRDUP(repo->suffix, ext + 4, goto mem_error);
+	if(asprintf(&repo->lockfile, "%s.lck", dbfile) == -1) {
+		repo->lockfile = NULL;
+		goto mem_error;
+	}
+
+	fd = open(repo->lockfile, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("Failed to acquire lockfile: %s.\n"),
+				repo->lockfile);
+		FREE(repo->lockfile);
+		alpm_repo_free(repo);
+		RET_ERR(handle, ALPM_ERR_HANDLE_LOCK, NULL);
+	}
+	len = snprintf(pid, sizeof(pid), "%ld\n", (long)getpid());
+	if(write(fd, pid, len) != len) {
+		_alpm_log(handle, ALPM_LOG_WARNING, _("could not write lock file %s: %s\n"),
+				repo->lockfile, strerror(errno));
+	}
+	close(fd);
+
+	if(access(dbfile, F_OK) == 0) {
+		if(repo_load(repo, dbfile) != 0) {
+			alpm_repo_free(repo);
+			return NULL;
+		}
+	} else if(errno == ENOENT) {
+		/* a commit creates the database even if it stays empty */
+		repo->modified = 1;
+	} else {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				dbfile, strerror(errno));
+		alpm_repo_free(repo);
+		RET_ERR(handle, ALPM_ERR_DB_OPEN, NULL);
+	}
+
+	return repo;
+
+mem_error:
+	alpm_repo_free(repo);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+}
+
+static void write_field(FILE *fp, const char *header, const char *value)
+{
+	if(value == NULL || *value == '\0') {
+		return;
+	}
+	fprintf(fp, "%%%s%%\n%s\n\n", header, value);
+}
+
+static void write_list(FILE *fp, const char *header, alpm_list_t *list)
+{
+	alpm_list_t *i;
+	if(list == NULL) {
+		return;
+	}
+	fprintf(fp, "%%%s%%\n", header);
+	for(i = list; i; i = i->next) {
+		fprintf(fp, "%s\n", (char *)i->data);
+	}
+	fputc('\n', fp);
+}
+
+static void write_deps(FILE *fp, const char *header, alpm_list_t *deplist)
+{
+	alpm_list_t *i;
+	if(deplist == NULL) {
+		return;
+	}
+	fprintf(fp, "%%%s%%\n", header);
+	for(i = deplist; i; i = i->next) {
+		char *depstring = alpm_dep_compute_string(i->data);
+		fprintf(fp, "%s\n", depstring);
+		free(depstring);
+	}
+	fputc('\n', fp);
+}
+
+/* the desc entry, in the field order of dulge-repo-add */
+static char *repo_format_desc(alpm_pkg_t *pkg, const char *filename,
+		const char *sha256sum, const char *pgpsig)
+{
+	char *desc = NULL;
+	size_t size;
+	FILE *fp;
+
+	if((fp = open_memstream(&desc, &size)) == NULL) {
+		return NULL;
+	}
+	write_field(fp, "FILENAME", filename);
+	write_field(fp, "NAME", pkg->name);
+	write_field(fp, "BASE", pkg->base);
+	write_field(fp, "VERSION", pkg->version);
+	write_field(fp, "DESC", pkg->desc);
+	write_list(fp, "GROUPS", pkg->groups);
+	fprintf(fp, "%%CSIZE%%\n%jd\n\n", (intmax_t)pkg->size);
+	fprintf(fp, "%%ISIZE%%\n%jd\n\n", (intmax_t)pkg->isize);
+	write_field(fp, "SHA256SUM", sha256sum);
+	write_field(fp, "PGPSIG", pgpsig);
+	write_field(fp, "URL", pkg->url);
+	write_list(fp, "LICENSE", pkg->licenses);
+	write_field(fp, "ARCH", pkg->arch);
+	if(pkg->builddate) {
+		fprintf(fp, "%%BUILDDATE%%\n%jd\n\n", (intmax_t)pkg->builddate);
+	}
+	write_field(fp, "PACKAGER", pkg->packager);
+	write_deps(fp, "REPLACES", pkg->replaces);
+	write_deps(fp, "CONFLICTS", pkg->conflicts);
+	write_deps(fp, "PROVIDES", pkg->provides);
+	write_deps(fp, "DEPENDS", pkg->depends);
+	write_deps(fp, "OPTDEPENDS", pkg->optdepends);
+	write_deps(fp, "MAKEDEPENDS", pkg->makedepends);
+	write_deps(fp, "CHECKDEPENDS", pkg->checkdepends);
+	if(fclose(fp) != 0) {
+		free(desc);
+		return NULL;
+	}
+	return desc;
+}
+
+/* the files entry, the loader already sorted the file list */
+static char *repo_format_files(alpm_pkg_t *pkg)
+{
+	char *files = NULL;
+	size_t size, i;
+	FILE *fp;
+
+	if((fp = open_memstream(&files, &size)) == NULL) {
+		return NULL;
+	}
+	fputs("%FILES%\n", fp);
+	for(i = 0; i < pkg->files.count; i++) {
+		fprintf(fp, "%s\n", pkg->files.files[i].name);
+	}
+	if(fclose(fp) != 0) {
+		free(files);
+		return NULL;
+	}
+	return files;
+}
+
+static int repo_read_sig(alpm_repo_t *repo, const char *pkgfile, char **pgpsig)
+{
+	alpm_handle_t *handle = repo->handle;
+	unsigned char *sig = NULL;
+	size_t siglen, len = 0;
+	char *sigpath;
+	alpm_errno_t err;
+
+	*pgpsig = NULL;
+	if(asprintf(&sigpath, "%s.sig", pkgfile) == -1) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	if(access(sigpath, F_OK) != 0) {
+		free(sigpath);
+		return 0;
+	}
+	if((err = _alpm_read_file(sigpath, &sig, &siglen)) != ALPM_ERR_OK) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				sigpath, strerror(errno));
+		free(sigpath);
+		RET_ERR(handle, err, -1);
+	}
+	if(siglen > REPO_MAX_SIGSIZE) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("Invalid package signature file '%s'.\n"), sigpath);
+		goto sig_error;
+	}
+	if(siglen >= 5 && memcmp(sig, "-----", 5) == 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("Cannot use armored signatures for packages: %s\n"), sigpath);
+		goto sig_error;
+	}
+
+	base64_encode(NULL, &len, sig, siglen);
+	MALLOC(*pgpsig, len, free(sig); free(sigpath); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	base64_encode((unsigned char *)*pgpsig, &len, sig, siglen);
+	free(sig);
+	free(sigpath);
+	return 0;
+
+sig_error:
+	free(sig);
+	free(sigpath);
+	RET_ERR(handle, ALPM_ERR_SIG_INVALID, -1);
+}
+
+/* everything alpm_repo_add() needs from a package file, gathered without
+ * touching the repository so that many files can be loaded at once */
+struct repo_pkg {
+	const char *pkgfile;
+	char *name;
+	char *version;
+	char *filename;
+	char *desc;
+	char *files;
+	time_t builddate;
+	int loaded;
+	/* messages and errors of the load, see _alpm_log_capture() */
+	alpm_list_t *output;
+};
+
+static void repo_pkg_free(struct repo_pkg *rpkg)
+{
+	free(rpkg->name);
+	free(rpkg->version);
+	free(rpkg->filename);
+	free(rpkg->desc);
+	free(rpkg->files);
+}
+
+/* Load a package file and build its entries. Only reads repo->flags and
+ * the handle, so it can run in several threads at once as long as their
+ * output is captured. */
+static int repo_pkg_load(alpm_repo_t *repo, struct repo_pkg *rpkg)
+{
+	alpm_handle_t *handle = repo->handle;
+	alpm_pkg_t *pkg = NULL;
+	char *sha256sum = NULL, *pgpsig = NULL;
+	int ret = -1;
+
+#if defined HAVE_LIBSSL || defined HAVE_LIBNETTLE
+	pkg = _alpm_pkg_load_digest(handle, rpkg->pkgfile, 1, &sha256sum);
+#else
+	_alpm_log(handle, ALPM_LOG_ERROR, _("no SHA-256 support to add %s\n"), rpkg->pkgfile);
+	RET_ERR(handle, ALPM_ERR_MISSING_CAPABILITY_SIGNATURES, -1);
+#endif
+	if(pkg == NULL) {
+		return -1;
+	}
+
+	if((repo->flags & ALPM_REPO_FLAG_INCLUDESIGS)
+			&& repo_read_sig(repo, rpkg->pkgfile, &pgpsig) != 0) {
+		goto cleanup;
+	}
+
+	STRDUP(rpkg->name, pkg->name, GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup));
+	STRDUP(rpkg->version, pkg->version, GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup));
+	STRDUP(rpkg->filename, mbasename(rpkg->pkgfile),
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup));
+	rpkg->builddate = (time_t)pkg->builddate;
+	if((rpkg->desc = repo_format_desc(pkg, rpkg->filename, sha256sum, pgpsig)) == NULL
+			|| (rpkg->files = repo_format_files(pkg)) == NULL) {
+		GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup);
+	}
+	rpkg->loaded = 1;
+	ret = 0;
+
+cleanup:
+	/* only the formatted entries are kept, not the file lists */
+	_alpm_pkg_free(pkg);
+	free(sha256sum);
+	free(pgpsig);
+	return ret;
+}
+
+/* Replace the entry of a loaded package, honouring the repository flags.
+ * Takes over the strings of rpkg on success. */
+static int repo_pkg_insert(alpm_repo_t *repo, struct repo_pkg *rpkg)
+{
+	alpm_handle_t *handle = repo->handle;
+	struct repo_entry *entry = repo_lookup(repo, rpkg->name);
+	const char *base = mbasename(rpkg->pkgfile);
+	char *pkgdir;
+	int ret;
+
+	if(entry && strcmp(entry->version, rpkg->version) == 0) {
+		_alpm_log(handle, ALPM_LOG_WARNING, _("An entry for '%s' already existed\n"),
+				rpkg->pkgfile);
+		if(repo->flags & ALPM_REPO_FLAG_NEWONLY) {
+			return 1;
+		}
+	} else if(entry) {
+		if(alpm_pkg_vercmp(entry->version, rpkg->version) > 0) {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("A newer version for '%s' is already present in database\n"),
+					rpkg->name);
+			if(repo->flags & ALPM_REPO_FLAG_NODOWNGRADE) {
+				return 1;
+			}
+		}
+		if(entry->filename && strcmp(entry->filename, rpkg->filename) != 0) {
+			STRNDUP(pkgdir, rpkg->pkgfile, base - rpkg->pkgfile,
+					RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+			ret = repo_queue_oldfile(repo, *pkgdir ? pkgdir : "./", entry);
+			free(pkgdir);
+			if(ret != 0) {
+				RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+			}
+		}
+	}
+
+	if(entry == NULL && (entry = repo_entry_get(repo, rpkg->name)) == NULL) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	if(repo_entry_drop(repo, entry) != 0) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+
+	free(entry->version);
+	free(entry->filename);
+	entry->version = rpkg->version;
+	entry->filename = rpkg->filename;
+	entry->desc = rpkg->desc;
+	entry->files = rpkg->files;
+	entry->builddate = rpkg->builddate;
+	entry->removed = 0;
+	rpkg->version = rpkg->filename = rpkg->desc = rpkg->files = NULL;
+	repo->modified = 1;
+	return 0;
+}
+
+int SYMEXPORT alpm_repo_add(alpm_repo_t *repo, const char *pkgfile)
+{
+	struct repo_pkg rpkg = { 0 };
+	int ret = -1;
+
+	ASSERT(repo != NULL, return -1);
+	CHECK_HANDLE(repo->handle, return -1);
+	ASSERT(pkgfile != NULL, RET_ERR(repo->handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	rpkg.pkgfile = pkgfile;
+	if(repo_pkg_load(repo, &rpkg) == 0) {
+		ret = repo_pkg_insert(repo, &rpkg);
+	}
+	repo_pkg_free(&rpkg);
+	return ret;
+}
+
+struct repo_pool {
+	alpm_repo_t *repo;
+	struct repo_pkg *rpkgs;
+	size_t count;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+static void *repo_load_worker(void *data)
+{
+	struct repo_pool *pool = data;
+
+	for(;;) {
+		size_t index;
+
+		pthread_mutex_lock(&pool->lock);
+		index = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if(index >= pool->count) {
+			break;
+		}
+		/* reported in order by the calling thread once all are loaded */
+		_alpm_log_capture(&pool->rpkgs[index].output);
+		repo_pkg_load(pool->repo, pool->rpkgs + index);
+		_alpm_log_capture(NULL);
+	}
+	return NULL;
+}
+
+int SYMEXPORT alpm_repo_add_list(alpm_repo_t *repo, alpm_list_t *pkgfiles)
+{
+	alpm_handle_t *handle;
+	struct repo_pool pool;
+	pthread_t *threads = NULL;
+	size_t nthreads, started = 0, i;
+	alpm_list_t *j;
+	int ret = 0;
+
+	ASSERT(repo != NULL, return -1);
+	handle = repo->handle;
+	CHECK_HANDLE(handle, return -1);
+
+	pool.repo = repo;
+	pool.count = alpm_list_count(pkgfiles);
+	pool.next = 0;
+	if(pool.count == 0) {
+		return 0;
+	}
+	CALLOC(pool.rpkgs, pool.count, sizeof(struct repo_pkg),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = 0, j = pkgfiles; j; i++, j = j->next) {
+		pool.rpkgs[i].pkgfile = j->data;
+	}
+
+	pthread_mutex_init(&pool.lock, NULL);
+	nthreads = repo->jobs < pool.count ? repo->jobs : pool.count;
+	if(nthreads > 1) {
+		CALLOC(threads, nthreads - 1, sizeof(pthread_t), nthreads = 1);
+	}
+	for(i = 0; i + 1 < nthreads; i++) {
+		if(pthread_create(threads + i, NULL, repo_load_worker, &pool) != 0) {
+			break;
+		}
+		started++;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "loading %zu packages with %zu threads\n",
+			pool.count, started + 1);
+	repo_load_worker(&pool);
+	for(i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&pool.lock);
+
+	/* entries are replaced in the order the files were given, as if they
+	 * had been added one by one */
+	for(i = 0; i < pool.count; i++) {
+		struct repo_pkg *rpkg = pool.rpkgs + i;
+		_alpm_log_replay(handle, rpkg->output);
+		rpkg->output = NULL;
+		if(!rpkg->loaded || repo_pkg_insert(repo, rpkg) < 0) {
+			ret = -1;
+		}
+		repo_pkg_free(rpkg);
+	}
+	free(pool.rpkgs);
+	return ret;
+}
+
+int SYMEXPORT alpm_repo_remove(alpm_repo_t *repo, const char *pkgname)
+{
+	alpm_handle_t *handle;
+	struct repo_entry *entry;
+
+	ASSERT(repo != NULL, return -1);
+	handle = repo->handle;
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(pkgname != NULL, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	if((entry = repo_lookup(repo, pkgname)) == NULL) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("Package matching '%s' not found.\n"), pkgname);
+		RET_ERR(handle, ALPM_ERR_PKG_NOT_FOUND, -1);
+	}
+	if(repo_queue_oldfile(repo, repo->dir, entry) != 0
+			|| repo_entry_drop(repo, entry) != 0) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	entry->removed = 1;
+	repo->modified = 1;
+	return 0;
+}
+
+/* Format the name of a database member into path, PATH_MAX bytes. Returns
+ * -1 if it doesn't fit. */
+__attribute__((format(printf, 2, 3)))
+static int repo_member_name(char *path, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(path, PATH_MAX, fmt, args);
+	va_end(args);
+	return len < 0 || len >= PATH_MAX ? -1 : 0;
+}
+
+static int repo_write_data(struct archive *archive, const char *path,
+		const char *data, time_t mtime)
+{
+	struct archive_entry *ae = archive_entry_new();
+	size_t len = data ? strlen(data) : 0;
+	int ret = 0;
+
+	if(ae == NULL) {
+		return -1;
+	}
+	archive_entry_set_pathname(ae, path);
+	archive_entry_set_filetype(ae, data ? AE_IFREG : AE_IFDIR);
+	archive_entry_set_perm(ae, data ? 0644 : 0755);
+	archive_entry_set_size(ae, len);
+	archive_entry_set_mtime(ae, mtime, 0);
+	archive_entry_set_uname(ae, "root");
+	archive_entry_set_gname(ae, "root");
+	if(archive_write_header(archive, ae) != ARCHIVE_OK
+			|| (len && archive_write_data(archive, data, len) != (la_ssize_t)len)) {
+		ret = -1;
+	}
+	archive_entry_free(ae);
+	return ret;
+}
+
+/* output of a seekable database */
+struct repo_frames {
+	alpm_handle_t *handle;
+	const char *filter;
+	int fd;
+	/* bytes written to the file so far */
+	off_t offset;
+	/* uncompressed tar output since the last frame */
+	char *buf;
+	size_t len, size;
+	/* "<dir> <offset> <size>\n" of every package frame written */
+	char *index;
+	size_t indexlen, indexsize;
+	/* directories already in the index, owning their keys */
+	alpm_strset_t dirs;
+};
+
+static int repo_buf_append(char **buf, size_t *len, size_t *size,
+		const void *data, size_t n)
+{
+	if(*len + n > *size) {
+		size_t newsize = *size ? *size : 65536;
+		while(newsize < *len + n) {
+			newsize *= 2;
+		}
+		REALLOC(*buf, newsize, return -1);
+		*size = newsize;
+	}
+	memcpy(*buf + *len, data, n);
+	*len += n;
+	return 0;
+}
+
+static int repo_write_all(struct repo_frames *frames, const void *data, size_t len)
+{
+	const char *p = data;
+	while(len > 0) {
+		ssize_t n = write(frames->fd, p, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+		frames->offset += n;
+	}
+	return 0;
+}
+
+static la_ssize_t repo_tar_write(struct archive *archive, void *data,
+		const void *buf, size_t len)
+{
+	struct repo_frames *frames = data;
+	if(repo_buf_append(&frames->buf, &frames->len, &frames->size, buf, len) != 0) {
+		archive_set_error(archive, ENOMEM, "%s", strerror(ENOMEM));
+		return -1;
+	}
+	return len;
+}
+
+static la_ssize_t repo_frame_write(struct archive *archive, void *data,
+		const void *buf, size_t len)
+{
+	struct repo_frames *frames = data;
+	if(repo_write_all(frames, buf, len) != 0) {
+		archive_set_error(archive, errno, "%s", strerror(errno));
+		return -1;
+	}
+	return len;
+}
+
+/* compress the tar output collected so far as a frame of its own */
+static int repo_write_frame(struct repo_frames *frames)
+{
+	struct archive *archive = archive_write_new();
+	struct archive_entry *ae = archive_entry_new();
+	int ret = -1;
+
+	if(archive == NULL || ae == NULL) {
+		archive_entry_free(ae);
+		archive_write_free(archive);
+		RET_ERR(frames->handle, ALPM_ERR_MEMORY, -1);
+	}
+	archive_entry_set_filetype(ae, AE_IFREG);
+	archive_entry_set_size(ae, frames->len);
+	if(archive_write_set_format_raw(archive) == ARCHIVE_OK
+			&& archive_write_add_filter_by_name(archive, frames->filter) == ARCHIVE_OK
+			&& archive_write_set_bytes_per_block(archive, 0) == ARCHIVE_OK) {
+		if(strcmp(frames->filter, "gzip") == 0) {
+			/* like the mtime of the entries, a time in the gzip headers would
+			 * change the database whenever it is rewritten */
+			archive_write_set_filter_option(archive, "gzip", "timestamp", NULL);
+		}
+		if(archive_write_open(archive, frames, NULL, repo_frame_write, NULL) == ARCHIVE_OK
+				&& archive_write_header(archive, ae) == ARCHIVE_OK
+				&& archive_write_data(archive, frames->buf, frames->len) == (la_ssize_t)frames->len
+				&& archive_write_close(archive) == ARCHIVE_OK) {
+			ret = 0;
+		}
+	}
+	if(ret != 0) {
+		_alpm_log(frames->handle, ALPM_LOG_ERROR, _("could not compress db entries (%s)\n"),
+				archive_error_string(archive));
+		_alpm_set_errno(frames->handle, ALPM_ERR_DB_WRITE);
+	}
+	frames->len = 0;
+	archive_entry_free(ae);
+	archive_write_free(archive);
+	return ret;
+}
+
+/* close the frame of the package directory dir; entries are only flushed
+ * to the tar output when the next one starts, so finish the last one */
+static int repo_end_package(struct repo_frames *frames, struct archive *out,
+		const char *dir)
+{
+	char line[PATH_MAX + 64];
+	char *key;
+	off_t start;
+	int len;
+
+	if(frames == NULL) {
+		return 0;
+	}
+	if(archive_write_finish_entry(out) != ARCHIVE_OK) {
+		_alpm_log(frames->handle, ALPM_LOG_ERROR, _("could not write db entries (%s)\n"),
+				archive_error_string(out));
+		RET_ERR(frames->handle, ALPM_ERR_DB_WRITE, -1);
+	}
+	if(frames->len == 0) {
+		return 0;
+	}
+	STRDUP(key, dir, RET_ERR(frames->handle, ALPM_ERR_MEMORY, -1));
+	switch(_alpm_strset_add(&frames->dirs, key, key)) {
+		case 1:
+			break;
+		case 0:
+			_alpm_log(frames->handle, ALPM_LOG_ERROR,
+					_("entries of %s are not stored together, the database cannot be indexed\n"),
+					dir);
+			free(key);
+			RET_ERR(frames->handle, ALPM_ERR_DB_INVALID, -1);
+		default:
+			free(key);
+			RET_ERR(frames->handle, ALPM_ERR_MEMORY, -1);
+	}
+
+	start = frames->offset;
+	if(repo_write_frame(frames) != 0) {
+		return -1;
+	}
+	len = snprintf(line, sizeof(line), "%s %jd %jd\n", dir,
+			(intmax_t)start, (intmax_t)(frames->offset - start));
+	if(repo_buf_append(&frames->index, &frames->indexlen, &frames->indexsize,
+				line, len) != 0) {
+		RET_ERR(frames->handle, ALPM_ERR_MEMORY, -1);
+	}
+	return 0;
+}
+
+/* write the end of archive frame and the index after it */
+static int repo_write_index(struct repo_frames *frames)
+{
+	static const unsigned char gzip_head[10] = {
+		0x1f, 0x8b, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff
+	};
+	static const unsigned char gzip_tail[11] = { 0x00, 0x03, 0x00 };
+	char footer[ALPM_DBINDEX_FOOTER_SIZE + 1];
+	int gzip = strcmp(frames->filter, "gzip") == 0;
+
+	if(repo_write_frame(frames) != 0) {
+		return -1;
+	}
+	snprintf(footer, sizeof(footer), "%s%016jx", ALPM_DBINDEX_MAGIC,
+			(uintmax_t)frames->indexlen);
+	if(gzip) {
+		/* an empty member, the index is its comment */
+		if(repo_write_all(frames, gzip_head, sizeof(gzip_head)) != 0) {
+			return -1;
+		}
+	} else {
+		/* a skippable frame */
+		uint32_t framelen = frames->indexlen + ALPM_DBINDEX_FOOTER_SIZE;
+		unsigned char head[8] = {
+			0x5e, 0x2a, 0x4d, 0x18, framelen & 0xff, (framelen >> 8) & 0xff,
+			(framelen >> 16) & 0xff, (framelen >> 24) & 0xff
+		};
+		if(repo_write_all(frames, head, sizeof(head)) != 0) {
+			return -1;
+		}
+	}
+	if(repo_write_all(frames, frames->index, frames->indexlen) != 0
+			|| repo_write_all(frames, footer, ALPM_DBINDEX_FOOTER_SIZE) != 0
+			|| (gzip && repo_write_all(frames, gzip_tail, sizeof(gzip_tail)) != 0)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* copy the entries of an old database the repository still holds; frames
+ * is set when writing a seekable database */
+static int repo_copy_old(alpm_repo_t *repo, const char *dbfile, struct archive *out,
+		struct repo_frames *frames)
+{
+	alpm_handle_t *handle = repo->handle;
+	struct archive *archive;
+	struct archive_entry *ae;
+	struct stat st;
+	char *buf = NULL, curdir[PATH_MAX] = "";
+	int fd, ret;
+
+	if(access(dbfile, F_OK) != 0) {
+		return 0;
+	}
+	fd = _alpm_open_archive(handle, dbfile, &st, &archive, ALPM_ERR_DB_OPEN);
+	if(fd < 0) {
+		return -1;
+	}
+	MALLOC(buf, ALPM_BUFFER_SIZE, GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+
+	while((ret = archive_read_next_header(archive, &ae)) == ARCHIVE_OK) {
+		const char *path = archive_entry_pathname(ae);
+		size_t dirlen = strcspn(path, "/");
+		char dirname[PATH_MAX];
+		ssize_t n;
+
+		if(dirlen >= sizeof(dirname)) {
+			continue;
+		}
+		memcpy(dirname, path, dirlen);
+		dirname[dirlen] = '\0';
+		if(_alpm_strset_contains(&repo->dropped, dirname)) {
+			continue;
+		}
+		if(frames) {
+			/* every frame holds a single package directory */
+			if(path[dirlen] != '/' && archive_entry_filetype(ae) != AE_IFDIR) {
+				continue;
+			}
+			if(*curdir && strcmp(curdir, dirname) != 0
+					&& repo_end_package(frames, out, curdir) != 0) {
+				goto error;
+			}
+			strcpy(curdir, dirname);
+		}
+		if(archive_write_header(out, ae) != ARCHIVE_OK) {
+			goto write_error;
+		}
+		while((n = archive_read_data(archive, buf, ALPM_BUFFER_SIZE)) > 0) {
+			if(archive_write_data(out, buf, n) != n) {
+				goto write_error;
+			}
+		}
+		if(n < 0) {
+			ret = ARCHIVE_FATAL;
+			break;
+		}
+	}
+	if(ret != ARCHIVE_EOF) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+				dbfile, archive_error_string(archive));
+		GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
+	}
+	if(*curdir && repo_end_package(frames, out, curdir) != 0) {
+		goto error;
+	}
+
+	free(buf);
+	_alpm_archive_read_free(archive);
+	close(fd);
+	return 0;
+
+write_error:
+	_alpm_log(handle, ALPM_LOG_ERROR, _("could not write db '%s' (%s)\n"),
+			dbfile, archive_error_string(out));
+	_alpm_set_errno(handle, ALPM_ERR_DB_WRITE);
+error:
+	free(buf);
+	_alpm_archive_read_free(archive);
+	close(fd);
+	return -1;
+}
+
+struct repo_write {
+	alpm_repo_t *repo;
+	const char *db;
+	const char *dbfile;
+	const char *tmpfile;
+	/* new entries, sorted by name */
+	alpm_vector_t *added;
+	int withfiles;
+	int ret;
+	/* messages and errors of the job, see _alpm_log_capture() */
+	alpm_list_t *output;
+};
+
+static int repo_entry_cmp(const void *p1, const void *p2)
+{
+	const struct repo_entry *e1 = *(struct repo_entry * const *)p1;
+	const struct repo_entry *e2 = *(struct repo_entry * const *)p2;
+	return strcmp(e1->name, e2->name);
+}
+
+static void repo_set_threads(alpm_repo_t *repo, struct archive *out,
+		const char *filter)
+{
+	char threads[16];
+
+	/* only the zstd and xz filters can compress in several threads */
+	if(repo->jobs <= 1 || filter == NULL
+			|| (strcmp(filter, "zstd") != 0 && strcmp(filter, "xz") != 0)) {
+		return;
+	}
+	snprintf(threads, sizeof(threads), "%u", repo->jobs);
+	if(archive_write_set_filter_option(out, filter, "threads", threads) != ARCHIVE_OK) {
+		_alpm_log(repo->handle, ALPM_LOG_DEBUG,
+				"%s compression does not support threads: %s\n",
+				filter, archive_error_string(out));
+	}
+}
+
+/* write "<dir>.tmp.<repo>.<db>.<ext>", the old entries followed by the new
+ * ones */
+static void repo_write_db(struct repo_write *job)
+{
+	alpm_repo_t *repo = job->repo;
+	alpm_handle_t *handle = repo->handle;
+	struct archive *out;
+	struct repo_frames frames = { 0 }, *seekable = NULL;
+	const char *filter = NULL;
+	size_t i;
+
+	job->ret = -1;
+	repo_find_filter(repo->suffix, &filter);
+	if((out = archive_write_new()) == NULL) {
+		_alpm_set_errno(handle, ALPM_ERR_MEMORY);
+		return;
+	}
+	if(archive_write_set_format_pax_restricted(out) != ARCHIVE_OK) {
+		goto create_error;
+	}
+	if(repo->flags & ALPM_REPO_FLAG_SEEKABLE) {
+		/* plain tar output, compressed a package at a time */
+		seekable = &frames;
+		frames.handle = handle;
+		frames.filter = filter;
+		frames.fd = open(job->tmpfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(frames.fd < 0) {
+			archive_set_error(out, errno, "%s", strerror(errno));
+			goto create_error;
+		}
+		if(archive_write_set_bytes_per_block(out, 0) != ARCHIVE_OK
+				|| archive_write_open(out, &frames, NULL, repo_tar_write, NULL) != ARCHIVE_OK) {
+			goto create_error;
+		}
+	} else {
+		if(filter && archive_write_add_filter_by_name(out, filter) != ARCHIVE_OK) {
+			goto create_error;
+		}
+		if(filter && strcmp(filter, "gzip") == 0) {
+			/* no time in the gzip header, see repo_write_frame() */
+			archive_write_set_filter_option(out, "gzip", "timestamp", NULL);
+		}
+		repo_set_threads(repo, out, filter);
+		if(archive_write_open_filename(out, job->tmpfile) != ARCHIVE_OK) {
+			goto create_error;
+		}
+	}
+
+	if(repo_copy_old(repo, job->dbfile, out, seekable) != 0) {
+		goto error;
+	}
+
+	for(i = 0; i < job->added->count; i++) {
+		struct repo_entry *entry = job->added->data[i];
+		char dir[PATH_MAX], path[PATH_MAX];
+
+		if(repo_member_name(dir, "%s-%s", entry->name, entry->version) != 0
+				|| repo_member_name(path, "%s/", dir) != 0) {
+			goto name_error;
+		}
+		if(repo_write_data(out, path, NULL, entry->builddate) != 0) {
+			goto write_error;
+		}
+		if(repo_member_name(path, "%s/desc", dir) != 0) {
+			goto name_error;
+		}
+		if(repo_write_data(out, path, entry->desc, entry->builddate) != 0) {
+			goto write_error;
+		}
+		if(job->withfiles) {
+			if(repo_member_name(path, "%s/files", dir) != 0) {
+				goto name_error;
+			}
+			if(repo_write_data(out, path, entry->files, entry->builddate) != 0) {
+				goto write_error;
+			}
+		}
+		if(repo_end_package(seekable, out, dir) != 0) {
+			goto error;
+		}
+	}
+
+	if(archive_write_close(out) != ARCHIVE_OK) {
+		goto write_error;
+	}
+	if(seekable) {
+		if(repo_write_index(seekable) != 0) {
+			goto error;
+		}
+		if(close(frames.fd) != 0) {
+			frames.fd = -1;
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not write db '%s' (%s)\n"),
+					job->tmpfile, strerror(errno));
+			_alpm_set_errno(handle, ALPM_ERR_DB_WRITE);
+			goto error;
+		}
+		frames.fd = -1;
+	}
+	archive_write_free(out);
+	job->ret = 0;
+	goto cleanup;
+
+create_error:
+	_alpm_log(handle, ALPM_LOG_ERROR, _("could not create %s database %s (%s)\n"),
+			job->db, job->tmpfile, archive_error_string(out));
+	_alpm_set_errno(handle, ALPM_ERR_DB_WRITE);
+	archive_write_free(out);
+	if(seekable && frames.fd >= 0) {
+		unlink(job->tmpfile);
+	}
+	goto cleanup;
+
+name_error:
+	_alpm_log(handle, ALPM_LOG_ERROR, _("could not write db '%s' (%s)\n"),
+			job->tmpfile, strerror(ENAMETOOLONG));
+	_alpm_set_errno(handle, ALPM_ERR_SYSTEM);
+	goto error;
+
+write_error:
+	_alpm_log(handle, ALPM_LOG_ERROR, _("could not write db '%s' (%s)\n"),
+			job->tmpfile, archive_error_string(out));
+	_alpm_set_errno(handle, ALPM_ERR_DB_WRITE);
+error:
+	archive_write_free(out);
+	unlink(job->tmpfile);
+cleanup:
+	if(seekable) {
+		if(frames.fd >= 0) {
+			close(frames.fd);
+		}
+		free(frames.buf);
+		free(frames.index);
+		_alpm_strset_free(&frames.dirs, free);
+	}
+}
+
+/* run a repo_write job, possibly in its own thread; its output is passed on
+ * by the calling thread */
+static void *repo_write_job(void *data)
+{
+	struct repo_write *job = data;
+
+	_alpm_log_capture(&job->output);
+	repo_write_db(job);
+	_alpm_log_capture(NULL);
+	return NULL;
+}
+
+/* move the new database into place, keeping the previous one as .old */
+static int repo_rotate(alpm_repo_t *repo, const char *dbfile, const char *tmpfile)
+{
+	alpm_handle_t *handle = repo->handle;
+	char *old = NULL, *sig = NULL, *oldsig = NULL, *dblink = NULL, *linksig = NULL;
+	const char *tar;
+	int ret = -1;
+
+	if(asprintf(&old, "%s.old", dbfile) == -1
+			|| asprintf(&sig, "%s.sig", dbfile) == -1
+			|| asprintf(&oldsig, "%s.old.sig", dbfile) == -1) {
+		goto mem_error;
+	}
+	tar = strstr(mbasename(dbfile), ".tar");
+	STRNDUP(dblink, dbfile, tar - dbfile, goto mem_error);
+	if(asprintf(&linksig, "%s.sig", dblink) == -1) {
+		goto mem_error;
+	}
+
+	if(access(dbfile, F_OK) == 0) {
+		unlink(old);
+		if(link(dbfile, old) != 0 && rename(dbfile, old) != 0) {
+			_alpm_log(handle, ALPM_LOG_WARNING, _("could not rename %s to %s (%s)\n"),
+					dbfile, old, strerror(errno));
+		}
+		/* the signature does not match the new database */
+		if(rename(sig, oldsig) != 0) {
+			unlink(oldsig);
+		}
+	}
+	if(rename(tmpfile, dbfile) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not rename %s to %s (%s)\n"),
+				tmpfile, dbfile, strerror(errno));
+		unlink(tmpfile);
+		GOTO_ERR(handle, ALPM_ERR_DB_WRITE, cleanup);
+	}
+
+	unlink(dblink);
+	unlink(linksig);
+	if(symlink(mbasename(dbfile), dblink) != 0 && link(dbfile, dblink) != 0
+			&& _alpm_copyfile(dbfile, dblink) != 0) {
+		_alpm_log(handle, ALPM_LOG_WARNING, _("could not create %s (%s)\n"),
+				dblink, strerror(errno));
+	}
+	ret = 0;
+	goto cleanup;
+
+mem_error:
+	_alpm_set_errno(handle, ALPM_ERR_MEMORY);
+cleanup:
+	free(old);
+	free(sig);
+	free(oldsig);
+	free(dblink);
+	free(linksig);
+	return ret;
+}
+
+int SYMEXPORT alpm_repo_commit(alpm_repo_t *repo)
+{
+	alpm_handle_t *handle;
+	const char *dbs[] = { "db", "files" };
+	char *dbfile[2] = { NULL, NULL }, *tmpfile[2] = { NULL, NULL };
+	struct repo_write jobs[2];
+	alpm_vector_t added = { 0 };
+	pthread_t thread;
+	int threaded = 0, ret = -1;
+	alpm_list_t *i;
+	size_t j;
+
+	ASSERT(repo != NULL, return -1);
+	handle = repo->handle;
+	CHECK_HANDLE(handle, return -1);
+
+	if(!repo->modified) {
+		return 0;
+	}
+
+	for(j = 0; j < ARRAYSIZE(dbs); j++) {
+		if((dbfile[j] = repo_path(repo, "", dbs[j], "")) == NULL
+				|| (tmpfile[j] = repo_path(repo, ".tmp.", dbs[j], "")) == NULL) {
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup);
+		}
+	}
+
+	/* new entries go in by name, whatever order they were added in */
+	for(j = 0; j < repo->entries.count; j++) {
+		struct repo_entry *entry = repo->entries.data[j];
+		if(entry->desc && !entry->removed && _alpm_vector_push(&added, entry) != 0) {
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, cleanup);
+		}
+	}
+	if(added.count) {
+		qsort(added.data, added.count, sizeof(void *), repo_entry_cmp);
+	}
+
+	/* write both databases before touching either of them; the files
+	 * database is the larger one, give it a thread of its own if allowed */
+	for(j = 0; j < ARRAYSIZE(dbs); j++) {
+		jobs[j].repo = repo;
+		jobs[j].db = dbs[j];
+		jobs[j].dbfile = dbfile[j];
+		jobs[j].tmpfile = tmpfile[j];
+		jobs[j].added = &added;
+		jobs[j].withfiles = (j == 1);
+		jobs[j].ret = -1;
+		jobs[j].output = NULL;
+		_alpm_log(handle, ALPM_LOG_DEBUG, "writing %s\n", tmpfile[j]);
+	}
+	if(repo->jobs > 1 && pthread_create(&thread, NULL, repo_write_job, &jobs[1]) == 0) {
+		threaded = 1;
+	}
+	repo_write_job(&jobs[0]);
+	if(threaded) {
+		pthread_join(thread, NULL);
+	} else {
+		repo_write_job(&jobs[1]);
+	}
+	for(j = 0; j < ARRAYSIZE(dbs); j++) {
+		_alpm_log_replay(handle, jobs[j].output);
+	}
+	if(jobs[0].ret != 0 || jobs[1].ret != 0) {
+		for(j = 0; j < ARRAYSIZE(dbs); j++) {
+			unlink(tmpfile[j]);
+		}
+		goto cleanup;
+	}
+
+	for(j = 0; j < ARRAYSIZE(dbs); j++) {
+		if(repo_rotate(repo, dbfile[j], tmpfile[j]) != 0) {
+			goto cleanup;
+		}
+	}
+
+	for(i = repo->oldfiles; i; i = i->next) {
+		if(unlink(i->data) == 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "removed old package file %s\n",
+					(char *)i->data);
+		}
+	}
+	FREELIST(repo->oldfiles);
+	repo->modified = 0;
+	ret = 0;
+
+cleanup:
+	_alpm_vector_free(&added, NULL);
+	for(j = 0; j < ARRAYSIZE(dbs); j++) {
+		free(dbfile[j]);
+		free(tmpfile[j]);
+	}
+	return ret;
+}
+
+int SYMEXPORT alpm_repo_set_jobs(alpm_repo_t *repo, unsigned int jobs)
+{
+	ASSERT(repo != NULL, return -1);
+	CHECK_HANDLE(repo->handle, return -1);
+	ASSERT(jobs > 0, RET_ERR(repo->handle, ALPM_ERR_WRONG_ARGS, -1));
+	repo->jobs = jobs;
+	return 0;
+}
+
+void SYMEXPORT alpm_repo_free(alpm_repo_t *repo)
+{
+	if(repo == NULL) {
+		return;
+	}
+	if(repo->lockfile && unlink(repo->lockfile) != 0) {
+		_alpm_log(repo->handle, ALPM_LOG_WARNING,
+				_("could not remove lock file %s\n"), repo->lockfile);
+	}
+	_alpm_strset_free(&repo->names, NULL);
+	_alpm_strset_free(&repo->dropped, free);
+	_alpm_vector_free(&repo->entries, (alpm_list_fn_free)repo_entry_free);
+	FREELIST(repo->oldfiles);
+	free(repo->dir);
+	free(repo->prefix);
+	free(repo->suffix);
+	free(repo->lockfile);
+	free(repo);
+}
@@ -5,9 +5,11 @@
 
 
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #ifdef HAVE_LIBGPGME
 #include <locale.h> /* setlocale() */
@@ -188,6 +190,132 @@ gpg_error:
 	RET_ERR(handle, ALPM_ERR_GPGME, -1);
 }
 
+/* Result of looking up a key ID or fingerprint in our keychain. Lookups are
+ * case insensitive; an entry with known == -1 must be looked up again. */
+struct keycache_entry {
+	char *fpr;
+	int known;
+};
+
+struct _alpm_keycache_t {
+	size_t size;
+	size_t count;
+	struct keycache_entry *entries;
+};
+
+static unsigned long keycache_hash(const char *fpr)
+{
+	unsigned long hash = 0;
+	for(; *fpr; fpr++) {
+		hash = toupper((unsigned char)*fpr) + (hash << 6) + (hash << 16) - hash;
+	}
+	return hash;
+}
+
+static struct keycache_entry *keycache_slot(struct _alpm_keycache_t *cache,
+		const char *fpr)
+{
+	size_t pos = keycache_hash(fpr) % cache->size;
+	while(cache->entries[pos].fpr && strcasecmp(cache->entries[pos].fpr, fpr) != 0) {
+		pos = (pos + 1) % cache->size;
+	}
+	return cache->entries + pos;
+}
+
+static struct keycache_entry *keycache_find(alpm_handle_t *handle, const char *fpr)
+{
+	struct keycache_entry *entry;
+	if(handle->keycache == NULL) {
+		return NULL;
+	}
+	entry = keycache_slot(handle->keycache, fpr);
+	return entry->fpr ? entry : NULL;
+}
+
+static int keycache_set(alpm_handle_t *handle, const char *fpr, int known)
+{
+	struct _alpm_keycache_t *cache = handle->keycache;
+	struct keycache_entry *entry;
+
+	if(cache == NULL) {
+		CALLOC(cache, 1, sizeof(struct _alpm_keycache_t), return -1);
+		handle->keycache = cache;
+	}
+	/* keep the table at most half full */
+	if((cache->count + 1) * 2 > cache->size) {
+		struct keycache_entry *old = cache->entries;
+		size_t i, oldsize = cache->size;
+		size_t newsize = oldsize ? oldsize * 2 : 64;
+
+		CALLOC(cache->entries, newsize, sizeof(struct keycache_entry),
+				cache->entries = old; return -1);
+		cache->size = newsize;
+		for(i = 0; i < oldsize; i++) {
+			if(old[i].fpr) {
+				*keycache_slot(cache, old[i].fpr) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	entry = keycache_slot(cache, fpr);
+	if(entry->fpr == NULL) {
+		STRDUP(entry->fpr, fpr, return -1);
+		cache->count++;
+	}
+	entry->known = known;
+	return 0;
+}
+
+/**
+ * Get the GPGME context of the verification session, creating it if needed.
+ * The context is shared by all signature checks and key lookups until the
+ * transaction is released.
+ * @param handle the context handle
+ * @return the context, NULL on error
+ */
+static gpgme_ctx_t session_ctx(alpm_handle_t *handle)
+{
+	gpgme_error_t gpg_err;
+	gpgme_ctx_t ctx;
+
+	if(handle->gpgctx) {
+		return handle->gpgctx;
+	}
+	if(init_gpgme(handle)) {
+		/* pm_errno was set in gpgme_init() */
+		return NULL;
+	}
+	gpg_err = gpgme_new(&ctx);
+	if(gpg_err_code(gpg_err) != GPG_ERR_NO_ERROR) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("GPGME error: %s\n"), gpgme_strerror(gpg_err));
+		RET_ERR(handle, ALPM_ERR_GPGME, NULL);
+	}
+	handle->gpgctx = ctx;
+	return ctx;
+}
+
+/**
+ * End the verification session: release the shared GPGME context and
+ * forget every key lookup result.
+ * @param handle the context handle
+ */
+void _alpm_gpgme_session_end(alpm_handle_t *handle)
+{
+	if(handle->gpgctx) {
+		gpgme_release(handle->gpgctx);
+		handle->gpgctx = NULL;
+	}
+	if(handle->keycache) {
+		size_t i;
+		for(i = 0; i < handle->keycache->size; i++) {
+			free(handle->keycache->entries[i].fpr);
+		}
+		free(handle->keycache->entries);
+		FREE(handle->keycache);
+	}
+}
+
 /**
  * Determine if we have a key is known in our local keyring.
  * @param handle the context handle
@@ -197,23 +325,21 @@ gpg_error:
 int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 {
 	gpgme_error_t gpg_err;
-	gpgme_ctx_t ctx = {0};
-	gpgme_key_t key;
+	gpgme_ctx_t ctx;
+	gpgme_key_t key = NULL;
+	struct keycache_entry *entry;
 	int ret = -1;
 
-	if(alpm_list_find_str(handle->known_keys, fpr)) {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "key %s found in cache\n", fpr);
-		return 1;
+	if((entry = keycache_find(handle, fpr)) && entry->known >= 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "key %s found in cache (%s)\n", fpr,
+				entry->known ? "known" : "unknown");
+		return entry->known;
 	}
 
-	if(init_gpgme(handle)) {
-		/* pm_errno was set in gpgme_init() */
-		goto error;
+	if((ctx = session_ctx(handle)) == NULL) {
+		return -1;
 	}
 
-	gpg_err = gpgme_new(&ctx);
-	CHECK_ERR();
-
 	_alpm_log(handle, ALPM_LOG_DEBUG, "looking up key %s locally\n", fpr);
 
 	gpg_err = gpgme_get_key(ctx, fpr, &key, 0);
@@ -226,7 +352,6 @@ int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 			ret = 0;
 		} else {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup success, key exists\n");
-			handle->known_keys = alpm_list_add(handle->known_keys, strdup(fpr));
 			ret = 1;
 		}
 	} else {
@@ -234,10 +359,117 @@ int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 	}
 	gpgme_key_unref(key);
 
-gpg_error:
-	gpgme_release(ctx);
+	if(ret >= 0) {
+		keycache_set(handle, fpr, ret);
+	}
+	return ret;
+}
 
-error:
+static int key_matches(gpgme_key_t key, const char *fpr)
+{
+	size_t len = strlen(fpr);
+	gpgme_subkey_t subkey;
+
+	for(subkey = key->subkeys; subkey; subkey = subkey->next) {
+		size_t fprlen = subkey->fpr ? strlen(subkey->fpr) : 0;
+		/* long and short key IDs are suffixes of the fingerprint */
+		if(fprlen >= len && strcasecmp(subkey->fpr + fprlen - len, fpr) == 0) {
+			return 1;
+		}
+		if(subkey->keyid && strcasecmp(subkey->keyid, fpr) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Look up several keys in our local keyring with a single keylist operation
+ * and remember the results for _alpm_key_in_keychain().
+ * Keys that are already cached are skipped.
+ * @param handle the context handle
+ * @param fprs list of fingerprints or key IDs
+ * @return 0 on success, -1 on error; lookups that failed are simply not
+ * cached and will be retried one by one
+ */
+int _alpm_key_lookup_batch(alpm_handle_t *handle, alpm_list_t *fprs)
+{
+	gpgme_error_t gpg_err;
+	gpgme_ctx_t ctx;
+	gpgme_key_t key;
+	const char **patterns;
+	alpm_list_t *i;
+	size_t count = 0, n;
+	int ret = -1;
+
+	MALLOC(patterns, (alpm_list_count(fprs) + 1) * sizeof(char *),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = fprs; i; i = i->next) {
+		struct keycache_entry *entry = keycache_find(handle, i->data);
+		/* skip cached results and keys already queued (known == -2) */
+		if(entry && entry->known != -1) {
+			continue;
+		}
+		if(keycache_set(handle, i->data, -2) != 0) {
+			free(patterns);
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+		}
+		patterns[count++] = keycache_find(handle, i->data)->fpr;
+	}
+	patterns[count] = NULL;
+
+	if(count == 0) {
+		free(patterns);
+		return 0;
+	}
+	if((ctx = session_ctx(handle)) == NULL) {
+		free(patterns);
+		return -1;
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "looking up %zu keys locally\n", count);
+
+	gpg_err = gpgme_op_keylist_ext_start(ctx, patterns, 0, 0);
+	CHECK_ERR();
+	while((gpg_err = gpgme_op_keylist_next(ctx, &key)) == GPG_ERR_NO_ERROR) {
+		for(n = 0; n < count; n++) {
+			struct keycache_entry *entry = keycache_find(handle, patterns[n]);
+			if(entry->known != 1 && key_matches(key, patterns[n])) {
+				entry->known = key->expired ? 0 : 1;
+			}
+		}
+		gpgme_key_unref(key);
+	}
+	if(gpg_err_code(gpg_err) != GPG_ERR_EOF) {
+		goto gpg_error;
+	}
+
+	/* the keylist completed, anything not listed is not in the keyring */
+	for(n = 0; n < count; n++) {
+		struct keycache_entry *entry = keycache_find(handle, patterns[n]);
+		if(entry->known == -2) {
+			entry->known = 0;
+		}
+		_alpm_log(handle, ALPM_LOG_DEBUG, "key %s is %s\n", patterns[n],
+				entry->known ? "known" : "unknown");
+	}
+	gpg_err = GPG_ERR_NO_ERROR;
+	ret = 0;
+
+gpg_error:
+	gpgme_op_keylist_end(ctx);
+	if(gpg_err_code(gpg_err) != GPG_ERR_NO_ERROR) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "batch key lookup failed: %s\n",
+				gpgme_strerror(gpg_err));
+	}
+	/* anything left unresolved is looked up again one by one */
+	for(n = 0; n < count; n++) {
+		struct keycache_entry *entry = keycache_find(handle, patterns[n]);
+		if(entry->known == -2) {
+			entry->known = -1;
+		}
+	}
+	free(patterns);
 	return ret;
 }
 
@@ -502,6 +734,13 @@ int _alpm_key_import(alpm_handle_t *handle, const char *uid, const char *fpr)
 		}
 	}
 	gpgme_key_unref(fetch_key.data);
+	if(ret == 0) {
+		/* the key is in the keyring now; look it up again when asked */
+		struct keycache_entry *entry = keycache_find(handle, fpr);
+		if(entry) {
+			entry->known = -1;
+		}
+	}
 	return ret;
 }
 
@@ -527,7 +766,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 {
 	int ret = -1, sigcount;
 	gpgme_error_t gpg_err = 0;
-	gpgme_ctx_t ctx = {0};
+	gpgme_ctx_t ctx;
 	gpgme_data_t filedata = {0}, sigdata = {0};
 	gpgme_verify_result_t verify_result;
 	gpgme_signature_t gpgsig;
@@ -560,16 +799,12 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 		GOTO_ERR(handle, ALPM_ERR_NOT_A_FILE, error);
 	}
 
-	if(init_gpgme(handle)) {
-		/* pm_errno was set in gpgme_init() */
+	if((ctx = session_ctx(handle)) == NULL) {
 		goto error;
 	}
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "checking signature for %s\n", path);
 
-	gpg_err = gpgme_new(&ctx);
-	CHECK_ERR();
-
 	/* create our necessary data objects to verify the signature */
 	gpg_err = gpgme_data_new_from_stream(&filedata, file);
 	CHECK_ERR();
@@ -712,7 +947,6 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 gpg_error:
 	gpgme_data_release(sigdata);
 	gpgme_data_release(filedata);
-	gpgme_release(ctx);
 
 error:
 	if(sigfile) {
@@ -744,6 +978,16 @@ int _alpm_key_import(alpm_handle_t *handle, const char UNUSED *uid,
 	return -1;
 }
 
+int _alpm_key_lookup_batch(alpm_handle_t *handle, alpm_list_t UNUSED *fprs)
+{
+	handle->pm_errno = ALPM_ERR_MISSING_CAPABILITY_SIGNATURES;
+	return -1;
+}
+
+void _alpm_gpgme_session_end(alpm_handle_t UNUSED *handle)
+{
+}
+
 int _alpm_gpgme_checksig(alpm_handle_t *handle, const char UNUSED *path,
 		const char UNUSED *base64_sig, alpm_siglist_t *siglist)
 {
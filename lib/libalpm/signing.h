@@ -20,6 +20,8 @@ int _alpm_process_siglist(alpm_handle_t *handle, const char *identifier,
 		alpm_siglist_t *siglist, int optional, int marginal, int unknown);
 
 int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr);
+int _alpm_key_lookup_batch(alpm_handle_t *handle, alpm_list_t *fprs);
+void _alpm_gpgme_session_end(alpm_handle_t *handle);
 int _alpm_key_import(alpm_handle_t *handle, const char *uid, const char *fpr);
 
 #endif /* ALPM_SIGNING_H */
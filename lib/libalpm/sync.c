@@ -6,6 +6,8 @@
 
 
 #include <sys/types.h> /* off_t */
+#include <sys/stat.h>
+#include <dirent.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -31,6 +33,7 @@
 #include "remove.h"
 #include "diskspace.h"
 #include "signing.h"
+#include "vector.h"
 
 struct keyinfo_t {
        char* uid;
@@ -105,18 +108,54 @@ static int check_literal(alpm_handle_t *handle, alpm_pkg_t *lpkg,
 	return 0;
 }
 
+static void free_replacers(void *replacers)
+{
+	_alpm_vector_free(replacers, NULL);
+	free(replacers);
+}
+
+/* Map each name replaced in sdb to the packages replacing it, in the
+ * order of the package cache. */
+static int index_replaces(alpm_db_t *sdb, alpm_strset_t *index)
+{
+	alpm_list_t *k, *l;
+
+	for(k = _alpm_db_get_pkgcache(sdb); k; k = k->next) {
+		alpm_pkg_t *spkg = k->data;
+		for(l = alpm_pkg_get_replaces(spkg); l; l = l->next) {
+			alpm_depend_t *replace = l->data;
+			alpm_vector_t *replacers = _alpm_strset_get(index, replace->name);
+			if(replacers == NULL) {
+				CALLOC(replacers, 1, sizeof(alpm_vector_t), return -1);
+				if(_alpm_strset_add(index, replace->name, replacers) != 1) {
+					free(replacers);
+					return -1;
+				}
+			}
+			if(replacers->count && replacers->data[replacers->count - 1] == spkg) {
+				continue;
+			}
+			if(_alpm_vector_push(replacers, spkg) != 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
 static alpm_list_t *check_replacers(alpm_handle_t *handle, alpm_pkg_t *lpkg,
-		alpm_db_t *sdb)
+		alpm_db_t *sdb, alpm_strset_t *replaces, alpm_strset_t *targets)
 {
 	/* 2. search for replacers in sdb */
 	alpm_list_t *replacers = NULL;
-	alpm_list_t *k;
+	alpm_vector_t *candidates = _alpm_strset_get(replaces, lpkg->name);
+	size_t k;
 	_alpm_log(handle, ALPM_LOG_DEBUG,
 			"searching for replacements for %s in %s\n",
 			lpkg->name, sdb->treename);
-	for(k = _alpm_db_get_pkgcache(sdb); k; k = k->next) {
+	for(k = 0; candidates && k < candidates->count; k++) {
 		int found = 0;
-		alpm_pkg_t *spkg = k->data;
+		alpm_pkg_t *spkg = candidates->data[k];
 		alpm_list_t *l;
 		for(l = alpm_pkg_get_replaces(spkg); l; l = l->next) {
 			alpm_depend_t *replace = l->data;
@@ -151,7 +190,7 @@ static alpm_list_t *check_replacers(alpm_handle_t *handle, alpm_pkg_t *lpkg,
 
 			/* If spkg is already in the target list, we append lpkg to spkg's
 			 * removes list */
-			tpkg = alpm_pkg_find(handle->trans->add, spkg->name);
+			tpkg = _alpm_strset_get(targets, spkg->name);
 			if(tpkg) {
 				/* sanity check, multiple repos can contain spkg->name */
 				if(tpkg->origin_data.db != sdb) {
@@ -185,38 +224,68 @@ int SYMEXPORT alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade)
 {
 	alpm_list_t *i, *j;
 	alpm_trans_t *trans;
+	alpm_strset_t targets = {0}, removes = {0}, *replaces = NULL;
+	size_t ndbs, n;
+	int ret = -1;
 
 	CHECK_HANDLE(handle, return -1);
 	trans = handle->trans;
 	ASSERT(trans != NULL, RET_ERR(handle, ALPM_ERR_TRANS_NULL, -1));
 	ASSERT(trans->state == STATE_INITIALIZED, RET_ERR(handle, ALPM_ERR_TRANS_NOT_INITIALIZED, -1));
 
+	ndbs = alpm_list_count(handle->dbs_sync);
+	CALLOC(replaces, ndbs + 1, sizeof(alpm_strset_t),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = handle->dbs_sync, n = 0; i; i = i->next, n++) {
+		alpm_db_t *sdb = i->data;
+		if((sdb->usage & ALPM_DB_USAGE_UPGRADE)
+				&& index_replaces(sdb, &replaces[n]) != 0) {
+			goto cleanup;
+		}
+	}
+	for(i = trans->add; i; i = i->next) {
+		alpm_pkg_t *spkg = i->data;
+		if(_alpm_strset_add(&targets, spkg->name, spkg) < 0) {
+			goto cleanup;
+		}
+	}
+	for(i = trans->remove; i; i = i->next) {
+		alpm_pkg_t *rpkg = i->data;
+		if(_alpm_strset_add(&removes, rpkg->name, rpkg) < 0) {
+			goto cleanup;
+		}
+	}
+
 	_alpm_log(handle, ALPM_LOG_DEBUG, "checking for package upgrades\n");
 	for(i = _alpm_db_get_pkgcache(handle->db_local); i; i = i->next) {
 		alpm_pkg_t *lpkg = i->data;
 
-		if(alpm_pkg_find(trans->remove, lpkg->name)) {
+		if(_alpm_strset_contains(&removes, lpkg->name)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "%s is marked for removal -- skipping\n", lpkg->name);
 			continue;
 		}
 
-		if(alpm_pkg_find(trans->add, lpkg->name)) {
+		if(_alpm_strset_contains(&targets, lpkg->name)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "%s is already in the target list -- skipping\n", lpkg->name);
 			continue;
 		}
 
 		/* Search for replacers then literal (if no replacer) in each sync database. */
-		for(j = handle->dbs_sync; j; j = j->next) {
+		for(j = handle->dbs_sync, n = 0; j; j = j->next, n++) {
 			alpm_db_t *sdb = j->data;
-			alpm_list_t *replacers;
+			alpm_list_t *replacers, *k;
 
 			if(!(sdb->usage & ALPM_DB_USAGE_UPGRADE)) {
 				continue;
 			}
 
 			/* Check sdb */
-			replacers = check_replacers(handle, lpkg, sdb);
+			replacers = check_replacers(handle, lpkg, sdb, &replaces[n], &targets);
 			if(replacers) {
+				for(k = replacers; k; k = k->next) {
+					alpm_pkg_t *spkg = k->data;
+					_alpm_strset_add(&targets, spkg->name, spkg);
+				}
 				trans->add = alpm_list_join(trans->add, replacers);
 				/* jump to next local package */
 				break;
@@ -225,6 +294,7 @@ int SYMEXPORT alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade)
 				if(spkg) {
 					if(check_literal(handle, lpkg, spkg, enable_downgrade)) {
 						trans->add = alpm_list_add(trans->add, spkg);
+						_alpm_strset_add(&targets, spkg->name, spkg);
 					}
 					/* jump to next local package */
 					break;
@@ -232,7 +302,18 @@ int SYMEXPORT alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade)
 			}
 		}
 	}
+	ret = 0;
 
+cleanup:
+	for(n = 0; n < ndbs; n++) {
+		_alpm_strset_free(&replaces[n], free_replacers);
+	}
+	free(replaces);
+	_alpm_strset_free(&targets, NULL);
+	_alpm_strset_free(&removes, NULL);
+	if(ret != 0) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
 	return 0;
 }
 
@@ -306,6 +387,9 @@ static int compute_download_size(alpm_pkg_t *newpkg)
 		return 0;
 	}
 
+	if(_alpm_pkg_load_sync(newpkg) != 0) {
+		RET_ERR(handle, ALPM_ERR_PKG_INVALID, -1);
+	}
 	ASSERT(newpkg->filename != NULL, RET_ERR(handle, ALPM_ERR_PKG_INVALID_NAME, -1));
 	fname = newpkg->filename;
 	fpath = _alpm_filecache_find(handle, fname);
@@ -316,6 +400,12 @@ static int compute_download_size(alpm_pkg_t *newpkg)
 		goto finish;
 	}
 
+	/* the package store holds it, it will be linked into the cache */
+	if(_alpm_cachestore_exists(handle, newpkg->sha256sum)) {
+		size = 0;
+		goto finish;
+	}
+
 	fnamepartlen = strlen(fname) + 6;
 	CALLOC(fnamepart, fnamepartlen, sizeof(char), return -1);
 	snprintf(fnamepart, fnamepartlen, "%s.part", fname);
@@ -353,6 +443,7 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 	alpm_list_t *i, *j;
 	alpm_list_t *deps = NULL;
 	alpm_list_t *unresolvable = NULL;
+	alpm_strset_t removes = {0};
 	int from_sync = 0;
 	int ret = 0;
 	alpm_trans_t *trans = handle->trans;
@@ -370,6 +461,14 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		}
 	}
 
+	/* the rest of the transaction reads the fields of the targets directly,
+	 * load those coming from indexed sync databases now */
+	for(i = trans->add; i; i = i->next) {
+		if(_alpm_pkg_load_sync(i->data) != 0) {
+			RET_ERR(handle, ALPM_ERR_PKG_INVALID, -1);
+		}
+	}
+
 	/* ensure all sync database are valid if we will be using them */
 	for(i = handle->dbs_sync; i; i = i->next) {
 		const alpm_db_t *db = i->data;
@@ -386,6 +485,7 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		alpm_list_t *resolved = NULL;
 		alpm_list_t *remove = alpm_list_copy(trans->remove);
 		alpm_list_t *localpkgs;
+		alpm_strset_t filenames = {0}, targets = {0};
 
 		/* Build up list by repeatedly resolving each transaction package */
 		/* Resolve targets dependencies */
@@ -408,17 +508,14 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 
 		/* Resolve packages in the transaction one at a time, in addition
 		   building up a list of packages which could not be resolved. */
-		for(i = trans->add; i; i = i->next) {
-			alpm_pkg_t *pkg = i->data;
-			if(_alpm_resolvedeps(handle, localpkgs, pkg, trans->add,
-						&resolved, remove, data) == -1) {
-				unresolvable = alpm_list_add(unresolvable, pkg);
-			}
-			/* Else, [resolved] now additionally contains [pkg] and all of its
-			   dependencies not already on the list */
-		}
+		ret = _alpm_resolvedeps(handle, localpkgs, trans->add, remove,
+				&resolved, &unresolvable, data);
 		alpm_list_free(localpkgs);
 		alpm_list_free(remove);
+		if(ret != 0) {
+			alpm_list_free(unresolvable);
+			goto cleanup;
+		}
 
 		/* If there were unresolvable top-level packages, prompt the user to
 		   see if they'd like to ignore them rather than failing the sync */
@@ -452,30 +549,53 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 
 		/* Ensure two packages don't have the same filename */
 		for(i = resolved; i; i = i->next) {
-			alpm_pkg_t *pkg1 = i->data;
-			for(j = i->next; j; j = j->next) {
-				alpm_pkg_t *pkg2 = j->data;
-				if(strcmp(pkg1->filename, pkg2->filename) == 0) {
-					ret = -1;
-					handle->pm_errno = ALPM_ERR_TRANS_DUP_FILENAME;
-					_alpm_log(handle, ALPM_LOG_ERROR, _("packages %s and %s have the same filename: %s\n"),
-						pkg1->name, pkg2->name, pkg1->filename);
-				}
+			alpm_pkg_t *pkg2 = i->data;
+			alpm_pkg_t *pkg1;
+			/* pulled in dependencies have not been loaded yet */
+			if(_alpm_pkg_load_sync(pkg2) != 0) {
+				ret = -1;
+				handle->pm_errno = ALPM_ERR_PKG_INVALID;
+				continue;
+			}
+			pkg1 = _alpm_strset_get(&filenames, pkg2->filename);
+			if(pkg1) {
+				ret = -1;
+				handle->pm_errno = ALPM_ERR_TRANS_DUP_FILENAME;
+				_alpm_log(handle, ALPM_LOG_ERROR, _("packages %s and %s have the same filename: %s\n"),
+					pkg1->name, pkg2->name, pkg1->filename);
+			} else if(_alpm_strset_add(&filenames, pkg2->filename, pkg2) < 0) {
+				ret = -1;
+				handle->pm_errno = ALPM_ERR_MEMORY;
+				break;
 			}
 		}
+		_alpm_strset_free(&filenames, NULL);
 
 		if(ret != 0) {
 			alpm_list_free(resolved);
+			alpm_list_free(unresolvable);
 			goto cleanup;
 		}
 
 		/* Set DEPEND reason for pulled packages */
+		for(i = trans->add; i; i = i->next) {
+			alpm_pkg_t *pkg = i->data;
+			if(_alpm_strset_add(&targets, pkg->name, NULL) < 0) {
+				ret = -1;
+				handle->pm_errno = ALPM_ERR_MEMORY;
+				_alpm_strset_free(&targets, NULL);
+				alpm_list_free(resolved);
+				alpm_list_free(unresolvable);
+				goto cleanup;
+			}
+		}
 		for(i = resolved; i; i = i->next) {
 			alpm_pkg_t *pkg = i->data;
-			if(!alpm_pkg_find(trans->add, pkg->name)) {
+			if(!_alpm_strset_contains(&targets, pkg->name)) {
 				pkg->reason = ALPM_PKG_REASON_DEPEND;
 			}
 		}
+		_alpm_strset_free(&targets, NULL);
 
 		/* Unresolvable packages will be removed from the target list; set these
 		 * aside in the transaction as a list we won't operate on. If we free them
@@ -620,20 +740,34 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 	}
 
 	/* Build trans->remove list */
+	for(i = trans->remove; i; i = i->next) {
+		alpm_pkg_t *rpkg = i->data;
+		if(_alpm_strset_add(&removes, rpkg->name, NULL) < 0) {
+			_alpm_strset_free(&removes, NULL);
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+		}
+	}
 	for(i = trans->add; i; i = i->next) {
 		alpm_pkg_t *spkg = i->data;
 		for(j = spkg->removes; j; j = j->next) {
 			alpm_pkg_t *rpkg = j->data;
-			if(!alpm_pkg_find(trans->remove, rpkg->name)) {
+			if(!_alpm_strset_contains(&removes, rpkg->name)) {
 				alpm_pkg_t *copy;
 				_alpm_log(handle, ALPM_LOG_DEBUG, "adding '%s' to remove list\n", rpkg->name);
 				if(_alpm_pkg_dup(rpkg, &copy) == -1) {
+					_alpm_strset_free(&removes, NULL);
 					return -1;
 				}
+				if(_alpm_strset_add(&removes, copy->name, NULL) < 0) {
+					_alpm_pkg_free(copy);
+					_alpm_strset_free(&removes, NULL);
+					RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+				}
 				trans->remove = alpm_list_add(trans->remove, copy);
 			}
 		}
 	}
+	_alpm_strset_free(&removes, NULL);
 
 	if(!(trans->flags & ALPM_TRANS_FLAG_NODEPS)) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "checking dependencies\n");
@@ -727,6 +861,11 @@ static int find_dl_candidates(alpm_handle_t *handle, alpm_list_t **files)
 
 			ASSERT(spkg->filename != NULL, RET_ERR(handle, ALPM_ERR_PKG_INVALID_NAME, -1));
 
+			if(!_alpm_filecache_exists(handle, spkg->filename)) {
+				/* reuse a copy kept in the package store, if any */
+				free(_alpm_cachestore_fetch(handle, spkg->filename, spkg->sha256sum));
+			}
+
 			need_download = spkg->download_size != 0 || !_alpm_filecache_exists(handle, spkg->filename);
 			/* even if the package file in the cache we need to check for
 			 * accompanion *.sig file as well.
@@ -883,7 +1022,7 @@ static int key_cmp(const void *k1, const void *k2) {
 static int check_keyring(alpm_handle_t *handle)
 {
 	size_t current = 0, numtargs;
-	alpm_list_t *i, *errors = NULL;
+	alpm_list_t *i, *keys = NULL, *keyids = NULL, *errors = NULL;
 	alpm_event_t event;
 	struct keyinfo_t *keyinfo;
 
@@ -892,6 +1031,7 @@ static int check_keyring(alpm_handle_t *handle)
 
 	numtargs = alpm_list_count(handle->trans->add);
 
+	/* gather the unique signing keys of all targets first... */
 	for(i = handle->trans->add; i; i = i->next, current++) {
 		alpm_pkg_t *pkg = i->data;
 		int level;
@@ -910,31 +1050,48 @@ static int check_keyring(alpm_handle_t *handle)
 			size_t sig_len;
 			int ret = alpm_pkg_get_sig(pkg, &sig, &sig_len);
 			if(ret == 0) {
-				alpm_list_t *keys = NULL;
+				alpm_list_t *pkgkeys = NULL;
 				if(alpm_extract_keyid(handle, pkg->name, sig,
-							sig_len, &keys) == 0) {
+							sig_len, &pkgkeys) == 0) {
 					alpm_list_t *k;
-					for(k = keys; k; k = k->next) {
+					for(k = pkgkeys; k; k = k->next) {
 						char *key = k->data;
 						_alpm_log(handle, ALPM_LOG_DEBUG, "found signature key: %s\n", key);
-						if(!alpm_list_find(errors, key, key_cmp) &&
-								_alpm_key_in_keychain(handle, key) == 0) {
+						if(!alpm_list_find(keys, key, key_cmp)) {
 							keyinfo = malloc(sizeof(struct keyinfo_t));
 							if(!keyinfo) {
 								break;
 							}
 							keyinfo->uid = strdup(pkg->packager);
 							keyinfo->keyid = strdup(key);
-							errors = alpm_list_add(errors, keyinfo);
+							keys = alpm_list_add(keys, keyinfo);
+							keyids = alpm_list_add(keyids, keyinfo->keyid);
 						}
 					}
-					FREELIST(keys);
+					FREELIST(pkgkeys);
 				}
 			}
 			free(sig);
 		}
 	}
 
+	/* ...then look them all up in one go; the checks below hit the cache */
+	if(keyids) {
+		_alpm_key_lookup_batch(handle, keyids);
+		alpm_list_free(keyids);
+	}
+	for(i = keys; i; i = i->next) {
+		keyinfo = i->data;
+		if(_alpm_key_in_keychain(handle, keyinfo->keyid) == 0) {
+			errors = alpm_list_add(errors, keyinfo);
+		} else {
+			free(keyinfo->uid);
+			free(keyinfo->keyid);
+			free(keyinfo);
+		}
+	}
+	alpm_list_free(keys);
+
 	PROGRESS(handle, ALPM_PROGRESS_KEYRING_START, "", 100,
 			numtargs, current);
 	event.type = ALPM_EVENT_KEYRING_DONE;
@@ -1016,6 +1173,8 @@ static int check_validity(alpm_handle_t *handle,
 			memcpy(invalid, &v, sizeof(struct validity));
 			errors = alpm_list_add(errors, invalid);
 		} else {
+			/* known good, share it with other caches and roots */
+			_alpm_cachestore_add(handle, v.path, v.pkg->sha256sum);
 			alpm_siglist_cleanup(v.siglist);
 			free(v.siglist);
 			free(v.path);
@@ -1271,6 +1430,89 @@ int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 	return 0;
 }
 
+/* Whether path, a directory ending in '/', is one libalpm writes its own
+ * files to: the database or a package cache. Hooks and keyrings are put
+ * there by someone else and may be owned by a package. */
+static int is_alpm_dir(alpm_handle_t *handle, const char *path)
+{
+	alpm_list_t *i;
+
+	if(strcmp(path, handle->dbpath) == 0) {
+		return 1;
+	}
+	for(i = handle->cachedirs; i; i = i->next) {
+		if(strcmp(path, i->data) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Look for anything but directories below the directory path, which has
+ * length len in a buffer of PATH_MAX. The directories libalpm writes its own
+ * files to and the log file don't count. Returns 1 if there is nothing. */
+static int dir_is_empty(alpm_handle_t *handle, char *path, size_t len, int depth)
+{
+	struct dirent *ent;
+	DIR *dir;
+	int empty = 1;
+
+	if(depth > 32 || (dir = opendir(path)) == NULL) {
+		return 0;
+	}
+	while(empty && (ent = readdir(dir)) != NULL) {
+		size_t namelen = strlen(ent->d_name);
+		int isdir = 0;
+
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+			continue;
+		}
+		if(len + namelen + 2 > PATH_MAX) {
+			empty = 0;
+			break;
+		}
+		memcpy(path + len, ent->d_name, namelen + 1);
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+		if(ent->d_type != DT_UNKNOWN) {
+			isdir = ent->d_type == DT_DIR;
+		} else
+#endif
+		{
+			struct stat buf;
+			isdir = lstat(path, &buf) == 0 && S_ISDIR(buf.st_mode);
+		}
+
+		if(isdir) {
+			strcpy(path + len + namelen, "/");
+			if(!is_alpm_dir(handle, path)) {
+				empty = dir_is_empty(handle, path, len + namelen + 1, depth + 1);
+			}
+		} else if(!(handle->logfile && strcmp(path, handle->logfile) == 0)) {
+			empty = 0;
+		}
+	}
+	closedir(dir);
+	path[len] = '\0';
+	return empty;
+}
+
+/* Whether the transaction installs into a root nothing was installed in
+ * yet, such as a new chroot or container image. Nothing but directories
+ * may exist there, so the files of the packages can't conflict with the
+ * filesystem and are created without looking for an existing one first. */
+static int is_fresh_root(alpm_handle_t *handle)
+{
+	char path[PATH_MAX];
+	size_t len = strlen(handle->root);
+
+	if(handle->trans->remove || _alpm_db_get_pkgcache(handle->db_local)
+			|| len >= PATH_MAX) {
+		return 0;
+	}
+	memcpy(path, handle->root, len + 1);
+	return dir_is_empty(handle, path, len, 0);
+}
+
 int _alpm_sync_check(alpm_handle_t *handle, alpm_list_t **data)
 {
 	alpm_trans_t *trans = handle->trans;
@@ -1278,6 +1520,11 @@ int _alpm_sync_check(alpm_handle_t *handle, alpm_list_t **data)
 
 	/* fileconflict check */
 	if(!(trans->flags & ALPM_TRANS_FLAG_DBONLY)) {
+		if((trans->freshroot = is_fresh_root(handle))) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"%s is empty, skipping checks against the filesystem\n", handle->root);
+		}
+
 		event.type = ALPM_EVENT_FILECONFLICTS_START;
 		EVENT(handle, &event);
 
@@ -1326,7 +1573,7 @@ int _alpm_sync_commit(alpm_handle_t *handle)
 		_alpm_log(handle, ALPM_LOG_DEBUG,
 				"removing conflicting and to-be-replaced packages\n");
 		/* we want the frontend to be aware of commit details */
-		if(_alpm_remove_packages(handle, 0) == -1) {
+		if(_alpm_remove_packages(handle) == -1) {
 			_alpm_log(handle, ALPM_LOG_ERROR,
 					_("could not commit removal transaction\n"));
 			return -1;
@@ -5,6 +5,7 @@
 
 
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -25,6 +26,7 @@
 #include "alpm.h"
 #include "deps.h"
 #include "hook.h"
+#include "signing.h"
 
 int SYMEXPORT alpm_trans_init(alpm_handle_t *handle, int flags)
 {
@@ -194,10 +196,11 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 	EVENT(handle, (void *)&event);
 
 	if(trans->add == NULL) {
-		if(_alpm_remove_packages(handle, 1) == -1) {
+		if(_alpm_remove_packages(handle) == -1) {
 			/* pm_errno is set by _alpm_remove_packages() */
 			alpm_errno_t save = handle->pm_errno;
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction failed\n");
+			_alpm_log_flush(handle);
 			handle->pm_errno = save;
 			return -1;
 		}
@@ -206,6 +209,7 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 			/* pm_errno is set by _alpm_sync_commit() */
 			alpm_errno_t save = handle->pm_errno;
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction failed\n");
+			_alpm_log_flush(handle);
 			handle->pm_errno = save;
 			return -1;
 		}
@@ -214,6 +218,13 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 	if(trans->state == STATE_INTERRUPTED) {
 		alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction interrupted\n");
 	} else {
+		if(_alpm_trans_run_deferred(handle) != 0) {
+			/* the packages are in place; like a failing post_install, this
+			 * does not fail the transaction, but it goes into the log */
+			alpm_logaction(handle, ALPM_CALLER_PREFIX,
+					"post-transaction commands failed\n");
+		}
+
 		event.type = ALPM_EVENT_TRANSACTION_DONE;
 		EVENT(handle, (void *)&event);
 		alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction completed\n");
@@ -224,6 +235,7 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 	}
 
 	trans->state = STATE_COMMITTED;
+	_alpm_log_flush(handle);
 
 	return 0;
 }
@@ -260,6 +272,10 @@ int SYMEXPORT alpm_trans_release(alpm_handle_t *handle)
 
 	_alpm_trans_free(trans);
 	handle->trans = NULL;
+	_alpm_log_flush(handle);
+
+	/* keys may be imported or signed between transactions */
+	_alpm_gpgme_session_end(handle);
 
 	/* unlock db */
 	if(!nolock_flag) {
@@ -269,6 +285,31 @@ int SYMEXPORT alpm_trans_release(alpm_handle_t *handle)
 	return 0;
 }
 
+/* remove the copies of deferred scriptlets that did not get to run */
+static void deferred_cleanup(alpm_trans_t *trans)
+{
+	size_t i, count = alpm_list_count(trans->scriptlets);
+	char path[PATH_MAX];
+
+	if(trans->scriptletdir == NULL) {
+		return;
+	}
+
+	for(i = 1; i <= count; i++) {
+		snprintf(path, PATH_MAX, "%s/%zu.INSTALL", trans->scriptletdir, i);
+		unlink(path);
+		snprintf(path, PATH_MAX, "%s/%zu.failed", trans->scriptletdir, i);
+		unlink(path);
+	}
+	snprintf(path, PATH_MAX, "%s/run", trans->scriptletdir);
+	unlink(path);
+	rmdir(trans->scriptletdir);
+
+	FREE(trans->scriptletdir);
+	FREELIST(trans->scriptlets);
+	FREELIST(trans->scriptletpkgs);
+}
+
 void _alpm_trans_free(alpm_trans_t *trans)
 {
 	if(trans == NULL) {
@@ -284,6 +325,10 @@ void _alpm_trans_free(alpm_trans_t *trans)
 	alpm_list_free(trans->remove);
 
 	FREELIST(trans->skip_remove);
+	FREELIST(trans->dbsync);
+	alpm_list_free(trans->dbwrite);
+
+	deferred_cleanup(trans);
 
 	FREE(trans);
 }
@@ -318,6 +363,26 @@ static int grep(const char *fn, const char *needle)
 	return 0;
 }
 
+/* create a directory in $root/tmp/ for copying/extracting scriptlets */
+static char *scriptlet_tmpdir(alpm_handle_t *handle)
+{
+	char *tmpdir;
+	size_t len = strlen(handle->root) + strlen("tmp/alpm_XXXXXX") + 1;
+
+	MALLOC(tmpdir, len, RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	snprintf(tmpdir, len, "%stmp/", handle->root);
+	if(access(tmpdir, F_OK) != 0) {
+		_alpm_makepath_mode(tmpdir, 01777);
+	}
+	snprintf(tmpdir, len, "%stmp/alpm_XXXXXX", handle->root);
+	if(mkdtemp(tmpdir) == NULL) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not create temp directory\n"));
+		free(tmpdir);
+		return NULL;
+	}
+	return tmpdir;
+}
+
 int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 		const char *script, const char *ver, const char *oldver, int is_archive)
 {
@@ -341,22 +406,12 @@ int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 	strcpy(arg0, SCRIPTLET_SHELL);
 	strcpy(arg1, "-c");
 
-	/* create a directory in $root/tmp/ for copying/extracting the scriptlet */
-	len = strlen(handle->root) + strlen("tmp/alpm_XXXXXX") + 1;
-	MALLOC(tmpdir, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
-	snprintf(tmpdir, len, "%stmp/", handle->root);
-	if(access(tmpdir, F_OK) != 0) {
-		_alpm_makepath_mode(tmpdir, 01777);
-	}
-	snprintf(tmpdir, len, "%stmp/alpm_XXXXXX", handle->root);
-	if(mkdtemp(tmpdir) == NULL) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not create temp directory\n"));
-		free(tmpdir);
+	if((tmpdir = scriptlet_tmpdir(handle)) == NULL) {
 		return 1;
 	}
 
 	/* either extract or copy the scriptlet */
-	len += strlen("/.INSTALL");
+	len = strlen(tmpdir) + strlen("/.INSTALL") + 1;
 	MALLOC(scriptfn, len, free(tmpdir); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
 	snprintf(scriptfn, len, "%s/.INSTALL", tmpdir);
 	if(is_archive) {
@@ -408,6 +463,186 @@ cleanup:
 	return retval;
 }
 
+/* packages opt in to batched scriptlets with xdata 'scriptlet=batch' */
+static int scriptlet_batchable(alpm_pkg_t *pkg)
+{
+	alpm_list_t *i;
+	for(i = alpm_pkg_get_xdata(pkg); i; i = i->next) {
+		alpm_pkg_xdata_t *pd = i->data;
+		if(strcmp(pd->name, "scriptlet") == 0 && strcmp(pd->value, "batch") == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** Queue a post_install/post_upgrade call to run at the end of the commit.
+ * All queued calls are run by _alpm_trans_run_deferred() from a single
+ * shell, each in a subshell of its own whose exit status is kept apart.
+ * @param handle the context handle
+ * @param pkg the package the scriptlet belongs to
+ * @param filepath path to the scriptlet in the local database
+ * @param script the function to call
+ * @param ver version passed to the function
+ * @param oldver previous version passed to the function, or NULL
+ * @return 0 if the call was queued or the function does not exist, 1 if the
+ * package did not opt in or the scriptlet could not be queued; the caller
+ * has to run it itself then
+ */
+int _alpm_trans_defer_scriptlet(alpm_handle_t *handle, alpm_pkg_t *pkg,
+		const char *filepath, const char *script, const char *ver, const char *oldver)
+{
+	alpm_trans_t *trans = handle->trans;
+	char path[PATH_MAX], *call, *name;
+	size_t num;
+
+	if(!scriptlet_batchable(pkg)) {
+		return 1;
+	}
+	if(_alpm_access(handle, NULL, filepath, R_OK) != 0 || !grep(filepath, script)) {
+		return 0;
+	}
+
+	if(trans->scriptletdir == NULL
+			&& (trans->scriptletdir = scriptlet_tmpdir(handle)) == NULL) {
+		return 1;
+	}
+
+	num = alpm_list_count(trans->scriptlets) + 1;
+	snprintf(path, PATH_MAX, "%s/%zu.INSTALL", trans->scriptletdir, num);
+	if(_alpm_copyfile(filepath, path)) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not copy tempfile to %s (%s)\n"),
+				path, strerror(errno));
+		unlink(path);
+		return 1;
+	}
+
+	/* chop off the root so we can find the copy in the chroot; a failing
+	 * call leaves its exit status in <num>.failed next to it */
+	if(asprintf(&call, "( . %s; %s %s%s%s ) || echo $? > %s/%zu.failed\n",
+				path + strlen(handle->root) - 1,
+				script, ver, oldver ? " " : "", oldver ? oldver : "",
+				trans->scriptletdir + strlen(handle->root) - 1, num) == -1) {
+		_alpm_alloc_fail(0);
+		unlink(path);
+		return 1;
+	}
+	if(asprintf(&name, "%s: %s", pkg->name, script) == -1) {
+		_alpm_alloc_fail(0);
+		free(call);
+		unlink(path);
+		return 1;
+	}
+	trans->scriptlets = alpm_list_add(trans->scriptlets, call);
+	trans->scriptletpkgs = alpm_list_add(trans->scriptletpkgs, name);
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "deferring %s of %s\n", script, pkg->name);
+	return 0;
+}
+
+/* Does the path belong to a shared library or the dynamic linker
+ * configuration? Matches 'libfoo.so' and 'libfoo.so.1.2', but not
+ * 'foo.so.txt', anywhere, so directories that are only listed in
+ * ld.so.conf are covered too. */
+static int is_ldconfig_path(const char *path)
+{
+	const char *so;
+
+	if(strncmp(path, "etc/ld.so.conf", 14) == 0) {
+		return 1;
+	}
+	for(so = strstr(path, ".so"); so; so = strstr(so + 3, ".so")) {
+		if(so[3] == '\0' || (so[3] == '.' && isdigit((unsigned char)so[4]))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** Note whether installing or removing a package requires ldconfig.
+ * @param handle the context handle
+ * @param pkg a package whose files are being installed or removed
+ */
+void _alpm_trans_check_libs(alpm_handle_t *handle, alpm_pkg_t *pkg)
+{
+	alpm_filelist_t *files;
+	size_t i;
+
+	if(handle->trans->ldconfig) {
+		return;
+	}
+
+	files = alpm_pkg_get_files(pkg);
+	for(i = 0; files && i < files->count; i++) {
+		if(is_ldconfig_path(files->files[i].name)) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "%s touches %s, ldconfig needed\n",
+					pkg->name, files->files[i].name);
+			handle->trans->ldconfig = 1;
+			return;
+		}
+	}
+}
+
+/** Run the work deferred to the end of a successful commit: ldconfig, once,
+ * if any package touched a library, then the batched scriptlets. Each
+ * scriptlet that fails is reported with its package.
+ * @param handle the context handle
+ * @return 0 on success, 1 if a command failed
+ */
+int _alpm_trans_run_deferred(alpm_handle_t *handle)
+{
+	alpm_trans_t *trans = handle->trans;
+	int ret = 0;
+
+	if(trans->ldconfig) {
+		/* run ldconfig if it exists */
+		ret |= _alpm_ldconfig(handle);
+		trans->ldconfig = 0;
+	} else {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "no libraries changed, skipping ldconfig\n");
+	}
+
+	if(trans->scriptlets) {
+		char arg0[PATH_MAX], arg1[3], cmdline[PATH_MAX], path[PATH_MAX];
+		char *argv[] = { arg0, arg1, cmdline, NULL };
+		alpm_list_t *i;
+		size_t num;
+		FILE *fp;
+
+		snprintf(path, PATH_MAX, "%s/run", trans->scriptletdir);
+		if((fp = fopen(path, "w")) == NULL) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+					path, strerror(errno));
+			deferred_cleanup(trans);
+			return 1;
+		}
+		for(i = trans->scriptlets; i; i = i->next) {
+			fputs(i->data, fp);
+		}
+		fclose(fp);
+
+		strcpy(arg0, SCRIPTLET_SHELL);
+		strcpy(arg1, "-c");
+		snprintf(cmdline, PATH_MAX, ". %s", path + strlen(handle->root) - 1);
+
+		_alpm_log(handle, ALPM_LOG_DEBUG, "running %zu batched scriptlets\n",
+				alpm_list_count(trans->scriptlets));
+		ret |= _alpm_run_chroot(handle, SCRIPTLET_SHELL, argv, NULL, NULL);
+
+		for(i = trans->scriptletpkgs, num = 1; i; i = i->next, num++) {
+			snprintf(path, PATH_MAX, "%s/%zu.failed", trans->scriptletdir, num);
+			if(access(path, F_OK) == 0) {
+				_alpm_log(handle, ALPM_LOG_ERROR, _("%s scriptlet failed\n"),
+						(char *)i->data);
+				ret = 1;
+			}
+		}
+	}
+	deferred_cleanup(trans);
+
+	return ret;
+}
+
 int SYMEXPORT alpm_trans_get_flags(alpm_handle_t *handle)
 {
 	/* Sanity checks */
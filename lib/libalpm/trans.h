@@ -28,6 +28,14 @@ typedef struct _alpm_trans_t {
 	alpm_list_t *add;           /* list of (alpm_pkg_t *) */
 	alpm_list_t *remove;        /* list of (alpm_pkg_t *) */
 	alpm_list_t *skip_remove;   /* list of (char *) */
+	alpm_list_t *dbsync;        /* list of (char *) local db entries pending fsync */
+	int freshroot;              /* nothing is installed in the root yet */
+	alpm_list_t *dbwrite;       /* list of (alpm_pkg_t *) local db entries pending write */
+	/* work deferred to the end of the commit */
+	int ldconfig;               /* a shared library or ld.so.conf was touched */
+	char *scriptletdir;         /* copies of the deferred scriptlets */
+	alpm_list_t *scriptlets;    /* list of (char *) deferred scriptlet calls */
+	alpm_list_t *scriptletpkgs; /* list of (char *) "pkgname: function" of each call */
 } alpm_trans_t;
 
 void _alpm_trans_free(alpm_trans_t *trans);
@@ -35,5 +43,9 @@ void _alpm_trans_free(alpm_trans_t *trans);
 int _alpm_trans_init(alpm_trans_t *trans, int flags);
 int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 		const char *script, const char *ver, const char *oldver, int is_archive);
+int _alpm_trans_defer_scriptlet(alpm_handle_t *handle, alpm_pkg_t *pkg,
+		const char *filepath, const char *script, const char *ver, const char *oldver);
+void _alpm_trans_check_libs(alpm_handle_t *handle, alpm_pkg_t *pkg);
+int _alpm_trans_run_deferred(alpm_handle_t *handle);
 
 #endif /* ALPM_TRANS_H */
@@ -22,6 +22,11 @@
 #include <pwd.h>
 #include <signal.h>
 
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h> /* FICLONE */
+#endif
+
 /* libarchive */
 #include <archive.h>
 #include <archive_entry.h>
@@ -129,7 +134,43 @@ done:
 	return ret;
 }
 
+/** Copy file contents without passing them through user space.
+ * A reflink sharing the source extents is tried first, then
+ * copy_file_range(). Both leave the file offsets where they stopped, so on
+ * failure the caller can continue with a buffered copy.
+ * @param in file descriptor to copy from, positioned at the start
+ * @param out file descriptor to copy to, positioned at the start
+ * @param size number of bytes to copy
+ * @return 0 if everything was copied, -1 otherwise
+ */
+static int copyfile_kernel(int in, int out, off_t size)
+{
+#ifdef FICLONE
+	if(ioctl(out, FICLONE, in) == 0) {
+		return 0;
+	}
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	while(size > 0) {
+		ssize_t ncopy = copy_file_range(in, NULL, out, NULL, size, 0);
+		if(ncopy < 0 && errno == EINTR) {
+			continue;
+		} else if(ncopy <= 0) {
+			return -1;
+		}
+		size -= ncopy;
+	}
+	return 0;
+#else
+	(void)in;
+	(void)out;
+	(void)size;
+	return -1;
+#endif
+}
+
 /** Copies a file.
+ * Reflinks or in-kernel copies are used where the filesystem supports them.
  * @param src file path to copy from
  * @param dest file path to copy to
  * @return 0 on success, 1 on error
@@ -155,7 +196,12 @@ int _alpm_copyfile(const char *src, const char *dest)
 		goto cleanup;
 	}
 
-	/* do the actual file copy */
+	if(copyfile_kernel(in, out, st.st_size) == 0) {
+		ret = 0;
+		goto cleanup;
+	}
+
+	/* do the actual file copy, starting where the kernel copy stopped */
 	while((nread = read(in, buf, ALPM_BUFFER_SIZE)) > 0 || errno == EINTR) {
 		ssize_t nwrite = 0;
 		if(nread < 0) {
@@ -238,6 +284,19 @@ size_t _alpm_strip_newline(char *str, size_t len)
  */
 int _alpm_open_archive(alpm_handle_t *handle, const char *path,
 		struct stat *buf, struct archive **archive, alpm_errno_t error)
+{
+	return _alpm_open_archive_threads(handle, path, buf, archive, error, 1);
+}
+
+/** Open an archive for reading, decompressing it in several threads where
+ * the filter supports it.
+ * See _alpm_open_archive() for the other parameters.
+ * @param threads the number of threads the decompression may use
+ * @return -1 on failure, >=0 file descriptor on success
+ */
+int _alpm_open_archive_threads(alpm_handle_t *handle, const char *path,
+		struct stat *buf, struct archive **archive, alpm_errno_t error,
+		unsigned int threads)
 {
 	int fd;
 	size_t bufsize = ALPM_BUFFER_SIZE;
@@ -250,6 +309,18 @@ int _alpm_open_archive(alpm_handle_t *handle, const char *path,
 	_alpm_archive_read_support_filter_all(*archive);
 	archive_read_support_format_all(*archive);
 
+	if(threads > 1) {
+		char value[16];
+		snprintf(value, sizeof(value), "%u", threads);
+		/* libzstd decodes a frame in a single thread, only the xz reader of
+		 * newer libarchive releases can use more */
+		if(archive_read_set_filter_option(*archive, "xz", "threads", value) != ARCHIVE_OK) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"xz decompression does not support threads: %s\n",
+					archive_error_string(*archive));
+		}
+	}
+
 	_alpm_log(handle, ALPM_LOG_DEBUG, "opening archive %s\n", path);
 	OPEN(fd, path, O_RDONLY | O_CLOEXEC);
 	if(fd < 0) {
@@ -581,62 +652,204 @@ void _alpm_reset_signals(void)
 	}
 }
 
-/** Execute a command with arguments in a chroot.
- * @param handle the context handle
- * @param cmd command to execute
- * @param argv arguments to pass to cmd
- * @param stdin_cb callback to provide input to the chroot on stdin
- * @param stdin_ctx context to be passed to @a stdin_cb
- * @return 0 on success, 1 on error
- */
-int _alpm_run_chroot(alpm_handle_t *handle, const char *cmd, char *const argv[],
-		_alpm_cb_io stdin_cb, void *stdin_ctx)
+#define HEAD 1
+#define TAIL 0
+
+#ifdef HAVE_VFORK
+/* vfork() shares the address space with the parent until the child calls
+ * execve(), so starting a command costs the same no matter how much memory
+ * the front end has mapped; fork() copies the page tables of all of it */
+static int spawn_vfork = 1;
+
+/* filled in by a vfork child that failed before or in execve() */
+struct spawn_error {
+	const char *call;
+	int errnum;
+};
+
+/* The environment for the child: SHLVL defaults to 1 and BASH_ENV is
+ * removed, see the fork() path. Only the array is allocated. */
+static const char **_alpm_chroot_env(void)
 {
+	const char **env;
+	char **e;
+	size_t count = 0, n = 0;
+	int shlvl = 0;
+
+	for(e = environ; *e; e++) {
+		count++;
+	}
+	MALLOC(env, (count + 2) * sizeof(char *), return NULL);
+	for(e = environ; *e; e++) {
+		if(strncmp(*e, "BASH_ENV=", 9) == 0) {
+			continue;
+		}
+		if(strncmp(*e, "SHLVL=", 6) == 0) {
+			shlvl = 1;
+		}
+		env[n++] = *e;
+	}
+	if(!shlvl) {
+		env[n++] = "SHLVL=1";
+	}
+	env[n] = NULL;
+	return env;
+}
+
+/* Start cmd with vfork() and the environment env. The child may only make
+ * async-signal-safe calls and must not touch the parent's memory except for
+ * *err; all signals are blocked around vfork() so no handler of the parent
+ * can run in it. */
+static pid_t _alpm_chroot_vfork(alpm_handle_t *handle, const char *cmd,
+		char *const argv[], const char **env, int cwdfd,
+		int child2parent_pipefd[2], int parent2child_pipefd[2])
+{
+	volatile struct spawn_error err = { NULL, 0 };
+	const char *root = handle->root;
+	sigset_t all, old;
 	pid_t pid;
-	int child2parent_pipefd[2], parent2child_pipefd[2];
-	int cwdfd;
-	int retval = 0;
+	int vfork_errno;
 
-#define HEAD 1
-#define TAIL 0
+	sigfillset(&all);
+	sigprocmask(SIG_BLOCK, &all, &old);
 
-	/* save the cwd so we can restore it later */
-	OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
-	if(cwdfd < 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
+	pid = vfork();
+	vfork_errno = errno;
+	if(pid == 0) {
+		while(dup2(child2parent_pipefd[HEAD], 1) == -1 && errno == EINTR);
+		while(dup2(child2parent_pipefd[HEAD], 2) == -1 && errno == EINTR);
+		while(dup2(parent2child_pipefd[TAIL], 0) == -1 && errno == EINTR);
+		close(parent2child_pipefd[TAIL]);
+		close(parent2child_pipefd[HEAD]);
+		close(child2parent_pipefd[TAIL]);
+		close(child2parent_pipefd[HEAD]);
+		if(cwdfd >= 0) {
+			close(cwdfd);
+		}
+
+		if(strcmp(root, "/") != 0 && chroot(root) != 0) {
+			err.call = "chroot";
+		} else if(chdir("/") != 0) {
+			err.call = "chdir";
+		} else {
+			umask(0022);
+			_alpm_reset_signals();
+			sigprocmask(SIG_SETMASK, &old, NULL);
+			execve(cmd, argv, (char *const *)env);
+			err.call = "execve";
+		}
+		err.errnum = errno;
+		_exit(127);
 	}
 
-	/* just in case our cwd was removed in the upgrade operation */
-	if(chdir(handle->root) != 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
-				handle->root, strerror(errno));
-		goto cleanup;
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	if(pid == -1) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not fork a new process (%s)\n"),
+				strerror(vfork_errno));
+		return -1;
+	}
+
+	if(err.call) {
+		/* the child has already exited */
+		while(waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+		if(strcmp(err.call, "chroot") == 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("could not change the root directory (%s)\n"), strerror(err.errnum));
+		} else if(strcmp(err.call, "chdir") == 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
+					"/", strerror(err.errnum));
+		} else {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("call to execv failed (%s)\n"), strerror(err.errnum));
+		}
+		return -1;
+	}
+
+	return pid;
+}
+#else
+static int spawn_vfork = 0;
+#endif
+
+/** Select how commands are started in the chroot.
+ * @param method "fork" or "vfork"
+ * @return 0 on success, -1 if the method is not available
+ */
+int _alpm_chroot_set_spawn(const char *method)
+{
+	if(strcmp(method, "fork") == 0) {
+		spawn_vfork = 0;
+		return 0;
+	}
+#ifdef HAVE_VFORK
+	if(strcmp(method, "vfork") == 0) {
+		spawn_vfork = 1;
+		return 0;
 	}
+#endif
+	return -1;
+}
+
+/* Fork and execute cmd in the chroot. The child's stdout and stderr are
+ * returned in *outfd; its stdin in *infd, or closed if infd is NULL. Both
+ * are non-blocking. The caller must have changed into handle->root.
+ * Returns the pid of the child, -1 on error. */
+static pid_t _alpm_chroot_spawn(alpm_handle_t *handle, const char *cmd,
+		char *const argv[], int cwdfd, int *outfd, int *infd)
+{
+	pid_t pid;
+	int child2parent_pipefd[2], parent2child_pipefd[2];
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "executing \"%s\" under chroot \"%s\"\n",
 			cmd, handle->root);
 
 	/* Flush open fds before fork() to avoid cloning buffers */
 	fflush(NULL);
+	_alpm_log_flush(handle);
 
-	if(socketpair(AF_UNIX, SOCK_STREAM, 0, child2parent_pipefd) == -1) {
+	/* close on exec, or the children of hooks run at the same time would keep
+	 * each other's stdin open; the copies the child dup2()s are inherited */
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, child2parent_pipefd) == -1) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not create pipe (%s)\n"), strerror(errno));
-		retval = 1;
-		goto cleanup;
+		return -1;
 	}
 
-	if(socketpair(AF_UNIX, SOCK_STREAM, 0, parent2child_pipefd) == -1) {
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, parent2child_pipefd) == -1) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not create pipe (%s)\n"), strerror(errno));
-		retval = 1;
-		goto cleanup;
+		close(child2parent_pipefd[HEAD]);
+		close(child2parent_pipefd[TAIL]);
+		return -1;
 	}
 
+#ifdef HAVE_VFORK
+	if(spawn_vfork) {
+		/* allocated here, the parent must not use it after vfork() */
+		const char **env = _alpm_chroot_env();
+
+		pid = env ? _alpm_chroot_vfork(handle, cmd, argv, env, cwdfd,
+				child2parent_pipefd, parent2child_pipefd) : -1;
+		free(env);
+		if(pid == -1) {
+			close(child2parent_pipefd[HEAD]);
+			close(child2parent_pipefd[TAIL]);
+			close(parent2child_pipefd[HEAD]);
+			close(parent2child_pipefd[TAIL]);
+			return -1;
+		}
+		goto parent;
+	}
+#endif
+
 	/* fork- parent and child each have separate code blocks below */
 	pid = fork();
 	if(pid == -1) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not fork a new process (%s)\n"), strerror(errno));
-		retval = 1;
-		goto cleanup;
+		close(child2parent_pipefd[HEAD]);
+		close(child2parent_pipefd[TAIL]);
+		close(parent2child_pipefd[HEAD]);
+		close(parent2child_pipefd[TAIL]);
+		return -1;
 	}
 
 	if(pid == 0) {
@@ -681,117 +894,381 @@ int _alpm_run_chroot(alpm_handle_t *handle, const char *cmd, char *const argv[],
 		/* execv only returns if there was an error */
 		fprintf(stderr, _("call to execv failed (%s)\n"), strerror(errno));
 		exit(1);
+	}
+
+#ifdef HAVE_VFORK
+parent:
+#endif
+	/* this code runs for the parent only */
+	close(child2parent_pipefd[HEAD]);
+	close(parent2child_pipefd[TAIL]);
+
+	*outfd = child2parent_pipefd[TAIL];
+	fcntl(*outfd, F_SETFL, O_NONBLOCK);
+
+	if(infd) {
+		*infd = parent2child_pipefd[HEAD];
+		fcntl(*infd, F_SETFL, O_NONBLOCK);
 	} else {
-		/* this code runs for the parent only (wait on the child) */
-		int status;
-		char obuf[PIPE_BUF]; /* writes <= PIPE_BUF are guaranteed atomic */
-		char ibuf[LINE_MAX];
-		ssize_t olen = 0, ilen = 0;
-		nfds_t nfds = 2;
-		struct pollfd fds[2], *child2parent = &(fds[0]), *parent2child = &(fds[1]);
-		int poll_ret;
+		close(parent2child_pipefd[HEAD]);
+	}
 
-		child2parent->fd = child2parent_pipefd[TAIL];
-		child2parent->events = POLLIN;
-		fcntl(child2parent->fd, F_SETFL, O_NONBLOCK);
-		close(child2parent_pipefd[HEAD]);
-		close(parent2child_pipefd[TAIL]);
+	return pid;
+}
 
-		if(stdin_cb) {
-			parent2child->fd = parent2child_pipefd[HEAD];
-			parent2child->events = POLLOUT;
-			fcntl(parent2child->fd, F_SETFL, O_NONBLOCK);
-		} else {
-			parent2child->fd = -1;
-			parent2child->events = 0;
-			close(parent2child_pipefd[HEAD]);
+/* Reap a child started by _alpm_chroot_spawn and check how it exited.
+ * Returns 0 on success, 1 on error. */
+static int _alpm_chroot_wait(alpm_handle_t *handle, pid_t pid)
+{
+	int status;
+
+	while(waitpid(pid, &status, 0) == -1) {
+		if(errno != EINTR) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("call to waitpid failed (%s)\n"), strerror(errno));
+			return 1;
+		}
+	}
+
+	/* check the return status, make sure it is 0 (success) */
+	if(WIFEXITED(status)) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "call to waitpid succeeded\n");
+		if(WEXITSTATUS(status) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("command failed to execute correctly\n"));
+			return 1;
+		}
+	} else if(WIFSIGNALED(status) != 0) {
+		char *signal_description = strsignal(WTERMSIG(status));
+		/* strsignal can return NULL on some (non-Linux) platforms */
+		if(signal_description == NULL) {
+			signal_description = _("Unknown signal");
 		}
+		_alpm_log(handle, ALPM_LOG_ERROR, _("command terminated by signal %d: %s\n"),
+					WTERMSIG(status), signal_description);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* save the cwd and change into the root, returns the fd to restore from */
+static int _alpm_chroot_enter(alpm_handle_t *handle, int *cwdfd)
+{
+	OPEN(*cwdfd, ".", O_RDONLY | O_CLOEXEC);
+	if(*cwdfd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
+	}
+
+	/* just in case our cwd was removed in the upgrade operation */
+	if(chdir(handle->root) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
+				handle->root, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void _alpm_chroot_leave(alpm_handle_t *handle, int cwdfd)
+{
+	if(cwdfd >= 0) {
+		if(fchdir(cwdfd) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("could not restore working directory (%s)\n"), strerror(errno));
+		}
+		close(cwdfd);
+	}
+}
+
+/** Execute a command with arguments in a chroot.
+ * @param handle the context handle
+ * @param cmd command to execute
+ * @param argv arguments to pass to cmd
+ * @param stdin_cb callback to provide input to the chroot on stdin
+ * @param stdin_ctx context to be passed to @a stdin_cb
+ * @return 0 on success, 1 on error
+ */
+int _alpm_run_chroot(alpm_handle_t *handle, const char *cmd, char *const argv[],
+		_alpm_cb_io stdin_cb, void *stdin_ctx)
+{
+	pid_t pid;
+	int cwdfd;
+	int retval = 0;
+	char obuf[PIPE_BUF]; /* writes <= PIPE_BUF are guaranteed atomic */
+	char ibuf[LINE_MAX];
+	ssize_t olen = 0, ilen = 0;
+	nfds_t nfds = 2;
+	struct pollfd fds[2], *child2parent = &(fds[0]), *parent2child = &(fds[1]);
+	int poll_ret;
+
+	if(_alpm_chroot_enter(handle, &cwdfd) != 0) {
+		goto cleanup;
+	}
+
+	child2parent->events = POLLIN;
+	parent2child->fd = -1;
+	parent2child->events = stdin_cb ? POLLOUT : 0;
+
+	pid = _alpm_chroot_spawn(handle, cmd, argv, cwdfd, &child2parent->fd,
+			stdin_cb ? &parent2child->fd : NULL);
+	if(pid == -1) {
+		retval = 1;
+		goto cleanup;
+	}
 
 #define STOP_POLLING(p) do { close(p->fd); p->fd = -1; } while(0)
 
-		while((child2parent->fd != -1 || parent2child->fd != -1)
-				&& (poll_ret = poll(fds, nfds, -1)) != 0) {
-			if(poll_ret == -1) {
-				if(errno == EINTR) {
-					continue;
-				} else {
-					break;
-				}
+	while((child2parent->fd != -1 || parent2child->fd != -1)
+			&& (poll_ret = poll(fds, nfds, -1)) != 0) {
+		if(poll_ret == -1) {
+			if(errno == EINTR) {
+				continue;
+			} else {
+				break;
 			}
-			if(child2parent->revents & POLLIN) {
-				if(_alpm_chroot_read_from_child(handle, child2parent->fd,
-							ibuf, &ilen, sizeof(ibuf)) != 0) {
-					/* we encountered end-of-file or an error */
-					STOP_POLLING(child2parent);
-				}
-			} else if(child2parent->revents) {
-				/* anything but POLLIN indicates an error */
+		}
+		if(child2parent->revents & POLLIN) {
+			if(_alpm_chroot_read_from_child(handle, child2parent->fd,
+						ibuf, &ilen, sizeof(ibuf)) != 0) {
+				/* we encountered end-of-file or an error */
 				STOP_POLLING(child2parent);
 			}
-			if(parent2child->revents & POLLOUT) {
-				if(_alpm_chroot_write_to_child(handle, parent2child->fd, obuf, &olen,
-							sizeof(obuf), stdin_cb, stdin_ctx) != 0) {
-					STOP_POLLING(parent2child);
-				}
-			} else if(parent2child->revents) {
-				/* anything but POLLOUT indicates an error */
+		} else if(child2parent->revents) {
+			/* anything but POLLIN indicates an error */
+			STOP_POLLING(child2parent);
+		}
+		if(parent2child->revents & POLLOUT) {
+			if(_alpm_chroot_write_to_child(handle, parent2child->fd, obuf, &olen,
+						sizeof(obuf), stdin_cb, stdin_ctx) != 0) {
 				STOP_POLLING(parent2child);
 			}
+		} else if(parent2child->revents) {
+			/* anything but POLLOUT indicates an error */
+			STOP_POLLING(parent2child);
 		}
-		/* process anything left in the input buffer */
-		if(ilen) {
-			/* buffer would have already been flushed if it had a newline */
-			strcpy(ibuf + ilen, "\n");
-			_alpm_chroot_process_output(handle, ibuf);
-		}
+	}
+	/* process anything left in the input buffer */
+	if(ilen) {
+		/* buffer would have already been flushed if it had a newline */
+		strcpy(ibuf + ilen, "\n");
+		_alpm_chroot_process_output(handle, ibuf);
+	}
 
 #undef STOP_POLLING
+
+	if(parent2child->fd != -1) {
+		close(parent2child->fd);
+	}
+	if(child2parent->fd != -1) {
+		close(child2parent->fd);
+	}
+
+	retval = _alpm_chroot_wait(handle, pid);
+
+cleanup:
+	_alpm_chroot_leave(handle, cwdfd);
+
+	return retval;
+}
+
 #undef HEAD
 #undef TAIL
 
-		if(parent2child->fd != -1) {
-			close(parent2child->fd);
+/* pass the buffered output of a job on line by line */
+static void _alpm_chroot_job_flush(alpm_handle_t *handle, struct _alpm_chroot_job_t *job)
+{
+	char *line = job->out, *end = job->out + job->outlen;
+
+	while(line < end) {
+		char *newline = memchr(line, '\n', end - line);
+		char old;
+		if(newline == NULL) {
+			/* room for "\n\0" is always reserved */
+			strcpy(end, "\n");
+			newline = end;
 		}
-		if(child2parent->fd != -1) {
-			close(child2parent->fd);
+		old = newline[1];
+		newline[1] = '\0';
+		_alpm_chroot_process_output(handle, line);
+		newline[1] = old;
+		line = newline + 1;
+	}
+
+	FREE(job->out);
+	job->outlen = job->outsize = 0;
+}
+
+/* buffer whatever the job has written, returns -1 once done reading */
+static int _alpm_chroot_job_read(alpm_handle_t *handle, struct _alpm_chroot_job_t *job)
+{
+	ssize_t nread;
+
+	/* reserve 2 for "\n\0" */
+	if(!_alpm_greedy_grow((void **)&job->out, &job->outsize, job->outlen + PIPE_BUF + 2)) {
+		_alpm_alloc_fail(job->outlen + PIPE_BUF + 2);
+		return -1;
+	}
+
+	nread = read(job->outfd, job->out + job->outlen, PIPE_BUF);
+	if(nread > 0) {
+		job->outlen += nread;
+	} else if(nread == 0) {
+		return -1;
+	} else if(!should_retry(errno)) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("unable to read from pipe (%s)\n"), strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void _alpm_chroot_job_finish(alpm_handle_t *handle,
+		struct _alpm_chroot_job_t *job, _alpm_cb_chroot_job cb, void *ctx)
+{
+	cb(handle, job, 0, ctx);
+	_alpm_chroot_job_flush(handle, job);
+	job->retval = job->pid > 0 ? _alpm_chroot_wait(handle, job->pid) : 1;
+	job->pid = 0;
+	cb(handle, job, 1, ctx);
+}
+
+/** Execute several commands in the chroot at the same time.
+ *
+ * Up to @a limit commands run concurrently, started in array order. The
+ * output of each command is buffered; once a command has exited, @a cb is
+ * called with done = 0, the output is logged and emitted as scriptlet info
+ * events, then @a cb is called again with done = 1. Each command's output
+ * thus appears in one piece, in the order the commands finish.
+ *
+ * @param handle the context handle
+ * @param jobs the commands to run; retval is set for each of them
+ * @param count number of entries in @a jobs
+ * @param limit maximum number of commands to run at once
+ * @param cb callback run before and after emitting a command's output
+ * @param ctx context to be passed to @a cb
+ * @return 0 if all commands succeeded, 1 otherwise
+ */
+int _alpm_run_chroot_jobs(alpm_handle_t *handle, struct _alpm_chroot_job_t *jobs,
+		size_t count, size_t limit, _alpm_cb_chroot_job cb, void *ctx)
+{
+	struct pollfd *fds = NULL;
+	size_t *owner = NULL, next = 0, running = 0, i;
+	int cwdfd, retval = 0;
+
+	if(limit < 1) {
+		limit = 1;
+	}
+
+	for(i = 0; i < count; i++) {
+		jobs[i].pid = 0;
+		jobs[i].outfd = jobs[i].infd = -1;
+		jobs[i].out = NULL;
+		jobs[i].outlen = jobs[i].outsize = 0;
+		jobs[i].olen = 0;
+		jobs[i].retval = 1;
+	}
+
+	MALLOC(fds, 2 * limit * sizeof(struct pollfd), return 1);
+	MALLOC(owner, 2 * limit * sizeof(size_t), free(fds); return 1);
+
+	if(_alpm_chroot_enter(handle, &cwdfd) != 0) {
+		for(i = 0; i < count; i++) {
+			_alpm_chroot_job_finish(handle, &jobs[i], cb, ctx);
 		}
+		retval = 1;
+		goto cleanup;
+	}
 
-		while(waitpid(pid, &status, 0) == -1) {
-			if(errno != EINTR) {
-				_alpm_log(handle, ALPM_LOG_ERROR, _("call to waitpid failed (%s)\n"), strerror(errno));
-				retval = 1;
-				goto cleanup;
+	while(next < count || running) {
+		nfds_t nfds = 0;
+		int poll_ret;
+
+		/* fill up the free slots */
+		while(running < limit && next < count) {
+			struct _alpm_chroot_job_t *job = &jobs[next++];
+			job->pid = _alpm_chroot_spawn(handle, job->cmd, job->argv, cwdfd,
+					&job->outfd, job->stdin_cb ? &job->infd : NULL);
+			if(job->pid == -1) {
+				_alpm_chroot_job_finish(handle, job, cb, ctx);
+				continue;
 			}
+			running++;
 		}
 
-		/* check the return status, make sure it is 0 (success) */
-		if(WIFEXITED(status)) {
-			_alpm_log(handle, ALPM_LOG_DEBUG, "call to waitpid succeeded\n");
-			if(WEXITSTATUS(status) != 0) {
-				_alpm_log(handle, ALPM_LOG_ERROR, _("command failed to execute correctly\n"));
-				retval = 1;
+		for(i = 0; i < next; i++) {
+			if(jobs[i].outfd != -1) {
+				fds[nfds].fd = jobs[i].outfd;
+				fds[nfds].events = POLLIN;
+				owner[nfds++] = i;
 			}
-		} else if(WIFSIGNALED(status) != 0) {
-			char *signal_description = strsignal(WTERMSIG(status));
-			/* strsignal can return NULL on some (non-Linux) platforms */
-			if(signal_description == NULL) {
-				signal_description = _("Unknown signal");
+			if(jobs[i].infd != -1) {
+				fds[nfds].fd = jobs[i].infd;
+				fds[nfds].events = POLLOUT;
+				owner[nfds++] = i;
+			}
+		}
+		if(nfds == 0) {
+			poll_ret = 0;
+		} else if((poll_ret = poll(fds, nfds, -1)) == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			_alpm_log(handle, ALPM_LOG_ERROR, _("call to poll failed (%s)\n"), strerror(errno));
+			/* stop listening; the children are still reaped below */
+			for(i = 0; i < next; i++) {
+				if(jobs[i].outfd != -1) {
+					close(jobs[i].outfd);
+					jobs[i].outfd = -1;
+				}
+				if(jobs[i].infd != -1) {
+					close(jobs[i].infd);
+					jobs[i].infd = -1;
+				}
+			}
+		}
+
+		for(i = 0; poll_ret > 0 && i < nfds; i++) {
+			struct _alpm_chroot_job_t *job = &jobs[owner[i]];
+			if(fds[i].fd == job->outfd) {
+				if(!(fds[i].revents & POLLIN) && fds[i].revents) {
+					/* anything but POLLIN indicates an error */
+					close(job->outfd);
+					job->outfd = -1;
+				} else if(fds[i].revents && _alpm_chroot_job_read(handle, job) != 0) {
+					close(job->outfd);
+					job->outfd = -1;
+				}
+			} else if(fds[i].revents & POLLOUT) {
+				if(_alpm_chroot_write_to_child(handle, job->infd, job->obuf, &job->olen,
+							sizeof(job->obuf), job->stdin_cb, job->stdin_ctx) != 0) {
+					close(job->infd);
+					job->infd = -1;
+				}
+			} else if(fds[i].revents) {
+				/* anything but POLLOUT indicates an error */
+				close(job->infd);
+				job->infd = -1;
+			}
+		}
+
+		for(i = 0; i < next; i++) {
+			struct _alpm_chroot_job_t *job = &jobs[i];
+			if(job->pid > 0 && job->outfd == -1 && job->infd == -1) {
+				_alpm_chroot_job_finish(handle, job, cb, ctx);
+				running--;
 			}
-			_alpm_log(handle, ALPM_LOG_ERROR, _("command terminated by signal %d: %s\n"),
-						WTERMSIG(status), signal_description);
-			retval = 1;
 		}
 	}
 
-cleanup:
-	if(cwdfd >= 0) {
-		if(fchdir(cwdfd) != 0) {
-			_alpm_log(handle, ALPM_LOG_ERROR,
-					_("could not restore working directory (%s)\n"), strerror(errno));
+	for(i = 0; i < count; i++) {
+		if(jobs[i].retval != 0) {
+			retval = 1;
 		}
-		close(cwdfd);
 	}
 
+cleanup:
+	_alpm_chroot_leave(handle, cwdfd);
+	free(fds);
+	free(owner);
+
 	return retval;
 }
 
@@ -930,6 +1407,193 @@ const char *_alpm_filecache_setup(alpm_handle_t *handle)
 	return cachedir;
 }
 
+/** Build the path of a file in the content-addressed package store.
+ * Blobs are kept as <store>/<first two digest characters>/<digest>.
+ * @param handle the context handle
+ * @param sha256sum hex SHA-256 digest of the package file
+ * @param suffix suffix to append to the blob name, e.g. ".sig"
+ * @return malloced path, NULL if there is no store or the digest is invalid
+ */
+static char *cachestore_path(alpm_handle_t *handle, const char *sha256sum,
+		const char *suffix)
+{
+	char *path;
+	size_t len;
+
+	if(handle->cachestore == NULL || sha256sum == NULL
+			|| strlen(sha256sum) != 64
+			|| strspn(sha256sum, "0123456789abcdef") != 64) {
+		return NULL;
+	}
+
+	len = strlen(handle->cachestore) + 3 + 64 + strlen(suffix) + 1;
+	MALLOC(path, len, return NULL);
+	snprintf(path, len, "%s%.2s/%s%s", handle->cachestore, sha256sum,
+			sha256sum, suffix);
+	return path;
+}
+
+/** Atomically make dest refer to the contents of src.
+ * A hard link is used where possible; if the two paths are on different
+ * filesystems and copy is set, the file is copied instead.
+ * @param src existing file
+ * @param dest path to create or replace
+ * @param copy whether to fall back to copying
+ * @return 0 on success, 1 on error
+ */
+static int cachestore_link(const char *src, const char *dest, int copy)
+{
+	char tmp[PATH_MAX];
+
+	if(snprintf(tmp, PATH_MAX, "%s.%ld.tmp", dest, (long)getpid()) >= PATH_MAX) {
+		return 1;
+	}
+	unlink(tmp);
+
+	if(link(src, tmp) != 0) {
+		if(!copy || (errno != EXDEV && errno != EPERM && errno != EMLINK)) {
+			return 1;
+		}
+		if(_alpm_copyfile(src, tmp) != 0) {
+			unlink(tmp);
+			return 1;
+		}
+	}
+	if(rename(tmp, dest) != 0) {
+		unlink(tmp);
+		return 1;
+	}
+	return 0;
+}
+
+/** Check whether the content-addressed store holds a package.
+ * @param handle the context handle
+ * @param sha256sum hex SHA-256 digest of the package file
+ * @return 1 if the package is in the store, 0 otherwise
+ */
+int _alpm_cachestore_exists(alpm_handle_t *handle, const char *sha256sum)
+{
+	struct stat buf;
+	int ret = 0;
+	char *blob = cachestore_path(handle, sha256sum, "");
+
+	if(blob) {
+		ret = (stat(blob, &buf) == 0 && S_ISREG(buf.st_mode));
+		free(blob);
+	}
+	return ret;
+}
+
+/** Link a package from the content-addressed store into the cache.
+ * The package file and, if present, its detached signature are placed in
+ * the writable cache directory under the given file name.
+ * @param handle the context handle
+ * @param filename file name the package should have in the cache
+ * @param sha256sum hex SHA-256 digest of the package file
+ * @return malloced path of the cached file, NULL if the store does not hold
+ * the package or it could not be linked
+ */
+char *_alpm_cachestore_fetch(alpm_handle_t *handle, const char *filename,
+		const char *sha256sum)
+{
+	const char *cachedir;
+	char *blob, *sigblob = NULL, *path = NULL, *sigpath = NULL;
+	struct stat buf;
+
+	blob = cachestore_path(handle, sha256sum, "");
+	if(blob == NULL || stat(blob, &buf) != 0 || !S_ISREG(buf.st_mode)) {
+		free(blob);
+		return NULL;
+	}
+
+	cachedir = _alpm_filecache_setup(handle);
+	path = _alpm_get_fullpath(cachedir, filename, "");
+	if(path == NULL) {
+		goto cleanup;
+	}
+	if(cachestore_link(blob, path, 1) != 0) {
+		_alpm_log(handle, ALPM_LOG_WARNING,
+				_("could not link %s from package store: %s\n"), filename, strerror(errno));
+		FREE(path);
+		goto cleanup;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "linked %s from package store %s\n", path, blob);
+
+	sigblob = cachestore_path(handle, sha256sum, ".sig");
+	sigpath = _alpm_get_fullpath(cachedir, filename, ".sig");
+	if(sigblob && sigpath && access(sigblob, F_OK) == 0) {
+		cachestore_link(sigblob, sigpath, 1);
+	}
+
+cleanup:
+	free(blob);
+	free(sigblob);
+	free(sigpath);
+	return path;
+}
+
+/** Add a validated package file to the content-addressed store.
+ * If the store already holds the package, the cached file is replaced by a
+ * link to the stored copy so the duplicate no longer takes up space.
+ * @param handle the context handle
+ * @param path path of the package file in the cache
+ * @param sha256sum hex SHA-256 digest of the package file
+ * @return 0 on success or if there is no store, -1 on error
+ */
+int _alpm_cachestore_add(alpm_handle_t *handle, const char *path,
+		const char *sha256sum)
+{
+	char *blob, *sigblob = NULL, *sigpath = NULL, *dir;
+	struct stat pathbuf, blobbuf;
+	int ret = 0;
+
+	blob = cachestore_path(handle, sha256sum, "");
+	if(blob == NULL) {
+		return 0;
+	}
+
+	if(stat(path, &pathbuf) != 0) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	if(stat(blob, &blobbuf) == 0) {
+		if(blobbuf.st_dev != pathbuf.st_dev || blobbuf.st_ino != pathbuf.st_ino) {
+			/* the store already has this package; share its copy, but never
+			 * replace a file by a copy of itself across filesystems */
+			if(cachestore_link(blob, path, 0) == 0) {
+				_alpm_log(handle, ALPM_LOG_DEBUG, "deduplicated %s against package store\n", path);
+			}
+		}
+	} else {
+		STRDUP(dir, blob, ret = -1; goto cleanup);
+		*strrchr(dir, '/') = '\0';
+		if(_alpm_makepath(dir) != 0 || cachestore_link(path, blob, 1) != 0) {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("could not add %s to package store: %s\n"), path, strerror(errno));
+			ret = -1;
+		} else {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "added %s to package store as %s\n", path, blob);
+		}
+		free(dir);
+		if(ret != 0) {
+			goto cleanup;
+		}
+	}
+
+	sigblob = cachestore_path(handle, sha256sum, ".sig");
+	sigpath = _alpm_get_fullpath(path, "", ".sig");
+	if(sigblob && sigpath && access(sigpath, F_OK) == 0 && access(sigblob, F_OK) != 0) {
+		cachestore_link(sigpath, sigblob, 1);
+	}
+
+cleanup:
+	free(blob);
+	free(sigblob);
+	free(sigpath);
+	return ret;
+}
+
 /** Setup directory for downloading files.
  * When using the sandbox, create a temporary directory under the supplied directory. The new
  * directory is writable by the download user, and will be removed after the download operation
@@ -1084,6 +1748,65 @@ static int md5_file(const char *path, unsigned char output[16])
 	return 0;
 }
 
+struct _alpm_sha256_t {
+#if HAVE_LIBSSL
+	EVP_MD_CTX *ctx;
+#else /* HAVE_LIBNETTLE */
+	struct sha256_ctx ctx;
+#endif
+};
+
+/** Start computing a SHA-256 digest over data fed in pieces.
+ * @return the digest state, NULL on failure
+ */
+alpm_sha256_t *_alpm_sha256_new(void)
+{
+	alpm_sha256_t *sha;
+
+	CALLOC(sha, 1, sizeof(alpm_sha256_t), return NULL);
+#if HAVE_LIBSSL
+	sha->ctx = EVP_MD_CTX_create();
+	if(sha->ctx == NULL
+			|| !EVP_DigestInit_ex(sha->ctx, EVP_get_digestbyname("SHA256"), NULL)) {
+		EVP_MD_CTX_destroy(sha->ctx);
+		free(sha);
+		return NULL;
+	}
+#else /* HAVE_LIBNETTLE */
+	sha256_init(&sha->ctx);
+#endif
+	return sha;
+}
+
+void _alpm_sha256_update(alpm_sha256_t *sha, const void *data, size_t len)
+{
+#if HAVE_LIBSSL
+	EVP_DigestUpdate(sha->ctx, data, len);
+#else /* HAVE_LIBNETTLE */
+	sha256_update(&sha->ctx, len, data);
+#endif
+}
+
+/** Finish a SHA-256 digest and free its state.
+ * @param sha the digest state, may be NULL
+ * @param output where to store the digest, NULL to discard it
+ */
+void _alpm_sha256_finish(alpm_sha256_t *sha, unsigned char output[32])
+{
+	unsigned char discard[32];
+
+	if(sha == NULL) {
+		return;
+	}
+#if HAVE_LIBSSL
+	EVP_DigestFinal_ex(sha->ctx, output ? output : discard, NULL);
+	EVP_MD_CTX_destroy(sha->ctx);
+#else /* HAVE_LIBNETTLE */
+	sha256_digest(&sha->ctx, SHA256_DIGEST_SIZE, output ? output : discard);
+#endif
+	free(sha);
+}
+
 /** Compute the SHA-256 message digest of a file.
  * @param path file path of file to compute SHA256 digest of
  * @param output string to hold computed SHA256 digest
@@ -1091,12 +1814,7 @@ static int md5_file(const char *path, unsigned char output[16])
  */
 static int sha256_file(const char *path, unsigned char output[32])
 {
-#if HAVE_LIBSSL
-	EVP_MD_CTX *ctx;
-	const EVP_MD *md = EVP_get_digestbyname("SHA256");
-#else /* HAVE_LIBNETTLE */
-	struct sha256_ctx ctx;
-#endif
+	alpm_sha256_t *sha;
 	unsigned char *buf;
 	ssize_t n;
 	int fd;
@@ -1109,37 +1827,28 @@ static int sha256_file(const char *path, unsigned char output[32])
 		return 1;
 	}
 
-#if HAVE_LIBSSL
-	ctx = EVP_MD_CTX_create();
-	EVP_DigestInit_ex(ctx, md, NULL);
-#else /* HAVE_LIBNETTLE */
-	sha256_init(&ctx);
-#endif
+	if((sha = _alpm_sha256_new()) == NULL) {
+		close(fd);
+		free(buf);
+		return 1;
+	}
 
 	while((n = read(fd, buf, ALPM_BUFFER_SIZE)) > 0 || errno == EINTR) {
 		if(n < 0) {
 			continue;
 		}
-#if HAVE_LIBSSL
-		EVP_DigestUpdate(ctx, buf, n);
-#else /* HAVE_LIBNETTLE */
-		sha256_update(&ctx, n, buf);
-#endif
+		_alpm_sha256_update(sha, buf, n);
 	}
 
 	close(fd);
 	free(buf);
 
 	if(n < 0) {
+		_alpm_sha256_finish(sha, NULL);
 		return 2;
 	}
 
-#if HAVE_LIBSSL
-	EVP_DigestFinal_ex(ctx, output, NULL);
-	EVP_MD_CTX_destroy(ctx);
-#else /* HAVE_LIBNETTLE */
-	sha256_digest(&ctx, SHA256_DIGEST_SIZE, output);
-#endif
+	_alpm_sha256_finish(sha, output);
 	return 0;
 }
 #endif /* HAVE_LIBSSL || HAVE_LIBNETTLE */
@@ -18,6 +18,7 @@
 #include <stdarg.h>
 #include <stddef.h> /* size_t */
 #include <sys/types.h>
+#include <limits.h> /* PIPE_BUF */
 #include <math.h> /* fabs */
 #include <float.h> /* DBL_EPSILON */
 #include <fcntl.h> /* open, close */
@@ -47,17 +48,17 @@ void _alpm_alloc_fail(size_t size);
 
 #define RET_ERR_VOID(handle, err) do { \
 	_alpm_log(handle, ALPM_LOG_DEBUG, "returning error %d from %s (%s: %d) : %s\n", err, __func__, __FILE__, __LINE__, alpm_strerror(err)); \
-	(handle)->pm_errno = (err); \
+	_alpm_set_errno(handle, err); \
 	return; } while(0)
 
 #define RET_ERR(handle, err, ret) do { \
 	_alpm_log(handle, ALPM_LOG_DEBUG, "returning error %d from %s (%s: %d) : %s\n", err, __func__, __FILE__, __LINE__, alpm_strerror(err)); \
-	(handle)->pm_errno = (err); \
+	_alpm_set_errno(handle, err); \
 	return (ret); } while(0)
 
 #define GOTO_ERR(handle, err, label) do { \
 	_alpm_log(handle, ALPM_LOG_DEBUG, "got error %d at %s (%s: %d) : %s\n", err, __func__, __FILE__, __LINE__, alpm_strerror(err)); \
-	(handle)->pm_errno = (err); \
+	_alpm_set_errno(handle, err); \
 	goto label; } while(0)
 
 #define RET_ERR_ASYNC_SAFE(handle, err, ret) do { \
@@ -104,6 +105,9 @@ size_t _alpm_strip_newline(char *str, size_t len);
 
 int _alpm_open_archive(alpm_handle_t *handle, const char *path,
 		struct stat *buf, struct archive **archive, alpm_errno_t error);
+int _alpm_open_archive_threads(alpm_handle_t *handle, const char *path,
+		struct stat *buf, struct archive **archive, alpm_errno_t error,
+		unsigned int threads);
 int _alpm_unpack_single(alpm_handle_t *handle, const char *archive,
 		const char *prefix, const char *filename);
 int _alpm_unpack(alpm_handle_t *handle, const char *archive, const char *prefix,
@@ -114,17 +118,54 @@ ssize_t _alpm_files_in_directory(alpm_handle_t *handle, const char *path, int fu
 typedef ssize_t (*_alpm_cb_io)(void *buf, ssize_t len, void *ctx);
 
 void _alpm_reset_signals(void);
+int _alpm_chroot_set_spawn(const char *method);
 int _alpm_run_chroot(alpm_handle_t *handle, const char *cmd, char *const argv[],
 		_alpm_cb_io in_cb, void *in_ctx);
+
+/* a command for _alpm_run_chroot_jobs */
+struct _alpm_chroot_job_t {
+	const char *cmd;
+	char *const *argv;
+	_alpm_cb_io stdin_cb;
+	void *stdin_ctx;
+	void *data;         /* for the caller */
+	int retval;         /* 0 on success, 1 on error */
+
+	/* private */
+	pid_t pid;
+	int outfd, infd;
+	char *out;          /* buffered output */
+	size_t outlen, outsize;
+	char obuf[PIPE_BUF];
+	ssize_t olen;
+};
+
+typedef void (*_alpm_cb_chroot_job)(alpm_handle_t *handle,
+		struct _alpm_chroot_job_t *job, int done, void *ctx);
+
+int _alpm_run_chroot_jobs(alpm_handle_t *handle, struct _alpm_chroot_job_t *jobs,
+		size_t count, size_t limit, _alpm_cb_chroot_job cb, void *ctx);
 int _alpm_ldconfig(alpm_handle_t *handle);
 int _alpm_str_cmp(const void *s1, const void *s2);
 char *_alpm_filecache_find(alpm_handle_t *handle, const char *filename);
 /* Checks whether a file exists in cache */
 int _alpm_filecache_exists(alpm_handle_t *handle, const char *filename);
 const char *_alpm_filecache_setup(alpm_handle_t *handle);
+int _alpm_cachestore_exists(alpm_handle_t *handle, const char *sha256sum);
+char *_alpm_cachestore_fetch(alpm_handle_t *handle, const char *filename,
+		const char *sha256sum);
+int _alpm_cachestore_add(alpm_handle_t *handle, const char *path,
+		const char *sha256sum);
 char *_alpm_download_dir_setup(alpm_handle_t *handle, const char *dir);
 void _alpm_remove_temporary_download_dir(const char *dir);
 
+#if defined HAVE_LIBSSL || defined HAVE_LIBNETTLE
+typedef struct _alpm_sha256_t alpm_sha256_t;
+alpm_sha256_t *_alpm_sha256_new(void);
+void _alpm_sha256_update(alpm_sha256_t *sha, const void *data, size_t len);
+void _alpm_sha256_finish(alpm_sha256_t *sha, unsigned char output[32]);
+#endif
+
 /* Unlike many uses of alpm_pkgvalidation_t, _alpm_test_checksum expects
  * an enum value rather than a bitfield. */
 int _alpm_test_checksum(const char *filepath, const char *expected, alpm_pkgvalidation_t type);
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+/* libalpm */
+#include "vector.h"
+#include "util.h"
+
+/** Make room for at least count items.
+ * @param vec the vector
+ * @param count number of items the vector must be able to hold
+ * @return 0 on success, -1 on allocation failure
+ */
+int _alpm_vector_reserve(alpm_vector_t *vec, size_t count)
+{
+	size_t size = vec->size ? vec->size : 16;
+
+	if(count <= vec->size) {
+		return 0;
+	}
+	while(size < count) {
+		if(size > (size_t)-1 / 2 / sizeof(void *)) {
+			return -1;
+		}
+		size *= 2;
+	}
+	REALLOC(vec->data, size * sizeof(void *), return -1);
+	vec->size = size;
+	return 0;
+}
+
+/** Append an item.
+ * @param vec the vector
+ * @param item the item to append
+ * @return 0 on success, -1 on allocation failure
+ */
+int _alpm_vector_push(alpm_vector_t *vec, void *item)
+{
+	if(_alpm_vector_reserve(vec, vec->count + 1) != 0) {
+		return -1;
+	}
+	vec->data[vec->count++] = item;
+	return 0;
+}
+
+/** Append every item of a list.
+ * @param vec the vector
+ * @param list the list to copy
+ * @return 0 on success, -1 on allocation failure
+ */
+int _alpm_vector_from_list(alpm_vector_t *vec, alpm_list_t *list)
+{
+	if(_alpm_vector_reserve(vec, vec->count + alpm_list_count(list)) != 0) {
+		return -1;
+	}
+	for(; list; list = list->next) {
+		vec->data[vec->count++] = list->data;
+	}
+	return 0;
+}
+
+/** Copy the items into a new list, in order.
+ * @param vec the vector
+ * @return the new list, NULL if the vector is empty or allocation failed
+ */
+alpm_list_t *_alpm_vector_to_list(const alpm_vector_t *vec)
+{
+	alpm_list_t *list = NULL, *last = NULL;
+	size_t i;
+
+	for(i = 0; i < vec->count; i++) {
+		alpm_list_t *node;
+		MALLOC(node, sizeof(alpm_list_t), alpm_list_free(list); return NULL);
+		node->data = vec->data[i];
+		node->next = NULL;
+		if(last) {
+			node->prev = last;
+			last->next = node;
+		} else {
+			list = node;
+		}
+		last = node;
+		list->prev = last;
+	}
+	return list;
+}
+
+/** Free the storage of a vector and reset it to empty.
+ * @param vec the vector
+ * @param fn function to free each item with, NULL to leave the items alone
+ */
+void _alpm_vector_free(alpm_vector_t *vec, alpm_list_fn_free fn)
+{
+	size_t i;
+
+	if(fn) {
+		for(i = 0; i < vec->count; i++) {
+			fn(vec->data[i]);
+		}
+	}
+	free(vec->data);
+	vec->data = NULL;
+	vec->count = vec->size = 0;
+}
+
+struct _alpm_strset_entry_t {
+	const char *key;
+	unsigned long hash;
+	void *data;
+};
+
+/* spread the sdbm hash over the table, its low bits alone cluster */
+static size_t strset_pos(const alpm_strset_t *set, unsigned long hash)
+{
+	return (size_t)((hash * 0x9E3779B97F4A7C15ULL) >> 32) & (set->size - 1);
+}
+
+static struct _alpm_strset_entry_t *strset_slot(const alpm_strset_t *set,
+		const char *key, unsigned long hash)
+{
+	size_t pos = strset_pos(set, hash);
+	struct _alpm_strset_entry_t *entry;
+
+	while((entry = set->entries + pos)->key
+			&& (entry->hash != hash || strcmp(entry->key, key) != 0)) {
+		pos = (pos + 1) & (set->size - 1);
+	}
+	return entry;
+}
+
+static int strset_grow(alpm_strset_t *set)
+{
+	struct _alpm_strset_entry_t *old = set->entries;
+	size_t i, oldsize = set->size;
+	size_t newsize = oldsize ? oldsize * 2 : 16;
+
+	CALLOC(set->entries, newsize, sizeof(struct _alpm_strset_entry_t),
+			set->entries = old; return -1);
+	set->size = newsize;
+	for(i = 0; i < oldsize; i++) {
+		if(old[i].key) {
+			*strset_slot(set, old[i].key, old[i].hash) = old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/** Add a key to a string set.
+ * @param set the set
+ * @param key the key, which is not copied
+ * @param data pointer to store with a new key
+ * @return 1 if the key was added, 0 if it was already present (its pointer
+ * is left unchanged), -1 on allocation failure
+ */
+int _alpm_strset_add(alpm_strset_t *set, const char *key, void *data)
+{
+	unsigned long hash = _alpm_hash_sdbm(key);
+	struct _alpm_strset_entry_t *entry;
+
+	/* keep the table at most three quarters full */
+	if((set->count + 1) * 4 > set->size * 3 && strset_grow(set) != 0) {
+		return -1;
+	}
+	entry = strset_slot(set, key, hash);
+	if(entry->key) {
+		return 0;
+	}
+	entry->key = key;
+	entry->hash = hash;
+	entry->data = data;
+	set->count++;
+	return 1;
+}
+
+/** Check whether a string set holds a key.
+ * @param set the set
+ * @param key the key to look for
+ * @return 1 if the key is present, 0 otherwise
+ */
+int _alpm_strset_contains(const alpm_strset_t *set, const char *key)
+{
+	if(set->count == 0) {
+		return 0;
+	}
+	return strset_slot(set, key, _alpm_hash_sdbm(key))->key != NULL;
+}
+
+/** Get the pointer stored with a key.
+ * @param set the set
+ * @param key the key to look for
+ * @return the pointer, NULL if the key is not present
+ */
+void *_alpm_strset_get(const alpm_strset_t *set, const char *key)
+{
+	if(set->count == 0) {
+		return NULL;
+	}
+	return strset_slot(set, key, _alpm_hash_sdbm(key))->data;
+}
+
+/** Free the storage of a string set and reset it to empty.
+ * @param set the set
+ * @param fn function to free the stored pointers with, NULL to leave them
+ */
+void _alpm_strset_free(alpm_strset_t *set, alpm_list_fn_free fn)
+{
+	size_t i;
+
+	if(fn) {
+		for(i = 0; i < set->size; i++) {
+			if(set->entries[i].key) {
+				fn(set->entries[i].data);
+			}
+		}
+	}
+	free(set->entries);
+	set->entries = NULL;
+	set->size = set->count = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef ALPM_VECTOR_H
+#define ALPM_VECTOR_H
+
+#include <stddef.h>
+
+#include "alpm_list.h"
+
+/**
+ * @brief A growable array of pointers.
+ *
+ * Internal replacement for alpm_list_t where a collection is appended to
+ * and then walked or indexed; lists are only built from it where they are
+ * handed out through the public API. A zero-initialized vector is empty.
+ */
+typedef struct _alpm_vector_t {
+	/** the items */
+	void **data;
+	/** number of items */
+	size_t count;
+	/** number of items data has room for */
+	size_t size;
+} alpm_vector_t;
+
+/**
+ * @brief A hash set of strings.
+ *
+ * Open addressing over sdbm hashes, used where a list would be searched by
+ * name over and over. Keys are not copied and must outlive the set; each
+ * key can carry a pointer. A zero-initialized set is empty.
+ */
+typedef struct _alpm_strset_t {
+	struct _alpm_strset_entry_t *entries;
+	/** number of slots, zero or a power of two */
+	size_t size;
+	/** number of keys */
+	size_t count;
+} alpm_strset_t;
+
+int _alpm_vector_reserve(alpm_vector_t *vec, size_t count);
+int _alpm_vector_push(alpm_vector_t *vec, void *item);
+int _alpm_vector_from_list(alpm_vector_t *vec, alpm_list_t *list);
+alpm_list_t *_alpm_vector_to_list(const alpm_vector_t *vec);
+void _alpm_vector_free(alpm_vector_t *vec, alpm_list_fn_free fn);
+
+int _alpm_strset_add(alpm_strset_t *set, const char *key, void *data);
+int _alpm_strset_contains(const alpm_strset_t *set, const char *key);
+void *_alpm_strset_get(const alpm_strset_t *set, const char *key);
+void _alpm_strset_free(alpm_strset_t *set, alpm_list_fn_free fn);
+
+#endif /* ALPM_VECTOR_H */
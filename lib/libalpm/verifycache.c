@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* Cache of package files that passed checksum and signature verification.
+ *
+ * Each line of <dbpath>/verifycache holds the validation result followed by
+ * a key made of the keyring generation, the identity of the package file
+ * (device, inode, size, mtime, ctime), the signature level, the expected
+ * digest and the signature that were checked. A package only hits the cache
+ * if all of these are unchanged; the keyring generation changes whenever a
+ * file in GPGDir is rewritten, which drops every entry at the next load.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* libalpm */
+#include "verifycache.h"
+#include "handle.h"
+#include "log.h"
+#include "signing.h"
+#include "util.h"
+#include "vector.h"
+
+#define VERIFYCACHE_FILE "verifycache"
+
+struct verify_entry {
+	int validation;
+	char *key;
+};
+
+static void verify_entry_free(struct verify_entry *entry)
+{
+	free(entry->key);
+	free(entry);
+}
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+#define MTIME_NSEC(st) ((long long)(st)->st_mtim.tv_nsec)
+#define CTIME_NSEC(st) ((long long)(st)->st_ctim.tv_nsec)
+#else
+#define MTIME_NSEC(st) 0LL
+#define CTIME_NSEC(st) 0LL
+#endif
+
+static unsigned long long mix(unsigned long long hash, unsigned long long val)
+{
+	return (hash ^ val) * 0x100000001b3ULL;
+}
+
+/* Changes whenever a keyring or trust database file in GPGDir is replaced
+ * or modified; importing, signing or revoking a key all rewrite them. */
+static unsigned long long keyring_generation(alpm_handle_t *handle)
+{
+	const char *files[] = { "pubring.kbx", "pubring.gpg", "trustdb.gpg" };
+	unsigned long long gen = 0xcbf29ce484222325ULL;
+	char path[PATH_MAX];
+	struct stat st;
+	size_t i;
+
+	if(handle->gpgdir == NULL) {
+		return 0;
+	}
+
+	for(i = 0; i < ARRAYSIZE(files); i++) {
+		snprintf(path, PATH_MAX, "%s%s", handle->gpgdir, files[i]);
+		if(stat(path, &st) != 0) {
+			gen = mix(gen, i);
+			continue;
+		}
+		gen = mix(gen, st.st_ino);
+		gen = mix(gen, st.st_size);
+		gen = mix(gen, st.st_mtime);
+		gen = mix(gen, MTIME_NSEC(&st));
+		gen = mix(gen, st.st_ctime);
+		gen = mix(gen, CTIME_NSEC(&st));
+	}
+
+	return gen;
+}
+
+/* Add an entry to the list and its index; a key that is already there, or
+ * one that cannot be indexed, frees the entry and returns -1. */
+static int verify_entry_insert(alpm_handle_t *handle, struct verify_entry *entry)
+{
+	if(_alpm_vector_push(&handle->verifycache_entries, entry) != 0) {
+		verify_entry_free(entry);
+		return -1;
+	}
+	if(_alpm_strset_add(&handle->verifycache_index, entry->key, entry) != 1) {
+		handle->verifycache_entries.count--;
+		verify_entry_free(entry);
+		return -1;
+	}
+	return 0;
+}
+
+static char *verifycache_path(alpm_handle_t *handle)
+{
+	char *path;
+	size_t len = strlen(handle->dbpath) + strlen(VERIFYCACHE_FILE) + 1;
+	MALLOC(path, len, return NULL);
+	snprintf(path, len, "%s%s", handle->dbpath, VERIFYCACHE_FILE);
+	return path;
+}
+
+/* Build the cache key for a package file, NULL if it cannot be stat'ed. */
+static char *verify_key(alpm_handle_t *handle, const char *pkgfile,
+		const char *sha256sum, const char *base64_sig, int level)
+{
+	char sigkey[128];
+	char *key;
+	struct stat st;
+
+	if(stat(pkgfile, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return NULL;
+	}
+
+	if(!(level & ALPM_SIG_PACKAGE)) {
+		snprintf(sigkey, sizeof(sigkey), "-");
+	} else if(base64_sig) {
+		snprintf(sigkey, sizeof(sigkey), "b:%zu:%lx", strlen(base64_sig),
+				_alpm_hash_sdbm(base64_sig));
+	} else {
+		/* detached signature next to the package */
+		char *sigpath = _alpm_sigpath(handle, pkgfile);
+		struct stat sigst;
+		if(sigpath && stat(sigpath, &sigst) == 0) {
+			snprintf(sigkey, sizeof(sigkey), "f:%llu:%llu:%lld:%lld.%lld",
+					(unsigned long long)sigst.st_dev, (unsigned long long)sigst.st_ino,
+					(long long)sigst.st_size, (long long)sigst.st_mtime,
+					MTIME_NSEC(&sigst));
+		} else {
+			snprintf(sigkey, sizeof(sigkey), "none");
+		}
+		free(sigpath);
+	}
+
+	if(asprintf(&key, "%016llx %llu %llu %lld %lld.%lld %lld.%lld %d %s %s",
+				keyring_generation(handle),
+				(unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+				(long long)st.st_size,
+				(long long)st.st_mtime, MTIME_NSEC(&st),
+				(long long)st.st_ctime, CTIME_NSEC(&st),
+				level, sha256sum ? sha256sum : "-", sigkey) == -1) {
+		_alpm_alloc_fail(0);
+		return NULL;
+	}
+	return key;
+}
+
+/* Write the loaded entries back, dropping the ones read from disk that no
+ * longer matched the keyring. Failure only costs a re-verification. */
+static void verifycache_rewrite(alpm_handle_t *handle, const char *path)
+{
+	char *tmppath = NULL;
+	size_t i;
+	FILE *fp;
+
+	if(asprintf(&tmppath, "%s.tmp", path) == -1) {
+		return;
+	}
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		free(tmppath);
+		return;
+	}
+	for(i = 0; i < handle->verifycache_entries.count; i++) {
+		struct verify_entry *entry = handle->verifycache_entries.data[i];
+		fprintf(fp, "%d %s\n", entry->validation, entry->key);
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		unlink(tmppath);
+	}
+	free(tmppath);
+}
+
+static void verifycache_load(alpm_handle_t *handle)
+{
+	char prefix[20], *path, *line = NULL;
+	size_t linesize = 0, dropped = 0;
+	ssize_t len;
+	FILE *fp;
+
+	handle->verifycache_loaded = 1;
+	if((path = verifycache_path(handle)) == NULL) {
+		return;
+	}
+	if((fp = fopen(path, "r")) == NULL) {
+		free(path);
+		return;
+	}
+
+	snprintf(prefix, sizeof(prefix), "%016llx ", keyring_generation(handle));
+	while((len = getline(&line, &linesize, fp)) != -1) {
+		struct verify_entry *entry;
+		char *key;
+		int validation;
+
+		_alpm_strip_newline(line, len);
+		validation = (int)strtol(line, &key, 10);
+		if(*key != ' ' || strncmp(key + 1, prefix, strlen(prefix)) != 0) {
+			dropped++;
+			continue;
+		}
+		CALLOC(entry, 1, sizeof(struct verify_entry), break);
+		entry->validation = validation;
+		STRDUP(entry->key, key + 1, free(entry); break);
+		if(verify_entry_insert(handle, entry) != 0) {
+			/* a duplicate line, leave it out when rewriting */
+			dropped++;
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "loaded %zu verification cache entries, dropped %zu\n",
+			handle->verifycache_entries.count, dropped);
+	if(dropped) {
+		verifycache_rewrite(handle, path);
+	}
+	free(path);
+}
+
+/** Look up a package file in the verification cache.
+ * @param handle the context handle
+ * @param pkgfile path of the package file
+ * @param sha256sum expected digest, NULL if none is checked
+ * @param base64_sig embedded signature, NULL if a detached one is used
+ * @param level signature level the file is checked with
+ * @param validation set to the cached validation result on a hit
+ * @return 0 if the file was verified before with the same inputs, -1 otherwise
+ */
+int _alpm_verifycache_lookup(alpm_handle_t *handle, const char *pkgfile,
+		const char *sha256sum, const char *base64_sig, int level, int *validation)
+{
+	struct verify_entry *entry;
+	char *key;
+
+	if(!handle->verifycache) {
+		return -1;
+	}
+	if(!handle->verifycache_loaded) {
+		verifycache_load(handle);
+	}
+	if((key = verify_key(handle, pkgfile, sha256sum, base64_sig, level)) == NULL) {
+		return -1;
+	}
+
+	entry = _alpm_strset_get(&handle->verifycache_index, key);
+	free(key);
+	if(entry == NULL) {
+		return -1;
+	}
+	if(validation) {
+		*validation = entry->validation;
+	}
+	return 0;
+}
+
+/** Record a package file that passed verification.
+ * The entry is appended to the cache file straight away so that it
+ * survives a transaction that fails later on.
+ * @param handle the context handle
+ * @param pkgfile path of the package file
+ * @param sha256sum digest that was checked, NULL if none
+ * @param base64_sig embedded signature, NULL if a detached one was used
+ * @param level signature level the file was checked with
+ * @param validation the resulting validation flags
+ */
+void _alpm_verifycache_add(alpm_handle_t *handle, const char *pkgfile,
+		const char *sha256sum, const char *base64_sig, int level, int validation)
+{
+	struct verify_entry *entry;
+	char *path;
+	FILE *fp;
+
+	if(!handle->verifycache) {
+		return;
+	}
+	if(!handle->verifycache_loaded) {
+		verifycache_load(handle);
+	}
+
+	CALLOC(entry, 1, sizeof(struct verify_entry), return);
+	entry->validation = validation;
+	if((entry->key = verify_key(handle, pkgfile, sha256sum, base64_sig, level)) == NULL) {
+		free(entry);
+		return;
+	}
+	if(verify_entry_insert(handle, entry) != 0) {
+		return;
+	}
+
+	if((path = verifycache_path(handle)) == NULL) {
+		return;
+	}
+	if((fp = fopen(path, "a")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not open verification cache %s: %s\n",
+				path, strerror(errno));
+		free(path);
+		return;
+	}
+	fprintf(fp, "%d %s\n", entry->validation, entry->key);
+	fclose(fp);
+	free(path);
+}
+
+void _alpm_verifycache_free(alpm_handle_t *handle)
+{
+	_alpm_strset_free(&handle->verifycache_index, NULL);
+	_alpm_vector_free(&handle->verifycache_entries,
+			(alpm_list_fn_free)verify_entry_free);
+	handle->verifycache_loaded = 0;
+}
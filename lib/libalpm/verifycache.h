@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef ALPM_VERIFYCACHE_H
+#define ALPM_VERIFYCACHE_H
+
+#include "alpm.h"
+
+int _alpm_verifycache_lookup(alpm_handle_t *handle, const char *pkgfile,
+		const char *sha256sum, const char *base64_sig, int level, int *validation);
+void _alpm_verifycache_add(alpm_handle_t *handle, const char *pkgfile,
+		const char *sha256sum, const char *base64_sig, int level, int validation);
+void _alpm_verifycache_free(alpm_handle_t *handle);
+
+#endif /* ALPM_VERIFYCACHE_H */
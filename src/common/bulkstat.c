@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(STATX_BASIC_STATS)
+#define BULKSTAT_URING 1
+#endif
+#endif
+
+#include "bulkstat.h"
+#include "util-common.h"
+
+/* below this many paths, plain sequential lstat calls are cheaper */
+#define BULKSTAT_MIN 32
+/* number of paths a worker thread claims at once */
+#define BULKSTAT_CHUNK 64
+#define BULKSTAT_MAX_THREADS 16
+#define BULKSTAT_QUEUE_DEPTH 256
+/* failed io_uring_enter calls in a row before giving up on the ring */
+#define BULKSTAT_URING_RETRIES 8
+
+struct bulkstat_req {
+	const char *prefix;
+	size_t prefixlen;
+	const char * const *paths;
+	size_t count;
+	struct stat *bufs;
+	int *errs;
+	size_t next;
+};
+
+/* Build "<prefix><path>" */
+static int bulkstat_path(const struct bulkstat_req *req, size_t i, char *buf)
+{
+	size_t len = strlen(req->paths[i]);
+
+	if(req->prefixlen + len >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+	memcpy(buf, req->prefix, req->prefixlen);
+	memcpy(buf + req->prefixlen, req->paths[i], len + 1);
+	return 0;
+}
+
+static void bulkstat_one(struct bulkstat_req *req, size_t i)
+{
+	char path[PATH_MAX];
+	int err = bulkstat_path(req, i, path);
+
+	if(err == 0 && llstat(path, req->bufs + i) != 0) {
+		err = errno;
+	}
+	req->errs[i] = err;
+}
+
+static void *bulkstat_worker(void *arg)
+{
+	struct bulkstat_req *req = arg;
+	size_t i;
+
+	while((i = __atomic_fetch_add(&req->next, BULKSTAT_CHUNK, __ATOMIC_RELAXED))
+			< req->count) {
+		size_t end = i + BULKSTAT_CHUNK;
+		if(end > req->count) {
+			end = req->count;
+		}
+		for(; i < end; i++) {
+			bulkstat_one(req, i);
+		}
+	}
+	return NULL;
+}
+
+/* Threads started on first use and kept for later calls. A request is
+ * published by bumping gen; workers that wake up after the caller has taken
+ * it back (req set to NULL) skip that generation. */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	struct bulkstat_req *req;
+	unsigned long gen;
+	size_t nthreads;
+	size_t active;
+	int in_use;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.idle = PTHREAD_COND_INITIALIZER,
+};
+
+static void *bulkstat_pool_worker(void *arg)
+{
+	unsigned long seen = 0;
+
+	(void)arg;
+	pthread_mutex_lock(&pool.lock);
+	for(;;) {
+		struct bulkstat_req *req;
+
+		while(pool.gen == seen) {
+			pthread_cond_wait(&pool.work, &pool.lock);
+		}
+		seen = pool.gen;
+		if((req = pool.req) == NULL) {
+			continue;
+		}
+		pool.active++;
+		pthread_mutex_unlock(&pool.lock);
+
+		bulkstat_worker(req);
+
+		pthread_mutex_lock(&pool.lock);
+		if(--pool.active == 0) {
+			pthread_cond_signal(&pool.idle);
+		}
+	}
+	return NULL;
+}
+
+static void bulkstat_threaded(struct bulkstat_req *req)
+{
+	size_t nthreads = (req->count + BULKSTAT_CHUNK - 1) / BULKSTAT_CHUNK;
+
+	if(nthreads > BULKSTAT_MAX_THREADS) {
+		nthreads = BULKSTAT_MAX_THREADS;
+	}
+	req->next = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	if(pool.in_use) {
+		/* another thread has the pool, work through the list alone */
+		pthread_mutex_unlock(&pool.lock);
+		bulkstat_worker(req);
+		return;
+	}
+	pool.in_use = 1;
+	/* the calling thread works through the list as well */
+	while(pool.nthreads + 1 < nthreads) {
+		pthread_attr_t attr;
+		pthread_t thread;
+		int ret;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		ret = pthread_create(&thread, &attr, bulkstat_pool_worker, NULL);
+		pthread_attr_destroy(&attr);
+		if(ret != 0) {
+			break;
+		}
+		pool.nthreads++;
+	}
+	pool.req = req;
+	pool.gen++;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	bulkstat_worker(req);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.req = NULL;
+	while(pool.active > 0) {
+		pthread_cond_wait(&pool.idle, &pool.lock);
+	}
+	pool.in_use = 0;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+#ifdef BULKSTAT_URING
+struct uring {
+	int fd;
+	unsigned entries;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static void uring_teardown(struct uring *ring)
+{
+	if(ring->sqes && ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if(ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_len);
+	}
+	if(ring->sq_ptr && ring->sq_ptr != MAP_FAILED) {
+		munmap(ring->sq_ptr, ring->sq_len);
+	}
+	close(ring->fd);
+}
+
+static int uring_setup(struct uring *ring, unsigned entries)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if(ring->fd < 0) {
+		return -1;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(ring->cq_len > ring->sq_len) {
+			ring->sq_len = ring->cq_len;
+		}
+		ring->cq_len = ring->sq_len;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ptr == MAP_FAILED) {
+		goto error;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cq_ptr == MAP_FAILED) {
+			goto error;
+		}
+	}
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) {
+		goto error;
+	}
+
+	sq = ring->sq_ptr;
+	cq = ring->cq_ptr;
+	ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+error:
+	uring_teardown(ring);
+	return -1;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/* Like the loop in llstat(), the length of path without trailing slashes */
+static size_t strip_slashes(const char *path)
+{
+	size_t len = strlen(path);
+
+	while(len > 1 && path[len - 1] == '/') {
+		--len;
+	}
+	return len;
+}
+
+/* Stat all paths through io_uring, a queue depth worth of requests at a time.
+ * Returns -1 if io_uring (or its statx operation) is unavailable or keeps
+ * failing, in which case the caller needs to redo the whole request. */
+static int bulkstat_uring(struct bulkstat_req *req)
+{
+	struct uring ring;
+	struct statx *stx;
+	char **slotpaths;
+	size_t done = 0;
+	int ret = 0, failures = 0;
+
+	if(uring_setup(&ring, BULKSTAT_QUEUE_DEPTH) != 0) {
+		return -1;
+	}
+	stx = calloc(ring.entries, sizeof(struct statx));
+	slotpaths = calloc(ring.entries, sizeof(char *));
+	if(!stx || !slotpaths) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	while(done < req->count) {
+		size_t n = req->count - done, k;
+		unsigned tail = *ring.sq_tail, queued = 0, to_submit, inflight;
+		int unsupported = 0;
+
+		if(n > ring.entries) {
+			n = ring.entries;
+		}
+
+		for(k = 0; k < n; k++) {
+			char path[PATH_MAX];
+			struct io_uring_sqe *sqe;
+			unsigned idx;
+			int err = bulkstat_path(req, done + k, path);
+
+			if(err == 0 && (slotpaths[k] = strndup(path, strip_slashes(path))) == NULL) {
+				err = ENOMEM;
+			}
+			if(err != 0) {
+				req->errs[done + k] = err;
+				continue;
+			}
+
+			idx = tail & *ring.sq_mask;
+			sqe = ring.sqes + idx;
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (unsigned long)slotpaths[k];
+			sqe->len = STATX_BASIC_STATS;
+			sqe->off = (unsigned long)(stx + k);
+			sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+			sqe->user_data = k;
+			ring.sq_array[idx] = idx;
+			tail++;
+			queued++;
+		}
+		__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+		to_submit = queued;
+		inflight = queued;
+		while(inflight > 0) {
+			unsigned head, cqtail;
+			int r = syscall(__NR_io_uring_enter, ring.fd, to_submit, 1,
+					IORING_ENTER_GETEVENTS, NULL, 0);
+			if(r < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				if(inflight == to_submit) {
+					/* nothing reached the kernel, safe to bail out */
+					ret = -1;
+					goto cleanup;
+				}
+				if(++failures >= BULKSTAT_URING_RETRIES) {
+					/* requests already submitted may still write to stx and
+					 * read slotpaths; leave both to the kernel */
+					stx = NULL;
+					slotpaths = NULL;
+					ret = -1;
+					goto cleanup;
+				}
+				continue;
+			}
+			failures = 0;
+			to_submit -= (unsigned)r < to_submit ? (unsigned)r : to_submit;
+
+			head = *ring.cq_head;
+			cqtail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+			for(; head != cqtail; head++) {
+				const struct io_uring_cqe *cqe = ring.cqes + (head & *ring.cq_mask);
+				size_t slot = cqe->user_data;
+				size_t i = done + slot;
+
+				if(cqe->res == -EINVAL) {
+					/* statx is not supported by this kernel's io_uring */
+					unsupported = 1;
+				} else if(cqe->res < 0) {
+					req->errs[i] = -cqe->res;
+				} else {
+					statx_to_stat(stx + slot, req->bufs + i);
+					req->errs[i] = 0;
+				}
+				free(slotpaths[slot]);
+				slotpaths[slot] = NULL;
+				inflight--;
+			}
+			__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		if(unsupported) {
+			ret = -1;
+			goto cleanup;
+		}
+		done += n;
+	}
+
+cleanup:
+	if(slotpaths) {
+		size_t k;
+		for(k = 0; k < ring.entries; k++) {
+			free(slotpaths[k]);
+		}
+		free(slotpaths);
+	}
+	free(stx);
+	uring_teardown(&ring);
+	return ret;
+}
+#endif
+
+static void bulkstat_init(struct bulkstat_req *req, const char *prefix,
+		const char * const *paths, size_t count, struct stat *bufs, int *errs)
+{
+	req->prefix = prefix ? prefix : "";
+	req->prefixlen = strlen(req->prefix);
+	req->paths = paths;
+	req->count = count;
+	req->bufs = bufs;
+	req->errs = errs;
+	req->next = 0;
+}
+
+/** Run llstat() on many paths one after the other in the calling thread,
+ * for callers that already spread their work over several threads.
+ * @param prefix string prepended to every path (e.g. the root), may be NULL
+ * @param paths paths to stat, trailing slashes are handled as by llstat()
+ * @param count number of paths
+ * @param bufs array of count stat structures to fill
+ * @param errs array of count ints set to 0 or the errno of each lookup
+ */
+void llstat_list(const char *prefix, const char * const *paths, size_t count,
+		struct stat *bufs, int *errs)
+{
+	struct bulkstat_req req;
+	size_t i;
+
+	bulkstat_init(&req, prefix, paths, count, bufs, errs);
+	for(i = 0; i < count; i++) {
+		bulkstat_one(&req, i);
+	}
+}
+
+/** Run llstat() on many paths, keeping a number of lookups in flight at once.
+ * On network-backed or cold filesystems the latency of each lstat dominates,
+ * so the lookups are batched through io_uring where available, falling back
+ * to a small pool of threads otherwise.
+ * @param prefix string prepended to every path (e.g. the root), may be NULL
+ * @param paths paths to stat, trailing slashes are handled as by llstat()
+ * @param count number of paths
+ * @param bufs array of count stat structures to fill
+ * @param errs array of count ints set to 0 or the errno of each lookup
+ */
+void llstat_bulk(const char *prefix, const char * const *paths, size_t count,
+		struct stat *bufs, int *errs)
+{
+	struct bulkstat_req req;
+
+	if(count < BULKSTAT_MIN) {
+		llstat_list(prefix, paths, count, bufs, errs);
+		return;
+	}
+	bulkstat_init(&req, prefix, paths, count, bufs, errs);
+
+#ifdef BULKSTAT_URING
+	if(bulkstat_uring(&req) == 0) {
+		return;
+	}
+#endif
+	bulkstat_threaded(&req);
+}
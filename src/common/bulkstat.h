@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#ifndef PM_BULKSTAT_H
+#define PM_BULKSTAT_H
+
+#include <stddef.h>
+#include <sys/stat.h> /* struct stat */
+
+void llstat_list(const char *prefix, const char * const *paths, size_t count,
+		struct stat *bufs, int *errs);
+void llstat_bulk(const char *prefix, const char * const *paths, size_t count,
+		struct stat *bufs, int *errs);
+
+#endif /* PM_BULKSTAT_H */
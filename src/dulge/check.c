@@ -8,26 +8,108 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
 
 /* dulge */
+#include "bulkstat.h"
 #include "check.h"
 #include "conf.h"
 #include "util.h"
 
-static int check_file_exists(const char *pkgname, char *filepath, size_t rootlen,
-		struct stat *st)
+/* a piece of output of a package check, see check_capture */
+struct check_chunk {
+	FILE *stream;
+	char *text;
+};
+
+/* when set, output of the checks run by this thread is collected here as a
+ * list of check_chunk instead of being printed right away */
+static __thread alpm_list_t **check_capture;
+
+/* libalpm is not thread safe, even its getters reset pm_errno. Every call
+ * into it made while checking goes through this lock, so with --jobs only
+ * the stat and hashing work runs in parallel. */
+static pthread_mutex_t check_alpm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* totals over all checks, reported by check_pkgs() */
+static struct {
+	size_t files;
+	off_t bytes;
+} check_stats;
+
+static void check_printf(const char *format, ...)
+	__attribute__((format(printf, 1, 2)));
+static void check_pm_printf(alpm_loglevel_t level, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void check_output(FILE *stream, char *text)
 {
-	/* use lstat to prevent errors from symlinks */
-	if(llstat(filepath, st) != 0) {
-		if(alpm_option_match_noextract(config->handle, filepath + rootlen) == 0) {
+	struct check_chunk *chunk;
+
+	if(text == NULL) {
+		return;
+	}
+	if(check_capture == NULL || (chunk = malloc(sizeof(*chunk))) == NULL) {
+		fputs(text, stream);
+		free(text);
+		return;
+	}
+	chunk->stream = stream;
+	chunk->text = text;
+	*check_capture = alpm_list_add(*check_capture, chunk);
+}
+
+static void check_printf(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	if(check_capture == NULL) {
+		vprintf(format, args);
+	} else {
+		char *text = NULL;
+		if(vasprintf(&text, format, args) != -1) {
+			check_output(stdout, text);
+		}
+	}
+	va_end(args);
+}
+
+static void check_pm_printf(alpm_loglevel_t level, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	if(check_capture == NULL) {
+		pm_vfprintf(stderr, level, format, args);
+	} else {
+		char *text = NULL;
+		pm_vasprintf(&text, level, format, args);
+		check_output(stderr, text);
+	}
+	va_end(args);
+}
+
+static int check_file_exists(const char *pkgname, const char *filepath,
+		size_t rootlen, int err)
+{
+	if(err != 0) {
+		int noextract;
+
+		pthread_mutex_lock(&check_alpm_lock);
+		noextract = alpm_option_match_noextract(config->handle, filepath + rootlen) == 0;
+		pthread_mutex_unlock(&check_alpm_lock);
+		if(noextract) {
 			/* NoExtract */
 			return -1;
 		} else {
 			if(config->quiet) {
-				printf("%s %s\n", pkgname, filepath);
+				check_printf("%s %s\n", pkgname, filepath);
 			} else {
-				pm_printf(ALPM_LOG_WARNING, "%s: %s (%s)\n",
-						pkgname, filepath, strerror(errno));
+				check_pm_printf(ALPM_LOG_WARNING, "%s: %s (%s)\n",
+						pkgname, filepath, strerror(err));
 			}
 			return 1;
 		}
@@ -46,9 +128,9 @@ static int check_file_type(const char *pkgname, const char *filepath,
 			(archive_type == AE_IFDIR && !S_ISDIR(file_type)) ||
 			(archive_type == AE_IFLNK && !S_ISLNK(file_type))) {
 		if(config->quiet) {
-			printf("%s %s\n", pkgname, filepath);
+			check_printf("%s %s\n", pkgname, filepath);
 		} else {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (File type mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (File type mismatch)\n"),
 					pkgname, filepath);
 		}
 		return 1;
@@ -67,7 +149,7 @@ static int check_file_permissions(const char *pkgname, const char *filepath,
 	if(st->st_uid != archive_entry_uid(entry)) {
 		errors++;
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (UID mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (UID mismatch)\n"),
 					pkgname, filepath);
 		}
 	}
@@ -76,7 +158,7 @@ static int check_file_permissions(const char *pkgname, const char *filepath,
 	if(st->st_gid != archive_entry_gid(entry)) {
 		errors++;
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (GID mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (GID mismatch)\n"),
 					pkgname, filepath);
 		}
 	}
@@ -86,7 +168,7 @@ static int check_file_permissions(const char *pkgname, const char *filepath,
 	if(fsmode != (~AE_IFMT & archive_entry_mode(entry))) {
 		errors++;
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Permissions mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (Permissions mismatch)\n"),
 					pkgname, filepath);
 		}
 	}
@@ -100,15 +182,15 @@ static int check_file_time(const char *pkgname, const char *filepath,
 	if(st->st_mtime != archive_entry_mtime(entry)) {
 		if(backup) {
 			if(!config->quiet) {
-				printf("%s%s%s: ", config->colstr.title, _("backup file"),
+				check_printf("%s%s%s: ", config->colstr.title, _("backup file"),
 						config->colstr.nocolor);
-				printf(_("%s: %s (Modification time mismatch)\n"),
+				check_printf(_("%s: %s (Modification time mismatch)\n"),
 						pkgname, filepath);
 			}
 			return 0;
 		}
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Modification time mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (Modification time mismatch)\n"),
 					pkgname, filepath);
 		}
 		return 1;
@@ -125,14 +207,14 @@ static int check_file_link(const char *pkgname, const char *filepath,
 
 	if(readlink(filepath, link, length) != st->st_size) {
 		/* this should not happen */
-		pm_printf(ALPM_LOG_ERROR, _("unable to read symlink contents: %s\n"), filepath);
+		check_pm_printf(ALPM_LOG_ERROR, _("unable to read symlink contents: %s\n"), filepath);
 		return 1;
 	}
 	link[length - 1] = '\0';
 
 	if(strcmp(link, archive_entry_symlink(entry)) != 0) {
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Symlink path mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (Symlink path mismatch)\n"),
 					pkgname, filepath);
 		}
 		return 1;
@@ -147,15 +229,15 @@ static int check_file_size(const char *pkgname, const char *filepath,
 	if(st->st_size != archive_entry_size(entry)) {
 		if(backup) {
 			if(!config->quiet) {
-				printf("%s%s%s: ", config->colstr.title, _("backup file"),
+				check_printf("%s%s%s: ", config->colstr.title, _("backup file"),
 						config->colstr.nocolor);
-				printf(_("%s: %s (Size mismatch)\n"),
+				check_printf(_("%s: %s (Size mismatch)\n"),
 						pkgname, filepath);
 			}
 			return 0;
 		}
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Size mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (Size mismatch)\n"),
 					pkgname, filepath);
 		}
 		return 1;
@@ -170,7 +252,7 @@ static int check_file_cksum(const char *pkgname, const char *filepath,
 {
 	if(!cksum_calc) {
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (failed to calculate %s checksum)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (failed to calculate %s checksum)\n"),
 					pkgname, filepath, cksum_name);
 		}
 		return 1;
@@ -178,7 +260,7 @@ static int check_file_cksum(const char *pkgname, const char *filepath,
 
 	if(!cksum_mtree) {
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (%s checksum information not available)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (%s checksum information not available)\n"),
 					pkgname, filepath, cksum_name);
 		}
 		return 1;
@@ -187,15 +269,15 @@ static int check_file_cksum(const char *pkgname, const char *filepath,
 	if(strcmp(cksum_calc, cksum_mtree) != 0) {
 		if(backup) {
 			if(!config->quiet) {
-				printf("%s%s%s: ", config->colstr.title, _("backup file"),
+				check_printf("%s%s%s: ", config->colstr.title, _("backup file"),
 						config->colstr.nocolor);
-				printf(_("%s: %s (%s checksum mismatch)\n"),
+				check_printf(_("%s: %s (%s checksum mismatch)\n"),
 						pkgname, filepath, cksum_name);
 			}
 			return 0;
 		}
 		if(!config->quiet) {
-			pm_printf(ALPM_LOG_WARNING, _("%s: %s (%s checksum mismatch)\n"),
+			check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (%s checksum mismatch)\n"),
 					pkgname, filepath, cksum_name);
 		}
 		return 1;
@@ -221,6 +303,17 @@ static int check_file_sha256sum(const char *pkgname, const char *filepath,
 	return (errors != 0 ? 1 : 0);
 }
 
+/* llstat_bulk() brings its own threads, which --jobs workers don't need */
+static void check_llstat(const char *prefix, const char * const *paths,
+		size_t count, struct stat *bufs, int *errs)
+{
+	if(config->jobs > 1) {
+		llstat_list(prefix, paths, count, bufs, errs);
+	} else {
+		llstat_bulk(prefix, paths, count, bufs, errs);
+	}
+}
+
 /* Loop through the files of the package to check if they exist. */
 int check_pkg_fast(alpm_pkg_t *pkg)
 {
@@ -229,38 +322,59 @@ int check_pkg_fast(alpm_pkg_t *pkg)
 	size_t rootlen;
 	char filepath[PATH_MAX];
 	alpm_filelist_t *filelist;
+	const char **paths;
+	struct stat *sts;
+	int *errs;
 	size_t i;
 
+	pthread_mutex_lock(&check_alpm_lock);
 	root = alpm_option_get_root(config->handle);
+	pkgname = alpm_pkg_get_name(pkg);
+	filelist = alpm_pkg_get_files(pkg);
+	pthread_mutex_unlock(&check_alpm_lock);
+
 	rootlen = strlen(root);
 	if(rootlen + 1 > PATH_MAX) {
 		/* we are in trouble here */
-		pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
+		check_pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
 		return 1;
 	}
 	strcpy(filepath, root);
 
-	pkgname = alpm_pkg_get_name(pkg);
-	filelist = alpm_pkg_get_files(pkg);
+	paths = malloc(filelist->count * sizeof(*paths));
+	sts = malloc(filelist->count * sizeof(*sts));
+	errs = malloc(filelist->count * sizeof(*errs));
+	if(filelist->count && (!paths || !sts || !errs)) {
+		check_pm_printf(ALPM_LOG_ERROR, "%s\n", alpm_strerror(ALPM_ERR_MEMORY));
+		free(paths);
+		free(sts);
+		free(errs);
+		return 1;
+	}
+
+	/* stat the whole file list at once, the results are checked in order below */
+	for(i = 0; i < filelist->count; i++) {
+		paths[i] = filelist->files[i].name;
+	}
+	check_llstat(root, paths, filelist->count, sts, errs);
+
 	for(i = 0; i < filelist->count; i++) {
-		const alpm_file_t *file = filelist->files + i;
-		struct stat st;
 		int exists;
-		const char *path = file->name;
+		const char *path = paths[i];
 		size_t plen = strlen(path);
 
 		if(rootlen + 1 + plen > PATH_MAX) {
-			pm_printf(ALPM_LOG_WARNING, _("path too long: %s%s\n"), root, path);
+			check_pm_printf(ALPM_LOG_WARNING, _("path too long: %s%s\n"), root, path);
 			continue;
 		}
 		strcpy(filepath + rootlen, path);
 
-		exists = check_file_exists(pkgname, filepath, rootlen, &st);
+		exists = check_file_exists(pkgname, filepath, rootlen, errs[i]);
 		if(exists == 0) {
 			int expect_dir = path[plen - 1] == '/' ? 1 : 0;
-			int is_dir = S_ISDIR(st.st_mode) ? 1 : 0;
+			int is_dir = S_ISDIR(sts[i].st_mode) ? 1 : 0;
 			if(expect_dir != is_dir) {
-				pm_printf(ALPM_LOG_WARNING, _("%s: %s (File type mismatch)\n"),
+				check_pm_printf(ALPM_LOG_WARNING, _("%s: %s (File type mismatch)\n"),
 						pkgname, filepath);
 				++errors;
 			}
@@ -269,59 +383,122 @@ int check_pkg_fast(alpm_pkg_t *pkg)
 		}
 	}
 
+	free(paths);
+	free(sts);
+	free(errs);
+	__atomic_add_fetch(&check_stats.files, filelist->count, __ATOMIC_RELAXED);
+
 	if(!config->quiet) {
-		printf(_n("%s: %jd total file, ", "%s: %jd total files, ",
+		check_printf(_n("%s: %jd total file, ", "%s: %jd total files, ",
 					(unsigned long)filelist->count), pkgname, (intmax_t)filelist->count);
-		printf(_n("%jd missing file\n", "%jd missing files\n",
+		check_printf(_n("%jd missing file\n", "%jd missing files\n",
 					(unsigned long)errors), (intmax_t)errors);
 	}
 
 	return (errors != 0 ? 1 : 0);
 }
 
-/* Loop though files in a package and perform full file property checking. */
-int check_pkg_full(alpm_pkg_t *pkg)
+/* Strip the leading "./" libarchive puts in front of mtree entries. */
+static const char *mtree_entry_path(struct archive_entry *entry)
+{
+	const char *path = archive_entry_pathname(entry);
+
+	if(path[0] == '.' && path[1] == '/') {
+		path += 2;
+	}
+	return path;
+}
+
+/* mtree entries of a package along with the status of the files on disk */
+struct check_files {
+	struct archive_entry **entries;
+	char **filepaths;
+	struct stat *sts;
+	int *errs;
+	size_t count;
+	size_t size;
+};
+
+static void check_files_free(struct check_files *files)
+{
+	size_t i;
+
+	for(i = 0; i < files->count; i++) {
+		archive_entry_free(files->entries[i]);
+		free(files->filepaths[i]);
+	}
+	free(files->entries);
+	free(files->filepaths);
+	free(files->sts);
+	free(files->errs);
+	memset(files, 0, sizeof(*files));
+}
+
+static int check_files_add(struct check_files *files,
+		struct archive_entry *entry, const char *filepath)
+{
+	if(files->count == files->size) {
+		size_t newsize = files->size ? files->size * 2 : 64;
+		struct archive_entry **newentries;
+		char **newpaths;
+
+		newentries = realloc(files->entries, newsize * sizeof(*newentries));
+		if(newentries) {
+			files->entries = newentries;
+		}
+		newpaths = realloc(files->filepaths, newsize * sizeof(*newpaths));
+		if(newpaths) {
+			files->filepaths = newpaths;
+		}
+		if(!newentries || !newpaths) {
+			return -1;
+		}
+		files->size = newsize;
+	}
+	if((files->entries[files->count] = archive_entry_clone(entry)) == NULL) {
+		return -1;
+	}
+	if((files->filepaths[files->count] = strdup(filepath)) == NULL) {
+		archive_entry_free(files->entries[files->count]);
+		return -1;
+	}
+	files->count++;
+	return 0;
+}
+
+/* Read the mtree of a package and stat all of its files in one batch.
+ * Returns 0 on success, 1 if the package has no mtree and -1 on error. */
+static int check_files_load(alpm_pkg_t *pkg, struct check_files *files)
 {
 	const char *root, *pkgname;
-	size_t errors = 0;
-	size_t rootlen;
 	struct archive *mtree;
 	struct archive_entry *entry = NULL;
-	size_t file_count = 0;
-	const alpm_list_t *lp;
 
+	/* reading the mtree is left to libalpm, so it is done under the lock */
+	pthread_mutex_lock(&check_alpm_lock);
 	root = alpm_option_get_root(config->handle);
-	rootlen = strlen(root);
-	if(rootlen + 1 > PATH_MAX) {
+	if(strlen(root) + 1 > PATH_MAX) {
 		/* we are in trouble here */
-		pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
-		return 1;
+		pthread_mutex_unlock(&check_alpm_lock);
+		check_pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
+		return -1;
 	}
 
 	pkgname = alpm_pkg_get_name(pkg);
 	mtree = alpm_pkg_mtree_open(pkg);
 	if(mtree == NULL) {
+		pthread_mutex_unlock(&check_alpm_lock);
 		/* TODO: check error to confirm failure due to no mtree file */
 		if(!config->quiet) {
-			printf(_("%s: no mtree file\n"), pkgname);
+			check_printf(_("%s: no mtree file\n"), pkgname);
 		}
-		return 0;
+		return 1;
 	}
 
 	while(alpm_pkg_mtree_next(pkg, mtree, &entry) == 0) {
-		struct stat st;
-		const char *path = archive_entry_pathname(entry);
+		const char *path = mtree_entry_path(entry);
 		char filepath[PATH_MAX];
 		int filepath_len;
-		mode_t type;
-		size_t file_errors = 0;
-		int backup = 0;
-		int exists;
-
-		/* strip leading "./" from path entries */
-		if(path[0] == '.' && path[1] == '/') {
-			path += 2;
-		}
 
 		if(*path == '.') {
 			const char *dbfile = NULL;
@@ -340,7 +517,7 @@ int check_pkg_full(alpm_pkg_t *pkg)
 					alpm_option_get_dbpath(config->handle),
 					pkgname, alpm_pkg_get_version(pkg), dbfile);
 			if(filepath_len >= PATH_MAX) {
-				pm_printf(ALPM_LOG_WARNING, _("path too long: %slocal/%s-%s/%s\n"),
+				check_pm_printf(ALPM_LOG_WARNING, _("path too long: %slocal/%s-%s/%s\n"),
 						alpm_option_get_dbpath(config->handle),
 						pkgname, alpm_pkg_get_version(pkg), dbfile);
 				continue;
@@ -348,14 +525,67 @@ int check_pkg_full(alpm_pkg_t *pkg)
 		} else {
 			filepath_len = snprintf(filepath, PATH_MAX, "%s%s", root, path);
 			if(filepath_len >= PATH_MAX) {
-				pm_printf(ALPM_LOG_WARNING, _("path too long: %s%s\n"), root, path);
+				check_pm_printf(ALPM_LOG_WARNING, _("path too long: %s%s\n"), root, path);
 				continue;
 			}
 		}
 
-		file_count++;
+		if(check_files_add(files, entry, filepath) != 0) {
+			goto memerror;
+		}
+	}
+
+	alpm_pkg_mtree_close(pkg, mtree);
+	mtree = NULL;
+	pthread_mutex_unlock(&check_alpm_lock);
+
+	files->sts = malloc(files->count * sizeof(*files->sts));
+	files->errs = malloc(files->count * sizeof(*files->errs));
+	if(files->count && (!files->sts || !files->errs)) {
+		goto memerror;
+	}
+	check_llstat(NULL, (const char * const *)files->filepaths, files->count,
+			files->sts, files->errs);
+	return 0;
+
+memerror:
+	if(mtree) {
+		alpm_pkg_mtree_close(pkg, mtree);
+		pthread_mutex_unlock(&check_alpm_lock);
+	}
+	check_pm_printf(ALPM_LOG_ERROR, "%s\n", alpm_strerror(ALPM_ERR_MEMORY));
+	check_files_free(files);
+	return -1;
+}
+
+/* Perform full file property checking on a range of loaded files, returns
+ * the number of altered files. */
+static size_t check_files_range(alpm_pkg_t *pkg, struct check_files *files,
+		size_t start, size_t end)
+{
+	const char *root, *pkgname;
+	size_t rootlen, errors = 0, i;
+	off_t hashed = 0;
+	const alpm_list_t *backups, *lp;
+
+	pthread_mutex_lock(&check_alpm_lock);
+	root = alpm_option_get_root(config->handle);
+	pkgname = alpm_pkg_get_name(pkg);
+	backups = alpm_pkg_get_backup(pkg);
+	pthread_mutex_unlock(&check_alpm_lock);
+	rootlen = strlen(root);
+
+	for(i = start; i < end; i++) {
+		struct archive_entry *entry = files->entries[i];
+		struct stat *st = files->sts + i;
+		const char *filepath = files->filepaths[i];
+		const char *path = mtree_entry_path(entry);
+		mode_t type;
+		size_t file_errors = 0;
+		int backup = 0;
+		int exists;
 
-		exists = check_file_exists(pkgname, filepath, rootlen, &st);
+		exists = check_file_exists(pkgname, filepath, rootlen, files->errs[i]);
 		if(exists == 1) {
 			errors++;
 			continue;
@@ -367,24 +597,24 @@ int check_pkg_full(alpm_pkg_t *pkg)
 		type = archive_entry_filetype(entry);
 
 		if(type != AE_IFDIR && type != AE_IFREG && type != AE_IFLNK) {
-			pm_printf(ALPM_LOG_WARNING, _("file type not recognized: %s%s\n"), root, path);
+			check_pm_printf(ALPM_LOG_WARNING, _("file type not recognized: %s%s\n"), root, path);
 			continue;
 		}
 
-		if(check_file_type(pkgname, filepath, &st, entry) == 1) {
+		if(check_file_type(pkgname, filepath, st, entry) == 1) {
 			errors++;
 			continue;
 		}
 
-		file_errors += check_file_permissions(pkgname, filepath, &st, entry);
+		file_errors += check_file_permissions(pkgname, filepath, st, entry);
 
 		if(type == AE_IFLNK) {
-			file_errors += check_file_link(pkgname, filepath, &st, entry);
+			file_errors += check_file_link(pkgname, filepath, st, entry);
 		}
 
 		/* the following checks are expected to fail if a backup file has been
 		   modified */
-		for(lp = alpm_pkg_get_backup(pkg); lp; lp = lp->next) {
+		for(lp = backups; lp; lp = lp->next) {
 			alpm_backup_t *bl = lp->data;
 
 			if(strcmp(path, bl->name) == 0) {
@@ -395,29 +625,315 @@ int check_pkg_full(alpm_pkg_t *pkg)
 
 		if(type != AE_IFDIR) {
 			/* file or symbolic link */
-			file_errors += check_file_time(pkgname, filepath, &st, entry, backup);
+			file_errors += check_file_time(pkgname, filepath, st, entry, backup);
 		}
 
 		if(type == AE_IFREG) {
-			file_errors += check_file_size(pkgname, filepath, &st, entry, backup);
+			file_errors += check_file_size(pkgname, filepath, st, entry, backup);
 			file_errors += check_file_sha256sum(pkgname, filepath, entry, backup);
+			hashed += st->st_size;
 		}
 
 		if(config->quiet && file_errors) {
-			printf("%s %s\n", pkgname, filepath);
+			check_printf("%s %s\n", pkgname, filepath);
 		}
 
 		errors += (file_errors != 0 ? 1 : 0);
 	}
 
-	alpm_pkg_mtree_close(pkg, mtree);
+	__atomic_add_fetch(&check_stats.files, end - start, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&check_stats.bytes, hashed, __ATOMIC_RELAXED);
+
+	return errors;
+}
 
+static void check_full_summary(alpm_pkg_t *pkg, size_t file_count, size_t errors)
+{
 	if(!config->quiet) {
-		printf(_n("%s: %jd total file, ", "%s: %jd total files, ",
+		const char *pkgname;
+
+		pthread_mutex_lock(&check_alpm_lock);
+		pkgname = alpm_pkg_get_name(pkg);
+		pthread_mutex_unlock(&check_alpm_lock);
+		check_printf(_n("%s: %jd total file, ", "%s: %jd total files, ",
 					(unsigned long)file_count), pkgname, (intmax_t)file_count);
-		printf(_n("%jd altered file\n", "%jd altered files\n",
+		check_printf(_n("%jd altered file\n", "%jd altered files\n",
 					(unsigned long)errors), (intmax_t)errors);
 	}
+}
+
+/* Loop though files in a package and perform full file property checking. */
+int check_pkg_full(alpm_pkg_t *pkg)
+{
+	struct check_files files;
+	size_t errors;
+	int ret;
+
+	memset(&files, 0, sizeof(files));
+	if((ret = check_files_load(pkg, &files)) != 0) {
+		/* a missing mtree file is not an error */
+		return ret < 0 ? 1 : 0;
+	}
+
+	errors = check_files_range(pkg, &files, 0, files.count);
+	check_full_summary(pkg, files.count, errors);
+	check_files_free(&files);
 
 	return (errors != 0 ? 1 : 0);
 }
+
+/* number of files of a package checked by one task in a parallel -Qkk */
+#define CHECK_RANGE_SIZE 256
+
+struct check_job;
+
+struct check_range {
+	struct check_job *job;
+	size_t start, end;
+	size_t errors;
+	alpm_list_t *output;
+	struct check_range *next;
+};
+
+struct check_job {
+	alpm_pkg_t *pkg;
+	struct check_files files;
+	alpm_list_t *output;
+	struct check_range *ranges;
+	size_t nranges;
+	size_t pending;
+	size_t file_count;
+	size_t errors;
+	int loaded;
+	int ret;
+	int done;
+};
+
+struct check_pool {
+	pthread_mutex_t lock;
+	/* signalled whenever ranges are queued or a job is done */
+	pthread_cond_t cond;
+	struct check_job *jobs;
+	size_t njobs;
+	size_t next_job;
+	size_t preparing;
+	struct check_range *queue;
+};
+
+/* Run the first stage of a job: the whole check for -Qk, loading the files
+ * and splitting them into ranges for -Qkk. Called without the pool lock. */
+static void check_job_prepare(struct check_pool *pool, struct check_job *job)
+{
+	size_t i;
+	int ret;
+
+	check_capture = &job->output;
+	if(config->op_q_check == 1) {
+		job->ret = check_pkg_fast(job->pkg);
+		check_capture = NULL;
+		return;
+	}
+
+	ret = check_files_load(job->pkg, &job->files);
+	check_capture = NULL;
+	if(ret != 0) {
+		job->ret = ret < 0 ? 1 : 0;
+		return;
+	}
+
+	job->loaded = 1;
+	job->file_count = job->files.count;
+	job->nranges = (job->files.count + CHECK_RANGE_SIZE - 1) / CHECK_RANGE_SIZE;
+	if(job->nranges == 0) {
+		return;
+	}
+	job->ranges = calloc(job->nranges, sizeof(struct check_range));
+	if(job->ranges == NULL) {
+		job->nranges = 0;
+		job->ret = 1;
+		check_files_free(&job->files);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	/* queue in reverse so the ranges are picked up in file order */
+	for(i = job->nranges; i > 0; i--) {
+		struct check_range *range = job->ranges + i - 1;
+		range->job = job;
+		range->start = (i - 1) * CHECK_RANGE_SIZE;
+		range->end = range->start + CHECK_RANGE_SIZE;
+		if(range->end > job->files.count) {
+			range->end = job->files.count;
+		}
+		range->next = pool->queue;
+		pool->queue = range;
+	}
+	job->pending = job->nranges;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *check_worker(void *arg)
+{
+	struct check_pool *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		if(pool->queue) {
+			/* ranges of packages already in progress come first */
+			struct check_range *range = pool->queue;
+			struct check_job *job = range->job;
+
+			pool->queue = range->next;
+			pthread_mutex_unlock(&pool->lock);
+
+			check_capture = &range->output;
+			range->errors = check_files_range(job->pkg, &job->files,
+					range->start, range->end);
+			check_capture = NULL;
+
+			pthread_mutex_lock(&pool->lock);
+			job->errors += range->errors;
+			if(--job->pending == 0) {
+				check_files_free(&job->files);
+				job->ret = job->errors != 0 ? 1 : 0;
+				job->done = 1;
+				pthread_cond_broadcast(&pool->cond);
+			}
+		} else if(pool->next_job < pool->njobs) {
+			struct check_job *job = pool->jobs + pool->next_job++;
+
+			pool->preparing++;
+			pthread_mutex_unlock(&pool->lock);
+			check_job_prepare(pool, job);
+			pthread_mutex_lock(&pool->lock);
+			pool->preparing--;
+			if(job->pending == 0) {
+				job->done = 1;
+			}
+			pthread_cond_broadcast(&pool->cond);
+		} else if(pool->preparing == 0) {
+			break;
+		} else {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void check_print_output(alpm_list_t *output)
+{
+	alpm_list_t *i;
+
+	for(i = output; i; i = i->next) {
+		struct check_chunk *chunk = i->data;
+		fputs(chunk->text, chunk->stream);
+		free(chunk->text);
+		free(chunk);
+	}
+	alpm_list_free(output);
+}
+
+/** Check a list of packages using config->jobs threads.
+ * Packages are handed out to the workers as they become idle; for -Qkk the
+ * files of each package are additionally split into ranges so large packages
+ * are spread over several workers. Output is buffered and printed in the
+ * order of the package list.
+ * @param pkgs list of packages to check
+ * @return 0 if all packages are fine, 1 otherwise
+ */
+int check_pkgs(alpm_list_t *pkgs)
+{
+	struct check_pool pool;
+	pthread_t *threads;
+	size_t nthreads, started = 0, i;
+	struct timespec begin, end;
+	alpm_list_t *lp;
+	double elapsed;
+	int ret = 0;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.njobs = alpm_list_count(pkgs);
+	if(pool.njobs == 0) {
+		return 0;
+	}
+	pool.jobs = calloc(pool.njobs, sizeof(struct check_job));
+	nthreads = config->jobs < pool.njobs ? config->jobs : pool.njobs;
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if(!pool.jobs || !threads) {
+		pm_printf(ALPM_LOG_ERROR, "%s\n", alpm_strerror(ALPM_ERR_MEMORY));
+		free(pool.jobs);
+		free(threads);
+		return 1;
+	}
+
+	/* libalpm loads package data lazily, do it before the workers start */
+	for(lp = pkgs, i = 0; lp; lp = lp->next, i++) {
+		pool.jobs[i].pkg = lp->data;
+		alpm_pkg_get_files(lp->data);
+		alpm_pkg_get_backup(lp->data);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	for(i = 0; i < nthreads; i++) {
+		if(pthread_create(threads + i, NULL, check_worker, &pool) != 0) {
+			break;
+		}
+		started++;
+	}
+	if(started == 0) {
+		/* no threads at all, do the work right here */
+		check_worker(&pool);
+	}
+
+	for(i = 0; i < pool.njobs; i++) {
+		struct check_job *job = pool.jobs + i;
+		size_t r;
+
+		pthread_mutex_lock(&pool.lock);
+		while(!job->done) {
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		check_print_output(job->output);
+		for(r = 0; r < job->nranges; r++) {
+			check_print_output(job->ranges[r].output);
+		}
+		if(job->loaded) {
+			check_full_summary(job->pkg, job->file_count, job->errors);
+		}
+		free(job->ranges);
+		if(job->ret != 0) {
+			ret = 1;
+		}
+	}
+
+	for(i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+	free(threads);
+	free(pool.jobs);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	if(!config->quiet && elapsed > 0) {
+		/* aggregate throughput, useful when scanning whole systems */
+		if(config->op_q_check > 1) {
+			printf(_("%zu packages, %zu files checked in %.2f seconds (%.0f files/s, %.1f MiB/s)\n"),
+					pool.njobs, check_stats.files, elapsed, check_stats.files / elapsed,
+					check_stats.bytes / (1024.0 * 1024.0) / elapsed);
+		} else {
+			printf(_("%zu packages, %zu files checked in %.2f seconds (%.0f files/s)\n"),
+					pool.njobs, check_stats.files, elapsed, check_stats.files / elapsed);
+		}
+	}
+
+	return ret;
+}
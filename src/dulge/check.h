@@ -12,5 +12,6 @@
 
 int check_pkg_fast(alpm_pkg_t *pkg);
 int check_pkg_full(alpm_pkg_t *pkg);
+int check_pkgs(alpm_list_t *pkgs);
 
 #endif /* PM_CHECK_H */
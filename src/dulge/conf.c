@@ -103,6 +103,9 @@ config_t *config_new(void)
 
 	/* by default use 1 download stream */
 	newconfig->parallel_downloads = 1;
+	newconfig->hookjobs = 1;
+	newconfig->extractjobs = 1;
+	newconfig->progress_interval = 100;
 	newconfig->colstr.colon   = ":: ";
 	newconfig->colstr.title   = "";
 	newconfig->colstr.repo    = "";
@@ -142,6 +145,7 @@ int config_free(config_t *oldconfig)
 	free(oldconfig->dbpath);
 	free(oldconfig->logfile);
 	free(oldconfig->gpgdir);
+	free(oldconfig->cachestore);
 	free(oldconfig->sandboxuser);
 	FREELIST(oldconfig->hookdirs);
 	FREELIST(oldconfig->cachedirs);
@@ -598,6 +602,9 @@ static int _parse_options(const char *key, char *value,
 		if(strcmp(key, "UseSyslog") == 0) {
 			config->usesyslog = 1;
 			pm_printf(ALPM_LOG_DEBUG, "config: usesyslog\n");
+		} else if(strcmp(key, "BufferedLog") == 0) {
+			config->bufferedlog = 1;
+			pm_printf(ALPM_LOG_DEBUG, "config: bufferedlog\n");
 		} else if(strcmp(key, "ILoveCandy") == 0) {
 			config->chomp = 1;
 			pm_printf(ALPM_LOG_DEBUG, "config: chomp\n");
@@ -606,6 +613,10 @@ static int _parse_options(const char *key, char *value,
 			pm_printf(ALPM_LOG_DEBUG, "config: verbosepkglists\n");
 		} else if(strcmp(key, "CheckSpace") == 0) {
 			config->checkspace = 1;
+		} else if(strcmp(key, "VerifyCache") == 0) {
+			config->verifycache = 1;
+		} else if(strcmp(key, "MetaCache") == 0) {
+			config->metacache = 1;
 		} else if(strcmp(key, "Color") == 0) {
 			if(config->color == PM_COLOR_UNSET) {
 				config->color = isatty(fileno(stdout)) ? PM_COLOR_ON : PM_COLOR_OFF;
@@ -650,6 +661,11 @@ static int _parse_options(const char *key, char *value,
 			}
 			*/
 			setrepeatingoption(value, "CacheDir", &(config->cachedirs));
+		} else if(strcmp(key, "CacheStore") == 0) {
+			if(!config->cachestore) {
+				config->cachestore = strdup(value);
+				pm_printf(ALPM_LOG_DEBUG, "config: cachestore: %s\n", value);
+			}
 		} else if(strcmp(key, "HookDir") == 0) {
 			/* FIXME - fails when multiple paths are specified on one line (#289)
 			char *path = resolve_path(value, "HookDir");
@@ -785,6 +801,74 @@ static int _parse_options(const char *key, char *value,
 			}
 
 			config->parallel_downloads = number;
+		} else if(strcmp(key, "HookJobs") == 0) {
+			long number;
+
+			if(parse_number(value, &number) != 0) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "HookJobs", value);
+				return 1;
+			}
+
+			if(number < 1) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' has to be positive : '%s'\n"),
+						file, linenum, "HookJobs", value);
+				return 1;
+			}
+
+			if(number > INT_MAX) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' is too large : '%s'\n"),
+						file, linenum, "HookJobs", value);
+				return 1;
+			}
+
+			config->hookjobs = number;
+		} else if(strcmp(key, "ExtractJobs") == 0) {
+			long number;
+
+			if(parse_number(value, &number) != 0) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "ExtractJobs", value);
+				return 1;
+			}
+
+			if(number < 1) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' has to be positive : '%s'\n"),
+						file, linenum, "ExtractJobs", value);
+				return 1;
+			}
+
+			if(number > INT_MAX) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' is too large : '%s'\n"),
+						file, linenum, "ExtractJobs", value);
+				return 1;
+			}
+
+			config->extractjobs = number;
+		} else if(strcmp(key, "ProgressInterval") == 0) {
+			long number;
+
+			if(parse_number(value, &number) != 0 || number < 0) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "ProgressInterval", value);
+				return 1;
+			}
+
+			if(number > INT_MAX) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' is too large : '%s'\n"),
+						file, linenum, "ProgressInterval", value);
+				return 1;
+			}
+
+			config->progress_interval = number;
 		} else {
 			pm_printf(ALPM_LOG_WARNING,
 					_("config file %s, line %d: directive '%s' in section '%s' not recognized.\n"),
@@ -941,6 +1025,15 @@ static int setup_libalpm(void)
 
 	alpm_option_set_cachedirs(handle, config->cachedirs);
 
+	if(config->cachestore) {
+		ret = alpm_option_set_cachestore(handle, config->cachestore);
+		if(ret != 0) {
+			pm_printf(ALPM_LOG_ERROR, _("problem setting cachestore '%s' (%s)\n"),
+					config->cachestore, alpm_strerror(alpm_errno(handle)));
+			return ret;
+		}
+	}
+
 	alpm_option_set_overwrite_files(handle, config->overwrite_files);
 
 	alpm_option_set_default_siglevel(handle, config->siglevel);
@@ -960,7 +1053,10 @@ static int setup_libalpm(void)
 
 	alpm_option_set_architectures(handle, config->architectures);
 	alpm_option_set_checkspace(handle, config->checkspace);
+	alpm_option_set_verifycache(handle, config->verifycache);
+	alpm_option_set_metacache(handle, config->metacache);
 	alpm_option_set_usesyslog(handle, config->usesyslog);
+	alpm_option_set_bufferedlog(handle, config->bufferedlog);
 
 	if((ret = alpm_option_set_sandboxuser(handle, config->sandboxuser)) != 0) {
 		pm_printf(ALPM_LOG_ERROR, _("problem setting DownloadUser '%s' (user does not exist)\n"),
@@ -977,6 +1073,9 @@ static int setup_libalpm(void)
 
 	alpm_option_set_disable_dl_timeout(handle, config->disable_dl_timeout);
 	alpm_option_set_parallel_downloads(handle, config->parallel_downloads);
+	alpm_option_set_hookjobs(handle, config->hookjobs);
+	alpm_option_set_extractjobs(handle, config->extractjobs);
+	alpm_option_set_progress_interval(handle, config->progress_interval);
 
 	for(i = config->assumeinstalled; i; i = i->next) {
 		char *entry = i->data;
@@ -1318,6 +1417,7 @@ static int prepend_sysroot(config_t *c)
 	SETSYSROOT(c->dbpath);
 	SETSYSROOT(c->logfile);
 	SETSYSROOT(c->gpgdir);
+	SETSYSROOT(c->cachestore);
 	for(i = c->cachedirs; i; i = i->next) {
 		SETSYSROOT(i->data);
 	}
@@ -42,7 +42,10 @@ typedef struct __config_t {
 	unsigned short logmask;
 	unsigned short print;
 	unsigned short checkspace;
+	unsigned short verifycache;
+	unsigned short metacache;
 	unsigned short usesyslog;
+	unsigned short bufferedlog;
 	unsigned short color;
 	unsigned short disable_dl_timeout;
 	unsigned short disable_sandbox_filesystem;
@@ -56,6 +59,7 @@ typedef struct __config_t {
 	char *dbpath;
 	char *logfile;
 	char *gpgdir;
+	char *cachestore;
 	char *sysroot;
 	char *sandboxuser;
 	alpm_list_t *hookdirs;
@@ -106,6 +110,12 @@ typedef struct __config_t {
 	unsigned short verbosepkglists;
 	/* number of parallel download streams */
 	unsigned int parallel_downloads;
+	unsigned int hookjobs;
+	unsigned int extractjobs;
+	/* milliseconds between repeated progress updates */
+	unsigned int progress_interval;
+	/* number of parallel jobs for operations supporting it (--jobs) */
+	unsigned int jobs;
 	/* select -Sc behavior */
 	unsigned short cleanmethod;
 	alpm_list_t *holdpkg;
@@ -204,7 +214,8 @@ enum {
 	OP_DISABLEDLTIMEOUT,
 	OP_DISABLESANDBOX,
 	OP_DISABLESANDBOXFILESYSTEM,
-	OP_DISABLESANDBOXSYSCALLS
+	OP_DISABLESANDBOXSYSCALLS,
+	OP_JOBS
 };
 
 /* clean method */
@@ -247,6 +247,7 @@ static void dump_config(void)
 	show_str("RootDir", config->rootdir);
 	show_str("DBPath", config->dbpath);
 	show_list_str("CacheDir", config->cachedirs);
+	show_str("CacheStore", config->cachestore);
 	show_list_str("HookDir", config->hookdirs);
 	show_str("GPGDir", config->gpgdir);
 	show_str("LogFile", config->logfile);
@@ -262,8 +263,11 @@ static void dump_config(void)
 	show_str("XferCommand", config->xfercommand);
 
 	show_bool("UseSyslog", config->usesyslog);
+	show_bool("BufferedLog", config->bufferedlog);
 	show_bool("Color", config->color);
 	show_bool("CheckSpace", config->checkspace);
+	show_bool("VerifyCache", config->verifycache);
+	show_bool("MetaCache", config->metacache);
 	show_bool("VerbosePkgLists", config->verbosepkglists);
 	show_bool("DisableDownloadTimeout", config->disable_dl_timeout);
 	show_bool("ILoveCandy", config->chomp);
@@ -272,6 +276,9 @@ static void dump_config(void)
 	show_bool("DisableSandboxSyscalls", config->disable_sandbox_syscalls);
 
 	show_int("ParallelDownloads", config->parallel_downloads);
+	show_int("HookJobs", config->hookjobs);
+	show_int("ExtractJobs", config->extractjobs);
+	show_int("ProgressInterval", config->progress_interval);
 
 	show_cleanmethod("CleanMethod", config->cleanmethod);
 
@@ -347,6 +354,8 @@ static int list_directives(void)
 			show_str("DBPath", config->dbpath);
 		} else if(strcasecmp(i->data, "CacheDir") == 0) {
 			show_list_str("CacheDir", config->cachedirs);
+		} else if(strcasecmp(i->data, "CacheStore") == 0) {
+			show_str("CacheStore", config->cachestore);
 		} else if(strcasecmp(i->data, "HookDir") == 0) {
 			show_list_str("HookDir", config->hookdirs);
 		} else if(strcasecmp(i->data, "GPGDir") == 0) {
@@ -375,10 +384,16 @@ static int list_directives(void)
 
 		} else if(strcasecmp(i->data, "UseSyslog") == 0) {
 			show_bool("UseSyslog", config->usesyslog);
+		} else if(strcasecmp(i->data, "BufferedLog") == 0) {
+			show_bool("BufferedLog", config->bufferedlog);
 		} else if(strcasecmp(i->data, "Color") == 0) {
 			show_bool("Color", config->color);
 		} else if(strcasecmp(i->data, "CheckSpace") == 0) {
 			show_bool("CheckSpace", config->checkspace);
+		} else if(strcasecmp(i->data, "VerifyCache") == 0) {
+			show_bool("VerifyCache", config->verifycache);
+		} else if(strcasecmp(i->data, "MetaCache") == 0) {
+			show_bool("MetaCache", config->metacache);
 		} else if(strcasecmp(i->data, "VerbosePkgLists") == 0) {
 			show_bool("VerbosePkgLists", config->verbosepkglists);
 		} else if(strcasecmp(i->data, "DisableDownloadTimeout") == 0) {
@@ -397,6 +412,12 @@ static int list_directives(void)
 
 		} else if(strcasecmp(i->data, "ParallelDownloads") == 0) {
 			show_int("ParallelDownloads", config->parallel_downloads);
+		} else if(strcasecmp(i->data, "HookJobs") == 0) {
+			show_int("HookJobs", config->hookjobs);
+		} else if(strcasecmp(i->data, "ExtractJobs") == 0) {
+			show_int("ExtractJobs", config->extractjobs);
+		} else if(strcasecmp(i->data, "ProgressInterval") == 0) {
+			show_int("ProgressInterval", config->progress_interval);
 
 		} else if(strcasecmp(i->data, "CleanMethod") == 0) {
 			show_cleanmethod("CleanMethod", config->cleanmethod);
@@ -203,6 +203,7 @@ static void usage(int op, const char * const myname)
 		addlist(_("      --config <path>  set an alternate configuration file\n"));
 		addlist(_("      --debug          display debug messages\n"));
 		addlist(_("      --gpgdir <path>  set an alternate home directory for GnuPG\n"));
+		addlist(_("      --jobs <n>       run up to <n> jobs in parallel (-Qk)\n"));
 		addlist(_("      --logfile <path> set an alternate log file\n"));
 		addlist(_("      --noconfirm      do not ask for any confirmation\n"));
 		addlist(_("      --confirm        always ask for confirmation\n"));
@@ -468,6 +469,22 @@ static int parsearg_global(int opt)
 				}
 			}
 			break;
+		case OP_JOBS:
+			{
+				char *endptr;
+				long jobs;
+
+				errno = 0;
+				jobs = strtol(optarg, &endptr, 10);
+				if(errno == ERANGE || endptr == optarg || *endptr != '\0'
+						|| jobs < 1 || jobs > 1024) {
+					pm_printf(ALPM_LOG_ERROR, _("invalid value for '%s' : '%s'\n"),
+							"--jobs", optarg);
+					return 2;
+				}
+				config->jobs = (unsigned int)jobs;
+			}
+			break;
 		case OP_LOGFILE:
 			free(config->logfile);
 			config->logfile = strndup(optarg, PATH_MAX);
@@ -967,6 +984,7 @@ static int parseargs(int argc, char *argv[])
 		{"groups",     no_argument,       0, OP_GROUPS},
 		{"info",       no_argument,       0, OP_INFO},
 		{"check",      no_argument,       0, OP_CHECK},
+		{"jobs",       required_argument, 0, OP_JOBS},
 		{"list",       no_argument,       0, OP_LIST},
 		{"foreign",    no_argument,       0, OP_FOREIGN},
 		{"native",     no_argument,       0, OP_NATIVE},
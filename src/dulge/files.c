@@ -15,7 +15,7 @@
 #include "conf.h"
 #include "package.h"
 
-static void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, char *filename)
+static void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, const char *filename)
 {
 	/* Fields are repo, pkgname, pkgver, filename separated with \0 */
 	fputs(alpm_db_get_name(db), stdout);
@@ -28,13 +28,23 @@ static void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, char *fil
 	fputs("\n", stdout);
 }
 
+struct dump_ctx {
+	alpm_db_t *db;
+	alpm_pkg_t *pkg;
+	const char *pkgname;
+};
+
+static int dump_file_machinereadable(void *ctx, const char *path)
+{
+	struct dump_ctx *dump = ctx;
+	print_line_machinereadable(dump->db, dump->pkg, path);
+	return 0;
+}
+
 static void dump_pkg_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg)
 {
-	alpm_filelist_t *pkgfiles = alpm_pkg_get_files(pkg);
-	for(size_t filenum = 0; filenum < pkgfiles->count; filenum++) {
-		const alpm_file_t *file = pkgfiles->files + filenum;
-		print_line_machinereadable(db, pkg, file->name);
-	}
+	struct dump_ctx dump = { .db = db, .pkg = pkg };
+	alpm_pkg_files_foreach(pkg, dump_file_machinereadable, &dump);
 }
 
 static void print_owned_by(alpm_db_t *db, alpm_pkg_t *pkg, char *filename)
@@ -94,6 +104,42 @@ static void filetarget_free(struct filetarget *ftarg) {
 	free(ftarg);
 }
 
+struct match_ctx {
+	regex_t *reg;
+	const char *targ;
+	int regex;
+	alpm_list_t *match;
+};
+
+/* the path passed in is only valid during the call, so matches are copied */
+static int match_path(void *ctx, const char *path)
+{
+	struct match_ctx *mctx = ctx;
+	if(regexec(mctx->reg, path, 0, 0, 0) == 0) {
+		mctx->match = alpm_list_add(mctx->match, strdup(path));
+	}
+	return 0;
+}
+
+static int match_basename(void *ctx, const char *path)
+{
+	struct match_ctx *mctx = ctx;
+	const char *c = strrchr(path, '/');
+	int m;
+
+	if(c && *(c + 1)) {
+		if(mctx->regex) {
+			m = regexec(mctx->reg, (c + 1), 0, 0, 0);
+		} else {
+			m = strcmp(c + 1, mctx->targ);
+		}
+		if(m == 0) {
+			mctx->match = alpm_list_add(mctx->match, strdup(path));
+		}
+	}
+	return 0;
+}
+
 static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 	int ret = 0;
 	alpm_list_t *t, *filetargs = NULL;
@@ -144,48 +190,27 @@ static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 			alpm_list_t *p;
 			alpm_db_t *repo = s->data;
 			alpm_list_t *packages = alpm_db_get_pkgcache(repo);
-			int m;
 
 			for(p = packages; p; p = alpm_list_next(p)) {
 				alpm_pkg_t *pkg = p->data;
-				alpm_filelist_t *files = alpm_pkg_get_files(pkg);
-				alpm_list_t *match = NULL;
-
-				if(exact_file) {
-					if (regex) {
-						for(size_t f = 0; f < files->count; f++) {
-							char *c = files->files[f].name;
-							if(regexec(reg, c, 0, 0, 0) == 0) {
-								match = alpm_list_add(match, files->files[f].name);
-								found = 1;
-							}
-						}
-					} else {
-						if(alpm_filelist_contains(files, targ)) {
-							match = alpm_list_add(match, targ);
-							found = 1;
-						}
+				struct match_ctx mctx = { .reg = reg, .targ = targ, .regex = regex };
+				alpm_list_t *match;
+
+				if(exact_file && !regex) {
+					if(alpm_pkg_has_file(pkg, targ)) {
+						mctx.match = alpm_list_add(NULL, strdup(targ));
 					}
+				} else if(exact_file) {
+					alpm_pkg_files_foreach(pkg, match_path, &mctx);
 				} else {
-					for(size_t f = 0; f < files->count; f++) {
-						char *c = strrchr(files->files[f].name, '/');
-						if(c && *(c + 1)) {
-							if(regex) {
-								m = regexec(reg, (c + 1), 0, 0, 0);
-							} else {
-								m = strcmp(c + 1, targ);
-							}
-							if(m == 0) {
-								match = alpm_list_add(match, files->files[f].name);
-								found = 1;
-							}
-						}
-					}
+					alpm_pkg_files_foreach(pkg, match_basename, &mctx);
 				}
+				match = mctx.match;
+				found |= match != NULL;
 
 				if(match != NULL) {
 					print_match(match, repo, pkg, exact_file);
-					alpm_list_free(match);
+					FREELIST(match);
 				}
 			}
 		}
@@ -202,24 +227,23 @@ cleanup:
 	return ret;
 }
 
-static void dump_file_list(alpm_pkg_t *pkg) {
-	const char *pkgname;
-	alpm_filelist_t *pkgfiles;
-	size_t i;
-
-	pkgname = alpm_pkg_get_name(pkg);
-	pkgfiles = alpm_pkg_get_files(pkg);
-
-	for(i = 0; i < pkgfiles->count; i++) {
-		const alpm_file_t *file = pkgfiles->files + i;
-		/* Regular: '<pkgname> <filepath>\n'
-		 * Quiet  : '<filepath>\n'
-		 */
-		if(!config->quiet) {
-			printf("%s%s%s ", config->colstr.title, pkgname, config->colstr.nocolor);
-		}
-		printf("%s\n", file->name);
+static int dump_file(void *ctx, const char *path)
+{
+	struct dump_ctx *dump = ctx;
+	/* Regular: '<pkgname> <filepath>\n'
+	 * Quiet  : '<filepath>\n'
+	 */
+	if(!config->quiet) {
+		printf("%s%s%s ", config->colstr.title, dump->pkgname, config->colstr.nocolor);
 	}
+	printf("%s\n", path);
+	return 0;
+}
+
+static void dump_file_list(alpm_pkg_t *pkg) {
+	struct dump_ctx dump = { .pkg = pkg, .pkgname = alpm_pkg_get_name(pkg) };
+
+	alpm_pkg_files_foreach(pkg, dump_file, &dump);
 
 	fflush(stdout);
 }
@@ -336,6 +336,13 @@ static int display(alpm_pkg_t *pkg)
 	return ret;
 }
 
+/* whether display() calls can be replaced by a single check_pkgs() */
+static int check_in_parallel(void)
+{
+	return config->jobs > 1 && config->op_q_check && !config->op_q_isfile
+		&& !config->op_q_info && !config->op_q_list && !config->op_q_changelog;
+}
+
 static int query_group(alpm_list_t *targets)
 {
 	alpm_list_t *i, *j;
@@ -387,7 +394,7 @@ int dulge_query(alpm_list_t *targets)
 {
 	int ret = 0;
 	int match = 0;
-	alpm_list_t *i;
+	alpm_list_t *i, *checklist = NULL;
 	alpm_pkg_t *pkg = NULL;
 	alpm_db_t *db_local;
 
@@ -425,13 +432,20 @@ int dulge_query(alpm_list_t *targets)
 		for(i = alpm_db_get_pkgcache(db_local); i; i = alpm_list_next(i)) {
 			pkg = i->data;
 			if(filter(pkg)) {
-				int value = display(pkg);
-				if(value != 0) {
+				if(check_in_parallel()) {
+					checklist = alpm_list_add(checklist, pkg);
+				} else if(display(pkg) != 0) {
 					ret = 1;
 				}
 				match = 1;
 			}
 		}
+		if(checklist) {
+			if(check_pkgs(checklist) != 0) {
+				ret = 1;
+			}
+			alpm_list_free(checklist);
+		}
 		if(!match) {
 			ret = 1;
 		}
@@ -487,8 +501,9 @@ int dulge_query(alpm_list_t *targets)
 		}
 
 		if(filter(pkg)) {
-			int value = display(pkg);
-			if(value != 0) {
+			if(check_in_parallel()) {
+				checklist = alpm_list_add(checklist, pkg);
+			} else if(display(pkg) != 0) {
 				ret = 1;
 			}
 			match = 1;
@@ -500,6 +515,13 @@ int dulge_query(alpm_list_t *targets)
 		}
 	}
 
+	if(checklist) {
+		if(check_pkgs(checklist) != 0) {
+			ret = 1;
+		}
+		alpm_list_free(checklist);
+	}
+
 	if(!match) {
 		ret = 1;
 	}
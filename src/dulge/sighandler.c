@@ -55,6 +55,7 @@ static void soft_interrupt_handler(int signum)
 		/* a transaction is being interrupted, don't exit dulge yet. */
 		return;
 	}
+	alpm_logaction_flush(config->handle);
 	alpm_unlock(config->handle);
 	/* output a newline to be sure we clear any line we may be on */
 	xwrite(STDOUT_FILENO, "\n", 1);
@@ -91,6 +92,8 @@ static void segv_handler(int signum)
 	xwrite(STDERR_FILENO, msg, sizeof(msg) - 1);
 	xwrite(STDOUT_FILENO, CURSOR_SHOW_ANSICODE,
 		sizeof(CURSOR_SHOW_ANSICODE) - 1);
+	/* keep the log of what happened up to the crash */
+	alpm_logaction_flush(config->handle);
 
 	/* restore the default handler */
 	_reset_handler(signum);
@@ -14,6 +14,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <fnmatch.h>
+#include <ctype.h>
 
 #include <alpm.h>
 #include <alpm_list.h>
@@ -142,12 +143,196 @@ static int sync_cleandb_all(void)
 	return ret;
 }
 
+/* a sync database package, found by the name of its package file */
+struct cache_index_entry {
+	const char *filename;
+	alpm_pkg_t *pkg;
+};
+
+/* sync database packages sorted by file name, built on first use */
+struct cache_index {
+	struct cache_index_entry *entries;
+	size_t count;
+	int built;
+};
+
+static int cache_index_cmp(const void *p1, const void *p2)
+{
+	const struct cache_index_entry *e1 = p1, *e2 = p2;
+	return strcmp(e1->filename, e2->filename);
+}
+
+/* Index the package files of all sync databases by file name. */
+static void cache_index_build(struct cache_index *index)
+{
+	alpm_list_t *sync_dbs = alpm_get_syncdbs(config->handle);
+	size_t size = 0;
+	alpm_list_t *i, *j;
+
+	index->built = 1;
+	for(i = sync_dbs; i; i = alpm_list_next(i)) {
+		size += alpm_list_count(alpm_db_get_pkgcache(i->data));
+	}
+	if(size == 0 || (index->entries = calloc(size, sizeof(struct cache_index_entry))) == NULL) {
+		return;
+	}
+	for(i = sync_dbs; i; i = alpm_list_next(i)) {
+		for(j = alpm_db_get_pkgcache(i->data); j; j = alpm_list_next(j)) {
+			const char *filename = alpm_pkg_get_filename(j->data);
+			if(filename) {
+				index->entries[index->count].filename = filename;
+				index->entries[index->count].pkg = j->data;
+				index->count++;
+			}
+		}
+	}
+	qsort(index->entries, index->count, sizeof(struct cache_index_entry),
+			cache_index_cmp);
+}
+
+static alpm_pkg_t *cache_index_find(struct cache_index *index, const char *filename)
+{
+	struct cache_index_entry key = { filename, NULL }, *found;
+
+	if(!index->built) {
+		cache_index_build(index);
+	}
+	if(index->count == 0) {
+		return NULL;
+	}
+	found = bsearch(&key, index->entries, index->count, sizeof(key), cache_index_cmp);
+	return found ? found->pkg : NULL;
+}
+
+static int valid_arch(const char *arch, size_t len)
+{
+	alpm_list_t *i;
+
+	if(len == 3 && strncmp(arch, "any", 3) == 0) {
+		return 1;
+	}
+	for(i = alpm_option_get_architectures(config->handle); i; i = alpm_list_next(i)) {
+		const char *a = i->data;
+		if(strlen(a) == len && strncmp(a, arch, len) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Split a canonical package file name, name-pkgver-pkgrel-arch.pkg.tar[.ext],
+ * into the package name and version. pkgver and pkgrel never contain a dash,
+ * so the name is whatever is left in front of them. Returns 0 on success,
+ * -1 if the file name does not have that form. */
+static int parse_pkg_filename(const char *filename, char **name, char **version)
+{
+	const char *ext = NULL, *p, *rel, *arch, *ver;
+
+	for(p = filename; (p = strstr(p, ".pkg.tar")) != NULL; p++) {
+		ext = p;
+	}
+	if(ext == NULL) {
+		return -1;
+	}
+	/* at most one compression suffix */
+	p = ext + strlen(".pkg.tar");
+	if(*p == '.' && (p[1] == '\0' || strchr(p + 1, '.'))) {
+		return -1;
+	} else if(*p != '.' && *p != '\0') {
+		return -1;
+	}
+
+	for(arch = ext; arch > filename && arch[-1] != '-'; arch--);
+	if(arch == filename || !valid_arch(arch, ext - arch)) {
+		return -1;
+	}
+	for(rel = arch - 1; rel > filename && rel[-1] != '-'; rel--);
+	if(rel == filename || rel == arch - 1) {
+		return -1;
+	}
+	for(p = rel; p < arch - 1; p++) {
+		if(!isdigit((unsigned char)*p) && *p != '.') {
+			return -1;
+		}
+	}
+	for(ver = rel - 1; ver > filename && ver[-1] != '-'; ver--);
+	if(ver == filename || ver == rel - 1 || ver - 1 == filename) {
+		return -1;
+	}
+
+	*name = strndup(filename, ver - 1 - filename);
+	*version = strndup(ver, arch - 1 - ver);
+	if(*name == NULL || *version == NULL) {
+		free(*name);
+		free(*version);
+		return -1;
+	}
+	return 0;
+}
+
+/* Learn the package name and version of a cache file from its file name:
+ * either a sync database lists it as the file of one of its packages, or
+ * the name has the canonical form. Returns 0 on success, -1 if only the
+ * package metadata can tell. */
+static int cache_file_identify(const char *filename, struct cache_index *index,
+		char **name, char **version)
+{
+	alpm_pkg_t *pkg = cache_index_find(index, filename);
+
+	if(pkg == NULL) {
+		return parse_pkg_filename(filename, name, version);
+	}
+	*name = strdup(alpm_pkg_get_name(pkg));
+	*version = strdup(alpm_pkg_get_version(pkg));
+	if(*name == NULL || *version == NULL) {
+		free(*name);
+		free(*version);
+		return -1;
+	}
+	return 0;
+}
+
+static int cache_file_keep(alpm_list_t *sync_dbs, alpm_db_t *db_local,
+		const char *local_name, const char *local_version)
+{
+	alpm_pkg_t *pkg;
+
+	if(config->cleanmethod & PM_CLEAN_KEEPINST) {
+		/* check if this package is in the local DB */
+		pkg = alpm_db_get_pkg(db_local, local_name);
+		if(pkg != NULL && alpm_pkg_vercmp(local_version,
+					alpm_pkg_get_version(pkg)) == 0) {
+			/* package was found in local DB and version matches, keep it */
+			pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in local db\n",
+					local_name, local_version);
+			return 1;
+		}
+	}
+	if(config->cleanmethod & PM_CLEAN_KEEPCUR) {
+		alpm_list_t *j;
+		/* check if this package is in a sync DB */
+		for(j = sync_dbs; j; j = alpm_list_next(j)) {
+			alpm_db_t *db = j->data;
+			pkg = alpm_db_get_pkg(db, local_name);
+			if(pkg != NULL && alpm_pkg_vercmp(local_version,
+						alpm_pkg_get_version(pkg)) == 0) {
+				/* package was found in a sync DB and version matches, keep it */
+				pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in sync db\n",
+						local_name, local_version);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
 static int sync_cleancache(int level)
 {
 	alpm_list_t *i;
 	alpm_list_t *sync_dbs = alpm_get_syncdbs(config->handle);
 	alpm_db_t *db_local = alpm_get_localdb(config->handle);
 	alpm_list_t *cachedirs = alpm_option_get_cachedirs(config->handle);
+	struct cache_index index = { NULL, 0, 0 };
 	int ret = 0;
 
 	if(!config->cleanmethod) {
@@ -200,8 +385,8 @@ static int sync_cleancache(int level)
 		while((ent = readdir(dir)) != NULL) {
 			char path[PATH_MAX];
 			int delete = 1;
-			alpm_pkg_t *localpkg = NULL, *pkg = NULL;
-			const char *local_name, *local_version;
+			alpm_pkg_t *localpkg = NULL;
+			char *name = NULL, *version = NULL;
 			size_t len;
 
 			if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
@@ -244,45 +429,26 @@ static int sync_cleancache(int level)
 				continue;
 			}
 
-			/* attempt to load the file as a package. if we cannot load the file,
-			 * simply skip it and move on. we don't need a full load of the package,
-			 * just the metadata. */
-			if(alpm_pkg_load(config->handle, path, 0, 0, &localpkg) != 0) {
+			/* most files are named after the package they hold and need not be
+			 * opened. attempt to load any other file as a package. if we cannot
+			 * load the file, simply skip it and move on. we don't need a full
+			 * load of the package, just the metadata. */
+			if(cache_file_identify(ent->d_name, &index, &name, &version) == 0) {
+				pm_printf(ALPM_LOG_DEBUG, "identified %s as %s-%s from its file name\n",
+						ent->d_name, name, version);
+				delete = !cache_file_keep(sync_dbs, db_local, name, version);
+				free(name);
+				free(version);
+			} else if(alpm_pkg_load(config->handle, path, 0, 0, &localpkg) != 0) {
 				pm_printf(ALPM_LOG_DEBUG, "skipping %s, could not load as package\n",
 						path);
 				continue;
+			} else {
+				delete = !cache_file_keep(sync_dbs, db_local,
+						alpm_pkg_get_name(localpkg), alpm_pkg_get_version(localpkg));
+				/* free the local file package */
+				alpm_pkg_free(localpkg);
 			}
-			local_name = alpm_pkg_get_name(localpkg);
-			local_version = alpm_pkg_get_version(localpkg);
-
-			if(config->cleanmethod & PM_CLEAN_KEEPINST) {
-				/* check if this package is in the local DB */
-				pkg = alpm_db_get_pkg(db_local, local_name);
-				if(pkg != NULL && alpm_pkg_vercmp(local_version,
-							alpm_pkg_get_version(pkg)) == 0) {
-					/* package was found in local DB and version matches, keep it */
-					pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in local db\n",
-							local_name, local_version);
-					delete = 0;
-				}
-			}
-			if(config->cleanmethod & PM_CLEAN_KEEPCUR) {
-				alpm_list_t *j;
-				/* check if this package is in a sync DB */
-				for(j = sync_dbs; j && delete; j = alpm_list_next(j)) {
-					alpm_db_t *db = j->data;
-					pkg = alpm_db_get_pkg(db, local_name);
-					if(pkg != NULL && alpm_pkg_vercmp(local_version,
-								alpm_pkg_get_version(pkg)) == 0) {
-						/* package was found in a sync DB and version matches, keep it */
-						pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in sync db\n",
-								local_name, local_version);
-						delete = 0;
-					}
-				}
-			}
-			/* free the local file package */
-			alpm_pkg_free(localpkg);
 
 			if(delete) {
 				size_t pathlen = strlen(path);
@@ -297,6 +463,7 @@ static int sync_cleancache(int level)
 		closedir(dir);
 		printf("\n");
 	}
+	free(index.entries);
 
 	return ret;
 }
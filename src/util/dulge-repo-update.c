@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+
+
+
+#include <getopt.h>
+#include <stdio.h> /* printf */
+#include <stdlib.h> /* exit */
+#include <stdarg.h> /* va_list */
+#include <unistd.h> /* sysconf */
+
+#include <alpm.h>
+#include "util.h" /* For Localization */
+
+static int quiet = 0;
+
+__attribute__((format(printf, 3, 0)))
+static void output_cb(void *ctx, alpm_loglevel_t level, const char *fmt, va_list args)
+{
+	(void)ctx;
+	if(fmt[0] == '\0') {
+		return;
+	}
+	switch(level) {
+		case ALPM_LOG_ERROR: fprintf(stderr, _("==> ERROR: ")); break;
+		case ALPM_LOG_WARNING: fprintf(stderr, _("==> WARNING: ")); break;
+		default: return; /* skip other messages */
+	}
+	vfprintf(stderr, fmt, args);
+}
+
+static void usage(int ret)
+{
+	FILE *stream = (ret ? stderr : stdout);
+	fputs(_("Usage: dulge-repo-update [options] <path-to-db> [<package>...]\n\n"), stream);
+	fputs(_("Update a package database in place, adding the given package files\n"
+				"and removing the packages named with --delete.\n\n"), stream);
+	fputs(_("Options:\n"), stream);
+	fputs(_("  -d, --delete <name>      remove a package from the database\n"), stream);
+	fputs(_("  -j, --jobs <n>           load packages and compress with <n> threads\n"
+				"                           (default: number of online CPUs)\n"), stream);
+	fputs(_("  -n, --new                only add packages that are not already in the database\n"), stream);
+	fputs(_("  -p, --prevent-downgrade  do not add package to database if a newer version is already present\n"), stream);
+	fputs(_("  -R, --remove             remove old package file from disk after updating database\n"), stream);
+	fputs(_("  --include-sigs           include package PGP signatures in the repository database (if available)\n"), stream);
+	fputs(_("  --seekable               write indexed databases that can be read a package at a time\n"), stream);
+	fputs(_("  -q, --quiet              minimize output\n"), stream);
+	fputs(_("  -h, --help               display this help information\n"), stream);
+	fputs(_("  -V, --version            display version information\n"), stream);
+	exit(ret);
+}
+
+int main(int argc, char *argv[])
+{
+	int retval = 1; /* default = false */
+	int flags = 0, fail = 0, c;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	char *endptr;
+	alpm_handle_t *handle;
+	alpm_repo_t *repo;
+	alpm_errno_t err;
+	alpm_list_t *deletes = NULL, *pkgfiles = NULL, *i;
+	const char *dbfile;
+
+	const char *short_opts = "d:hj:npqRV";
+	struct option long_opts[] = {
+		{ "delete"            , required_argument , NULL , 'd' },
+		{ "jobs"              , required_argument , NULL , 'j' },
+		{ "new"               , no_argument       , NULL , 'n' },
+		{ "prevent-downgrade" , no_argument       , NULL , 'p' },
+		{ "remove"            , no_argument       , NULL , 'R' },
+		{ "include-sigs"      , no_argument       , NULL , 's' },
+		{ "seekable"          , no_argument       , NULL , 'k' },
+		{ "quiet"             , no_argument       , NULL , 'q' },
+		{ "help"              , no_argument       , NULL , 'h' },
+		{ "version"           , no_argument       , NULL , 'V' },
+		{ 0, 0, 0, 0 },
+	};
+
+#if defined(ENABLE_NLS)
+	bindtextdomain(PACKAGE, LOCALEDIR);
+#endif
+
+	while((c = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
+		switch(c) {
+			case 'd':
+				deletes = alpm_list_add(deletes, optarg);
+				break;
+			case 'j':
+				jobs = strtol(optarg, &endptr, 10);
+				if(*endptr != '\0' || jobs < 1 || jobs > 1024) {
+					fprintf(stderr, _("invalid argument '%s' for %s\n"), optarg, "--jobs");
+					alpm_list_free(deletes);
+					return 1;
+				}
+				break;
+			case 'n':
+				flags |= ALPM_REPO_FLAG_NEWONLY;
+				break;
+			case 'p':
+				flags |= ALPM_REPO_FLAG_NODOWNGRADE;
+				break;
+			case 'R':
+				flags |= ALPM_REPO_FLAG_REMOVEOLD;
+				break;
+			case 's':
+				flags |= ALPM_REPO_FLAG_INCLUDESIGS;
+				break;
+			case 'k':
+				flags |= ALPM_REPO_FLAG_SEEKABLE;
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			case 'h':
+				usage(0);
+				break;
+			case 'V':
+				printf("dulge-repo-update (dulge) v" PACKAGE_VERSION "\n");
+				return 0;
+			case '?':
+			default:
+				usage(1);
+				break;
+		}
+	}
+	if(optind >= argc) {
+		usage(1);
+	}
+	dbfile = argv[optind++];
+
+	/* no package database is read, so do not require one to exist, e.g. on
+	 * a build server */
+	handle = alpm_initialize(ROOTDIR, ROOTDIR, &err);
+	if(!handle) {
+		fprintf(stderr, _("cannot initialize alpm: %s\n"), alpm_strerror(err));
+		alpm_list_free(deletes);
+		return 1;
+	}
+
+	/* let us get log messages from libalpm */
+	alpm_option_set_logcb(handle, output_cb, NULL);
+
+	if((repo = alpm_repo_open(handle, dbfile, flags)) == NULL) {
+		goto cleanup;
+	}
+	alpm_repo_set_jobs(repo, jobs > 0 ? (unsigned int)jobs : 1);
+
+	for(i = deletes; i; i = i->next) {
+		if(!quiet) {
+			printf(_("==> Removing package '%s'\n"), (char *)i->data);
+		}
+		if(alpm_repo_remove(repo, i->data) != 0) {
+			fail = 1;
+		}
+	}
+	for(; optind < argc; optind++) {
+		if(!quiet) {
+			printf(_("==> Adding package '%s'\n"), argv[optind]);
+		}
+		pkgfiles = alpm_list_add(pkgfiles, argv[optind]);
+	}
+	/* the packages are loaded in parallel, errors are reported as they come */
+	if(alpm_repo_add_list(repo, pkgfiles) != 0) {
+		fail = 1;
+	}
+
+	/* like dulge-repo-add, only write the database if everything went fine */
+	if(fail) {
+		printf(_("==> Package database was not modified due to errors.\n"));
+	} else if(alpm_repo_commit(repo) != 0) {
+		fprintf(stderr, _("==> ERROR: could not update '%s': %s\n"),
+				dbfile, alpm_strerror(alpm_errno(handle)));
+	} else {
+		if(!quiet) {
+			printf(_("==> Updated database file '%s'\n"), dbfile);
+		}
+		retval = 0;
+	}
+	alpm_repo_free(repo);
+
+cleanup:
+	alpm_list_free(deletes);
+	alpm_list_free(pkgfiles);
+	if(alpm_release(handle) == -1) {
+		fprintf(stderr, _("error releasing alpm\n"));
+	}
+
+	return retval;
+}
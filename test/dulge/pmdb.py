@@ -15,13 +15,16 @@
 
 
 from io import BytesIO
+import gzip
 import os
 import shutil
+import subprocess
 import tarfile
 
 import pmpkg
 import tap
 import util
+from util import vprint
 
 def _getsection(fd):
     i = []
@@ -54,6 +57,10 @@ def __init__(self, treename, root):
         self.pkgs = []
         self.option = {}
         self.syncdir = True
+        self.seekable = False
+        # "tar.gz" or "tar.zst" to have dulge-repo-update write the
+        # database, indexed, from the package files
+        self.repo_update = None
         if self.treename == "local":
             self.dbdir = os.path.join(root, util.PM_DBPATH, treename)
             self.dbfile = None
@@ -144,6 +151,8 @@ def db_read(self, name):
                     raise
             elif line == "%MD5SUM%":
                 pkg.md5sum = fd.readline().strip("\n")
+            elif line == "%SHA256SUM%":
+                pkg.sha256sum = fd.readline().strip("\n")
             elif line == "%PGPSIG%":
                 pkg.pgpsig = fd.readline().strip("\n")
             elif line == "%REPLACES%":
@@ -213,6 +222,7 @@ def db_write(self, pkg):
             make_section(data, "CSIZE", pkg.csize)
             make_section(data, "ISIZE", pkg.isize)
             make_section(data, "MD5SUM", pkg.md5sum)
+            make_section(data, "SHA256SUM", pkg.sha256sum)
             make_section(data, "PGPSIG", pkg.pgpsig)
 
         entry["desc"] = "\n".join(data)
@@ -229,7 +239,49 @@ def db_write(self, pkg):
 
         return entry
 
-    def generate(self):
+    def add_entries(self, tar, pkg, entry):
+        # TODO: the addition of the directory is currently a
+        # requirement for successful reading of a DB by libalpm
+        info = tarfile.TarInfo(pkg.fullname())
+        info.type = tarfile.DIRTYPE
+        tar.addfile(info)
+        for name, data in entry.items():
+            filename = os.path.join(pkg.fullname(), name)
+            info = tarfile.TarInfo(filename)
+            info.size = len(data)
+            tar.addfile(info, BytesIO(data.encode('utf8')))
+
+    def write_seekable(self, pkg_entries):
+        # one gzip member per package, then the end of archive and the
+        # index in the comment of an empty member; see lib/libalpm/be_sync.c
+        index = b""
+        with open(self.dbfile, "wb") as f:
+            for pkg, entry in pkg_entries:
+                buf = BytesIO()
+                # not closed, that would add the end of archive blocks
+                self.add_entries(tarfile.open(fileobj=buf, mode="w"), pkg, entry)
+                frame = gzip.compress(buf.getvalue(), mtime=0)
+                index += ("%s %d %d\n" % (pkg.fullname(), f.tell(), len(frame))).encode()
+                f.write(frame)
+            f.write(gzip.compress(bytes(1024), mtime=0))
+            f.write(b"\x1f\x8b\x08\x10\x00\x00\x00\x00\x00\xff")
+            f.write(index + ("ALPMIDX1%016x" % len(index)).encode())
+            f.write(b"\x00\x03\x00" + bytes(8))
+
+    def write_repo_update(self, dulge):
+        prog = util.which("dulge-repo-update", dulge["bindir"])
+        if not prog:
+            tap.bail("could not locate 'dulge-repo-update' binary")
+            return
+        repodir = os.path.join(self.root, "repo-update", self.treename)
+        util.mkdir(repodir)
+        dbfile = os.path.join(repodir, "%s.db.%s" % (self.treename, self.repo_update))
+        cmd = [prog, "-q", "--seekable", dbfile] + [pkg.path for pkg in self.pkgs]
+        vprint("\t%s" % " ".join(cmd))
+        subprocess.run(cmd, check=True)
+        shutil.copy(dbfile, self.dbfile)
+
+    def generate(self, dulge):
         pkg_entries = [(pkg, self.db_write(pkg)) for pkg in self.pkgs]
 
         if self.dbdir:
@@ -240,19 +292,15 @@ def generate(self):
                     util.mkfile(path, name, data)
 
         if self.dbfile:
-            tar = tarfile.open(self.dbfile, "w:gz")
-            for pkg, entry in pkg_entries:
-                # TODO: the addition of the directory is currently a
-                # requirement for successful reading of a DB by libalpm
-                info = tarfile.TarInfo(pkg.fullname())
-                info.type = tarfile.DIRTYPE
-                tar.addfile(info)
-                for name, data in entry.items():
-                    filename = os.path.join(pkg.fullname(), name)
-                    info = tarfile.TarInfo(filename)
-                    info.size = len(data)
-                    tar.addfile(info, BytesIO(data.encode('utf8')))
-            tar.close()
+            if self.repo_update:
+                self.write_repo_update(dulge)
+            elif self.seekable:
+                self.write_seekable(pkg_entries)
+            else:
+                tar = tarfile.open(self.dbfile, "w:gz")
+                for pkg, entry in pkg_entries:
+                    self.add_entries(tar, pkg, entry)
+                tar.close()
             # TODO: this is a bit unnecessary considering only one test uses it
             serverpath = os.path.join(self.root, util.SYNCREPO, self.treename)
             util.mkdir(serverpath)
@@ -14,6 +14,8 @@
 #  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 from io import BytesIO
+import gzip
+import hashlib
 import os
 import tarfile
 
@@ -43,12 +45,14 @@ def __init__(self, name, version = "1.0-1"):
         self.isize = 0
         self.reason = 0
         self.md5sum = ""      # sync only
+        self.sha256sum = ""   # sync only
         self.pgpsig = ""      # sync only
         self.replaces = []
         self.depends = []
         self.optdepends = []
         self.conflicts = []
         self.provides = []
+        self.xdata = []
         # files
         self.files = []
         self.backup = []
@@ -62,6 +66,7 @@ def __init__(self, name, version = "1.0-1"):
             "post_upgrade": "",
         }
         self.path = None
+        self.mtree = False    # local only
         self.finalized = False
 
     def __str__(self):
@@ -136,6 +141,8 @@ def dulge_build(self, path=None, fileobj=None):
             data.append("provides = %s" % i)
         for i in self.backup:
             data.append("backup = %s" % i)
+        for i in self.xdata:
+            data.append("xdata = %s" % i)
         archive_files.append((".PKGINFO", "\n".join(data)))
 
         # .INSTALL
@@ -183,6 +190,36 @@ def install_package(self, root):
             if os.path.isfile(path):
                 os.utime(path, (355, 355))
 
+    def install_mtree(self, root, dbdir):
+        """Write the mtree of the installed package to its local db entry.
+
+        Files are described as they are on disk, except that files marked
+        with a '*' get the contents the package would have shipped, so
+        -Qkk reports them as altered.
+        """
+        lines = ["#mtree"]
+        for f in sorted(self.files):
+            fileinfo = util.getfileinfo(f)
+            name = fileinfo["filename"]
+            st = os.lstat(os.path.join(root, name))
+            attrs = ["./%s" % name.rstrip("/"),
+                     "uid=%d" % st.st_uid, "gid=%d" % st.st_gid,
+                     "mode=%o" % (st.st_mode & 0o7777)]
+            if fileinfo["isdir"]:
+                attrs.append("type=dir")
+            elif fileinfo["islink"]:
+                attrs += ["type=link", "link=%s" % fileinfo["link"],
+                          "time=%d.0" % st.st_mtime]
+            else:
+                data = (f.rstrip("*") if fileinfo["changed"] else f) + "\n"
+                attrs += ["type=file", "size=%d" % len(data),
+                          "time=%d.0" % st.st_mtime,
+                          "sha256digest=%s" % hashlib.sha256(data.encode('utf8')).hexdigest()]
+            lines.append(" ".join(attrs))
+        path = os.path.join(dbdir, self.fullname(), "mtree")
+        with gzip.open(path, "wb") as fd:
+            fd.write(("\n".join(lines) + "\n").encode('utf8'))
+
     def filelist(self):
         """Generate a list of package files."""
         return sorted([self.parse_filename(f) for f in self.files])
@@ -14,6 +14,7 @@
 #  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 import os
+import re
 import stat
 
 import tap
@@ -128,6 +129,13 @@ def check(self, test):
                         success = f.read() == value
                 except:
                     success = 0
+            elif case == "MATCH":
+                # a multiline regular expression searched in the whole file
+                try:
+                    with open(filename, 'r') as f:
+                        success = re.search(value, f.read(), re.M) is not None
+                except:
+                    success = 0
             elif case == "MODIFIED":
                 for f in test.files:
                     if f.name == key:
@@ -186,6 +194,12 @@ def check(self, test):
             elif case == "FEXISTS":
                 if not os.path.isfile(os.path.join(cachedir, key)):
                     success = 0
+            elif case == "STORED":
+                pkg = test.findpkg(key, value)
+                if not pkg or not pkg.sha256sum or not os.path.isfile(
+                        os.path.join(test.cachestoredir(),
+                            pkg.sha256sum[:2], pkg.sha256sum)):
+                    success = 0
             elif case == "FCONTENTS":
                 filename = os.path.join(cachedir, key)
                 try:
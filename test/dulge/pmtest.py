@@ -40,6 +40,7 @@ def __init__(self, name, root, config):
         self.root = root
         self.dbver = 9
         self.cachepkgs = True
+        self.storepkgs = False
         self.config = config
         self.cmd = ["dulge", "--noconfirm",
                 "--config", self.configfile(),
@@ -93,6 +94,8 @@ def load(self):
         self.args = ""
         self.env = {}
         self.retcode = 0
+        # run the same command this many times, e.g. to exercise a cache
+        self.runs = 1
         self.db = {
             "local": pmdb.pmdb("local", self.root)
         }
@@ -173,17 +176,27 @@ def generate(self, dulge):
                 vprint("\t%s" % os.path.join(util.PM_CACHEDIR, pkg.filename()))
                 if self.cachepkgs:
                     pkg.dulge_build(cachedir)
+                elif self.storepkgs:
+                    pkg.dulge_build(tmpdir)
                 elif value.syncdir:
                     pkg.dulge_build(os.path.join(syncdir, value.treename))
                 if pkg.path:
                     pkg.md5sum = util.getmd5sum(pkg.path)
+                    pkg.sha256sum = util.getsha256sum(pkg.path)
                     pkg.csize = os.stat(pkg.path)[stat.ST_SIZE]
+                if self.storepkgs and not self.cachepkgs:
+                    # keep the package only in the content-addressed store
+                    path = os.path.join(self.cachestoredir(),
+                            pkg.sha256sum[:2], pkg.sha256sum)
+                    util.mkdir(os.path.dirname(path))
+                    os.rename(pkg.path, path)
+                    pkg.path = path
 
         # Creating sync database archives
         vprint("    Creating databases")
         for key, value in self.db.items():
             vprint("\t" + value.treename)
-            value.generate()
+            value.generate(dulge)
 
         # Filesystem
         vprint("    Populating file system")
@@ -199,6 +212,9 @@ def generate(self, dulge):
         for pkg in self.db["local"].pkgs:
             vprint("\tinstalling %s" % pkg.fullname())
             pkg.install_package(self.root)
+            if pkg.mtree:
+                pkg.install_mtree(self.root,
+                        os.path.join(self.root, util.PM_DBPATH, "local"))
         if self.db["local"].pkgs and self.dbver >= 9:
             path = os.path.join(self.root, util.PM_DBPATH, "local")
             util.mkfile(path, "ALPM_DB_VERSION", str(self.dbver))
@@ -287,28 +303,35 @@ def run(self, dulge):
             cmd.append("--debug=%s" % dulge["debug"])
         cmd.extend(shlex.split(self.args))
 
-        if not (dulge["gdb"] or dulge["nolog"]):
-            output = open(os.path.join(self.root, util.LOGFILE), 'w')
-        else:
-            output = None
         vprint("\trunning: %s" % " ".join(cmd))
 
         self.start_http_servers()
 
-        # Change to the tmp dir before running dulge, so that local package
-        # archives are made available more easily.
-        time_start = time.time()
-        self.retcode = subprocess.call(cmd, stdout=output, stderr=output,
-                cwd=os.path.join(self.root, util.TMPDIR), env={'LC_ALL': 'C', **self.env})
-        time_end = time.time()
-        vprint("\ttime elapsed: %.2fs" % (time_end - time_start))
+        # every run adds to the same log; the return code is that of the
+        # last run, or of the first one that failed
+        for run in range(self.runs):
+            if not (dulge["gdb"] or dulge["nolog"]):
+                output = open(os.path.join(self.root, util.LOGFILE),
+                        'w' if run == 0 else 'a')
+            else:
+                output = None
 
-        self.stop_http_servers()
+            # Change to the tmp dir before running dulge, so that local package
+            # archives are made available more easily.
+            time_start = time.time()
+            self.retcode = subprocess.call(cmd, stdout=output, stderr=output,
+                    cwd=os.path.join(self.root, util.TMPDIR), env={'LC_ALL': 'C', **self.env})
+            time_end = time.time()
+            vprint("\ttime elapsed: %.2fs" % (time_end - time_start))
 
-        if output:
-            output.close()
+            if output:
+                output.close()
 
-        vprint("\tretcode = %s" % self.retcode)
+            vprint("\tretcode = %s" % self.retcode)
+            if self.retcode != 0:
+                break
+
+        self.stop_http_servers()
 
         # Check if the lock is still there
         if os.path.isfile(util.PM_LOCK):
@@ -340,6 +363,9 @@ def rootdir(self):
     def cachedir(self):
         return os.path.join(self.root, util.PM_CACHEDIR)
 
+    def cachestoredir(self):
+        return os.path.join(self.root, util.PM_CACHESTORE)
+
     def hookdir(self):
         return os.path.join(self.root, util.PM_HOOKDIR)
 
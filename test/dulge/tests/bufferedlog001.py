@@ -0,0 +1,28 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "BufferedLog writes every log line once and in order"
+
+self.option["BufferedLog"] = []
+
+p1 = pmpkg("pkg1")
+p1.files = ["bin/pkg1"]
+p1.install['post_install'] = "echo pkg1 installed"
+self.addpkg(p1)
+
+p2 = pmpkg("pkg2")
+p2.files = ["bin/pkg2"]
+self.addpkg(p2)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2)])
+
+log = "var/log/dulge.log"
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("PKG_EXIST=pkg2")
+self.addrule("FILE_MATCH=%s|"
+		"\\[ALPM\\] transaction started\\n"
+		".*\\[ALPM\\] installed pkg1 \\(1\\.0-1\\)\\n"
+		".*\\[ALPM-SCRIPTLET\\] pkg1 installed\\n"
+		".*\\[ALPM\\] installed pkg2 \\(1\\.0-1\\)\\n"
+		".*\\[ALPM\\] transaction completed\\n" % log)
+self.addrule("!FILE_MATCH=%s|transaction started(.|\\n)*transaction started" % log)
+self.addrule("!FILE_MATCH=%s|installed pkg1(.|\\n)*installed pkg1" % log)
@@ -0,0 +1,15 @@
+self.description = "Add a package from the cache to the CacheStore"
+
+self.option["CacheStore"] = [self.cachestoredir()]
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=bin/dummy")
+self.addrule("CACHE_EXISTS=dummy|1.0-1")
+self.addrule("CACHE_STORED=dummy|1.0-1")
@@ -0,0 +1,19 @@
+self.description = "Install a package found only in the CacheStore"
+
+self.option["CacheStore"] = [self.cachestoredir()]
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy"]
+self.addpkg2db("sync", sp)
+
+# the package is neither in the cache nor on the server
+self.cachepkgs = False
+self.storepkgs = True
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=bin/dummy")
+self.addrule("CACHE_EXISTS=dummy|1.0-1")
+self.addrule("CACHE_STORED=dummy|1.0-1")
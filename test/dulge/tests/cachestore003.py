@@ -0,0 +1,14 @@
+self.description = "Install from the cache when the CacheStore is missing"
+
+self.option["CacheStore"] = ["%s/missing/store" % self.root]
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=bin/dummy")
+self.addrule("CACHE_EXISTS=dummy|1.0-1")
@@ -0,0 +1,42 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "CleanMethod = KeepInstalled, packages recognized by file name"
+
+sp = pmpkg("dummy", "2.0-1")
+self.addpkg2db("sync", sp)
+
+sp = pmpkg("foo", "1.0-1")
+self.addpkg2db("sync", sp)
+
+lp = pmpkg("dummy", "1.0-1")
+self.addpkg2db("local", lp)
+
+lp = pmpkg("foo", "1.0-1")
+self.addpkg2db("local", lp)
+
+lp = pmpkg("foo-bar", "3:1.2-1")
+self.addpkg2db("local", lp)
+
+# named like packages but empty, only the file name tells what they are
+self.filesystem = ["var/cache/dulge/pkg/dummy-1.0-1-any.pkg.tar.zst",
+                   "var/cache/dulge/pkg/dummy-0.9-1-any.pkg.tar.zst",
+                   "var/cache/dulge/pkg/foo-bar-3:1.2-1-any.pkg.tar.xz",
+                   "var/cache/dulge/pkg/foo-bar-3:1.1-2-any.pkg.tar.xz",
+                   "var/cache/dulge/pkg/notes.txt"]
+
+self.args = "-Sc --debug"
+self.option['CleanMethod'] = ['KeepInstalled']
+self.createlocalpkgs = True
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("!CACHE_EXISTS=dummy|2.0-1")
+self.addrule("CACHE_EXISTS=dummy|1.0-1")
+self.addrule("CACHE_EXISTS=foo|1.0-1")
+# the sync database names the package file, so it is kept unopened
+self.addrule("PACMAN_OUTPUT=identified foo-1.0-1.pkg.tar.gz as foo-1.0-1")
+self.addrule("FILE_EXIST=var/cache/dulge/pkg/dummy-1.0-1-any.pkg.tar.zst")
+self.addrule("FILE_EXIST=var/cache/dulge/pkg/foo-bar-3:1.2-1-any.pkg.tar.xz")
+# old versions by name, removed without being opened
+self.addrule("!FILE_EXIST=var/cache/dulge/pkg/dummy-0.9-1-any.pkg.tar.zst")
+self.addrule("!FILE_EXIST=var/cache/dulge/pkg/foo-bar-3:1.1-2-any.pkg.tar.xz")
+# not named like a package and not one: skipped
+self.addrule("FILE_EXIST=var/cache/dulge/pkg/notes.txt")
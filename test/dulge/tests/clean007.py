@@ -0,0 +1,40 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "CleanMethod = KeepInstalled with MetaCache"
+
+import os
+import pmfile
+
+sp = pmpkg("dummy", "2.0-1")
+self.addpkg2db("sync", sp)
+
+sp = pmpkg("baz", "2.0-1")
+self.addpkg2db("sync", sp)
+
+lp = pmpkg("dummy", "1.0-1")
+self.addpkg2db("local", lp)
+
+# a record of another file once at the path of the cached dummy-1.0-1;
+# were it used, the file would be taken for dummy-9.9-1 and removed
+pkgfile = os.path.join(self.root, "var/cache/dulge/pkg", lp.filename())
+pkginfo = "pkgname = dummy\npkgver = 9.9-1\n"
+self.filesystem = [pmfile.pmfile("var/lib/dulge/metacache",
+        "1 1 1 1.0 1.0 0 %d %s\n%s\n" % (len(pkginfo), pkgfile, pkginfo))]
+
+# the first run removes dummy-2.0-1 and baz-2.0-1, which the sync database
+# names, without opening them, and opens dummy-1.0-1; the second one reads
+# dummy-1.0-1 from the cache
+self.args = "-Sc --debug"
+self.runs = 2
+self.option['CleanMethod'] = ['KeepInstalled']
+self.option['MetaCache'] = []
+self.createlocalpkgs = True
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("!CACHE_EXISTS=dummy|2.0-1")
+self.addrule("CACHE_EXISTS=dummy|1.0-1")
+self.addrule("!CACHE_EXISTS=baz|2.0-1")
+self.addrule("PACMAN_OUTPUT=loaded 0 package metadata cache entries, dropped 1")
+self.addrule("PACMAN_OUTPUT=loaded 1 package metadata cache entries, dropped 0")
+self.addrule("PACMAN_OUTPUT=loading metadata of .*/dummy-1.0-1.pkg.tar.gz from the cache")
+self.addrule("FILE_MATCH=var/lib/dulge/metacache|^pkgver . 1.0-1$")
+self.addrule("!FILE_MATCH=var/lib/dulge/metacache|9.9-1")
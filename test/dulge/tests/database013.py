@@ -0,0 +1,35 @@
+self.description = "Local DB entries after an install, an upgrade and a removal"
+
+lp1 = pmpkg("pkg1")
+lp1.files = ["bin/pkg1"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkg2")
+lp2.files = ["bin/pkg2"]
+self.addpkg2db("local", lp2)
+
+sp1 = pmpkg("pkg1", "2.0-1")
+sp1.files = ["bin/pkg1", "usr/share/pkg1/data"]
+self.addpkg2db("sync", sp1)
+
+# replacing pkg2 installs pkg3 and removes pkg2 in the same commit
+sp3 = pmpkg("pkg3")
+sp3.files = ["bin/pkg3"]
+sp3.replaces = ["pkg2"]
+sp3.conflicts = ["pkg2"]
+self.addpkg2db("sync", sp3)
+
+self.args = "-Su"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=pkg1|2.0-1")
+self.addrule("PKG_FILES=pkg1|usr/share/pkg1/data")
+self.addrule("!PKG_EXIST=pkg2")
+self.addrule("PKG_EXIST=pkg3")
+self.addrule("PKG_FILES=pkg3|bin/pkg3")
+self.addrule("!DIR_EXIST=var/lib/dulge/local/pkg1-1.0-1/")
+self.addrule("!DIR_EXIST=var/lib/dulge/local/pkg2-1.0-1/")
+for entry in ["pkg1-2.0-1", "pkg3-1.0-1"]:
+	for f in ["desc", "files"]:
+		self.addrule("FILE_EXIST=var/lib/dulge/local/%s/%s" % (entry, f))
+		self.addrule("!FILE_EXIST=var/lib/dulge/local/%s/%s.tmp" % (entry, f))
@@ -0,0 +1,13 @@
+self.description = "Local DB entry after changing the install reason"
+
+lp = pmpkg("pkg1")
+lp.files = ["bin/pkg1"]
+lp.reason = 0
+self.addpkg2db("local", lp)
+
+self.args = "-D --asdeps %s" % lp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_REASON=pkg1|1")
+self.addrule("PKG_FILES=pkg1|bin/pkg1")
+self.addrule("!FILE_EXIST=var/lib/dulge/local/pkg1-1.0-1/desc.tmp")
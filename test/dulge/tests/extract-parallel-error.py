@@ -0,0 +1,34 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Extract packages in parallel, one of them can't be read"
+
+self.option["ExtractJobs"] = ["4"]
+
+sp = pmpkg("first")
+sp.files = ["usr/share/first/file"]
+self.addpkg2db("sync", sp)
+
+sp = pmpkg("broken")
+sp.files = ["usr/share/broken/file"]
+self.addpkg2db("sync", sp)
+
+# the package was checked already, break it before it is extracted
+self.add_hook("hook",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = broken
+
+        [Action]
+        When = PreTransaction
+        Exec = bin/sh -c 'echo garbage > var/cache/dulge/pkg/%s'
+        """ % sp.filename());
+
+self.args = "--debug -S first broken"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PKG_EXIST=first")
+self.addrule("FILE_EXIST=usr/share/first/file")
+self.addrule("PACMAN_OUTPUT=could not read package broken")
+self.addrule("PACMAN_OUTPUT=problem occurred while installing broken")
+self.addrule("!FILE_EXIST=usr/share/broken/file")
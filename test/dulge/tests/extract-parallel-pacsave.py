@@ -0,0 +1,28 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Extract packages in parallel, pacsave of a package held back"
+
+self.option["ExtractJobs"] = ["4"]
+
+sp = pmpkg("first")
+sp.files = ["usr/share/first/file"]
+self.addpkg2db("sync", sp)
+
+lp = pmpkg("dummy")
+lp.files = ["etc/dummy.conf*"]
+lp.backup = ["etc/dummy.conf"]
+self.addpkg2db("local", lp)
+
+sp = pmpkg("dummy", "1.0-2")
+sp.files = ["etc/dummy.d/file"]
+self.addpkg2db("sync", sp)
+
+# dummy is prepared while first is still extracted, its output and the
+# pacsave event come after those of first
+self.args = "--debug -S first dummy"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=dummy|1.0-2")
+self.addrule("FILE_PACSAVE=etc/dummy.conf")
+self.addrule("!FILE_EXIST=etc/dummy.conf")
+self.addrule("FILE_MATCH=var/log/pactest.log|"
+        "removing old package first \\(dummy-1.0-1\\)(?s:.*)etc/dummy.conf saved as")
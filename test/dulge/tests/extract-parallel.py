@@ -0,0 +1,47 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Extract packages in parallel, in order of their dependencies"
+
+self.option["ExtractJobs"] = ["4"]
+
+lp = pmpkg("old")
+lp.files = ["usr/share/old/",
+            "usr/share/old/file"]
+self.addpkg2db("local", lp)
+
+sp = pmpkg("old", "1.0-2")
+sp.files = ["usr/share/new/file"]
+self.addpkg2db("sync", sp)
+
+for name in ["a", "b", "c", "d", "e"]:
+    sp = pmpkg(name)
+    sp.files = ["usr/share/%s/file" % name,
+                "usr/share/%s/other" % name]
+    self.addpkg2db("sync", sp)
+
+sp = pmpkg("lib")
+sp.files = ["usr/lib/libfoo.so"]
+self.addpkg2db("sync", sp)
+
+sp = pmpkg("app")
+sp.depends = ["lib"]
+sp.files = ["usr/bin/app"]
+sp.install['pre_install'] = "test -f usr/lib/libfoo.so && : > pre_install"
+sp.install['post_install'] = "test -f usr/share/e/file && : > post_install"
+self.addpkg2db("sync", sp)
+
+self.args = "-S old a b c d e app"
+
+self.addrule("PACMAN_RETCODE=0")
+for name in ["a", "b", "c", "d", "e", "lib", "app"]:
+    self.addrule("PKG_EXIST=%s" % name)
+for name in ["a", "b", "c", "d", "e"]:
+    self.addrule("FILE_EXIST=usr/share/%s/file" % name)
+    self.addrule("FILE_EXIST=usr/share/%s/other" % name)
+self.addrule("PKG_VERSION=old|1.0-2")
+self.addrule("!FILE_EXIST=usr/share/old/file")
+self.addrule("!DIR_EXIST=usr/share/old/")
+self.addrule("FILE_EXIST=usr/share/new/file")
+self.addrule("FILE_EXIST=usr/lib/libfoo.so")
+self.addrule("FILE_EXIST=usr/bin/app")
+self.addrule("FILE_EXIST=pre_install")
+self.addrule("FILE_EXIST=post_install")
@@ -0,0 +1,54 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "A failing Parallel AbortOnFail hook stops the hooks after it"
+
+self.option["HookJobs"] = ["4"]
+
+self.add_hook("10-a",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PreTransaction
+        Exec = bin/sh -c ': > hook-10-a'
+        Parallel
+        """);
+
+self.add_hook("20-fail",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PreTransaction
+        Exec = bin/sh -c 'exit 1'
+        AbortOnFail
+        Parallel
+        """);
+
+self.add_hook("30-c",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PreTransaction
+        Exec = bin/sh -c ': > hook-30-c'
+        Parallel
+        """);
+
+sp = pmpkg("foo")
+self.addpkg2db("sync", sp)
+
+self.args = "-S foo"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PKG_EXIST=foo")
+self.addrule("FILE_EXIST=hook-10-a")
+self.addrule("!FILE_EXIST=hook-30-c")
@@ -0,0 +1,42 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "A parallel hook reading its targets is not held up by the others"
+
+self.option["HookJobs"] = ["4"]
+
+# reads its targets to the end, which only comes once its stdin is closed
+self.add_hook("10-a",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PostTransaction
+        Exec = bin/sh -c 'while read -r target; do :; done; echo A >> hook-order'
+        NeedsTargets
+        Parallel
+        """);
+
+# started after 10-a, busy for a while
+self.add_hook("20-b",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PostTransaction
+        Exec = bin/sh -c 'i=0; while [ $i -lt 200000 ]; do i=$((i+1)); done; echo B >> hook-order'
+        Parallel
+        """);
+
+sp = pmpkg("foo")
+self.addpkg2db("sync", sp)
+
+self.args = "-S foo"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=foo")
+self.addrule("FILE_CONTENTS=hook-order|A\nB\n")
@@ -0,0 +1,42 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Parallel hooks run before the next serial hook"
+
+self.option["HookJobs"] = ["4"]
+
+for name in ["10-a", "20-b", "30-c"]:
+    self.add_hook(name,
+            """
+            [Trigger]
+            Type = Package
+            Operation = Install
+            Target = foo
+
+            [Action]
+            When = PostTransaction
+            Exec = bin/sh -c ': > hook-%s'
+            Parallel
+            """ % name);
+
+self.add_hook("40-serial",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        When = PostTransaction
+        Exec = bin/sh -c 'test -f hook-10-a && test -f hook-20-b && test -f hook-30-c && : > hook-serial'
+        """);
+
+sp = pmpkg("foo")
+self.addpkg2db("sync", sp)
+
+self.args = "-S foo"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=foo")
+self.addrule("FILE_EXIST=hook-10-a")
+self.addrule("FILE_EXIST=hook-20-b")
+self.addrule("FILE_EXIST=hook-30-c")
+self.addrule("FILE_EXIST=hook-serial")
@@ -2,6 +2,7 @@
 self.description = "Make sure ldconfig runs on an upgrade operation"
 
 p = pmpkg("dummy")
+p.files = ["usr/lib/libdummy.so.1"]
 self.addpkg(p)
 
 self.args = "-U %s" % p.filename()
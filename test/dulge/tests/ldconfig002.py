@@ -2,9 +2,11 @@
 self.description = "Make sure ldconfig runs on an upgrade operation"
 
 lp = pmpkg("dummy")
+lp.files = ["usr/lib/libdummy.so.1"]
 self.addpkg2db("local", lp)
 
 p = pmpkg("dummy", "1.0-2")
+p.files = ["usr/lib/libdummy.so.1"]
 self.addpkg(p)
 
 self.args = "-U %s" % p.filename()
@@ -2,6 +2,7 @@
 self.description = "Make sure ldconfig runs on a sync operation"
 
 sp = pmpkg("dummy")
+sp.files = ["usr/lib/libdummy.so.1"]
 self.addpkg2db("sync", sp)
 
 self.args = "-S %s" % sp.name
@@ -0,0 +1,22 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "ldconfig runs once for several packages with libraries"
+
+p1 = pmpkg("pkg1")
+p1.files = ["usr/lib/libpkg1.so.1"]
+self.addpkg(p1)
+
+p2 = pmpkg("pkg2")
+p2.files = ["usr/lib/libpkg2.so"]
+self.addpkg(p2)
+
+p3 = pmpkg("pkg3")
+p3.files = ["usr/bin/pkg3"]
+self.addpkg(p3)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2, p3)])
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("PKG_EXIST=pkg2")
+self.addrule("PKG_EXIST=pkg3")
+self.addrule("FILE_CONTENTS=etc/ld.so.cache|ldconfig called\n")
@@ -0,0 +1,13 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "ldconfig does not run when no library is touched"
+
+p = pmpkg("dummy")
+p.files = ["usr/bin/dummy",
+           "usr/share/dummy/lib.so.txt"]
+self.addpkg(p)
+
+self.args = "-U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("!FILE_EXIST=etc/ld.so.cache")
@@ -0,0 +1,16 @@
+self.description = "Query--check mtree of several packages with --jobs"
+
+for n in range(4):
+	pkg = pmpkg("pkg%d" % n)
+	pkg.files = ["usr/share/pkg%d/file%03d" % (n, i) for i in range(300)]
+	pkg.files.append("usr/lib/libpkg%d.so.0" % n)
+	pkg.files.append("usr/lib/libpkg%d.so -> libpkg%d.so.0" % (n, n))
+	pkg.mtree = True
+	self.addpkg2db("local", pkg)
+
+self.args = "-Qkk --jobs 3"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=pkg0: 306 total files, 0 altered files")
+self.addrule("PACMAN_OUTPUT=pkg3: 306 total files, 0 altered files")
+self.addrule("PACMAN_OUTPUT=4 packages, 1224 files checked")
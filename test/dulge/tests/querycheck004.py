@@ -0,0 +1,17 @@
+self.description = "Query--check altered files of several packages with --jobs"
+
+for n in range(4):
+	pkg = pmpkg("pkg%d" % n)
+	pkg.files = ["usr/share/pkg%d/file%03d" % (n, i) for i in range(300)]
+	pkg.mtree = True
+	self.addpkg2db("local", pkg)
+
+# changed on disk after the mtree was written
+self.db["local"].getpkg("pkg2").files[299] += "*"
+
+self.args = "-Qkk --jobs 3"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=pkg1: 303 total files, 0 altered files")
+self.addrule("PACMAN_OUTPUT=pkg2: 303 total files, 1 altered file")
+self.addrule("PACMAN_OUTPUT=warning: pkg2: .*usr/share/pkg2/file299 \\(Size mismatch\\)")
@@ -0,0 +1,24 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "A failing batched scriptlet is reported for its package"
+
+p1 = pmpkg("pkg1")
+p1.files = ['etc/pkg1.conf']
+p1.xdata = ['scriptlet=batch']
+p1.install['post_install'] = "exit 3"
+self.addpkg(p1)
+
+p2 = pmpkg("pkg2")
+p2.files = ['etc/pkg2.conf']
+p2.xdata = ['scriptlet=batch']
+p2.install['post_install'] = "echo $1 > pkg2_post_install"
+self.addpkg(p2)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2)])
+
+# like an unbatched post_install, a failure does not fail the transaction
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("PKG_EXIST=pkg2")
+self.addrule("PACMAN_OUTPUT=pkg1: post_install scriptlet failed")
+self.addrule("!PACMAN_OUTPUT=pkg2: post_install scriptlet failed")
+self.addrule("FILE_CONTENTS=pkg2_post_install|1.0-1\n")
@@ -0,0 +1,28 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Batched post_install scriptlets run after all packages"
+
+p1 = pmpkg("pkg1")
+p1.files = ['etc/pkg1.conf']
+p1.xdata = ['scriptlet=batch']
+p1.install['post_install'] = "test -f etc/pkg2.conf && echo $1 > pkg1_post_install"
+self.addpkg(p1)
+
+p2 = pmpkg("pkg2")
+p2.files = ['etc/pkg2.conf']
+p2.depends = ['pkg1']
+p2.xdata = ['scriptlet=batch']
+p2.install['post_install'] = "echo $1 > pkg2_post_install"
+self.addpkg(p2)
+
+p3 = pmpkg("pkg3")
+p3.files = ['etc/pkg3.conf']
+p3.install['post_install'] = "echo $1 > pkg3_post_install"
+self.addpkg(p3)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2, p3)])
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("FILE_EXIST=pkg1_post_install")
+self.addrule("FILE_EXIST=pkg2_post_install")
+self.addrule("FILE_EXIST=pkg3_post_install")
+self.addrule("FILE_CONTENTS=pkg1_post_install|1.0-1\n")
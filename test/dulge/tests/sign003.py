@@ -0,0 +1,25 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Look up the key shared by several signed packages once"
+self.require_capability("gpg")
+
+# an empty keyring: the key is unknown and cannot be imported
+self.filesystem = ["etc/dulge.d/gnupg/"]
+self.option["GPGDir"] = ["%s/etc/dulge.d/gnupg/" % self.root]
+
+sig = "iEYEABECAAYFAkhMOggACgkQXC5GoPU6du2WVQCffVxF8GKXJIY4juJBIw/ljLrQxygAnj2QlvsUd7MdFekLX18+Ov/xzgZ1"
+for name in ["pkg1", "pkg2", "pkg3"]:
+	sp = pmpkg(name)
+	sp.pgpsig = sig
+	self.addpkg2db("sync+Required", sp)
+
+self.args = "-S --debug pkg1 pkg2 pkg3"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=looking up 1 keys locally")
+self.addrule("PACMAN_OUTPUT=key 5C2E46A0F53A76ED is unknown")
+self.addrule("PACMAN_OUTPUT=key 5C2E46A0F53A76ED found in cache \\(unknown\\)")
+self.addrule("!PACMAN_OUTPUT=looking up key 5C2E46A0F53A76ED locally")
+self.addrule("PACMAN_OUTPUT=required key missing from keyring")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!PKG_EXIST=pkg2")
+self.addrule("!PKG_EXIST=pkg3")
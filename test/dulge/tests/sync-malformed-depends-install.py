@@ -0,0 +1,17 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Install a package with a malformed %DEPENDS% entry"
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy"]
+sp.depends = [">=1.0"]
+self.addpkg2db("sync", sp)
+
+self.addpkg2db("sync", pmpkg("other"))
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=could not parse package description file 'dummy-1.0-1/desc'")
+self.addrule("PACMAN_OUTPUT=invalid or corrupted package")
+self.addrule("!PKG_EXIST=dummy")
+self.addrule("!FILE_EXIST=bin/dummy")
@@ -0,0 +1,15 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "List a sync db with a malformed %DEPENDS% entry"
+
+sp = pmpkg("dummy")
+sp.depends = [">=1.0"]
+self.addpkg2db("sync", sp)
+
+self.addpkg2db("sync", pmpkg("other"))
+
+self.args = "-Sl sync"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^sync dummy 1.0-1")
+self.addrule("PACMAN_OUTPUT=^sync other 1.0-1")
+self.addrule("!PACMAN_OUTPUT=could not parse")
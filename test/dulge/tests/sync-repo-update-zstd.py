@@ -0,0 +1,30 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Install from an indexed zstd sync db written by dulge-repo-update"
+
+sp = pmpkg("dummy")
+sp.desc = "test description"
+sp.files = ["bin/dummy",
+            "usr/man/man1/dummy.1"]
+sp.depends = ["dep"]
+self.addpkg2db("sync", sp)
+
+dp = pmpkg("dep")
+dp.files = ["bin/dep"]
+self.addpkg2db("sync", dp)
+
+self.addpkg2db("sync", pmpkg("unrelated"))
+
+self.db["sync"].repo_update = "tar.zst"
+
+self.args = "--debug -S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=reading index of 3 packages from db .sync.")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("PKG_DESC=dummy|test description")
+self.addrule("PKG_DEPENDS=dummy|dep")
+self.addrule("PKG_EXIST=dep")
+self.addrule("PKG_REASON=dep|1")
+self.addrule("!PKG_EXIST=unrelated")
+for f in sp.files + dp.files:
+	self.addrule("FILE_EXIST=%s" % f)
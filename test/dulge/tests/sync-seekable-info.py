@@ -0,0 +1,22 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Get info on a package from an indexed sync db"
+
+sp = pmpkg("dummy")
+sp.desc = "test description"
+sp.groups = ["foo"]
+sp.url = "http://www.archlinux.org"
+sp.depends = ["dep"]
+self.addpkg2db("sync", sp)
+
+self.addpkg2db("sync", pmpkg("other"))
+
+self.db["sync"].seekable = True
+
+self.args = "-Si %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^Name.*%s" % sp.name)
+self.addrule("PACMAN_OUTPUT=^Description.*%s" % sp.desc)
+self.addrule("PACMAN_OUTPUT=^Groups.*foo")
+self.addrule("PACMAN_OUTPUT=^Depends On.*dep")
+self.addrule("!PACMAN_OUTPUT=other")
@@ -0,0 +1,26 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Install a package and its dependency from an indexed sync db"
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy",
+            "usr/man/man1/dummy.1"]
+sp.depends = ["dep"]
+self.addpkg2db("sync", sp)
+
+dp = pmpkg("dep")
+dp.files = ["bin/dep"]
+self.addpkg2db("sync", dp)
+
+self.addpkg2db("sync", pmpkg("unrelated"))
+
+self.db["sync"].seekable = True
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("PKG_EXIST=dep")
+self.addrule("PKG_REASON=dep|1")
+self.addrule("!PKG_EXIST=unrelated")
+for f in sp.files + dp.files:
+	self.addrule("FILE_EXIST=%s" % f)
@@ -0,0 +1,21 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "Reinstalling a package with VerifyCache skips its checks"
+
+self.option["VerifyCache"] = []
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy",
+            "usr/man/man1/dummy.1"]
+self.addpkg2db("sync", sp)
+
+# the second run finds the package recorded by the first
+self.args = "-S --debug %s" % sp.name
+self.runs = 2
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=checking sha256sum")
+self.addrule("PACMAN_OUTPUT=was verified before, skipping checks")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=var/lib/dulge/verifycache")
+for f in sp.files:
+	self.addrule("FILE_EXIST=%s" % f)
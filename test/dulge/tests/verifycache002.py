@@ -0,0 +1,30 @@
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+self.description = "A package file changed after it was verified is checked again"
+
+self.option["VerifyCache"] = []
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy"]
+self.addpkg2db("sync", sp)
+
+# append to the cached package once the first run has recorded it
+self.add_hook("hook",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = dummy
+
+        [Action]
+        When = PostTransaction
+        Exec = bin/sh -c 'echo >> var/cache/dulge/pkg/%s'
+        """ % sp.filename());
+
+self.args = "-S --debug %s" % sp.name
+self.runs = 2
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PACMAN_OUTPUT=was verified before, skipping checks")
+self.addrule("PACMAN_OUTPUT=invalid or corrupted package \\(checksum\\)")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=var/lib/dulge/verifycache")
@@ -28,6 +28,7 @@
 PM_SYNCDBPATH = "var/lib/dulge/sync"
 PM_LOCK     = "var/lib/dulge/db.lck"
 PM_CACHEDIR = "var/cache/dulge/pkg"
+PM_CACHESTORE = "var/cache/dulge/store"
 PM_EXT_PKG  = ".pkg.tar.gz"
 PM_HOOKDIR  = "etc/dulge.d/hooks"
 
@@ -113,6 +114,9 @@ def mkcfgfile(filename, root, option, db):
     # Options
     data = ["[options]"]
     for key, value in option.items():
+        if not value:
+            # options without a value, e.g. CheckSpace
+            data.append(key)
         data.extend(["%s = %s" % (key, j) for j in value])
     if "SigLevel" not in option:
         data.append("SigLevel = Never\n")
@@ -134,7 +138,7 @@ def mkcfgfile(filename, root, option, db):
 
 
 #
-# MD5 helpers
+# Checksum helpers
 #
 
 def getmd5sum(filename):
@@ -150,6 +154,18 @@ def getmd5sum(filename):
     fd.close()
     return checksum.hexdigest()
 
+def getsha256sum(filename):
+    if not os.path.isfile(filename):
+        return ""
+    with open(filename, "rb") as fd:
+        checksum = hashlib.sha256()
+        while 1:
+            block = fd.read(32 * 1024)
+            if not block:
+                break
+            checksum.update(block)
+    return checksum.hexdigest()
+
 def mkmd5sum(data):
     checksum = hashlib.md5()
     checksum.update(("%s\n" % data).encode('utf8'))
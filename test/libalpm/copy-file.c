@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* copy-file - check and time _alpm_copyfile, which reflinks or copies in the
+ * kernel where it can, against a buffered read/write copy.
+ *
+ * Usage: copy-file [--iterations <n>] [--size <MiB>] [<directory>]
+ *
+ * A file of <MiB> MiB (default 1024) with a hole in the middle is created in
+ * <directory>, by default a new one under /tmp, and copied both ways each
+ * iteration. Pass a directory on a reflink capable filesystem (btrfs, xfs)
+ * to see the difference a clone makes. Output is TAP.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "util.h"
+
+#include "tap.h"
+
+#define CHUNK (1024 * 1024)
+
+/* data in the first and last quarter, a hole in between */
+static void make_file(const char *path, size_t mib)
+{
+	char *buf;
+	size_t n, i;
+	int fd;
+
+	if((buf = malloc(CHUNK)) == NULL) {
+		perror("malloc");
+		exit(99);
+	}
+	if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0640)) < 0) {
+		perror(path);
+		exit(99);
+	}
+	for(n = 0; n < mib; n++) {
+		if(n >= mib / 4 && n < mib - mib / 4) {
+			continue;
+		}
+		for(i = 0; i < CHUNK; i++) {
+			buf[i] = (char)(i * 31 + n);
+		}
+		if(pwrite(fd, buf, CHUNK, (off_t)n * CHUNK) != CHUNK) {
+			perror(path);
+			exit(99);
+		}
+	}
+	if(ftruncate(fd, (off_t)mib * CHUNK) != 0) {
+		perror(path);
+		exit(99);
+	}
+	close(fd);
+	free(buf);
+}
+
+/* what _alpm_copyfile did before it used the kernel */
+static int copy_buffered(const char *src, const char *dest)
+{
+	char *buf;
+	ssize_t nread;
+	int in, out, ret = 0;
+
+	if((buf = malloc(ALPM_BUFFER_SIZE)) == NULL) {
+		return 1;
+	}
+	in = open(src, O_RDONLY);
+	out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+	if(in < 0 || out < 0) {
+		ret = 1;
+	}
+	while(ret == 0 && (nread = read(in, buf, ALPM_BUFFER_SIZE)) > 0) {
+		if(write(out, buf, nread) != nread) {
+			ret = 1;
+		}
+	}
+	if(in >= 0) {
+		close(in);
+	}
+	if(out >= 0) {
+		close(out);
+	}
+	free(buf);
+	return ret;
+}
+
+static uint64_t file_sum(const char *path)
+{
+	unsigned char *buf;
+	uint64_t sum = 0;
+	ssize_t len, i;
+	int fd;
+
+	if((buf = malloc(CHUNK)) == NULL || (fd = open(path, O_RDONLY)) < 0) {
+		free(buf);
+		return 0;
+	}
+	while((len = read(fd, buf, CHUNK)) > 0) {
+		for(i = 0; i < len; i += 64) {
+			sum = sum * 1099511628211u + buf[i];
+		}
+	}
+	close(fd);
+	free(buf);
+	return sum;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/copy-file.XXXXXX", src[4096], dest[4096], missing[4096];
+	double buffered_time = 0, copy_time = 0, start;
+	const char *dir = NULL;
+	int iterations = 3, mib = 1024;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "size", &mib, 4 },
+		{ NULL, NULL, 0 }
+	};
+	uint64_t src_sum;
+	struct stat st;
+	int iter, errors = 0, same = 1, mode = 1, failed;
+
+	tap_options(&argc, &argv, options);
+	if(argc > 1) {
+		dir = argv[1];
+	} else if(mkdtemp(tmpdir) != NULL) {
+		dir = tmpdir;
+	} else {
+		perror("mkdtemp");
+		return 99;
+	}
+
+	printf("1..3\n");
+	printf("# %d MiB in %s, %d iterations\n", mib, dir, iterations);
+
+	snprintf(src, sizeof(src), "%s/copy-file.src", dir);
+	snprintf(dest, sizeof(dest), "%s/copy-file.dest", dir);
+	make_file(src, (size_t)mib);
+	src_sum = file_sum(src);
+
+	for(iter = 0; iter < iterations; iter++) {
+		unlink(dest);
+		start = now();
+		errors += copy_buffered(src, dest);
+		buffered_time += now() - start;
+		unlink(dest);
+
+		start = now();
+		errors += _alpm_copyfile(src, dest);
+		copy_time += now() - start;
+
+		same &= file_sum(dest) == src_sum;
+		mode &= stat(dest, &st) == 0 && (st.st_mode & 07777) == 0640;
+	}
+
+	ok(errors == 0 && same, "the copy has the contents of the original");
+	ok(mode, "the copy has the mode of the original");
+	failed = errors != 0 || !same || !mode;
+
+	snprintf(missing, sizeof(missing), "%s/missing/copy-file.dest", dir);
+	iter = _alpm_copyfile(src, missing);
+	ok(iter != 0, "copying into a missing directory fails");
+	failed |= iter == 0;
+
+	printf("# buffered %8.1f ms  copyfile %8.1f ms\n",
+			buffered_time / iterations * 1e3, copy_time / iterations * 1e3);
+
+	unlink(dest);
+	unlink(src);
+	if(dir == tmpdir) {
+		rmdir(tmpdir);
+	}
+
+	return failed;
+}
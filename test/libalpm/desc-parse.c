@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* desc-parse - check the database entry parser and time it against the
+ * strchr and strcmp chain it replaced.
+ *
+ * Usage: desc-parse [--iterations <n>] [--packages <n>]
+ *
+ * The desc entries of a sync database of <n> packages (default 15000, about
+ * the size of a full distribution repository) are generated in memory. Each
+ * iteration parses all of them with both parsers, copying every value the
+ * way the database backends do. Output is TAP.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "dbparse.h"
+
+#include "tap.h"
+
+static const struct {
+	const char *header;
+	alpm_dbkey_t key;
+} headers[] = {
+	{ "%NAME%", DBKEY_NAME },
+	{ "%VERSION%", DBKEY_VERSION },
+	{ "%FILENAME%", DBKEY_FILENAME },
+	{ "%BASE%", DBKEY_BASE },
+	{ "%DESC%", DBKEY_DESC },
+	{ "%GROUPS%", DBKEY_GROUPS },
+	{ "%URL%", DBKEY_URL },
+	{ "%LICENSE%", DBKEY_LICENSE },
+	{ "%ARCH%", DBKEY_ARCH },
+	{ "%BUILDDATE%", DBKEY_BUILDDATE },
+	{ "%INSTALLDATE%", DBKEY_INSTALLDATE },
+	{ "%PACKAGER%", DBKEY_PACKAGER },
+	{ "%REASON%", DBKEY_REASON },
+	{ "%VALIDATION%", DBKEY_VALIDATION },
+	{ "%SIZE%", DBKEY_SIZE },
+	{ "%CSIZE%", DBKEY_CSIZE },
+	{ "%ISIZE%", DBKEY_ISIZE },
+	{ "%MD5SUM%", DBKEY_MD5SUM },
+	{ "%SHA256SUM%", DBKEY_SHA256SUM },
+	{ "%PGPSIG%", DBKEY_PGPSIG },
+	{ "%REPLACES%", DBKEY_REPLACES },
+	{ "%DEPENDS%", DBKEY_DEPENDS },
+	{ "%OPTDEPENDS%", DBKEY_OPTDEPENDS },
+	{ "%MAKEDEPENDS%", DBKEY_MAKEDEPENDS },
+	{ "%CHECKDEPENDS%", DBKEY_CHECKDEPENDS },
+	{ "%CONFLICTS%", DBKEY_CONFLICTS },
+	{ "%PROVIDES%", DBKEY_PROVIDES },
+	{ "%XDATA%", DBKEY_XDATA },
+	{ "%DATA%", DBKEY_DATA },
+	{ "%FILES%", DBKEY_FILES },
+	{ "%BACKUP%", DBKEY_BACKUP },
+};
+
+#define NHEADERS (sizeof(headers) / sizeof(headers[0]))
+
+/* what a parse produces: the section and the copy of each value line */
+struct value {
+	alpm_dbkey_t key;
+	char *str;
+};
+
+struct result {
+	struct value *values;
+	size_t count, size;
+};
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	if((ptr = realloc(ptr, size)) == NULL) {
+		perror("realloc");
+		exit(99);
+	}
+	return ptr;
+}
+
+static void add_value(struct result *res, alpm_dbkey_t key, char *str)
+{
+	if(res->count == res->size) {
+		res->size = res->size ? res->size * 2 : 64;
+		res->values = xrealloc(res->values, res->size * sizeof(struct value));
+	}
+	res->values[res->count].key = key;
+	res->values[res->count++].str = str;
+}
+
+static void clear_result(struct result *res)
+{
+	size_t i;
+	for(i = 0; i < res->count; i++) {
+		free(res->values[i].str);
+	}
+	res->count = 0;
+}
+
+/* the previous parser: strchr to split, strcmp down the list of headers */
+static char *old_next_line(char **data)
+{
+	char *line = *data, *end;
+
+	if(*line == '\0') {
+		return NULL;
+	}
+	if((end = strchr(line, '\n')) != NULL) {
+		*data = end + 1;
+		*end = '\0';
+	} else {
+		*data = line + strlen(line);
+	}
+	return line;
+}
+
+static void old_parse(char *data, struct result *res)
+{
+	char *line;
+	size_t i;
+
+	while((line = old_next_line(&data)) != NULL) {
+		alpm_dbkey_t key = DBKEY_UNKNOWN;
+		if(*line == '\0') {
+			continue;
+		}
+		for(i = 0; i < NHEADERS; i++) {
+			if(strcmp(line, headers[i].header) == 0) {
+				key = headers[i].key;
+				break;
+			}
+		}
+		while((line = old_next_line(&data)) != NULL && *line != '\0') {
+			add_value(res, key, strdup(line));
+		}
+	}
+}
+
+static void new_parse(char *data, size_t datalen, struct result *res)
+{
+	alpm_dbparse_t parser;
+	char *line, *str;
+	size_t len;
+
+	_alpm_dbparse_init(&parser, data, datalen);
+	while((line = _alpm_dbparse_next(&parser, &len)) != NULL) {
+		alpm_dbkey_t key;
+		if(len == 0) {
+			continue;
+		}
+		key = _alpm_dbparse_key(line, len);
+		while((line = _alpm_dbparse_next(&parser, &len)) != NULL && len != 0) {
+			str = malloc(len + 1);
+			memcpy(str, line, len + 1);
+			add_value(res, key, str);
+		}
+	}
+}
+
+static int same_result(const struct result *a, const struct result *b)
+{
+	size_t i;
+	if(a->count != b->count) {
+		return 0;
+	}
+	for(i = 0; i < a->count; i++) {
+		if(a->values[i].key != b->values[i].key
+				|| strcmp(a->values[i].str, b->values[i].str) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* a desc entry shaped like those of a real repository, depends included */
+static char *make_desc(int num, int npkgs)
+{
+	char buf[8192], sig[401];
+	int len, i;
+
+	for(i = 0; i < 400; i++) {
+		sig[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(num + i * 7) % 64];
+	}
+	sig[400] = '\0';
+	len = snprintf(buf, sizeof(buf),
+			"%%FILENAME%%\npkg%d-1.%d-1-x86_64.pkg.tar.zst\n\n"
+			"%%NAME%%\npkg%d\n\n%%BASE%%\npkg%d\n\n%%VERSION%%\n1.%d-1\n\n"
+			"%%DESC%%\nA synthetic package number %d with a description of usual length\n\n"
+			"%%CSIZE%%\n%d\n\n%%ISIZE%%\n%d\n\n"
+			"%%SHA256SUM%%\n%064x\n\n%%PGPSIG%%\n%s\n\n"
+			"%%URL%%\nhttps://example.org/projects/pkg%d\n\n"
+			"%%LICENSE%%\nGPL-2.0-or-later\nLGPL-2.1-or-later\n\n%%ARCH%%\nx86_64\n\n"
+			"%%BUILDDATE%%\n%d\n\n%%PACKAGER%%\nSome Packager <packager@example.org>\n\n"
+			"%%DEPENDS%%\nglibc\npkg%d>=1.0\npkg%d\nlib%d.so=1-64\n\n"
+			"%%OPTDEPENDS%%\npkg%d: for an optional feature\n\n"
+			"%%MAKEDEPENDS%%\ncmake\nninja\n\n%%PROVIDES%%\nlibpkg%d.so=1-64\n",
+			num, num % 10, num, num, num % 10, num, 100000 + num * 13,
+			400000 + num * 29, num, sig, num, 1700000000 + num,
+			(num + 1) % npkgs, (num + 7) % npkgs, num % 100, (num + 3) % npkgs,
+			num);
+	return strndup(buf, len);
+}
+
+static void copy_descs(char *scratch, char **descs, size_t *lens, int npkgs)
+{
+	int i;
+	for(i = 0; i < npkgs; i++) {
+		memcpy(scratch, descs[i], lens[i] + 1);
+		scratch += lens[i] + 1;
+	}
+}
+
+static int check_keys(void)
+{
+	char line[64];
+	size_t i;
+
+	for(i = 0; i < NHEADERS; i++) {
+		if(_alpm_dbparse_key(headers[i].header, strlen(headers[i].header)) != headers[i].key) {
+			printf("# header %s is not recognized\n", headers[i].header);
+			return 0;
+		}
+		/* a missing or trailing character must not hit the same slot */
+		snprintf(line, sizeof(line), "%s", headers[i].header);
+		line[strlen(line) - 2] = '%';
+		if(_alpm_dbparse_key(line, strlen(line) - 1) != DBKEY_UNKNOWN) {
+			printf("# truncated header %s is recognized\n", headers[i].header);
+			return 0;
+		}
+	}
+	return _alpm_dbparse_key("%name%", 6) == DBKEY_UNKNOWN
+		&& _alpm_dbparse_key("NAME", 4) == DBKEY_UNKNOWN
+		&& _alpm_dbparse_key("%%", 2) == DBKEY_UNKNOWN
+		&& _alpm_dbparse_key("%FOO%", 5) == DBKEY_UNKNOWN;
+}
+
+static int check_lines(void)
+{
+	char data[] = "a\n\nbc\nlast";
+	const char *expect[] = { "a", "", "bc", "last" };
+	alpm_dbparse_t parser;
+	char *line;
+	size_t len, i = 0;
+
+	_alpm_dbparse_init(&parser, data, strlen(data));
+	while((line = _alpm_dbparse_next(&parser, &len)) != NULL) {
+		if(i == 4 || strcmp(line, expect[i]) != 0 || len != strlen(expect[i])) {
+			return 0;
+		}
+		i++;
+	}
+	return i == 4;
+}
+
+static int check_read_file(void)
+{
+	char path[] = "/tmp/desc-parse.XXXXXX";
+	const char content[] = "%NAME%\nfoo\n";
+	char *data = NULL;
+	size_t len = 0;
+	int fd, ret;
+
+	if((fd = mkstemp(path)) < 0) {
+		perror("mkstemp");
+		exit(99);
+	}
+	ret = _alpm_dbparse_read_file(path, &data, &len) == 0 && len == 0 && data[0] == '\0';
+	free(data);
+	ret &= write(fd, content, sizeof(content) - 1) == sizeof(content) - 1;
+	ret &= _alpm_dbparse_read_file(path, &data, &len) == 0
+		&& len == sizeof(content) - 1 && strcmp(data, content) == 0;
+	free(data);
+	close(fd);
+	unlink(path);
+	return ret && _alpm_dbparse_read_file(path, &data, &len) != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	double old_time = 0, new_time = 0, start;
+	struct result old_res = { 0 }, new_res = { 0 };
+	char **descs, *scratch, *pos;
+	size_t *lens, total = 0;
+	int iterations = 5, npkgs = 15000, iter, i, same = 1, failed;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "packages", &npkgs, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	descs = xrealloc(NULL, npkgs * sizeof(char *));
+	lens = xrealloc(NULL, npkgs * sizeof(size_t));
+	for(i = 0; i < npkgs; i++) {
+		descs[i] = make_desc(i, npkgs);
+		lens[i] = strlen(descs[i]);
+		total += lens[i];
+	}
+	scratch = xrealloc(NULL, total + npkgs);
+
+	printf("1..4\n");
+	printf("# %d packages, %.1f MiB of desc entries, %d iterations\n",
+			npkgs, total / 1048576.0, iterations);
+
+	failed = !check_keys();
+	ok(!failed, "every section header maps to its own key");
+	ok(check_lines(), "lines are split in place");
+	failed |= !check_lines();
+	ok(check_read_file(), "files are read whole and NUL-terminated");
+	failed |= !check_read_file();
+
+	for(iter = 0; iter < iterations; iter++) {
+		/* both parsers modify the entries, they get the same fresh copy */
+		copy_descs(scratch, descs, lens, npkgs);
+		start = now();
+		for(i = 0, pos = scratch; i < npkgs; pos += lens[i++] + 1) {
+			old_parse(pos, &old_res);
+		}
+		old_time += now() - start;
+
+		copy_descs(scratch, descs, lens, npkgs);
+		start = now();
+		for(i = 0, pos = scratch; i < npkgs; pos += lens[i++] + 1) {
+			new_parse(pos, lens[i], &new_res);
+		}
+		new_time += now() - start;
+
+		same &= same_result(&old_res, &new_res);
+		clear_result(&old_res);
+		clear_result(&new_res);
+	}
+	ok(same, "both parsers give the same values");
+	failed |= !same;
+
+	printf("# strcmp chain %8.1f ms  perfect hash %8.1f ms\n",
+			old_time / iterations * 1e3, new_time / iterations * 1e3);
+
+	for(i = 0; i < npkgs; i++) {
+		free(descs[i]);
+	}
+	free(descs);
+	free(lens);
+	free(scratch);
+	free(old_res.values);
+	free(new_res.values);
+
+	return failed;
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* filelist-setops - check and time the file list set operations with every
+ * comparison kernel the CPU supports, and check the packed, front-coded
+ * form files databases are kept in against the plain list.
+ *
+ * Usage: filelist-setops [--iterations <n>] [<old list> <new list>]
+ *
+ * The lists hold one path per line, e.g. from 'dulge -Qlq' of two versions
+ * of a large package. Without them two versions of a synthetic package with
+ * deep, versioned directories are generated. Output is TAP, with the memory
+ * each list takes as names plus alpm_file_t array and packed.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alpm.h"
+#include "filelist.h"
+
+#include "tap.h"
+
+static const char *kernels[] = { "scalar", "sse4.2", "avx2" };
+
+static int files_cmp(const void *f1, const void *f2)
+{
+	return strcmp(((const alpm_file_t *)f1)->name, ((const alpm_file_t *)f2)->name);
+}
+
+static void add_file(alpm_filelist_t *list, size_t *size, const char *name)
+{
+	if(list->count == *size) {
+		*size = *size ? *size * 2 : 1024;
+		list->files = realloc(list->files, *size * sizeof(alpm_file_t));
+		if(list->files == NULL) {
+			perror("realloc");
+			exit(99);
+		}
+	}
+	memset(list->files + list->count, 0, sizeof(alpm_file_t));
+	list->files[list->count++].name = strdup(name);
+}
+
+static void read_list(const char *path, alpm_filelist_t *list)
+{
+	char line[4096];
+	size_t size = 0;
+	FILE *fp = fopen(path, "r");
+
+	if(fp == NULL) {
+		perror(path);
+		exit(99);
+	}
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = '\0';
+		if(line[0] == '/') {
+			memmove(line, line + 1, strlen(line));
+		}
+		if(line[0]) {
+			add_file(list, &size, line);
+		}
+	}
+	fclose(fp);
+	qsort(list->files, list->count, sizeof(alpm_file_t), files_cmp);
+}
+
+/* roughly the shape of a large python or kernel module package: the new
+ * version moves a third of the tree to a new versioned directory and adds
+ * and drops a few modules */
+static void generate_list(int version, alpm_filelist_t *list)
+{
+	char path[PATH_MAX];
+	size_t size = 0;
+	int mod, sub, file;
+
+	for(mod = 0; mod < 200; mod++) {
+		int pyver = (mod % 3 == 0) ? 11 + version : 11;
+		if((version == 0 && mod % 50 == 7) || (version == 1 && mod % 50 == 8)) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "usr/lib/python3.%d/site-packages/vendor_package/module_%03d/",
+				pyver, mod);
+		add_file(list, &size, path);
+		for(sub = 0; sub < 10; sub++) {
+			snprintf(path, sizeof(path), "usr/lib/python3.%d/site-packages/vendor_package/module_%03d/subpackage_%02d/",
+					pyver, mod, sub);
+			add_file(list, &size, path);
+			for(file = 0; file < 25; file++) {
+				snprintf(path, sizeof(path), "usr/lib/python3.%d/site-packages/vendor_package/module_%03d/subpackage_%02d/implementation_file_%02d.py",
+						pyver, mod, sub, file);
+				add_file(list, &size, path);
+			}
+		}
+	}
+	qsort(list->files, list->count, sizeof(alpm_file_t), files_cmp);
+}
+
+struct result {
+	ssize_t diff_count, inter_count;
+	char **diff, **inter;
+	size_t found;
+	double diff_time, inter_time, contains_time;
+};
+
+static void run(alpm_filelist_t *a, alpm_filelist_t *b, int iterations,
+		struct result *res)
+{
+	double start;
+	size_t i;
+	int iter;
+
+	memset(res, 0, sizeof(*res));
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) {
+		free(res->diff);
+		res->diff_count = _alpm_filelist_difference(a, b, &res->diff);
+	}
+	res->diff_time = (now() - start) / iterations;
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) {
+		free(res->inter);
+		res->inter_count = _alpm_filelist_intersection(a, b, &res->inter);
+	}
+	res->inter_time = (now() - start) / iterations;
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) {
+		res->found = 0;
+		for(i = 0; i < a->count; i++) {
+			res->found += alpm_filelist_contains(b, a->files[i].name) != NULL;
+		}
+	}
+	res->contains_time = (now() - start) / iterations;
+}
+
+static int same_names(char **x, char **y, ssize_t count)
+{
+	ssize_t i;
+	for(i = 0; i < count; i++) {
+		if(x[i] != y[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+struct walk {
+	const alpm_filelist_t *list;
+	size_t pos, wrong;
+};
+
+static int walk_file(void *ctx, const char *path)
+{
+	struct walk *walk = ctx;
+	if(walk->pos >= walk->list->count
+			|| strcmp(walk->list->files[walk->pos].name, path) != 0) {
+		walk->wrong++;
+	}
+	walk->pos++;
+	return 0;
+}
+
+/* the number of probes alpm_filelist_contains and the packed lookup disagree
+ * on: every path, the path with its last byte dropped or one appended, and
+ * every path of the other list */
+static size_t probe(const alpm_filelist_packed_t *packed,
+		const alpm_filelist_t *list, const alpm_filelist_t *other)
+{
+	char path[PATH_MAX + 1];
+	size_t i, len, wrong = 0;
+
+	for(i = 0; i < list->count; i++) {
+		const char *name = list->files[i].name;
+		wrong += !_alpm_filelist_packed_contains(packed, name);
+
+		len = strlen(name);
+		memcpy(path, name, len - 1);
+		path[len - 1] = '\0';
+		wrong += _alpm_filelist_packed_contains(packed, path)
+			!= (alpm_filelist_contains(list, path) != NULL);
+		memcpy(path, name, len);
+		path[len] = '~';
+		path[len + 1] = '\0';
+		wrong += _alpm_filelist_packed_contains(packed, path)
+			!= (alpm_filelist_contains(list, path) != NULL);
+	}
+	for(i = 0; i < other->count; i++) {
+		const char *name = other->files[i].name;
+		wrong += _alpm_filelist_packed_contains(packed, name)
+			!= (alpm_filelist_contains(list, name) != NULL);
+	}
+	wrong += _alpm_filelist_packed_contains(packed, "");
+	wrong += _alpm_filelist_packed_contains(packed, "~");
+	return wrong;
+}
+
+static size_t list_size(const alpm_filelist_t *list)
+{
+	size_t i, size = list->count * sizeof(alpm_file_t);
+	for(i = 0; i < list->count; i++) {
+		size += strlen(list->files[i].name) + 1;
+	}
+	return size;
+}
+
+static size_t packed_size(const alpm_filelist_packed_t *packed)
+{
+	/* one restart offset every 16 paths, see FILELIST_RESTART */
+	return sizeof(*packed) + (packed->count + 15) / 16 * sizeof(uint32_t)
+		+ packed->size;
+}
+
+static int check_packed(alpm_filelist_t *list, alpm_filelist_t *other,
+		const char *which)
+{
+	alpm_filelist_packed_t *packed, *copy;
+	alpm_filelist_t unpacked = {0};
+	struct walk walk = { list, 0, 0 };
+	double start, contains_time, packed_time;
+	size_t i, wrong = 0, found = 0;
+
+	if((packed = _alpm_filelist_pack(list)) == NULL
+			|| (copy = _alpm_filelist_packed_dup(packed)) == NULL) {
+		perror("pack");
+		exit(99);
+	}
+	free(packed);
+
+	/* walk and look up through the copy only */
+	_alpm_filelist_packed_foreach(copy, walk_file, &walk);
+	wrong += walk.wrong + (walk.pos != list->count);
+	wrong += probe(copy, list, other);
+
+	if(_alpm_filelist_unpack(copy, &unpacked) != 0) {
+		perror("unpack");
+		exit(99);
+	}
+	wrong += unpacked.count != list->count;
+	for(i = 0; i < unpacked.count && i < list->count; i++) {
+		wrong += strcmp(unpacked.files[i].name, list->files[i].name) != 0;
+	}
+	ok(wrong == 0, "packed %s list round-trips and finds what the list finds", which);
+
+	start = now();
+	for(i = 0; i < other->count; i++) {
+		found += alpm_filelist_contains(list, other->files[i].name) != NULL;
+	}
+	contains_time = now() - start;
+	start = now();
+	for(i = 0; i < other->count; i++) {
+		found -= _alpm_filelist_packed_contains(copy, other->files[i].name);
+	}
+	packed_time = now() - start;
+
+	printf("# %s list: %zu paths  %zu bytes as list  %zu bytes packed"
+			"  contains %.1f us  packed contains %.1f us\n",
+			which, list->count, list_size(list), packed_size(copy),
+			contains_time * 1e6, packed_time * 1e6);
+
+	for(i = 0; i < unpacked.count; i++) {
+		free(unpacked.files[i].name);
+	}
+	free(unpacked.files);
+	free(copy);
+	return wrong != 0 || found != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	alpm_filelist_t a = {0}, b = {0};
+	struct result ref, res;
+	int iterations = 1, failed = 0;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ NULL, NULL, 0 }
+	};
+	size_t i;
+
+	tap_options(&argc, &argv, options);
+
+	if(argc == 3) {
+		read_list(argv[1], &a);
+		read_list(argv[2], &b);
+	} else {
+		generate_list(0, &a);
+		generate_list(1, &b);
+	}
+
+	printf("1..%d\n", (int)(sizeof(kernels) / sizeof(kernels[0])) + 2);
+	printf("# %zu old files, %zu new files, %d iterations\n", a.count, b.count, iterations);
+
+	_alpm_filelist_set_kernel("scalar");
+	run(&a, &b, 1, &ref);
+
+	for(i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		if(_alpm_filelist_set_kernel(kernels[i]) != 0) {
+			skip("%s not supported", kernels[i]);
+			continue;
+		}
+		run(&a, &b, iterations, &res);
+		if(res.diff_count != ref.diff_count || res.inter_count != ref.inter_count
+				|| res.found != ref.found
+				|| !same_names(res.diff, ref.diff, ref.diff_count)
+				|| !same_names(res.inter, ref.inter, ref.inter_count)) {
+			failed = 1;
+			ok(0, "%s matches scalar results", kernels[i]);
+		} else {
+			ok(1, "%s matches scalar results", kernels[i]);
+		}
+		printf("# %-7s difference %8.1f us  intersection %8.1f us  contains %8.1f us\n",
+				kernels[i], res.diff_time * 1e6, res.inter_time * 1e6,
+				res.contains_time * 1e6);
+		free(res.diff);
+		free(res.inter);
+	}
+
+	failed |= check_packed(&a, &b, "old");
+	failed |= check_packed(&b, &a, "new");
+
+	free(ref.diff);
+	free(ref.inter);
+	for(i = 0; i < a.count; i++) {
+		free(a.files[i].name);
+	}
+	for(i = 0; i < b.count; i++) {
+		free(b.files[i].name);
+	}
+	free(a.files);
+	free(b.files);
+
+	return failed;
+}
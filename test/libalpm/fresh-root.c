@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* fresh-root - check and time installing a base set of packages into an
+ * empty root, against installing them into a root that already holds a file.
+ *
+ * Usage: fresh-root [--iterations <n>] [--packages <n>]
+ *
+ * <n> packages (default 400) are generated, each with a few dozen small
+ * files in directories shared with the others, a configuration file in its
+ * backup array and dependencies on packages before it. Each iteration
+ * installs all of them with one transaction, from loading the package files
+ * to the database being written, into an empty root and into a root holding
+ * an unrelated file, which is handled like a live system. A package left in
+ * the package cache keeps the root empty, a hook does not. Output is TAP.
+ */
+
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "alpm.h"
+
+#include "tap.h"
+
+#define FILES_PER_PKG 24
+
+/* the contents of a stray file, a valid hook in case it is one */
+#define STRAY "[Trigger]\nType = Path\nOperation = Install\nTarget = nothing\n\n" \
+	"[Action]\nWhen = PostTransaction\nExec = /bin/true\n"
+
+/* base/rel into path, a buffer of PATH_MAX */
+static void join(char *path, const char *base, const char *rel)
+{
+	if(snprintf(path, PATH_MAX, "%s/%s", base, rel) >= PATH_MAX) {
+		fprintf(stderr, "%s/%s: path too long\n", base, rel);
+		exit(99);
+	}
+}
+
+static void add_entry(struct archive *a, const char *name, mode_t type, mode_t perm,
+		const char *data, size_t len)
+{
+	struct archive_entry *ae = archive_entry_new();
+
+	archive_entry_set_pathname(ae, name);
+	archive_entry_set_filetype(ae, type);
+	archive_entry_set_perm(ae, perm);
+	archive_entry_set_size(ae, len);
+	/* owned by whoever runs this, so extracting as a user doesn't warn */
+	archive_entry_set_uid(ae, getuid());
+	archive_entry_set_gid(ae, getgid());
+	archive_entry_set_mtime(ae, 1700000000, 0);
+	if(archive_write_header(a, ae) != ARCHIVE_OK
+			|| (len && archive_write_data(a, data, len) != (la_ssize_t)len)) {
+		fprintf(stderr, "could not write %s: %s\n", name, archive_error_string(a));
+		exit(99);
+	}
+	archive_entry_free(ae);
+}
+
+static char *make_pkg(const char *dir, int num)
+{
+	struct archive *a = archive_write_new();
+	char name[256], pkginfo[1024], data[512], *path;
+	int len, n;
+
+	if(asprintf(&path, "%s/pkg%d-1.0-1-x86_64.pkg.tar.gz", dir, num) == -1) {
+		perror("asprintf");
+		exit(99);
+	}
+	archive_write_set_format_pax_restricted(a);
+	archive_write_add_filter_gzip(a);
+	if(archive_write_open_filename(a, path) != ARCHIVE_OK) {
+		fprintf(stderr, "could not create %s: %s\n", path, archive_error_string(a));
+		exit(99);
+	}
+
+	len = snprintf(pkginfo, sizeof(pkginfo),
+			"# Generated by fresh-root\n"
+			"pkgname = pkg%d\npkgbase = pkg%d\npkgver = 1.0-1\n"
+			"pkgdesc = A generated base package number %d\n"
+			"builddate = 1700000000\nsize = %d\narch = x86_64\n"
+			"backup = etc/pkg%d.conf\n",
+			num, num, num, (FILES_PER_PKG + 2) * (int)sizeof(data), num);
+	if(num > 0) {
+		len += snprintf(pkginfo + len, sizeof(pkginfo) - len, "depend = pkg%d\n", num / 2);
+	}
+	if(num > 0 && num % 3 == 0) {
+		len += snprintf(pkginfo + len, sizeof(pkginfo) - len, "depend = pkg%d\n", num - 1);
+	}
+	add_entry(a, ".PKGINFO", AE_IFREG, 0644, pkginfo, len);
+
+	for(n = 0; n < (int)sizeof(data); n++) {
+		data[n] = "0123456789abcdef"[(n * 7 + num) % 16];
+	}
+	add_entry(a, "etc/", AE_IFDIR, 0755, NULL, 0);
+	snprintf(name, sizeof(name), "etc/pkg%d.conf", num);
+	add_entry(a, name, AE_IFREG, 0644, data, 64);
+	add_entry(a, "usr/", AE_IFDIR, 0755, NULL, 0);
+	add_entry(a, "usr/bin/", AE_IFDIR, 0755, NULL, 0);
+	snprintf(name, sizeof(name), "usr/bin/pkg%d", num);
+	add_entry(a, name, AE_IFREG, 0755, data, sizeof(data));
+	add_entry(a, "usr/lib/", AE_IFDIR, 0755, NULL, 0);
+	snprintf(name, sizeof(name), "usr/lib/pkg%d/", num);
+	add_entry(a, name, AE_IFDIR, 0755, NULL, 0);
+	for(n = 0; n < FILES_PER_PKG; n++) {
+		snprintf(name, sizeof(name), "usr/lib/pkg%d/file%02d", num, n);
+		add_entry(a, name, AE_IFREG, 0644, data + n, sizeof(data) - n);
+	}
+	add_entry(a, "usr/share/", AE_IFDIR, 0755, NULL, 0);
+	add_entry(a, "usr/share/doc/", AE_IFDIR, 0755, NULL, 0);
+	snprintf(name, sizeof(name), "usr/share/doc/pkg%d/", num);
+	add_entry(a, name, AE_IFDIR, 0755, NULL, 0);
+	snprintf(name, sizeof(name), "usr/share/doc/pkg%d/README", num);
+	add_entry(a, name, AE_IFREG, 0644, "README\n", 7);
+
+	archive_write_close(a);
+	archive_write_free(a);
+	return path;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+static void remove_tree(const char *dir)
+{
+	nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* create path and the directories leading to it, as a file if data is set */
+static void make_path(const char *base, const char *rel, const char *data)
+{
+	char path[PATH_MAX], *p;
+
+	join(path, base, rel);
+	for(p = path + strlen(base); (p = strchr(p, '/')) != NULL; p++) {
+		*p = '\0';
+		mkdir(path, 0755);
+		*p = '/';
+	}
+	if(data) {
+		FILE *fp = fopen(path, "w");
+		if(fp == NULL) {
+			perror(path);
+			exit(99);
+		}
+		fputs(data, fp);
+		fclose(fp);
+	}
+}
+
+/* libalpm says so when it finds the root empty */
+static void logcb(void *ctx, alpm_loglevel_t level, const char *fmt, va_list args)
+{
+	(void)args;
+	if(level == ALPM_LOG_DEBUG && strstr(fmt, "skipping checks against the filesystem")) {
+		*(int *)ctx = 1;
+	}
+}
+
+/* Install all packages into a new root under base holding the file stray,
+ * if set. Returns the seconds taken, the error of the commit if it failed
+ * and whether the root was taken as empty. */
+static double install(const char *base, char **files, int count, const char *stray,
+		alpm_errno_t *err, int *fresh)
+{
+	char root[PATH_MAX], dbpath[PATH_MAX], dir[PATH_MAX];
+	alpm_handle_t *handle;
+	alpm_list_t *data = NULL;
+	double start;
+	int i;
+
+	join(root, base, "root");
+	join(dbpath, root, "var/lib/dulge");
+	remove_tree(root);
+	make_path(root, "var/lib/dulge/local/", NULL);
+	if(stray) {
+		make_path(root, stray, STRAY);
+	}
+
+	*err = ALPM_ERR_OK;
+	*fresh = 0;
+	start = now();
+	if((handle = alpm_initialize(root, dbpath, err)) == NULL) {
+		return 0;
+	}
+	alpm_option_set_logcb(handle, logcb, fresh);
+	join(dir, root, "var/cache/dulge/pkg/");
+	alpm_option_add_cachedir(handle, dir);
+	join(dir, root, "etc/dulge.d/hooks/");
+	alpm_option_add_hookdir(handle, dir);
+
+	if(alpm_trans_init(handle, 0) != 0) {
+		goto error;
+	}
+	for(i = 0; i < count; i++) {
+		alpm_pkg_t *pkg;
+		if(alpm_pkg_load(handle, files[i], 1, 0, &pkg) != 0
+				|| alpm_add_pkg(handle, pkg) != 0) {
+			goto error;
+		}
+	}
+	if(alpm_trans_prepare(handle, &data) != 0 || alpm_trans_commit(handle, &data) != 0) {
+		goto error;
+	}
+	alpm_trans_release(handle);
+	alpm_release(handle);
+	return now() - start;
+
+error:
+	*err = alpm_errno(handle);
+	if(*err == ALPM_ERR_FILE_CONFLICTS) {
+		alpm_list_free_inner(data, (alpm_list_fn_free)alpm_fileconflict_free);
+	}
+	alpm_list_free(data);
+	alpm_trans_release(handle);
+	alpm_release(handle);
+	return now() - start;
+}
+
+/* the packages the database of the root under base lists, read back from
+ * disk, and how many of them have the hash of their backup file */
+static int count_installed(const char *base, int *hashed)
+{
+	char root[PATH_MAX], dbpath[PATH_MAX];
+	alpm_handle_t *handle;
+	alpm_errno_t err;
+	alpm_list_t *i;
+	int count = 0;
+
+	*hashed = 0;
+	join(root, base, "root");
+	join(dbpath, root, "var/lib/dulge");
+	if((handle = alpm_initialize(root, dbpath, &err)) == NULL) {
+		return 0;
+	}
+	for(i = alpm_db_get_pkgcache(alpm_get_localdb(handle)); i; i = i->next) {
+		alpm_list_t *backup = alpm_pkg_get_backup(i->data);
+		count++;
+		if(backup && ((alpm_backup_t *)backup->data)->hash) {
+			(*hashed)++;
+		}
+	}
+	alpm_release(handle);
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/fresh-root.XXXXXX", pkgdir[256];
+	double fresh_time = 0, used_time = 0;
+	alpm_errno_t err;
+	char **files;
+	int iterations = 3, count = 400, iter, i, fresh, hashed, failed = 0;
+	int fresh_ok = 1, used_ok = 1, detected = 1, undetected = 1;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "packages", &count, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	snprintf(pkgdir, sizeof(pkgdir), "%s/pkgs", tmpdir);
+	mkdir(pkgdir, 0755);
+	if((files = calloc(count, sizeof(char *))) == NULL) {
+		perror("calloc");
+		return 99;
+	}
+	for(i = 0; i < count; i++) {
+		files[i] = make_pkg(pkgdir, i);
+	}
+
+	printf("1..7\n");
+	printf("# %d packages, %d iterations\n", count, iterations);
+
+	for(iter = 0; iter < iterations; iter++) {
+		fresh_time += install(tmpdir, files, count, NULL, &err, &fresh);
+		detected &= fresh;
+		fresh_ok &= err == ALPM_ERR_OK && count_installed(tmpdir, &hashed) == count
+			&& hashed == count;
+
+		used_time += install(tmpdir, files, count, "etc/hostname", &err, &fresh);
+		undetected &= !fresh;
+		used_ok &= err == ALPM_ERR_OK && count_installed(tmpdir, &hashed) == count
+			&& hashed == count;
+	}
+
+	ok(detected, "an empty root is installed into as such");
+	ok(fresh_ok, "every package and backup hash is in the database of the empty root");
+	ok(undetected, "a root holding a file is not taken as empty");
+	ok(used_ok, "every package and backup hash is in the database of the other root");
+	failed = !detected || !fresh_ok || !undetected || !used_ok;
+
+	/* a file of a package in the way has to be reported up front */
+	install(tmpdir, files, count, "usr/bin/pkg0", &err, &fresh);
+	ok(err == ALPM_ERR_FILE_CONFLICTS && !fresh, "a file in the way is a conflict");
+	failed |= err != ALPM_ERR_FILE_CONFLICTS || fresh;
+
+	/* libalpm put the package there, someone else the hook */
+	install(tmpdir, files, count, "var/cache/dulge/pkg/pkg0-0.9-1-x86_64.pkg.tar.gz",
+			&err, &fresh);
+	ok(err == ALPM_ERR_OK && fresh, "a root holding a cached package is empty");
+	failed |= err != ALPM_ERR_OK || !fresh;
+
+	install(tmpdir, files, count, "etc/dulge.d/hooks/none.hook", &err, &fresh);
+	ok(err == ALPM_ERR_OK && !fresh, "a root holding a hook is not empty");
+	failed |= err != ALPM_ERR_OK || fresh;
+
+	printf("# empty root %8.1f ms  used root %8.1f ms\n",
+			fresh_time / iterations * 1e3, used_time / iterations * 1e3);
+
+	for(i = 0; i < count; i++) {
+		free(files[i]);
+	}
+	free(files);
+	remove_tree(tmpdir);
+
+	return failed;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* llstat-bulk - check llstat_bulk against llstat and time both.
+ *
+ * Usage: llstat-bulk [--iterations <n>] [--copies <n>]
+ *
+ * A directory with files, directories, symlinks to both and a dangling
+ * symlink is created, and a list of paths into it, with and without
+ * trailing slashes and including missing ones, is repeated <n> times
+ * (default 2000). Each path has to give the same result through
+ * llstat_bulk as through llstat, for a list short enough to be handled
+ * sequentially, for the full list, and for two threads calling
+ * llstat_bulk at once. Output is TAP.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bulkstat.h"
+#include "util-common.h"
+
+#include "tap.h"
+
+static const char *names[] = {
+	"", "file", "file/", "dir", "dir/", "dir//", "dir/sub", "dir/sub/",
+	"dirlink", "dirlink/", "dirlink//", "dirlink/sub", "filelink",
+	"filelink/", "dangling", "dangling/", "missing", "missing/",
+	"dir/missing", "file/missing",
+};
+#define NNAMES (sizeof(names) / sizeof(names[0]))
+
+struct job {
+	const char *prefix;
+	const char **paths;
+	size_t count;
+	struct stat *bufs;
+	int *errs;
+};
+
+static void make_tree(const char *dir)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/file", dir);
+	if((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(99);
+	}
+	fclose(fp);
+	snprintf(path, sizeof(path), "%s/dir", dir);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/dir/sub", dir);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/dirlink", dir);
+	if(symlink("dir", path) != 0) {
+		perror(path);
+		exit(99);
+	}
+	snprintf(path, sizeof(path), "%s/filelink", dir);
+	if(symlink("file", path) != 0) {
+		perror(path);
+		exit(99);
+	}
+	snprintf(path, sizeof(path), "%s/dangling", dir);
+	if(symlink("nowhere", path) != 0) {
+		perror(path);
+		exit(99);
+	}
+}
+
+static void remove_tree(const char *dir)
+{
+	const char *files[] = { "dangling", "filelink", "dirlink", "file" };
+	char path[PATH_MAX];
+	size_t i;
+
+	for(i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/dir/sub", dir);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/dir", dir);
+	rmdir(path);
+	rmdir(dir);
+}
+
+/* the number of paths whose llstat_bulk result differs from llstat */
+static size_t compare(const struct job *job)
+{
+	size_t i, wrong = 0;
+
+	for(i = 0; i < job->count; i++) {
+		char path[PATH_MAX];
+		struct stat st;
+		int err = 0;
+
+		snprintf(path, sizeof(path), "%s%s", job->prefix, job->paths[i]);
+		if(llstat(path, &st) != 0) {
+			err = errno;
+		}
+		if(err != job->errs[i] || (err == 0 && (st.st_ino != job->bufs[i].st_ino
+						|| st.st_mode != job->bufs[i].st_mode))) {
+			if(wrong++ < 5) {
+				printf("# %s: llstat %s, llstat_bulk %s\n", path,
+						err ? strerror(err) : "ok",
+						job->errs[i] ? strerror(job->errs[i]) : "ok");
+			}
+		}
+	}
+	return wrong;
+}
+
+static void *run_job(void *arg)
+{
+	struct job *job = arg;
+	llstat_bulk(job->prefix, job->paths, job->count, job->bufs, job->errs);
+	return NULL;
+}
+
+static struct job *new_job(const char *prefix, size_t count)
+{
+	struct job *job = calloc(1, sizeof(*job));
+	size_t i;
+
+	if(job == NULL || (job->paths = calloc(count, sizeof(char *))) == NULL
+			|| (job->bufs = calloc(count, sizeof(struct stat))) == NULL
+			|| (job->errs = calloc(count, sizeof(int))) == NULL) {
+		perror("calloc");
+		exit(99);
+	}
+	job->prefix = prefix;
+	job->count = count;
+	for(i = 0; i < count; i++) {
+		job->paths[i] = names[i % NNAMES];
+	}
+	return job;
+}
+
+static void free_job(struct job *job)
+{
+	free(job->paths);
+	free(job->bufs);
+	free(job->errs);
+	free(job);
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/llstat-bulk.XXXXXX", prefix[PATH_MAX];
+	double single_time = 0, bulk_time = 0, start;
+	struct job *small, *large, *other;
+	pthread_t thread;
+	size_t wrong, i;
+	int iterations = 3, copies = 2000, iter, failed = 0;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "copies", &copies, 4 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	make_tree(tmpdir);
+	snprintf(prefix, sizeof(prefix), "%s/", tmpdir);
+
+	printf("1..3\n");
+	printf("# %zu paths, %d iterations\n", copies * NNAMES, iterations);
+
+	small = new_job(prefix, NNAMES);
+	run_job(small);
+	wrong = compare(small);
+	ok(wrong == 0, "a short list gives the results of llstat");
+	failed |= wrong != 0;
+
+	large = new_job(prefix, copies * NNAMES);
+	wrong = 0;
+	for(iter = 0; iter < iterations; iter++) {
+		memset(large->errs, -1, large->count * sizeof(int));
+		start = now();
+		run_job(large);
+		bulk_time += now() - start;
+		wrong += compare(large);
+
+		start = now();
+		for(i = 0; i < large->count; i++) {
+			char path[PATH_MAX];
+			snprintf(path, sizeof(path), "%s%s", prefix, large->paths[i]);
+			llstat(path, large->bufs + i);
+		}
+		single_time += now() - start;
+	}
+	ok(wrong == 0, "a long list gives the results of llstat");
+	failed |= wrong != 0;
+
+	/* both calls share the thread pool or, while it is busy, run alone */
+	other = new_job(prefix, copies * NNAMES);
+	memset(large->errs, -1, large->count * sizeof(int));
+	if(pthread_create(&thread, NULL, run_job, other) != 0) {
+		perror("pthread_create");
+		return 99;
+	}
+	run_job(large);
+	pthread_join(thread, NULL);
+	wrong = compare(large) + compare(other);
+	ok(wrong == 0, "concurrent calls give the results of llstat");
+	failed |= wrong != 0;
+
+	printf("# llstat %8.1f ms  llstat_bulk %8.1f ms\n",
+			single_time / iterations * 1e3, bulk_time / iterations * 1e3);
+
+	free_job(small);
+	free_job(large);
+	free_job(other);
+	remove_tree(tmpdir);
+
+	return failed;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* log-flush - check that alpm_logaction_flush() writes out buffered log
+ * lines from a signal handler, whatever the interrupted code was doing.
+ *
+ * Usage: log-flush [--lines <n>]
+ *
+ * With BufferedLog, a flush while the log lock is held, as by the code a
+ * handler interrupted, has to write out the lines logged so far. Then <n>
+ * lines (default 200000) are logged while a timer signal flushes the
+ * buffer every 50 microseconds; each has to be in the log file, in order,
+ * though one may follow a second time. Output is TAP.
+ */
+
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "handle.h"
+
+#include "tap.h"
+
+static alpm_handle_t *handle;
+static volatile sig_atomic_t flushes;
+
+static void flush_handler(int signum)
+{
+	(void)signum;
+	alpm_logaction_flush(handle);
+	flushes++;
+}
+
+static off_t file_size(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+/* Whether lines 0 to count - 1 are in the file in order, allowing a run of
+ * them to come twice. Every line has to be whole. */
+static int check_lines(const char *path, int count, int *repeated)
+{
+	char line[256];
+	FILE *fp;
+	int next = 0, num;
+
+	*repeated = 0;
+	if((fp = fopen(path, "r")) == NULL) {
+		return 0;
+	}
+	while(fgets(line, sizeof(line), fp)) {
+		char *msg = strstr(line, "] [log-flush] line ");
+		if(msg == NULL || sscanf(msg, "] [log-flush] line %d\n", &num) != 1
+				|| line[strlen(line) - 1] != '\n') {
+			printf("# garbled line: %s", line);
+			break;
+		}
+		if(num == next) {
+			next++;
+		} else if(num < next) {
+			(*repeated)++;
+		} else {
+			printf("# line %d follows line %d\n", num, next - 1);
+			break;
+		}
+	}
+	fclose(fp);
+	return next == count;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/log-flush.XXXXXX", logfile[PATH_MAX];
+	struct sigaction sa = { .sa_handler = flush_handler };
+	struct itimerval timer = { { 0, 50 }, { 0, 50 } };
+	alpm_errno_t err;
+	int count = 200000, i, repeated, cond, failed = 0;
+	const struct tap_option options[] = {
+		{ "lines", &count, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	snprintf(logfile, sizeof(logfile), "%s/dulge.log", tmpdir);
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+	alpm_option_set_logfile(handle, logfile);
+	alpm_option_set_bufferedlog(handle, 1);
+
+	printf("1..3\n");
+
+	for(i = 0; i < 3; i++) {
+		alpm_logaction(handle, "log-flush", "line %d\n", i);
+	}
+	cond = file_size(logfile) == 0;
+	ok(cond, "lines are held back in the buffer");
+	failed |= !cond;
+
+	/* what a handler finds if it interrupted a thread logging */
+	pthread_mutex_lock(&handle->loglock);
+	alpm_logaction_flush(handle);
+	pthread_mutex_unlock(&handle->loglock);
+	cond = check_lines(logfile, 3, &repeated) && repeated == 0;
+	ok(cond, "a flush while the log is locked writes the lines out");
+	failed |= !cond;
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+	setitimer(ITIMER_REAL, &timer, NULL);
+	for(i = 3; i < count; i++) {
+		alpm_logaction(handle, "log-flush", "line %d\n", i);
+	}
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_REAL, &timer, NULL);
+	alpm_release(handle);
+
+	cond = check_lines(logfile, count, &repeated);
+	ok(cond, "every line is written out with flushes from a signal handler");
+	failed |= !cond;
+	printf("# %d lines, %d flushes from the handler, %d lines repeated\n",
+			count, (int)flushes, repeated);
+
+	unlink(logfile);
+	rmdir(tmpdir);
+
+	return failed;
+}
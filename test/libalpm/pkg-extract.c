@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* pkg-extract - check and time extracting a package with the decompression
+ * read ahead in another thread, against reading it in the extracting one.
+ *
+ * Usage: pkg-extract [--iterations <n>] [--files <n>] [<package>]
+ *
+ * Without a package, one of <n> files (default 4000) of a few bytes up to
+ * 256 KiB is generated, compressed with zstd if libarchive can. Each
+ * iteration extracts it into a fresh directory both ways and compares the
+ * extracted files. Output is TAP.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "alpm.h"
+#include "readahead.h"
+
+#include "tap.h"
+
+static void add_entry(struct archive *a, const char *name, mode_t type,
+		const char *data, size_t len)
+{
+	struct archive_entry *ae = archive_entry_new();
+
+	archive_entry_set_pathname(ae, name);
+	archive_entry_set_filetype(ae, type);
+	archive_entry_set_perm(ae, type == AE_IFDIR ? 0755 : 0644);
+	archive_entry_set_size(ae, len);
+	if(archive_write_header(a, ae) != ARCHIVE_OK
+			|| (len && archive_write_data(a, data, len) != (la_ssize_t)len)) {
+		fprintf(stderr, "could not write %s: %s\n", name, archive_error_string(a));
+		exit(99);
+	}
+	archive_entry_free(ae);
+}
+
+static void make_pkg(const char *path, int nfiles)
+{
+	struct archive *a = archive_write_new();
+	size_t maxlen = 256 * 1024, i;
+	char name[64], *data;
+	int n;
+
+	if((data = malloc(maxlen)) == NULL) {
+		perror("malloc");
+		exit(99);
+	}
+	/* compresses about as well as binaries do */
+	for(i = 0; i < maxlen; i++) {
+		data[i] = "\x7f" "ELF\0\0\0\0abcdefgh"[(i * 7 + i / 4096) % 16] ^ (i >> 11);
+	}
+
+	archive_write_set_format_pax_restricted(a);
+	if(archive_write_add_filter_zstd(a) != ARCHIVE_OK) {
+		archive_write_add_filter_gzip(a);
+	}
+	if(archive_write_open_filename(a, path) != ARCHIVE_OK) {
+		fprintf(stderr, "could not create %s: %s\n", path, archive_error_string(a));
+		exit(99);
+	}
+	add_entry(a, ".PKGINFO", AE_IFREG, "pkgname = pkg\npkgver = 1.0-1\n", 29);
+	add_entry(a, "usr/", AE_IFDIR, NULL, 0);
+	add_entry(a, "usr/lib/", AE_IFDIR, NULL, 0);
+	for(n = 0; n < nfiles; n++) {
+		/* mostly small files, every sixteenth a large one */
+		size_t len = n % 16 == 0 ? maxlen - 64 - n % 1000 : (n * 2654435761u) % 8192;
+		snprintf(name, sizeof(name), "usr/lib/file%05d", n);
+		add_entry(a, name, AE_IFREG, data + n % 64, len);
+	}
+	archive_write_close(a);
+	archive_write_free(a);
+	free(data);
+}
+
+static struct archive *open_pkg(const char *path)
+{
+	struct archive *a = archive_read_new();
+
+	archive_read_support_filter_all(a);
+	archive_read_support_format_all(a);
+	if(archive_read_open_filename(a, path, 128 * 1024) != ARCHIVE_OK) {
+		fprintf(stderr, "could not open %s: %s\n", path, archive_error_string(a));
+		exit(99);
+	}
+	return a;
+}
+
+static struct archive *new_writer(void)
+{
+	struct archive *w = archive_write_disk_new();
+	archive_write_disk_set_options(w, ARCHIVE_EXTRACT_PERM | ARCHIVE_EXTRACT_TIME
+			| ARCHIVE_EXTRACT_UNLINK);
+	return w;
+}
+
+/* extract into the current directory, reading in this thread */
+static int extract_plain(const char *pkg)
+{
+	struct archive *a = open_pkg(pkg), *w = new_writer();
+	struct archive_entry *entry;
+	int ret, errors = 0;
+
+	while((ret = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+		errors += archive_read_extract2(a, entry, w) != ARCHIVE_OK;
+	}
+	errors += ret != ARCHIVE_EOF;
+	archive_write_free(w);
+	archive_read_free(a);
+	return errors;
+}
+
+/* extract into the current directory, reading ahead in another thread */
+static int extract_readahead(alpm_handle_t *handle, const char *pkg, int *entries)
+{
+	struct archive *a = open_pkg(pkg), *w = new_writer();
+	struct archive_entry *entry;
+	alpm_readahead_t *ra;
+	int64_t pos;
+	int ret, errors = 0;
+
+	if((ra = _alpm_readahead_new(handle, a, 1)) == NULL) {
+		return 1;
+	}
+	*entries = 0;
+	while((ret = _alpm_readahead_next_header(ra, &entry, &pos)) == ARCHIVE_OK) {
+		errors += _alpm_readahead_extract(ra, entry, w) != ARCHIVE_OK;
+		(*entries)++;
+	}
+	errors += ret != ARCHIVE_EOF;
+	_alpm_readahead_free(ra);
+	archive_write_free(w);
+	archive_read_free(a);
+	return errors;
+}
+
+/* a checksum of every file of a directory extracted from the package */
+static uint64_t tree_sum(const char *dir, int nfiles)
+{
+	char path[4096], buf[65536];
+	uint64_t sum = 0;
+	int n;
+
+	for(n = -1; n < nfiles; n++) {
+		ssize_t len, i;
+		int fd;
+
+		if(n < 0) {
+			snprintf(path, sizeof(path), "%s/.PKGINFO", dir);
+		} else {
+			snprintf(path, sizeof(path), "%s/usr/lib/file%05d", dir, n);
+		}
+		if((fd = open(path, O_RDONLY)) < 0) {
+			return 0;
+		}
+		while((len = read(fd, buf, sizeof(buf))) > 0) {
+			for(i = 0; i < len; i++) {
+				sum = sum * 1099511628211u + (unsigned char)buf[i];
+			}
+		}
+		close(fd);
+		sum = sum * 31 + n;
+	}
+	return sum;
+}
+
+static void remove_tree(const char *dir, int nfiles)
+{
+	char path[4096];
+	int n;
+
+	for(n = 0; n < nfiles; n++) {
+		snprintf(path, sizeof(path), "%s/usr/lib/file%05d", dir, n);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/.PKGINFO", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/usr/lib", dir);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/usr", dir);
+	rmdir(path);
+	rmdir(dir);
+}
+
+/* a copy of the package cut in the middle of its data */
+static void truncate_copy(const char *pkg, const char *copy)
+{
+	struct stat st;
+	char buf[65536];
+	ssize_t len;
+	off_t left;
+	int in, out;
+
+	if((in = open(pkg, O_RDONLY)) < 0 || fstat(in, &st) != 0
+			|| (out = open(copy, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror(copy);
+		exit(99);
+	}
+	left = st.st_size / 2;
+	while(left > 0 && (len = read(in, buf, left < (off_t)sizeof(buf) ? (size_t)left : sizeof(buf))) > 0) {
+		if(write(out, buf, len) != len) {
+			perror(copy);
+			exit(99);
+		}
+		left -= len;
+	}
+	close(in);
+	close(out);
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/pkg-extract.XXXXXX", pkgfile[256], broken[256];
+	char plaindir[256], radir[256];
+	double plain_time = 0, ra_time = 0, start;
+	const char *pkg = NULL;
+	alpm_handle_t *handle;
+	alpm_errno_t err;
+	uint64_t plain_sum = 0, ra_sum = 0;
+	int iterations = 3, nfiles = 4000, iter, entries = 0, cwdfd;
+	int errors = 0, same = 1, failed;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "files", &nfiles, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+	if(argc > 1) {
+		pkg = argv[1];
+	}
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	if(pkg == NULL) {
+		snprintf(pkgfile, sizeof(pkgfile), "%s/pkg-1.0-1-x86_64.pkg.tar", tmpdir);
+		make_pkg(pkgfile, nfiles);
+		pkg = pkgfile;
+	}
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+	if((cwdfd = open(".", O_RDONLY)) < 0) {
+		perror("open");
+		return 99;
+	}
+
+	printf("1..3\n");
+	printf("# %s, %d iterations\n", pkg, iterations);
+
+	snprintf(plaindir, sizeof(plaindir), "%s/plain", tmpdir);
+	snprintf(radir, sizeof(radir), "%s/readahead", tmpdir);
+	for(iter = 0; iter < iterations; iter++) {
+		mkdir(plaindir, 0755);
+		mkdir(radir, 0755);
+
+		start = now();
+		if(chdir(plaindir) != 0) {
+			perror(plaindir);
+			return 99;
+		}
+		errors += extract_plain(pkg);
+		plain_time += now() - start;
+
+		start = now();
+		if(chdir(radir) != 0) {
+			perror(radir);
+			return 99;
+		}
+		errors += extract_readahead(handle, pkg, &entries);
+		ra_time += now() - start;
+
+		if(fchdir(cwdfd) != 0) {
+			perror("fchdir");
+			return 99;
+		}
+		/* only the generated package has known contents */
+		if(pkg == pkgfile) {
+			plain_sum = tree_sum(plaindir, nfiles);
+			ra_sum = tree_sum(radir, nfiles);
+			same &= plain_sum != 0 && plain_sum == ra_sum;
+			remove_tree(plaindir, nfiles);
+			remove_tree(radir, nfiles);
+		}
+	}
+
+	ok(errors == 0 && entries > 0, "every entry is read ahead and extracted");
+	ok(same, "the extracted files match those read in the same thread");
+	failed = errors != 0 || entries == 0 || !same;
+
+	/* a broken archive has to end the extraction with an error, not hang it */
+	snprintf(broken, sizeof(broken), "%s/broken.pkg.tar", tmpdir);
+	truncate_copy(pkg, broken);
+	mkdir(radir, 0755);
+	if(chdir(radir) != 0) {
+		perror(radir);
+		return 99;
+	}
+	iter = extract_readahead(handle, broken, &entries);
+	if(fchdir(cwdfd) != 0) {
+		perror("fchdir");
+		return 99;
+	}
+	ok(iter != 0, "a truncated package is reported");
+	failed |= iter == 0;
+	remove_tree(radir, nfiles);
+
+	printf("# plain %8.1f ms  read ahead %8.1f ms\n",
+			plain_time / iterations * 1e3, ra_time / iterations * 1e3);
+
+	alpm_release(handle);
+	close(cwdfd);
+	unlink(broken);
+	if(pkg == pkgfile) {
+		unlink(pkgfile);
+	}
+	rmdir(tmpdir);
+
+	return failed;
+}
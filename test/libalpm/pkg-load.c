@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* pkg-load - check and time loading the metadata of package files, with and
+ * without the package metadata cache.
+ *
+ * Usage: pkg-load [--iterations <n>] [--packages <n>] [<directory>]
+ *
+ * Every *.pkg.tar* file of <directory> is loaded with alpm_pkg_load() and
+ * full set to 0, as 'dulge -Sc' does. Without a directory, <n> packages
+ * (default 1000) are generated, each with a large first file so that
+ * reading into the payload shows. The first pass with the cache enabled
+ * fills it, the following ones are served from it. Output is TAP.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "alpm.h"
+
+#include "tap.h"
+
+static void add_entry(struct archive *a, const char *name, const char *data, size_t len)
+{
+	struct archive_entry *ae = archive_entry_new();
+
+	archive_entry_set_pathname(ae, name);
+	archive_entry_set_filetype(ae, AE_IFREG);
+	archive_entry_set_perm(ae, 0644);
+	archive_entry_set_size(ae, len);
+	if(archive_write_header(a, ae) != ARCHIVE_OK
+			|| archive_write_data(a, data, len) != (la_ssize_t)len) {
+		fprintf(stderr, "could not write %s: %s\n", name, archive_error_string(a));
+		exit(99);
+	}
+	archive_entry_free(ae);
+}
+
+static void make_pkg(const char *dir, int num, const char *payload, size_t payloadlen)
+{
+	char path[4096], pkginfo[1024];
+	struct archive *a = archive_write_new();
+	int len;
+
+	snprintf(path, sizeof(path), "%s/pkg%d-1.0-1-x86_64.pkg.tar.gz", dir, num);
+	archive_write_set_format_pax_restricted(a);
+	archive_write_add_filter_gzip(a);
+	if(archive_write_open_filename(a, path) != ARCHIVE_OK) {
+		fprintf(stderr, "could not create %s: %s\n", path, archive_error_string(a));
+		exit(99);
+	}
+	len = snprintf(pkginfo, sizeof(pkginfo),
+			"# Generated by pkg-load\n"
+			"pkgname = pkg%d\npkgbase = pkg%d\npkgver = 1.0-1\n"
+			"pkgdesc = A generated package number %d\n"
+			"url = https://example.org/pkg%d\nbuilddate = 1700000000\n"
+			"packager = Some Packager <packager@example.org>\n"
+			"size = %zu\narch = x86_64\nlicense = GPL-2.0-or-later\n"
+			"depend = glibc\ndepend = pkg%d\noptdepend = pkg%d: for a feature\n"
+			"provides = libpkg%d.so=1-64\n",
+			num, num, num, num, payloadlen, num + 1, num + 2, num);
+	add_entry(a, ".PKGINFO", pkginfo, len);
+	add_entry(a, ".INSTALL", "post_install() {\n\t:\n}\n", 22);
+	add_entry(a, "usr/lib/libpkg.so.1", payload, payloadlen);
+	add_entry(a, "usr/share/doc/pkg/README", "README\n", 7);
+	archive_write_close(a);
+	archive_write_free(a);
+}
+
+static int is_pkgfile(const char *name)
+{
+	return strstr(name, ".pkg.tar") != NULL && strstr(name, ".sig") == NULL
+		&& strstr(name, ".part") == NULL;
+}
+
+static char **list_pkgfiles(const char *dir, int *count)
+{
+	char **files = NULL;
+	struct dirent *ent;
+	DIR *d;
+	int size = 0;
+
+	*count = 0;
+	if((d = opendir(dir)) == NULL) {
+		perror(dir);
+		exit(99);
+	}
+	while((ent = readdir(d)) != NULL) {
+		if(!is_pkgfile(ent->d_name)) {
+			continue;
+		}
+		if(*count == size) {
+			size = size ? size * 2 : 256;
+			if((files = realloc(files, size * sizeof(char *))) == NULL) {
+				perror("realloc");
+				exit(99);
+			}
+		}
+		if(asprintf(&files[(*count)++], "%s/%s", dir, ent->d_name) == -1) {
+			perror("asprintf");
+			exit(99);
+		}
+	}
+	closedir(d);
+	return files;
+}
+
+/* load every file once, comparing with the names and versions of the
+ * reference pass if there is one */
+static double load_all(alpm_handle_t *handle, char **files, int count,
+		char **names, int *same, int *scriptlets)
+{
+	double start = now();
+	int i;
+
+	*scriptlets = 0;
+	for(i = 0; i < count; i++) {
+		alpm_pkg_t *pkg;
+		char *name;
+
+		if(alpm_pkg_load(handle, files[i], 0, 0, &pkg) != 0) {
+			*same = 0;
+			continue;
+		}
+		*scriptlets += alpm_pkg_has_scriptlet(pkg);
+		if(asprintf(&name, "%s-%s %s %lld", alpm_pkg_get_name(pkg),
+					alpm_pkg_get_version(pkg), alpm_pkg_get_desc(pkg),
+					(long long)alpm_pkg_get_isize(pkg)) == -1) {
+			perror("asprintf");
+			exit(99);
+		}
+		if(names[i] == NULL) {
+			names[i] = name;
+		} else {
+			*same &= strcmp(names[i], name) == 0;
+			free(name);
+		}
+		alpm_pkg_free(pkg);
+	}
+	return now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/pkg-load.XXXXXX", cachefile[64];
+	double plain_time = 0, fill_time, cached_time = 0;
+	const char *dir = NULL;
+	alpm_handle_t *handle;
+	alpm_errno_t err;
+	char **files, **names;
+	int iterations = 3, npkgs = 1000, count, iter, i;
+	int same = 1, scriptlets, plain_scriptlets, failed;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "packages", &npkgs, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+	if(argc > 1) {
+		dir = argv[1];
+	}
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	if(dir == NULL) {
+		/* a shared object compresses about as well as this */
+		size_t payloadlen = 1024 * 1024;
+		char *payload = malloc(payloadlen);
+		if(payload == NULL) {
+			perror("malloc");
+			return 99;
+		}
+		for(i = 0; i < (int)payloadlen; i++) {
+			payload[i] = "\x7f" "ELF\0\0\0\0abcdefgh"[(i * 7 + i / 4096) % 16] ^ (i >> 13);
+		}
+		for(i = 0; i < npkgs; i++) {
+			make_pkg(tmpdir, i, payload, payloadlen);
+		}
+		free(payload);
+		dir = tmpdir;
+	}
+	files = list_pkgfiles(dir, &count);
+	if((names = calloc(count + 1, sizeof(char *))) == NULL) {
+		perror("calloc");
+		return 99;
+	}
+
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+
+	printf("1..3\n");
+	printf("# %d packages in %s, %d iterations\n", count, dir, iterations);
+
+	for(iter = 0; iter < iterations; iter++) {
+		plain_time += load_all(handle, files, count, names, &same, &plain_scriptlets);
+	}
+
+	alpm_option_set_metacache(handle, 1);
+	fill_time = load_all(handle, files, count, names, &same, &scriptlets);
+	for(iter = 0; iter < iterations; iter++) {
+		cached_time += load_all(handle, files, count, names, &same, &scriptlets);
+	}
+	alpm_release(handle);
+
+	/* the cache is written back on release and read again by a new handle */
+	snprintf(cachefile, sizeof(cachefile), "%s/metacache", tmpdir);
+	ok(access(cachefile, F_OK) == 0, "the cache is written when the handle is released");
+	failed = access(cachefile, F_OK) != 0;
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+	alpm_option_set_metacache(handle, 1);
+	load_all(handle, files, count, names, &same, &scriptlets);
+	alpm_release(handle);
+
+	ok(same && count > 0, "cached metadata matches the packages");
+	ok(scriptlets == plain_scriptlets, "install scripts are remembered");
+	failed |= !same || count == 0 || scriptlets != plain_scriptlets;
+
+	printf("# plain %8.1f ms  filling the cache %8.1f ms  cached %8.1f ms\n",
+			plain_time / iterations * 1e3, fill_time * 1e3,
+			cached_time / iterations * 1e3);
+
+	for(i = 0; i < count; i++) {
+		if(dir == tmpdir) {
+			unlink(files[i]);
+		}
+		free(files[i]);
+		free(names[i]);
+	}
+	free(files);
+	free(names);
+	unlink(cachefile);
+	rmdir(tmpdir);
+
+	return failed;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* progress-limit - check which progress updates reach the front end and
+ * time the filter on a stream of updates.
+ *
+ * Usage: progress-limit [--updates <n>]
+ *
+ * Updates go through PROGRESS() to a callback counting them: the first
+ * update of a bar, a changed percentage and a new package or phase always
+ * get through, a repeated percentage only once the progress interval has
+ * passed, or never with an interval of 0. Then <n> updates (default
+ * 10000000) spread over 0 to 100 percent are sent like a large extraction
+ * would. Output is TAP.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "handle.h"
+
+#include "tap.h"
+
+static int delivered;
+
+static void count_progress(void *ctx, alpm_progress_t event, const char *pkg,
+		int percent, size_t howmany, size_t current)
+{
+	(void)ctx;
+	(void)event;
+	(void)pkg;
+	(void)percent;
+	(void)howmany;
+	(void)current;
+	delivered++;
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+	nanosleep(&ts, NULL);
+}
+
+/* the number of the updates delivered */
+static int send(alpm_handle_t *handle, alpm_progress_t event, const char *pkg,
+		int percent, size_t current)
+{
+	delivered = 0;
+	PROGRESS(handle, event, pkg, percent, 2, current);
+	return delivered;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/progress-limit.XXXXXX";
+	const char *pkg1 = "pkg1", *pkg2 = "pkg2";
+	alpm_handle_t *handle;
+	alpm_errno_t err;
+	long i;
+	double start, elapsed;
+	int updates = 10000000, failed = 0, cond, total;
+	const struct tap_option options[] = {
+		{ "updates", &updates, 100 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+	alpm_option_set_progresscb(handle, count_progress, NULL);
+
+	printf("1..6\n");
+
+	cond = alpm_option_get_progress_interval(handle) == 100
+		&& send(handle, ALPM_PROGRESS_ADD_START, pkg1, 0, 1) == 1
+		&& send(handle, ALPM_PROGRESS_ADD_START, pkg1, 0, 1) == 0
+		&& send(handle, ALPM_PROGRESS_ADD_START, pkg1, 1, 1) == 1;
+	ok(cond, "the first update and a new percentage get through, a repeat does not");
+	failed |= !cond;
+
+	cond = send(handle, ALPM_PROGRESS_ADD_START, pkg2, 1, 2) == 1
+		&& send(handle, ALPM_PROGRESS_CONFLICTS_START, pkg2, 1, 2) == 1;
+	ok(cond, "a new package or phase starts a new bar");
+	failed |= !cond;
+
+	alpm_option_set_progress_interval(handle, 20);
+	send(handle, ALPM_PROGRESS_ADD_START, pkg1, 50, 1);
+	sleep_ms(60);
+	cond = send(handle, ALPM_PROGRESS_ADD_START, pkg1, 50, 1) == 1
+		&& send(handle, ALPM_PROGRESS_ADD_START, pkg1, 50, 1) == 0;
+	ok(cond, "a repeated percentage gets through once the interval passed");
+	failed |= !cond;
+
+	alpm_option_set_progress_interval(handle, 0);
+	send(handle, ALPM_PROGRESS_ADD_START, pkg1, 60, 1);
+	sleep_ms(60);
+	cond = send(handle, ALPM_PROGRESS_ADD_START, pkg1, 60, 1) == 0
+		&& send(handle, ALPM_PROGRESS_ADD_START, pkg1, 61, 1) == 1;
+	ok(cond, "with an interval of 0 only a new percentage gets through");
+	failed |= !cond;
+
+	cond = alpm_option_set_progress_interval(handle, 250) == 0
+		&& alpm_option_get_progress_interval(handle) == 250;
+	ok(cond, "the interval can be read back");
+	failed |= !cond;
+
+	/* a stream too fast for the interval to matter: one bar per percent */
+	alpm_option_set_progress_interval(handle, 100000);
+	total = 0;
+	start = now();
+	for(i = 0; i < updates; i++) {
+		delivered = 0;
+		PROGRESS(handle, ALPM_PROGRESS_ADD_START, pkg2, (int)(i * 100 / updates), 1, 1);
+		total += delivered;
+	}
+	elapsed = now() - start;
+	ok(total == 100, "a stream of updates reaches the front end once per percent");
+	failed |= total != 100;
+
+	printf("# %d updates, %d delivered, %.1f ns per update\n",
+			updates, total, elapsed / updates * 1e9);
+
+	alpm_release(handle);
+	rmdir(tmpdir);
+
+	return failed;
+}
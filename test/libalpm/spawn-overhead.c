@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* spawn-overhead - check and time starting a command through
+ * _alpm_run_chroot with every spawn method available.
+ *
+ * Usage: spawn-overhead [--iterations <n>] [--heap <MiB>] [<dbpath>]
+ *
+ * To stand in for a front end with full file databases loaded, <MiB> of
+ * memory is allocated and touched first (default 256). With a <dbpath>, the
+ * local database there is loaded as well, including every file list.
+ * Output is TAP.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "util.h"
+
+#include "tap.h"
+
+static const char *methods[] = { "fork", "vfork" };
+
+static size_t load_pkgcache(alpm_handle_t *handle)
+{
+	alpm_list_t *i;
+	size_t files = 0;
+
+	for(i = alpm_db_get_pkgcache(alpm_get_localdb(handle)); i; i = i->next) {
+		files += alpm_pkg_get_files(i->data)->count;
+	}
+	return files;
+}
+
+int main(int argc, char *argv[])
+{
+	char truearg[] = "true", falsearg[] = "false";
+	char *truecmd[] = { truearg, NULL }, *falsecmd[] = { falsearg, NULL };
+	char tmpdir[] = "/tmp/spawn-overhead.XXXXXX";
+	const char *dbpath = NULL;
+	alpm_handle_t *handle;
+	alpm_errno_t err;
+	size_t heapsize, i;
+	char *heap;
+	int iterations = 20, heap_mib = 256, failed = 0;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "heap", &heap_mib, 0 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+	if(argc == 2) {
+		dbpath = argv[1];
+	} else if((dbpath = mkdtemp(tmpdir)) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+
+	if((handle = alpm_initialize("/", dbpath, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+
+	heapsize = (size_t)heap_mib << 20;
+	if((heap = malloc(heapsize ? heapsize : 1)) == NULL) {
+		perror("malloc");
+		return 99;
+	}
+	memset(heap, 1, heapsize);
+
+	printf("1..%d\n", (int)(2 * sizeof(methods) / sizeof(methods[0])));
+	printf("# %zu MiB heap, %zu files in the local database, %d iterations\n",
+			heapsize >> 20, load_pkgcache(handle), iterations);
+
+	for(i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		double start, elapsed;
+		int iter, ret = 0;
+
+		if(_alpm_chroot_set_spawn(methods[i]) != 0) {
+			skip("%s not supported", methods[i]);
+			skip("%s not supported", methods[i]);
+			continue;
+		}
+
+		start = now();
+		for(iter = 0; iter < iterations; iter++) {
+			ret |= _alpm_run_chroot(handle, "/bin/true", truecmd, NULL, NULL);
+		}
+		elapsed = (now() - start) / iterations;
+		ok(ret == 0, "%s runs a command", methods[i]);
+		failed |= ret != 0;
+
+		ret = _alpm_run_chroot(handle, "/bin/false", falsecmd, NULL, NULL);
+		ok(ret == 1, "%s reports a failing command", methods[i]);
+		failed |= ret != 1;
+
+		printf("# %-5s %8.1f us per command\n", methods[i], elapsed * 1e6);
+	}
+
+	free(heap);
+	alpm_release(handle);
+	if(dbpath == tmpdir) {
+		rmdir(tmpdir);
+	}
+
+	return failed;
+}
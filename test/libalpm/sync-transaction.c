@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* sync-transaction - time the preparation of a large system upgrade against
+ * in-memory databases.
+ *
+ * Usage: sync-transaction [--iterations <n>] [--packages <n>]
+ *
+ * A local database of <n> packages (default 2000) is generated with a sync
+ * database holding a newer version of each of them. Every package depends
+ * on a few others and some pull in packages that are not installed yet.
+ * Each iteration upgrades the whole system: the targets are selected,
+ * dependencies resolved, conflicts checked and the targets sorted, without
+ * touching the disk. Output is TAP.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alpm.h"
+#include "db.h"
+#include "deps.h"
+#include "handle.h"
+#include "package.h"
+#include "pkghash.h"
+#include "trans.h"
+#include "util.h"
+
+#include "tap.h"
+
+__attribute__((format(printf, 2, 3)))
+static void add_dep(alpm_list_t **list, const char *fmt, ...)
+{
+	char dep[64];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(dep, sizeof(dep), fmt, args);
+	va_end(args);
+	*list = alpm_list_add(*list, alpm_dep_from_string(dep));
+}
+
+static alpm_pkg_t *make_pkg(alpm_db_t *db, const char *prefix, int num,
+		const char *version)
+{
+	char name[64], filename[128];
+	alpm_pkg_t *pkg = _alpm_pkg_new();
+
+	snprintf(name, sizeof(name), "%s-%04d", prefix, num);
+	snprintf(filename, sizeof(filename), "%s-%s-x86_64.pkg.tar.zst", name, version);
+	pkg->name = strdup(name);
+	pkg->name_hash = _alpm_hash_sdbm(name);
+	pkg->version = strdup(version);
+	pkg->filename = strdup(filename);
+	pkg->arch = strdup("x86_64");
+	pkg->size = pkg->isize = 1 << 20;
+	pkg->handle = db->handle;
+	pkg->ops = &default_pkg_ops;
+	pkg->origin = db == db->handle->db_local ? ALPM_PKG_FROM_LOCALDB : ALPM_PKG_FROM_SYNCDB;
+	pkg->origin_data.db = db;
+	pkg->infolevel = INFRQ_ALL;
+	pkg->reason = ALPM_PKG_REASON_EXPLICIT;
+
+	if(strcmp(prefix, "pkg") != 0) {
+		return pkg;
+	}
+
+	/* a shallow tree of library dependencies */
+	if(num > 0) {
+		add_dep(&pkg->depends, "pkg-%04d", num / 2);
+	}
+	if(num > 2) {
+		add_dep(&pkg->depends, "pkg-%04d>=1.0", num / 3);
+	}
+	if(num > 7) {
+		add_dep(&pkg->depends, "pkg-%04d", num - 7);
+	}
+	if(num % 10 == 0) {
+		add_dep(&pkg->provides, "lib%d.so=1", num);
+	} else if(num > 10) {
+		add_dep(&pkg->depends, "lib%d.so", num / 10 * 10);
+	}
+	if(num % 50 == 0) {
+		add_dep(&pkg->conflicts, "old-%04d", num);
+	}
+	/* the new version pulls in packages that are not installed yet */
+	if(db != db->handle->db_local && num % 20 == 0) {
+		add_dep(&pkg->depends, "new-%04d", num);
+	}
+	return pkg;
+}
+
+static void fill_db(alpm_db_t *db, const char *version, int npkgs)
+{
+	int i;
+
+	db->pkgcache = _alpm_pkghash_create(npkgs * 2);
+	for(i = 0; i < npkgs; i++) {
+		_alpm_pkghash_add_sorted(&db->pkgcache, make_pkg(db, "pkg", i, version));
+		if(db != db->handle->db_local && i % 20 == 0) {
+			_alpm_pkghash_add_sorted(&db->pkgcache, make_pkg(db, "new", i, version));
+		}
+	}
+	db->status &= ~(DB_STATUS_INVALID | DB_STATUS_MISSING);
+	db->status |= DB_STATUS_VALID | DB_STATUS_EXISTS | DB_STATUS_PKGCACHE;
+}
+
+/* every target must come after the targets it depends on */
+static int check_order(alpm_list_t *targets)
+{
+	alpm_list_t *i, *j, *k;
+
+	for(i = targets; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		for(k = pkg->depends; k; k = k->next) {
+			for(j = i->next; j; j = j->next) {
+				if(_alpm_depcmp(j->data, k->data)) {
+					return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[] = "/tmp/sync-transaction.XXXXXX";
+	double upgrade_time = 0, prepare_time = 0;
+	alpm_handle_t *handle;
+	alpm_db_t *syncdb;
+	alpm_errno_t err;
+	size_t selected = 0, prepared = 0;
+	int iterations = 5, npkgs = 2000, iter, failed = 0, ordered = 1, ret = 0;
+	const struct tap_option options[] = {
+		{ "iterations", &iterations, 1 },
+		{ "packages", &npkgs, 1 },
+		{ NULL, NULL, 0 }
+	};
+
+	tap_options(&argc, &argv, options);
+
+	if(mkdtemp(tmpdir) == NULL) {
+		perror("mkdtemp");
+		return 99;
+	}
+	if((handle = alpm_initialize("/", tmpdir, &err)) == NULL) {
+		fprintf(stderr, "could not initialize alpm: %s\n", alpm_strerror(err));
+		return 99;
+	}
+	syncdb = alpm_register_syncdb(handle, "sim", ALPM_SIG_USE_DEFAULT);
+	fill_db(handle->db_local, "1.0-1", npkgs);
+	fill_db(syncdb, "1.1-1", npkgs);
+
+	printf("1..3\n");
+	printf("# %d installed packages, %d iterations\n", npkgs, iterations);
+
+	for(iter = 0; iter < iterations; iter++) {
+		alpm_list_t *data = NULL;
+		double start;
+
+		ret |= alpm_trans_init(handle, ALPM_TRANS_FLAG_NOLOCK);
+
+		start = now();
+		ret |= alpm_sync_sysupgrade(handle, 0);
+		upgrade_time += now() - start;
+		selected = alpm_list_count(alpm_trans_get_add(handle));
+
+		start = now();
+		ret |= alpm_trans_prepare(handle, &data);
+		prepare_time += now() - start;
+		prepared = alpm_list_count(alpm_trans_get_add(handle));
+		ordered &= check_order(alpm_trans_get_add(handle));
+
+		alpm_list_free(data);
+		alpm_trans_release(handle);
+	}
+
+	ok(selected == (size_t)npkgs, "sysupgrade selects every installed package");
+	ok(ret == 0 && prepared == (size_t)(npkgs + (npkgs + 19) / 20),
+			"prepare pulls in the new dependencies");
+	ok(ordered, "targets are sorted by dependencies");
+	failed = ret != 0 || selected != (size_t)npkgs || !ordered;
+
+	printf("# sysupgrade %8.1f ms  prepare %8.1f ms\n",
+			upgrade_time / iterations * 1e3, prepare_time / iterations * 1e3);
+
+	alpm_release(handle);
+	rmdir(tmpdir);
+
+	return failed;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tap.h"
+
+static int testnum;
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void ok(int cond, const char *fmt, ...)
+{
+	va_list args;
+
+	printf("%s %d - ", cond ? "ok" : "not ok", ++testnum);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	putchar('\n');
+}
+
+void skip(const char *fmt, ...)
+{
+	va_list args;
+
+	printf("ok %d # SKIP ", ++testnum);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	putchar('\n');
+}
+
+void tap_options(int *argc, char ***argv, const struct tap_option *options)
+{
+	while(*argc > 2 && strncmp((*argv)[1], "--", 2) == 0) {
+		const struct tap_option *opt;
+
+		for(opt = options; opt->name; opt++) {
+			if(strcmp((*argv)[1] + 2, opt->name) == 0) {
+				*opt->value = atoi((*argv)[2]);
+				if(*opt->value < opt->min) {
+					*opt->value = opt->min;
+				}
+				break;
+			}
+		}
+		*argc -= 2;
+		*argv += 2;
+	}
+}
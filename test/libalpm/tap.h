@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+*/
+
+/* tap.h - what the programs in test/libalpm share: TAP output, a clock to
+ * time them with and their "--<name> <n>" options.
+ */
+
+#ifndef TEST_LIBALPM_TAP_H
+#define TEST_LIBALPM_TAP_H
+
+/* An option "--<name> <n>" of a test program, read into value and raised
+ * to min if it is below that. */
+struct tap_option {
+	const char *name;
+	int *value;
+	int min;
+};
+
+/* seconds on the monotonic clock */
+double now(void);
+
+/* report the next test as passed if cond is set */
+void ok(int cond, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* report the next test as skipped */
+void skip(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Read the options in front of the other arguments, skipping those not in
+ * options, which ends with an empty entry. *argc and *argv are moved past
+ * them, so (*argv)[1] is the first argument left. */
+void tap_options(int *argc, char ***argv, const struct tap_option *options);
+
+#endif /* TEST_LIBALPM_TAP_H */
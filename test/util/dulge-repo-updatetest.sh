@@ -0,0 +1,156 @@
+#!/bin/bash
+# Copyright (C) 2026 Arch Linux team and TigerClips1 <TigerClips1@ps4jaguarlinux.com>
+#
+# repo-updatetest - check databases written by dulge-repo-update against
+# dulge-repo-add and read them back with libalpm
+#
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+source "$(dirname "$0")"/../tap.sh || exit 1
+
+# binaries and script to use, defaults from the build directory
+bin=${1:-${PMTEST_UTIL_DIR}dulge-repo-update}
+repoadd=${2:-${PMTEST_SCRIPT_DIR}dulge-repo-add}
+dulge=${3:-${PMTEST_UTIL_DIR}dulge}
+export MAKEPKG_LIBRARY=${MAKEPKG_LIBRARY:-${PMTEST_LIBMAKEPKG_DIR%/}}
+
+for prog in "$bin" "$repoadd" "$dulge"; do
+	if ! type -p "$prog" &>/dev/null; then
+		tap_bail "$prog could not be located"
+		exit 1
+	fi
+done
+
+tmpdir=$(mktemp -d "${TMPDIR:-/tmp}/repo-updatetest.XXXXXX") || exit 1
+trap 'rm -rf "$tmpdir"' EXIT
+
+# dulge-repo-add picks what to do from the name it is called by and runs
+# dulge-vercmp from the build directory
+mkdir "$tmpdir/bin"
+export PATH="$(dirname "$(type -p "$bin")"):$PATH"
+ln -s "$(type -p "$repoadd")" "$tmpdir/bin/dulge-dulge-dulge-repo-add"
+ln -s "$(type -p "$repoadd")" "$tmpdir/bin/dulge-dulge-dulge-repo-remove"
+
+# args:
+# mkpkg name version [depend...]
+mkpkg() {
+	local name=$1 ver=$2 dir=$tmpdir/build/$1-$2 dep
+	shift 2
+	mkdir -p "$dir/usr/share/$name"
+	echo "$name $ver" > "$dir/usr/share/$name/README"
+	{
+		printf 'pkgname = %s\npkgbase = %s\npkgver = %s\n' "$name" "$name" "$ver"
+		printf 'pkgdesc = the %s package\nurl = https://example.org/%s\n' "$name" "$name"
+		printf 'builddate = 1700000000\npackager = Test <test@example.org>\n'
+		printf 'size = 4096\narch = any\nlicense = GPL\n'
+		for dep in "$@"; do
+			printf 'depend = %s\n' "$dep"
+		done
+	} > "$dir/.PKGINFO"
+	bsdtar -C "$dir" -czf "$tmpdir/pkgs/$name-$ver-any.pkg.tar.gz" .PKGINFO usr
+}
+
+# args:
+# extract db dir
+extract() {
+	mkdir -p "$2"
+	bsdtar -C "$2" -xf "$1"
+}
+
+mkdir -p "$tmpdir/pkgs" "$tmpdir/update" "$tmpdir/add"
+mkpkg foo 1.0-1
+mkpkg bar 1.0-1 'foo>=1.0'
+mkpkg foo 1.0-2
+# the format of the signature does not matter to either tool
+head -c 566 /dev/urandom > "$tmpdir/pkgs/bar-1.0-1-any.pkg.tar.gz.sig"
+
+foo1=$tmpdir/pkgs/foo-1.0-1-any.pkg.tar.gz
+foo2=$tmpdir/pkgs/foo-1.0-2-any.pkg.tar.gz
+bar=$tmpdir/pkgs/bar-1.0-1-any.pkg.tar.gz
+
+tap_plan 14
+
+# add, remove, add again and replace, once with each
+db=$tmpdir/update/test.db.tar.gz
+"$bin" -q --include-sigs "$db" "$foo1" "$bar"
+tap_is_int $? 0 "dulge-repo-update adds packages"
+"$bin" -q -d foo "$db"
+tap_is_int $? 0 "dulge-repo-update removes a package"
+"$bin" -q "$db" "$foo1"
+tap_is_int $? 0 "dulge-repo-update adds a removed package again"
+"$bin" -q "$db" "$foo2"
+tap_is_int $? 0 "dulge-repo-update replaces a package"
+
+adddb=$tmpdir/add/test.db.tar.gz
+"$tmpdir/bin/dulge-dulge-dulge-repo-add" -q --include-sigs "$adddb" "$foo1" "$bar" &&
+	"$tmpdir/bin/dulge-dulge-dulge-repo-remove" -q "$adddb" foo &&
+	"$tmpdir/bin/dulge-dulge-dulge-repo-add" -q "$adddb" "$foo1" &&
+	"$tmpdir/bin/dulge-dulge-dulge-repo-add" -q "$adddb" "$foo2"
+tap_is_int $? 0 "dulge-repo-add builds the same database"
+
+for d in update add; do
+	extract "$tmpdir/$d/test.db.tar.gz" "$tmpdir/$d/db"
+	extract "$tmpdir/$d/test.files.tar.gz" "$tmpdir/$d/files"
+done
+tap_is_str "$(diff -r "$tmpdir/update/db" "$tmpdir/add/db")" "" \
+	"the database entries match those of dulge-repo-add"
+tap_is_str "$(diff -r "$tmpdir/update/files" "$tmpdir/add/files")" "" \
+	"the files database entries match those of dulge-repo-add"
+
+# errors of packages loaded at once are reported in the order given
+for n in 1 2 3 4; do
+	echo "not a package" > "$tmpdir/pkgs/bad$n-1.0-1-any.pkg.tar.gz"
+done
+out=$("$bin" -q -j 4 "$db" "$tmpdir"/pkgs/bad{1,2,3,4}-1.0-1-any.pkg.tar.gz 2>&1)
+tap_is_int $? 1 "dulge-repo-update fails on files that are not packages"
+tap_is_str "$(grep -o 'ERROR: .*bad[0-9]' <<<"$out" | grep -o 'bad[0-9]' | tr '\n' ' ')" \
+	"bad1 bad2 bad3 bad4 " "each of them is reported once, in order"
+
+# the same packages give the same bytes, whenever they are written
+for opt in '' --seekable; do
+	for run in 1 2; do
+		mkdir -p "$tmpdir/again$opt$run"
+		"$bin" -q $opt --include-sigs "$tmpdir/again$opt$run/test.db.tar.gz" "$bar" "$foo2"
+		# the gzip header has a time in seconds
+		(( run == 1 )) && sleep 1
+	done
+	cmp -s "$tmpdir/again${opt}1/test.db.tar.gz" "$tmpdir/again${opt}2/test.db.tar.gz" &&
+		cmp -s "$tmpdir/again${opt}1/test.files.tar.gz" "$tmpdir/again${opt}2/test.files.tar.gz"
+	tap_is_int $? 0 "writing the database ${opt:+with $opt }again gives the same bytes"
+done
+
+# read the database back through libalpm
+mkdir -p "$tmpdir/root" "$tmpdir/dbpath/sync" "$tmpdir/dbpath/local"
+cp "$db" "$tmpdir/dbpath/sync/test.db"
+cp "$tmpdir/update/test.files.tar.gz" "$tmpdir/dbpath/sync/test.files"
+cat > "$tmpdir/dulge.conf" <<EOF
+[options]
+SigLevel = Never
+[test]
+Server = file://$tmpdir/update
+EOF
+dulgecmd=("$dulge" --config "$tmpdir/dulge.conf" --root "$tmpdir/root"
+	--dbpath "$tmpdir/dbpath/" --noconfirm)
+
+tap_is_str "$("${dulgecmd[@]}" -Sl test 2>/dev/null)" $'test bar 1.0-1\ntest foo 1.0-2' \
+	"libalpm lists the packages"
+tap_is_str "$("${dulgecmd[@]}" -Si bar 2>/dev/null | grep -E '^(Depends On|Validated By)')" \
+	$'Depends On      : foo>=1.0\nValidated By    : SHA-256 Sum  Signature' \
+	"libalpm reads the package entry and its signature"
+tap_is_str "$("${dulgecmd[@]}" -Fl foo 2>/dev/null)" \
+	$'foo usr/\nfoo usr/share/\nfoo usr/share/foo/\nfoo usr/share/foo/README' \
+	"libalpm reads the files entry"
+
+tap_finish